@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "ftp/data_cipher.hpp"
+#include "ftp/detail/crc32c.hpp"
+#include "utils/RC4.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::uint64_t;
+using std::string;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+/* The size of a read from the file or the socket in the data connection. */
+static const size_t chunk_size = 64 * 1024;
+
+/* Encrypts 'bytes' in chunks the way the data connection does, on one
+ * core, so the result is the throughput per core.
+ */
+template<typename Apply>
+static double measure(uint64_t bytes, Apply apply)
+{
+    vector<char> chunk(chunk_size, 'x');
+
+    steady_clock::time_point started = steady_clock::now();
+
+    for (uint64_t done = 0; done < bytes; done += chunk.size())
+    {
+        apply(chunk.data(), chunk.size());
+    }
+
+    return duration<double>(steady_clock::now() - started).count();
+}
+
+/* Usage: cipher_bench [megabytes]
+ *
+ * Compares RC4EncryptContent, which the server stores contents with, to
+ * the data ciphers: RC4 with its keystream computed once, and those that
+ * OpenSSL accelerates in hardware. The CRC-32C that checks transfers is
+ * measured alongside.
+ */
+int main(int argc, char *argv[])
+{
+    const uint64_t bytes = (argc > 1 ? std::stoull(argv[1]) : 1024) * 1024 * 1024;
+    string token = "0123456789abcdef";
+
+    auto report = [bytes](const char *name, double seconds)
+    {
+        std::cout << name << bytes / seconds / (1024 * 1024 * 1024) << " GiB/s" << std::endl;
+    };
+
+    report("RC4EncryptContent: ", measure(bytes, [&token](char *data, size_t size)
+    {
+        RC4EncryptContent(data, size, &token[0], token.size());
+    }));
+
+    for (const string name : { "RC4", "AES-256-CTR", "CHACHA20" })
+    {
+        std::unique_ptr<ftp::data_cipher> cipher = ftp::make_data_cipher(name, { token, 1, 0 });
+        string label = name + ":" + string(19 - name.size() - 1, ' ');
+
+        report(label.c_str(), measure(bytes, [&cipher](char *data, size_t size)
+        {
+            cipher->apply(data, size);
+        }));
+    }
+
+    ftp::detail::crc32c crc;
+
+    report("CRC-32C:           ", measure(bytes, [&crc](char *data, size_t size)
+    {
+        crc.update(data, size);
+    }));
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "ftp/detail/md5.hpp"
+#include "ftp/detail/md5_engine.hpp"
+#include <openssl/evp.h>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::uint64_t;
+using std::string;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+using ftp::detail::md5;
+using ftp::detail::md5_engine;
+
+/* The size of a read from the file or the socket in the data connection. */
+static const size_t chunk_size = 8 * 1024;
+
+/* Small writes, so jobs are short and threads mostly wait for each other. */
+static const size_t small_chunk_size = 512;
+
+/* Runs 'streams' threads that each hash 'bytes' in chunks, like as many
+ * sessions uploading at the same time.
+ */
+static double measure(size_t streams,
+                      uint64_t bytes,
+                      const std::function<void(const string &)> & hash_stream,
+                      size_t chunk_bytes = chunk_size)
+{
+    vector<std::thread> threads;
+    string chunk(chunk_bytes, 'x');
+
+    steady_clock::time_point started = steady_clock::now();
+
+    for (size_t stream = 0; stream < streams; stream++)
+    {
+        threads.emplace_back([&hash_stream, &chunk]()
+        {
+            hash_stream(chunk);
+        });
+    }
+
+    for (std::thread & thread : threads)
+    {
+        thread.join();
+    }
+
+    return duration<double>(steady_clock::now() - started).count();
+}
+
+/* Usage: hash_bench [streams] [megabytes per stream]
+ *
+ * Compares the aggregate MD5 throughput of concurrent streams when each
+ * hashes on its own, with OpenSSL, and through the shared engine, which
+ * hashes them in the lanes of AVX2. Then runs the engine with small writes
+ * from many more threads than processors, where waking the threads whose
+ * jobs are done costs the most.
+ */
+int main(int argc, char *argv[])
+{
+    const size_t streams = argc > 1 ? std::stoul(argv[1]) : 64;
+    const uint64_t bytes = (argc > 2 ? std::stoull(argv[2]) : 16) * 1024 * 1024;
+
+    auto report = [streams, bytes](const char *name, double seconds)
+    {
+        std::cout << name << streams * bytes / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+    };
+
+    std::cout << std::thread::hardware_concurrency() << " processors, " << streams << " streams, "
+              << (ftp::detail::md5_has_lanes() ? "AVX2" : "no AVX2") << std::endl;
+
+    report("OpenSSL per stream: ", measure(streams, bytes, [bytes](const string & chunk)
+    {
+        EVP_MD_CTX *context = EVP_MD_CTX_new();
+        unsigned char digest[EVP_MAX_MD_SIZE];
+
+        EVP_DigestInit_ex(context, EVP_md5(), nullptr);
+
+        for (uint64_t done = 0; done < bytes; done += chunk.size())
+        {
+            EVP_DigestUpdate(context, chunk.data(), chunk.size());
+        }
+
+        EVP_DigestFinal_ex(context, digest, nullptr);
+        EVP_MD_CTX_free(context);
+    }));
+
+    auto hash_engine = [bytes](const string & chunk)
+    {
+        md5 hash;
+
+        for (uint64_t done = 0; done < bytes; done += chunk.size())
+        {
+            hash.update(chunk.data(), chunk.size());
+        }
+
+        hash.hex_digest();
+    };
+
+    report("Shared engine:      ", measure(streams, bytes, hash_engine));
+
+    const size_t many = 4 * streams;
+
+    std::cout << many << " streams, " << small_chunk_size << " byte writes: "
+              << many * bytes / measure(many, bytes, hash_engine, small_chunk_size) / (1024 * 1024)
+              << " MiB/s" << std::endl;
+
+    md5_engine::stats stats = md5_engine::shared().get_stats();
+
+    std::cout << "Blocks in shared lanes: " << 100.0 * stats.shared_blocks / stats.blocks << "%" << std::endl;
+
+    return 0;
+}
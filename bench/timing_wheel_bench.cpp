@@ -0,0 +1,113 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ftp/detail/timing_wheel.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::uint64_t;
+using std::vector;
+using std::pair;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+using ftp::detail::timing_wheel;
+
+/* Usage: timing_wheel_bench [timers]
+ *
+ * Models keepalives and deadlines of many sessions: every timer is scheduled
+ * with a delay of up to ten minutes in 10 ms ticks, most of them are
+ * cancelled before they expire, the rest expire while the wheel advances.
+ */
+int main(int argc, char *argv[])
+{
+    const uint64_t timers = argc > 1 ? std::stoull(argv[1]) : 4000000;
+    const uint64_t max_delay = 60000;
+
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<uint64_t> delays(1, max_delay);
+
+    timing_wheel wheel;
+    vector<timing_wheel::timer_id> ids;
+    ids.reserve(timers);
+
+    uint64_t fired = 0;
+
+    steady_clock::time_point started = steady_clock::now();
+
+    for (uint64_t i = 0; i < timers; ++i)
+    {
+        ids.push_back(wheel.schedule(delays(random), [&fired]() { ++fired; }));
+    }
+
+    steady_clock::time_point scheduled = steady_clock::now();
+
+    /* Cancel three out of four, like replies that arrive before their
+     * deadline.
+     */
+    uint64_t cancelled = 0;
+
+    for (uint64_t i = 0; i < timers; ++i)
+    {
+        if (i % 4 != 0 && wheel.cancel(ids[i]))
+        {
+            ++cancelled;
+        }
+    }
+
+    steady_clock::time_point cancelled_at = steady_clock::now();
+
+    vector<pair<timing_wheel::timer_id, timing_wheel::callback>> expired;
+
+    for (uint64_t tick = 1; tick <= max_delay; ++tick)
+    {
+        wheel.advance(tick, expired);
+
+        for (auto & timer : expired)
+        {
+            timer.second();
+        }
+
+        expired.clear();
+    }
+
+    steady_clock::time_point finished = steady_clock::now();
+
+    auto per_op = [](steady_clock::time_point from, steady_clock::time_point to, uint64_t count)
+    {
+        return count > 0 ? duration_cast<nanoseconds>(to - from).count() / static_cast<double>(count) : 0.0;
+    };
+
+    std::cout << "timers:    " << timers << std::endl;
+    std::cout << "schedule:  " << per_op(started, scheduled, timers) << " ns/timer" << std::endl;
+    std::cout << "cancel:    " << per_op(scheduled, cancelled_at, cancelled) << " ns/timer" << std::endl;
+    std::cout << "advance:   " << per_op(cancelled_at, finished, max_delay) << " ns/tick, "
+              << per_op(cancelled_at, finished, fired) << " ns/expired timer" << std::endl;
+    std::cout << "expired:   " << fired << " of " << timers - cancelled << std::endl;
+
+    return fired == timers - cancelled && wheel.size() == 0 ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ftp/tls_transport.hpp"
+#include "ftp/detail/data_connection.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/ssl.hpp>
+#include <openssl/x509.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::uint64_t;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using boost::asio::ip::tcp;
+
+namespace ssl = boost::asio::ssl;
+
+using ftp::tls_transport;
+using ftp::detail::basic_data_connection;
+
+/* A throwaway certificate, the client doesn't verify it. */
+static void use_self_signed(ssl::context & context)
+{
+    EVP_PKEY_CTX *key_context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY *key = nullptr;
+
+    EVP_PKEY_keygen_init(key_context);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_context, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(key_context, &key);
+    EVP_PKEY_CTX_free(key_context);
+
+    X509 *certificate = X509_new();
+
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+    X509_set_pubkey(certificate, key);
+    X509_set_issuer_name(certificate, X509_get_subject_name(certificate));
+    X509_sign(certificate, key, EVP_sha256());
+
+    SSL_CTX_use_certificate(context.native_handle(), certificate);
+    SSL_CTX_use_PrivateKey(context.native_handle(), key);
+
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+}
+
+/* Reads until the client's close_notify. */
+template<typename Stream>
+static void drain(Stream & stream)
+{
+    vector<char> chunk(256 * 1024);
+    boost::system::error_code ec;
+
+    while (!ec)
+    {
+        stream.read_some(boost::asio::buffer(chunk), ec);
+    }
+}
+
+enum class mode
+{
+    plain,
+    user_space_tls,
+    kernel_tls
+};
+
+/* Uploads the file over one data connection, returns the seconds it took
+ * or a negative value if kernel TLS isn't available.
+ */
+static double upload(mode m, const std::string & path)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    ssl::context server_context(ssl::context::tls_server);
+    ssl::context client_context(ssl::context::tls_client);
+
+    use_self_signed(server_context);
+
+    std::thread server([&]()
+    {
+        tcp::socket socket(io_context);
+
+        acceptor.accept(socket);
+
+        if (m == mode::plain)
+        {
+            drain(socket);
+            return;
+        }
+
+        ssl::stream<tcp::socket &> secure(socket, server_context);
+        boost::system::error_code ec;
+
+        secure.handshake(ssl::stream_base::server, ec);
+        drain(secure);
+        secure.shutdown(ec);
+    });
+
+    basic_data_connection<tls_transport> connection("127.0.0.1", acceptor.local_endpoint().port());
+
+    connection.set_kernel_tls(m == mode::kernel_tls);
+    connection.open();
+
+    steady_clock::time_point started = steady_clock::now();
+
+    if (m != mode::plain)
+    {
+        connection.start_tls(client_context, "127.0.0.1", nullptr);
+    }
+
+    bool available = m != mode::kernel_tls || connection.is_kernel_tls();
+
+    if (!connection.send_file(path, 0))
+    {
+        std::ifstream file(path, std::ios_base::binary);
+
+        connection.send(file);
+    }
+
+    connection.close();
+    server.join();
+
+    return available ? duration<double>(steady_clock::now() - started).count() : -1.0;
+}
+
+/* Usage: tls_bench [megabytes]
+ *
+ * Uploads a file over a loopback data connection in plain text with
+ * sendfile, over TLS encrypted by OpenSSL, and over TLS encrypted by the
+ * kernel with sendfile. The last needs the 'tls' kernel module.
+ */
+int main(int argc, char *argv[])
+{
+    const uint64_t bytes = (argc > 1 ? std::stoull(argv[1]) : 1024) * 1024 * 1024;
+    const std::string path = "/tmp/tls_bench_" + std::to_string(::getpid());
+
+    /* A sparse file: reading it costs no disk I/O. */
+    int file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (file < 0 || ::ftruncate(file, bytes) != 0)
+    {
+        std::cerr << "Cannot create " << path << std::endl;
+        return 1;
+    }
+
+    ::close(file);
+
+    auto report = [bytes](const char *name, double seconds)
+    {
+        if (seconds < 0)
+        {
+            std::cout << name << "not available" << std::endl;
+        }
+        else
+        {
+            std::cout << name << bytes / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+        }
+    };
+
+    report("plain sendfile:  ", upload(mode::plain, path));
+    report("user-space TLS:  ", upload(mode::user_space_tls, path));
+    report("kernel TLS:      ", upload(mode::kernel_tls, path));
+
+    ::unlink(path.c_str());
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "ftp/memory_transport.hpp"
+#include "ftp/detail/data_connection.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/write.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using std::uint64_t;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using boost::asio::ip::tcp;
+using boost::asio::local::stream_protocol;
+
+using ftp::memory_transport;
+using ftp::detail::basic_data_connection;
+
+static const size_t chunk_size = 64 * 1024;
+
+template<typename Socket>
+static void serve(Socket & socket, uint64_t bytes)
+{
+    vector<char> chunk(chunk_size, 'x');
+
+    while (bytes > 0)
+    {
+        size_t size = std::min<uint64_t>(bytes, chunk.size());
+
+        boost::asio::write(socket, boost::asio::buffer(chunk.data(), size));
+        bytes -= size;
+    }
+
+    socket.close();
+}
+
+/* Downloads into /dev/null, so only the transport and the data connection
+ * are measured.
+ */
+template<typename Transport>
+static double download(basic_data_connection<Transport> & connection, std::thread & server)
+{
+    std::ofstream sink("/dev/null", std::ios_base::binary);
+
+    steady_clock::time_point started = steady_clock::now();
+
+    connection.open();
+    connection.recv(sink);
+    connection.close();
+    server.join();
+
+    return duration<double>(steady_clock::now() - started).count();
+}
+
+/* Usage: transport_bench [megabytes]
+ *
+ * Downloads over a data connection of each transport: loopback TCP, a
+ * Unix-domain socket, and the in-memory transport, which shows what the
+ * client itself costs without the kernel.
+ */
+int main(int argc, char *argv[])
+{
+    const uint64_t bytes = (argc > 1 ? std::stoull(argv[1]) : 1024) * 1024 * 1024;
+
+    auto report = [bytes](const char *name, double seconds)
+    {
+        std::cout << name << bytes / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+    };
+
+    {
+        boost::asio::io_context io_context;
+        tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        basic_data_connection<ftp::tcp_transport> connection("127.0.0.1", acceptor.local_endpoint().port());
+
+        std::thread server([&acceptor, &io_context, bytes]()
+        {
+            tcp::socket socket(io_context);
+
+            acceptor.accept(socket);
+            serve(socket, bytes);
+        });
+
+        report("tcp:     ", download(connection, server));
+    }
+
+    {
+        std::string path = "/tmp/transport_bench_" + std::to_string(::getpid());
+        const uint16_t port = 50000;
+
+        boost::asio::io_context io_context;
+        stream_protocol::endpoint endpoint(ftp::unix_transport::data_path(path, port));
+        stream_protocol::acceptor acceptor(io_context, endpoint);
+        basic_data_connection<ftp::unix_transport> connection(path, port);
+
+        std::thread server([&acceptor, &io_context, bytes]()
+        {
+            stream_protocol::socket socket(io_context);
+
+            acceptor.accept(socket);
+            serve(socket, bytes);
+        });
+
+        report("unix:    ", download(connection, server));
+
+        ::unlink(ftp::unix_transport::data_path(path, port).c_str());
+    }
+
+    {
+        memory_transport::acceptor acceptor("server");
+        basic_data_connection<memory_transport> connection("server", acceptor.port());
+
+        std::thread server([&acceptor, bytes]()
+        {
+            boost::asio::io_context io_context;
+            memory_transport::socket socket(io_context);
+
+            acceptor.accept(socket);
+            serve(socket, bytes);
+        });
+
+        report("memory:  ", download(connection, server));
+    }
+
+    return 0;
+}
@@ -25,7 +25,9 @@
 #include "command_handler.hpp"
 #include "cmdline_exception.hpp"
 #include "utils/utils.hpp"
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <boost/lexical_cast/try_lexical_convert.hpp>
 
 using std::string;
@@ -446,3 +448,39 @@ void command_handler::exit()
         ftp_client_.close();
     }
 }
+
+/* One line like 'ftp' prints after each transfer, and one with what the
+ * kernel saw on the data connection.
+ */
+void command_handler::stdout_writer::on_transfer(const ftp::transfer_result & result)
+{
+    using std::chrono::duration;
+
+    double seconds = duration<double>(result.duration).count();
+    std::ostringstream line;
+
+    line << std::fixed << std::setprecision(2);
+    line << result.bytes << " bytes in " << seconds << " secs";
+
+    if (seconds > 0)
+    {
+        line << " (" << result.bytes / seconds / 1024 << " kB/s)";
+    }
+
+    line << ", network " << duration<double>(result.network_time).count() << " secs"
+         << ", file " << duration<double>(result.file_time).count() << " secs\n";
+
+    if (result.final_sample)
+    {
+        const ftp::tcp_sample & sample = result.final_sample.value();
+
+        line << "tcp: rtt " << duration<double, std::milli>(sample.rtt).count() << " ms"
+             << ", cwnd " << sample.cwnd
+             << ", " << sample.total_retransmits << " retransmits"
+             << ", rwnd-limited " << duration<double, std::milli>(sample.rwnd_limited).count() << " ms"
+             << ", sndbuf-limited " << duration<double, std::milli>(sample.sndbuf_limited).count() << " ms\n";
+    }
+
+    cout << line.str();
+    cout.flush();
+}
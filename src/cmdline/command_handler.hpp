@@ -83,6 +83,8 @@ private:
             std::cout << reply;
             std::cout.flush();
         }
+
+        void on_transfer(const ftp::transfer_result & result) override;
     };
 
     stdout_writer stdout_writer_;
@@ -24,12 +24,21 @@
 
 #include "client.hpp"
 #include "ftp_exception.hpp"
+#include "memory_transport.hpp"
 #include "detail/connection_exception.hpp"
+#include "detail/kernel_tls.hpp"
+#include "detail/list_parser.hpp"
+#include "detail/md5.hpp"
 #include <filesystem>
 #include <fstream>
 #include <boost/lexical_cast.hpp>
 #include "utils/RC4.h"
 #include <iostream>
+#include <atomic>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <unordered_set>
 
 namespace ftp
 {
@@ -44,26 +53,119 @@ using std::pair;
 using std::make_pair;
 using std::nullopt;
 using std::make_optional;
+using std::vector;
+using std::size_t;
 
 using namespace ftp::detail;
 
-client::client(client::event_observer *observer)
+/* Directories with more entries than this are listed over a data connection
+ * in the adaptive listing mode. A long listing would otherwise hold up the
+ * control connection for the whole transfer.
+ */
+static const size_t default_stat_listing_threshold = 128;
+
+/* Bounds the memory spent on remembered directory sizes. */
+static const size_t max_remembered_listings = 1024;
+
+/* Bounds the memory spent on remembered file hashes. An upload manifest
+ * keeps them for good.
+ */
+static const size_t max_content_hashes = 4096;
+
+static std::atomic<std::uint64_t> next_cache_scope(1);
+
+/* Servers close passive ports nobody uses after a while, so older prefetched
+ * connections are not trusted.
+ */
+static const std::chrono::seconds max_prefetched_age(20);
+
+/* What a SYN can carry with a typical MSS. */
+static const size_t fast_open_chunk_size = 1400;
+
+/* Commands sent ahead of their replies, few enough that the replies fit
+ * into the socket buffers and the server never stops reading.
+ */
+static const size_t pipeline_window = 64;
+
+static std::shared_ptr<boost::asio::ssl::context> default_tls_context()
+{
+    auto context = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client);
+
+    context->set_default_verify_paths();
+    context->set_verify_mode(boost::asio::ssl::verify_peer);
+
+    /* Kernel TLS may keep the secrets of its connections. */
+    detail::own_tls_context(context->native_handle());
+
+    return context;
+}
+
+template<typename Transport>
+basic_client<Transport>::basic_client(event_observer *observer)
+    : transfer_mode_(transfer_mode::passive),
+      socket_profile_(socket_profile::lan()),
+      eprt_supported_(true),
+      prefetch_depth_(0),
+      prefetch_requests_(0),
+      overlap_data_connect_(false),
+      fast_open_(false),
+      fast_open_stats_(),
+      tls_stats_(),
+      kernel_tls_(false),
+      data_cipher_nonce_(0),
+      data_cipher_transfers_(0),
+      verify_transfers_(false),
+      content_md5_(false),
+      content_rc4_(false),
+      dedup_stats_(),
+      xcrc_supported_(true),
+      hash_supported_(true),
+      hash_selected_(false),
+      stat_listing_supported_(true),
+      stat_listing_threshold_(default_stat_listing_threshold),
+      cache_scope_(next_cache_scope++)
 {
+    control_connection_.set_socket_options(socket_profile_.control);
+
+    if constexpr (Transport::is_tls)
+    {
+        tls_context_ = default_tls_context();
+    }
+
     if (observer)
     {
         observers_.push_back(observer);
     }
 }
 
-bool client::open(const string & hostname, uint16_t port)
+template<typename Transport>
+bool basic_client<Transport>::open(const string & hostname, uint16_t port)
 {
     try
     {
+        drop_prefetched();
         control_connection_.open(hostname, port);
 
+        /* What we learned about the previous server doesn't apply anymore. */
+        data_listener_.reset();
+        eprt_supported_ = true;
+        stat_listing_supported_ = true;
+        data_cipher_.reset();
+        xcrc_supported_ = true;
+        hash_supported_ = true;
+        hash_selected_ = false;
+        listing_sizes_.clear();
+        username_.clear();
+        new_cache_scope();
+
         reply_t reply = recv();
 
-        return reply.is_positive();
+        return reply.is_positive() && start_tls();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
     }
     catch (const connection_exception & ex)
     {
@@ -72,15 +174,34 @@ bool client::open(const string & hostname, uint16_t port)
     }
 }
 
-bool client::open_v6(const string & hostname, uint16_t port)
+template<typename Transport>
+bool basic_client<Transport>::open_v6(const string & hostname, uint16_t port)
 {
     try
     {
+        drop_prefetched();
         control_connection_.open_v6(hostname, port);
 
+        /* What we learned about the previous server doesn't apply anymore. */
+        data_listener_.reset();
+        eprt_supported_ = true;
+        stat_listing_supported_ = true;
+        data_cipher_.reset();
+        xcrc_supported_ = true;
+        hash_supported_ = true;
+        hash_selected_ = false;
+        listing_sizes_.clear();
+        username_.clear();
+        new_cache_scope();
+
         reply_t reply = recv();
 
-        return reply.is_positive();
+        return reply.is_positive() && start_tls();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
     }
     catch (const connection_exception & ex)
     {
@@ -90,12 +211,18 @@ bool client::open_v6(const string & hostname, uint16_t port)
 }
 
 
-bool client::is_open()
+template<typename Transport>
+bool basic_client<Transport>::is_open()
 {
     try
     {
         return control_connection_.is_open();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -103,7 +230,24 @@ bool client::is_open()
     }
 }
 
-bool client::login(const string & username, const string & password)
+template<typename Transport>
+bool basic_client<Transport>::is_alive()
+{
+    try
+    {
+        /* Replies to the refill would look like unsolicited ones. */
+        collect_prefetched();
+    }
+    catch (const connection_exception &)
+    {
+        return false;
+    }
+
+    return control_connection_.is_alive();
+}
+
+template<typename Transport>
+bool basic_client<Transport>::login(const string & username, const string & password)
 {
     try
     {
@@ -145,9 +289,23 @@ bool client::login(const string & username, const string & password)
              * Sorry, we don't support ACCT command.
              */
         }
-		
+
+        if (reply.is_positive())
+        {
+            /* Users may have their own home directory. */
+            username_ = username;
+            new_cache_scope();
+
+            negotiate_data_cipher();
+        }
+
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -155,7 +313,8 @@ bool client::login(const string & username, const string & password)
     }
 }
 
-bool client::cd(const string & remote_directory)
+template<typename Transport>
+bool basic_client<Transport>::cd(const string & remote_directory)
 {
     try
     {
@@ -166,8 +325,19 @@ bool client::cd(const string & remote_directory)
 
         reply_t reply = send_command("CWD " + remote_directory);
 
+        if (reply.is_positive())
+        {
+            /* Relative paths mean something else from now on. */
+            new_cache_scope();
+        }
+
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -175,7 +345,8 @@ bool client::cd(const string & remote_directory)
     }
 }
 
-bool client::ls(const optional<string> & remote_directory)
+template<typename Transport>
+bool basic_client<Transport>::ls(const optional<string> & remote_directory)
 {
     try
     {
@@ -210,8 +381,16 @@ bool client::ls(const optional<string> & remote_directory)
 
         reply_t reply = recv();
 
+        report_transfer(*data_connection, command, reply);
+        refill_prefetched();
+
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -219,7 +398,10 @@ bool client::ls(const optional<string> & remote_directory)
     }
 }
 
-bool client::upload(const string & local_file, const string & remote_file)
+template<typename Transport>
+bool basic_client<Transport>::ls(const optional<string> & remote_directory,
+                                 vector<list_entry> & entries,
+                                 listing_mode mode)
 {
     try
     {
@@ -228,51 +410,123 @@ bool client::upload(const string & local_file, const string & remote_file)
             throw ftp_exception("Connection is not open.");
         }
 
-        ifstream file(local_file, ios_base::binary);
+        entries.clear();
 
-        if (!file)
+        /* 'STAT' without an argument reports the server status instead of
+         * a listing, so name the current directory explicitly.
+         */
+        string path = remote_directory ? remote_directory.value() : ".";
+
+        string key;
+
+        if (metadata_cache_)
         {
-            throw ftp_exception("Cannot open file '%1%'.", local_file);
+            key = cache_key(path);
+            optional<vector<list_entry>> cached = metadata_cache_->find_listing(key);
+
+            if (cached)
+            {
+                entries = std::move(cached.value());
+                return true;
+            }
+        }
+
+        if (use_stat_listing(path, mode))
+        {
+            reply_t reply = send_command("STAT " + path);
+            vector<list_entry> listing;
+
+            if (reply.status_code == 211 || reply.status_code == 212 || reply.status_code == 213)
+            {
+                listing = parse_stat_listing(reply.status_line);
+            }
+
+            /* RFC 959 allows 211 as well as 212 and 213 in reply to 'STAT'
+             * with a path, but 211 is also the server status reply of
+             * servers that ignore the path: take it as a listing only if
+             * it lists something.
+             */
+            if (reply.status_code == 212 || reply.status_code == 213 ||
+                (reply.status_code == 211 && !listing.empty()))
+            {
+                entries = std::move(listing);
+                remember_listing_size(path, entries.size());
+
+                if (metadata_cache_)
+                {
+                    metadata_cache_->store_listing(key, entries);
+                }
+
+                return true;
+            }
+            else if (reply.status_code == 500 || reply.status_code == 501 ||
+                     reply.status_code == 502 || reply.status_code == 504 ||
+                     reply.status_code == 211 || reply.status_code == 0)
+            {
+                /* The server doesn't list directories in reply to 'STAT',
+                 * don't ask it again during this session.
+                 */
+                stat_listing_supported_ = false;
+
+                if (mode == listing_mode::control_connection)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        string command;
+
+        if (remote_directory)
+        {
+            command = "LIST " + remote_directory.value();
+        }
+        else
+        {
+            command = "LIST";
         }
 
-        unique_ptr<data_connection> data_connection = establish_data_connection("STOR " + remote_file);
+        unique_ptr<data_connection> data_connection = establish_data_connection(command);
 
         if (!data_connection)
         {
             return false;
         }
 
-        data_connection->send(file);
+        string file_list = data_connection->recv();
+        report_reply(file_list);
 
         /* Don't keep the data connection. */
         data_connection->close();
 
         reply_t reply = recv();
 
-        return reply.is_positive();
-    }
-    catch (const connection_exception & ex)
-    {
-        reset_connection();
-        throw ftp_exception(ex);
-    }
-}
+        report_transfer(*data_connection, command, reply);
+        refill_prefetched();
 
-bool client::upload_cache(detail::data_connection* pDataConn, const char* pszBuffer, std::size_t uBufferSize)
-{
-    try
-    {
-        if (!is_open() || !pDataConn->is_open())
+        if (!reply.is_positive())
         {
-            throw ftp_exception("Connection is not open.");
+            return false;
         }
 
-        pDataConn->send(pszBuffer, uBufferSize);
-        //flush??
-        pDataConn->close();
-        reply_t reply = recv();
+        entries = parse_list(file_list);
+        remember_listing_size(path, entries.size());
 
-        return reply.is_positive();
+        if (metadata_cache_)
+        {
+            metadata_cache_->store_listing(key, entries);
+        }
+
+        return true;
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
     }
     catch (const connection_exception & ex)
     {
@@ -281,148 +535,941 @@ bool client::upload_cache(detail::data_connection* pDataConn, const char* pszBuf
     }
 }
 
-std::unique_ptr<detail::data_connection> client::prepare_upload(const std::string & remote_file)
+template<typename Transport>
+void basic_client<Transport>::set_stat_listing_threshold(size_t max_entries)
 {
-    if (!is_open())
-    {
-        throw ftp_exception("Connection is not open.");
-    }
+    stat_listing_threshold_ = max_entries;
+}
 
-    unique_ptr<data_connection> data_connection = establish_data_connection("STOR");// + remote_file);
+template<typename Transport>
+void basic_client<Transport>::set_timeouts(const timeouts & timeouts)
+{
+    control_connection_.set_timeouts(timeouts);
+}
 
-    if (!data_connection)
+template<typename Transport>
+void basic_client<Transport>::set_transfer_mode(transfer_mode mode)
+{
+    transfer_mode_ = mode;
+
+    if (mode != transfer_mode::passive)
     {
-        return nullptr;
+        drop_prefetched();
     }
+}
 
-    return data_connection;
+template<typename Transport>
+void basic_client<Transport>::set_overlap_data_connect(bool enabled)
+{
+    overlap_data_connect_ = enabled;
 }
 
-bool client::download(const string & remote_file, const string & local_file)
+template<typename Transport>
+void basic_client<Transport>::set_socket_profile(const socket_profile & profile)
 {
-    try
-    {
-        if (!is_open())
-        {
-            throw ftp_exception("Connection is not open.");
-        }
+    socket_profile_ = profile;
+    control_connection_.set_socket_options(profile.control);
+}
 
-        if (std::filesystem::exists(local_file))
-        {
-            throw ftp_exception("The file '%1%' already exists.", local_file);
-        }
+template<typename Transport>
+void basic_client<Transport>::set_source_address_pool(std::shared_ptr<source_address_pool> pool)
+{
+    source_address_pool_ = std::move(pool);
+}
 
-        ofstream file(local_file, ios_base::binary);
+template<typename Transport>
+void basic_client<Transport>::set_fast_open(bool enabled)
+{
+    fast_open_ = enabled;
+}
 
-        if (!file)
-        {
-            throw ftp_exception("Cannot create file %1%.", local_file);
-        }
+template<typename Transport>
+fast_open_stats basic_client<Transport>::get_fast_open_stats() const
+{
+    return fast_open_stats_;
+}
 
-        unique_ptr<data_connection> data_connection = establish_data_connection("RETR " + remote_file);
+template<typename Transport>
+void basic_client<Transport>::set_tls_context(std::shared_ptr<boost::asio::ssl::context> context)
+{
+    tls_context_ = std::move(context);
+}
 
-        if (!data_connection)
-        {
-            return false;
-        }
+template<typename Transport>
+tls_stats basic_client<Transport>::get_tls_stats() const
+{
+    return tls_stats_;
+}
 
-        data_connection->recv(file);
+template<typename Transport>
+void basic_client<Transport>::set_kernel_tls(bool enabled)
+{
+    kernel_tls_ = enabled;
+}
 
-        /* Don't keep the data connection. */
-        data_connection->close();
+template<typename Transport>
+void basic_client<Transport>::set_verify_transfers(bool enabled)
+{
+    verify_transfers_ = enabled;
+}
 
-        reply_t reply = recv();
+template<typename Transport>
+void basic_client<Transport>::set_content_md5(bool enabled)
+{
+    content_md5_ = enabled;
+}
 
-        return reply.is_positive();
-    }
-    catch (const connection_exception & ex)
-    {
-        reset_connection();
-        throw ftp_exception(ex);
-    }
+template<typename Transport>
+void basic_client<Transport>::set_data_ciphers(const vector<string> & names)
+{
+    data_ciphers_ = names;
 }
 
-bool client::pwd()
+template<typename Transport>
+void basic_client<Transport>::set_content_rc4(bool enabled)
 {
-    try
-    {
-        if (!is_open())
-        {
-            throw ftp_exception("Connection is not open.");
-        }
+    content_rc4_ = enabled;
+}
 
-        reply_t reply = send_command("PWD");
+template<typename Transport>
+const optional<string> & basic_client<Transport>::negotiated_data_cipher() const
+{
+    return data_cipher_;
+}
 
-        return reply.is_positive();
-    }
-    catch (const connection_exception & ex)
+/* Servers that don't know DCPH, or none of the ciphers, refuse with a 5xx
+ * reply, which isn't an error.
+ */
+template<typename Transport>
+void basic_client<Transport>::negotiate_data_cipher()
+{
+    data_cipher_.reset();
+
+    if (content_rc4_)
     {
-        reset_connection();
-        throw ftp_exception(ex);
+        data_cipher_ = "RC4";
+        data_cipher_nonce_ = 0;
+        data_cipher_transfers_ = 0;
+        return;
     }
-}
 
-bool client::mkdir(const string & directory_name)
-{
-    try
+    for (const string & name : data_ciphers_)
     {
-        if (!is_open())
+        /* RC4 is keyed by the token alone, the server applies it without
+         * being asked.
+         */
+        if (!is_data_cipher(name) || name == "RC4")
         {
-            throw ftp_exception("Connection is not open.");
+            continue;
         }
 
-        reply_t reply = send_command("MKD " + directory_name);
+        std::uint32_t nonce = std::random_device()();
+        std::ostringstream command;
 
-        return reply.is_positive();
+        command << "DCPH " << name << " " << std::hex << std::setw(8) << std::setfill('0') << nonce;
+
+        if (send_command(command.str()).is_positive())
+        {
+            data_cipher_ = name;
+            data_cipher_nonce_ = nonce;
+            data_cipher_transfers_ = 0;
+            return;
+        }
     }
-    catch (const connection_exception & ex)
+}
+
+template<typename Transport>
+void basic_client<Transport>::encrypt_transfer(data_connection & connection)
+{
+    if (data_cipher_)
     {
-        reset_connection();
-        throw ftp_exception(ex);
+        connection.set_cipher(make_data_cipher(*data_cipher_, { token_, data_cipher_nonce_, data_cipher_transfers_++ }));
     }
 }
 
-bool client::rmdir(const string & directory_name)
+template<typename Transport>
+void basic_client<Transport>::set_prefetch_depth(size_t depth)
 {
-    try
+    prefetch_depth_ = depth;
+
+    while (prefetched_.size() > prefetch_depth_)
     {
-        if (!is_open())
-        {
-            throw ftp_exception("Connection is not open.");
-        }
+        prefetched_.pop_back();
+    }
+}
 
-        reply_t reply = send_command("RMD " + directory_name);
+template<typename Transport>
+void basic_client<Transport>::set_timer_service(std::shared_ptr<timer_service> timers)
+{
+    control_connection_.set_timer_service(std::move(timers));
+}
 
-        return reply.is_positive();
+template<typename Transport>
+const optional<transfer_result> & basic_client<Transport>::last_transfer() const
+{
+    return last_transfer_;
+}
+
+template<typename Transport>
+std::chrono::microseconds basic_client<Transport>::smoothed_rtt() const
+{
+    return control_connection_.rtt().srtt();
+}
+
+template<typename Transport>
+void basic_client<Transport>::set_metadata_cache(std::shared_ptr<metadata_cache> cache)
+{
+    metadata_cache_ = std::move(cache);
+}
+
+template<typename Transport>
+bool basic_client<Transport>::use_stat_listing(const string & path, listing_mode mode) const
+{
+    if (mode == listing_mode::data_connection)
+    {
+        return false;
     }
-    catch (const connection_exception & ex)
+
+    if (mode == listing_mode::control_connection)
     {
-        reset_connection();
-        throw ftp_exception(ex);
+        return true;
     }
-}
 
-bool client::rm(const string & remote_file)
-{
-    try
+    if (!stat_listing_supported_)
     {
-        if (!is_open())
-        {
-            throw ftp_exception("Connection is not open.");
-        }
+        return false;
+    }
 
-        reply_t reply = send_command("DELE " + remote_file);
+    auto it = listing_sizes_.find(path);
 
-        return reply.is_positive();
+    /* Most directories are small, so a directory we haven't listed yet is
+     * tried with 'STAT' first. The result tells us which way to go next time.
+     */
+    if (it == listing_sizes_.end())
+    {
+        return true;
     }
-    catch (const connection_exception & ex)
+
+    return it->second <= stat_listing_threshold_;
+}
+
+template<typename Transport>
+void basic_client<Transport>::remember_listing_size(const string & path, size_t entries)
+{
+    if (listing_sizes_.size() >= max_remembered_listings && listing_sizes_.count(path) == 0)
     {
-        reset_connection();
-        throw ftp_exception(ex);
+        listing_sizes_.clear();
     }
+
+    listing_sizes_[path] = entries;
 }
 
-bool client::binary()
+template<typename Transport>
+bool basic_client<Transport>::upload(const string & local_file, const string & remote_file)
+{
+    try
+    {
+        if (!is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        ifstream file(local_file, ios_base::binary);
+
+        if (!file)
+        {
+            throw ftp_exception("Cannot open file '%1%'.", local_file);
+        }
+
+        invalidate_cached(remote_file);
+
+        string first_chunk;
+
+        if (fast_open_)
+        {
+            first_chunk.resize(fast_open_chunk_size);
+            file.read(&first_chunk[0], first_chunk.size());
+
+            if (file.fail() && !file.eof())
+            {
+                throw ftp_exception("Cannot read data from file '%1%'.", local_file);
+            }
+
+            first_chunk.resize(file.gcount());
+        }
+
+        /* Where the rest of the file starts, whether or not the first chunk
+         * goes out with the SYN.
+         */
+        std::uint64_t first_chunk_size = first_chunk.size();
+
+        unique_ptr<data_connection> data_connection = establish_data_connection("STOR " + remote_file, &first_chunk);
+
+        if (!data_connection)
+        {
+            return false;
+        }
+
+        encrypt_transfer(*data_connection);
+
+        if (!first_chunk.empty())
+        {
+            /* The chunk isn't needed afterwards. */
+            data_connection->send_in_place(&first_chunk[0], first_chunk.size());
+        }
+
+        if (!data_connection->send_file(local_file, first_chunk_size))
+        {
+            data_connection->send(file);
+        }
+
+        if (data_connection->is_fast_open())
+        {
+            ++fast_open_stats_.attempts;
+
+            if (data_connection->fast_open_accepted())
+            {
+                ++fast_open_stats_.accepted;
+            }
+        }
+
+        /* Don't keep the data connection. */
+        data_connection->close();
+
+        reply_t reply = recv();
+        server_checksums checksums;
+
+        if (reply.is_positive())
+        {
+            checksums = server_checksum(*data_connection, remote_file);
+        }
+
+        report_transfer(*data_connection, "STOR " + remote_file, reply, checksums);
+        refill_prefetched();
+
+        return last_transfer_->success;
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+/* Replies are either plain or encrypted with the token. */
+static string reply_text(const reply_t & reply, const string & token)
+{
+    string text = reply.status_line;
+
+    if (reply.status_code == 0 && text.size() > 3)
+    {
+        string plain(text.size(), '\0');
+
+        RC4DecryptStr(&plain[0], text.c_str() + 2, text.size() - 3, token.c_str(), token.size());
+        text = plain.c_str();
+    }
+
+    return text;
+}
+
+/* The directory in a '257 "<directory>"' reply, where quotes in the name
+ * are doubled.
+ */
+static optional<string> parse_working_directory(const string & reply)
+{
+    if (reply.compare(0, 5, "257 \"") != 0)
+    {
+        return nullopt;
+    }
+
+    string directory;
+
+    for (size_t i = 5; i < reply.size(); ++i)
+    {
+        if (reply[i] != '"')
+        {
+            directory += reply[i];
+        }
+        else if (i + 1 < reply.size() && reply[i + 1] == '"')
+        {
+            directory += '"';
+            ++i;
+        }
+        else if (!directory.empty() && directory.front() == '/')
+        {
+            return directory;
+        }
+        else
+        {
+            return nullopt;
+        }
+    }
+
+    return nullopt;
+}
+
+/* Resolves '.' and '..' and drops repeated and trailing slashes. */
+static string normalize_path(const string & path)
+{
+    vector<string> components;
+    size_t begin = 0;
+
+    while (begin <= path.size())
+    {
+        size_t end = path.find('/', begin);
+
+        if (end == string::npos)
+        {
+            end = path.size();
+        }
+
+        string component = path.substr(begin, end - begin);
+
+        if (component == "..")
+        {
+            if (!components.empty())
+            {
+                components.pop_back();
+            }
+        }
+        else if (!component.empty() && component != ".")
+        {
+            components.push_back(std::move(component));
+        }
+
+        begin = end + 1;
+    }
+
+    string normalized;
+
+    for (const string & component : components)
+    {
+        normalized += '/' + component;
+    }
+
+    return normalized.empty() ? "/" : normalized;
+}
+
+static bool is_existing_object(const reply_t & reply, const string & token)
+{
+    string text = reply_text(reply, token);
+
+    return text.size() >= 3 && text[0] == '2';
+}
+
+/* As upload_objects names them. */
+static bool is_object_name(const string & name)
+{
+    size_t separator = name.find('_');
+
+    return separator == 32 &&
+           name.find_first_not_of("0123456789ABCDEFabcdef") == separator &&
+           name.size() > separator + 1 &&
+           name.find_first_not_of("0123456789", separator + 1) == string::npos;
+}
+
+template<typename Transport>
+vector<optional<string>> basic_client<Transport>::upload_objects(const vector<string> & local_files,
+                                                                 const string & directory)
+{
+    if (!is_open())
+    {
+        throw ftp_exception("Connection is not open.");
+    }
+
+    vector<string> objects;
+    /* Kept here, the remembered ones may be evicted while uploading. */
+    vector<content_hash> hashes;
+    vector<string> commands;
+
+    for (const string & local_file : local_files)
+    {
+        hashes.push_back(hash_content(local_file));
+
+        string name = hashes.back().md5 + "_" + std::to_string(hashes.back().size);
+
+        objects.push_back(directory.empty() ? name : directory + "/" + name);
+        commands.push_back("MLST " + objects.back());
+    }
+
+    vector<reply_t> replies;
+
+    try
+    {
+        replies = send_pipelined(commands);
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+
+    vector<optional<string>> uploaded;
+    /* Files of the same contents are uploaded once. */
+    std::unordered_set<string> present;
+
+    for (size_t i = 0; i < local_files.size(); i++)
+    {
+        ++dedup_stats_.checked;
+
+        if (present.count(objects[i]) != 0 || is_existing_object(replies[i], token_))
+        {
+            ++dedup_stats_.skipped;
+            dedup_stats_.bytes_saved += hashes[i].size;
+            present.insert(objects[i]);
+            uploaded.push_back(objects[i]);
+        }
+        else if (upload(local_files[i], objects[i]))
+        {
+            present.insert(objects[i]);
+            uploaded.push_back(objects[i]);
+        }
+        else
+        {
+            uploaded.push_back(nullopt);
+            continue;
+        }
+
+        manifest_entry entry;
+
+        if (upload_manifest_ && upload_manifest::identify(local_files[i], entry.inode, entry.mtime, entry.size))
+        {
+            entry.path = local_files[i];
+            entry.md5 = hashes[i].md5;
+            entry.remote_name = objects[i];
+            upload_manifest_->add(entry);
+        }
+    }
+
+    return uploaded;
+}
+
+template<typename Transport>
+dedup_stats basic_client<Transport>::get_dedup_stats() const
+{
+    return dedup_stats_;
+}
+
+template<typename Transport>
+void basic_client<Transport>::set_upload_manifest(std::shared_ptr<upload_manifest> manifest)
+{
+    upload_manifest_ = std::move(manifest);
+}
+
+template<typename Transport>
+typename basic_client<Transport>::content_hash basic_client<Transport>::hash_content(const string & local_file)
+{
+    std::error_code size_ec;
+    std::error_code modified_ec;
+    std::uintmax_t size = std::filesystem::file_size(local_file, size_ec);
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(local_file, modified_ec);
+
+    if (size_ec || modified_ec)
+    {
+        throw ftp_exception("Cannot open file '%1%'.", local_file);
+    }
+
+    auto it = content_hashes_.find(local_file);
+
+    if (it != content_hashes_.end() && it->second.size == size && it->second.modified == modified)
+    {
+        content_lru_.splice(content_lru_.begin(), content_lru_, it->second.lru);
+        return it->second;
+    }
+
+    content_hash hash{ size, modified, string(), content_lru_.end() };
+
+    if (upload_manifest_)
+    {
+        std::uint64_t inode;
+        std::int64_t mtime;
+        std::uint64_t stat_size;
+        optional<manifest_entry> entry;
+
+        if (upload_manifest::identify(local_file, inode, mtime, stat_size) && stat_size == size)
+        {
+            entry = upload_manifest_->find_file(inode, mtime, size);
+        }
+
+        if (entry)
+        {
+            hash.md5 = entry->md5;
+        }
+    }
+
+    if (hash.md5.empty())
+    {
+        ifstream file(local_file, ios_base::binary);
+        vector<char> buffer(64 * 1024);
+        detail::md5 md5;
+
+        if (!file)
+        {
+            throw ftp_exception("Cannot open file '%1%'.", local_file);
+        }
+
+        while (file)
+        {
+            file.read(buffer.data(), buffer.size());
+            md5.update(buffer.data(), file.gcount());
+        }
+
+        if (file.bad())
+        {
+            throw ftp_exception("Cannot read data from file '%1%'.", local_file);
+        }
+
+        hash.md5 = md5.hex_digest();
+    }
+
+    remember_content_hash(local_file, hash);
+
+    return hash;
+}
+
+template<typename Transport>
+void basic_client<Transport>::remember_content_hash(const string & local_file, content_hash hash)
+{
+    auto it = content_hashes_.find(local_file);
+
+    if (it != content_hashes_.end())
+    {
+        content_lru_.erase(it->second.lru);
+        content_hashes_.erase(it);
+    }
+
+    while (content_hashes_.size() >= max_content_hashes)
+    {
+        content_hashes_.erase(content_lru_.back());
+        content_lru_.pop_back();
+    }
+
+    content_lru_.push_front(local_file);
+    hash.lru = content_lru_.begin();
+    content_hashes_.emplace(local_file, std::move(hash));
+}
+
+template<typename Transport>
+vector<reply_t> basic_client<Transport>::send_pipelined(const vector<string> & commands)
+{
+    vector<reply_t> replies;
+
+    collect_prefetched();
+
+    for (size_t sent = 0; sent < commands.size(); sent++)
+    {
+        control_connection_.send(commands[sent], false);
+
+        if (sent + 1 - replies.size() >= pipeline_window)
+        {
+            replies.push_back(recv());
+        }
+    }
+
+    while (replies.size() < commands.size())
+    {
+        replies.push_back(recv());
+    }
+
+    return replies;
+}
+
+template<typename Transport>
+bool basic_client<Transport>::upload_cache(data_connection* pDataConn, const char* pszBuffer, std::size_t uBufferSize)
+{
+    try
+    {
+        if (!is_open() || !pDataConn->is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        pDataConn->send(pszBuffer, uBufferSize);
+        //flush??
+        pDataConn->close();
+        reply_t reply = recv();
+
+        report_transfer(*pDataConn, "STOR", reply);
+        refill_prefetched();
+
+        return reply.is_positive();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+template<typename Transport>
+auto basic_client<Transport>::prepare_upload(const std::string & remote_file) -> unique_ptr<data_connection>
+{
+    if (!is_open())
+    {
+        throw ftp_exception("Connection is not open.");
+    }
+
+    unique_ptr<data_connection> data_connection = establish_data_connection("STOR");// + remote_file);
+
+    if (!data_connection)
+    {
+        return nullptr;
+    }
+
+    encrypt_transfer(*data_connection);
+
+    return data_connection;
+}
+
+template<typename Transport>
+bool basic_client<Transport>::download(const string & remote_file, const string & local_file)
+{
+    try
+    {
+        if (!is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        if (std::filesystem::exists(local_file))
+        {
+            throw ftp_exception("The file '%1%' already exists.", local_file);
+        }
+
+        optional<string> cache_key;
+
+        if (download_cache_)
+        {
+            cache_key = download_cache_key(remote_file);
+
+            if (cache_key && download_cache_->fetch(cache_key.value(), local_file))
+            {
+                return true;
+            }
+        }
+
+        ofstream file(local_file, ios_base::binary);
+
+        if (!file)
+        {
+            throw ftp_exception("Cannot create file %1%.", local_file);
+        }
+
+        unique_ptr<data_connection> data_connection = establish_data_connection("RETR " + remote_file);
+
+        if (!data_connection)
+        {
+            return false;
+        }
+
+        encrypt_transfer(*data_connection);
+
+        data_connection->recv(file);
+
+        /* Don't keep the data connection. */
+        data_connection->close();
+
+        reply_t reply = recv();
+        server_checksums checksums;
+
+        if (reply.is_positive())
+        {
+            checksums = server_checksum(*data_connection, remote_file);
+        }
+
+        report_transfer(*data_connection, "RETR " + remote_file, reply, checksums);
+        refill_prefetched();
+
+        if (cache_key && last_transfer_->success)
+        {
+            file.close();
+            download_cache_->store(cache_key.value(), local_file);
+        }
+
+        return last_transfer_->success;
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+template<typename Transport>
+void basic_client<Transport>::set_download_cache(std::shared_ptr<download_cache> cache)
+{
+    download_cache_ = std::move(cache);
+}
+
+template<typename Transport>
+optional<string> basic_client<Transport>::download_cache_key(const string & remote_file)
+{
+    string name = remote_file.substr(remote_file.rfind('/') + 1);
+
+    /* Its contents can't change, whichever server it is on. */
+    if (is_object_name(name))
+    {
+        return "object " + name;
+    }
+
+    /* Relative paths depend on the working directory. */
+    if (remote_file.empty() || remote_file.front() != '/')
+    {
+        return nullopt;
+    }
+
+    vector<reply_t> replies = send_pipelined({ "SIZE " + remote_file, "MDTM " + remote_file });
+    string size = reply_text(replies[0], token_);
+    string modified = reply_text(replies[1], token_);
+
+    if (size.compare(0, 4, "213 ") != 0 || modified.compare(0, 4, "213 ") != 0)
+    {
+        return nullopt;
+    }
+
+    return detail::utils::format("file %1%:%2%:%3% %4% %5%",
+                                 control_connection_.host(), control_connection_.port(), remote_file,
+                                 size.substr(4), modified.substr(4));
+}
+
+template<typename Transport>
+bool basic_client<Transport>::pwd()
+{
+    try
+    {
+        if (!is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        reply_t reply = send_command("PWD");
+        optional<string> directory = parse_working_directory(reply_text(reply, token_));
+
+        if (directory)
+        {
+            working_directory_ = directory;
+        }
+
+        return reply.is_positive();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+template<typename Transport>
+bool basic_client<Transport>::mkdir(const string & directory_name)
+{
+    try
+    {
+        if (!is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        invalidate_cached(directory_name);
+
+        reply_t reply = send_command("MKD " + directory_name);
+
+        return reply.is_positive();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+template<typename Transport>
+bool basic_client<Transport>::rmdir(const string & directory_name)
+{
+    try
+    {
+        if (!is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        invalidate_cached(directory_name);
+
+        reply_t reply = send_command("RMD " + directory_name);
+
+        return reply.is_positive();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+template<typename Transport>
+bool basic_client<Transport>::rm(const string & remote_file)
+{
+    try
+    {
+        if (!is_open())
+        {
+            throw ftp_exception("Connection is not open.");
+        }
+
+        invalidate_cached(remote_file);
+
+        reply_t reply = send_command("DELE " + remote_file);
+
+        return reply.is_positive();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+template<typename Transport>
+bool basic_client<Transport>::binary()
 {
     try
     {
@@ -435,6 +1482,11 @@ bool client::binary()
 
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -442,7 +1494,8 @@ bool client::binary()
     }
 }
 
-bool client::size(const string & remote_file)
+template<typename Transport>
+bool basic_client<Transport>::size(const string & remote_file)
 {
     try
     {
@@ -451,10 +1504,34 @@ bool client::size(const string & remote_file)
             throw ftp_exception("Connection is not open.");
         }
 
+        string key;
+
+        if (metadata_cache_)
+        {
+            key = cache_key(remote_file);
+            optional<reply_t> cached = metadata_cache_->find_size(key);
+
+            if (cached)
+            {
+                report_reply(cached.value());
+                return true;
+            }
+        }
+
         reply_t reply = send_command("SIZE " + remote_file);
 
+        if (metadata_cache_ && reply.is_positive())
+        {
+            metadata_cache_->store_size(key, reply);
+        }
+
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -462,7 +1539,8 @@ bool client::size(const string & remote_file)
     }
 }
 
-bool client::stat(const optional<string> & remote_file)
+template<typename Transport>
+bool basic_client<Transport>::stat(const optional<string> & remote_file)
 {
     try
     {
@@ -482,10 +1560,37 @@ bool client::stat(const optional<string> & remote_file)
             command = "STAT";
         }
 
+        /* Without an argument 'STAT' reports the session status, which
+         * changes with every command. Don't cache it.
+         */
+        string key;
+
+        if (metadata_cache_ && remote_file)
+        {
+            key = cache_key(remote_file.value());
+            optional<reply_t> cached = metadata_cache_->find_stat(key);
+
+            if (cached)
+            {
+                report_reply(cached.value());
+                return true;
+            }
+        }
+
         reply_t reply = send_command(command);
 
+        if (metadata_cache_ && remote_file && reply.is_positive())
+        {
+            metadata_cache_->store_stat(key, reply);
+        }
+
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -493,7 +1598,8 @@ bool client::stat(const optional<string> & remote_file)
     }
 }
 
-bool client::system()
+template<typename Transport>
+bool basic_client<Transport>::system()
 {
     try
     {
@@ -506,6 +1612,11 @@ bool client::system()
 
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -513,7 +1624,8 @@ bool client::system()
     }
 }
 
-bool client::noop()
+template<typename Transport>
+bool basic_client<Transport>::noop()
 {
     try
     {
@@ -526,6 +1638,11 @@ bool client::noop()
 
         return reply.is_positive();
     }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
     catch (const connection_exception & ex)
     {
         reset_connection();
@@ -533,7 +1650,8 @@ bool client::noop()
     }
 }
 
-bool client::close()
+template<typename Transport>
+bool basic_client<Transport>::close()
 {
     try
     {
@@ -542,21 +1660,136 @@ bool client::close()
             throw ftp_exception("Connection is not open.");
         }
 
-        reply_t reply = send_command("QUIT");
+        reply_t reply = send_command("QUIT");
+
+        drop_prefetched();
+        control_connection_.close();
+        data_listener_.reset();
+
+        return reply.is_positive();
+    }
+    catch (const detail::timeout_exception & ex)
+    {
+        reset_connection();
+        throw ftp::timeout_exception(ex);
+    }
+    catch (const connection_exception & ex)
+    {
+        reset_connection();
+        throw ftp_exception(ex);
+    }
+}
+
+/* Paths name the same file only on the same server and for the same user,
+ * whose home directory relative paths may start from. The cache may be
+ * shared, so keys carry both. Paths are made absolute first, so that
+ * relative and absolute names of a file share their entries. When the
+ * server doesn't report its working directory, relative paths are only
+ * meaningful to this client and are prefixed with the current cache scope.
+ */
+template<typename Transport>
+string basic_client<Transport>::cache_key(const string & path)
+{
+    optional<string> absolute = absolute_path(path);
+
+    if (absolute)
+    {
+        return detail::utils::format("%1%:%2%:%3%:%4%", control_connection_.host(),
+                                     control_connection_.port(), username_, absolute.value());
+    }
+
+    string key = path;
+
+    while (key.size() > 1 && key.back() == '/')
+    {
+        key.pop_back();
+    }
+
+    if (key.empty() || key == ".")
+    {
+        return detail::utils::format("@%1%:.", cache_scope_);
+    }
+
+    return detail::utils::format("@%1%:%2%", cache_scope_, key);
+}
+
+template<typename Transport>
+optional<string> basic_client<Transport>::absolute_path(const string & path)
+{
+    if (!path.empty() && path.front() == '/')
+    {
+        return normalize_path(path);
+    }
+
+    if (!working_directory_)
+    {
+        reply_t reply = send_command("PWD");
+
+        /* Empty when the server doesn't tell, so that it isn't asked again
+         * until the next 'cd'.
+         */
+        working_directory_ = parse_working_directory(reply_text(reply, token_)).value_or("");
+    }
+
+    if (working_directory_->empty())
+    {
+        return nullopt;
+    }
+
+    return normalize_path(working_directory_.value() + '/' + path);
+}
+
+template<typename Transport>
+void basic_client<Transport>::invalidate_cached(const string & path)
+{
+    if (!metadata_cache_)
+    {
+        return;
+    }
+
+    string target = absolute_path(path).value_or(path);
 
-        control_connection_.close();
+    metadata_cache_->invalidate(cache_key(target));
 
-        return reply.is_positive();
+    /* The listing of the parent directory changes as well, but nothing
+     * else below it.
+     */
+    string parent = target;
+
+    while (parent.size() > 1 && parent.back() == '/')
+    {
+        parent.pop_back();
     }
-    catch (const connection_exception & ex)
+
+    size_t last_slash = parent.rfind('/');
+
+    if (last_slash == string::npos)
     {
-        reset_connection();
-        throw ftp_exception(ex);
+        parent = ".";
+    }
+    else if (last_slash == 0)
+    {
+        parent = "/";
+    }
+    else
+    {
+        parent.erase(last_slash);
     }
+
+    metadata_cache_->invalidate_listing(cache_key(parent));
 }
 
-reply_t client::send_command(const string & command)
+template<typename Transport>
+void basic_client<Transport>::new_cache_scope()
 {
+    cache_scope_ = next_cache_scope++;
+    working_directory_.reset();
+}
+
+template<typename Transport>
+reply_t basic_client<Transport>::send_command(const string & command)
+{
+    collect_prefetched();
     control_connection_.send(command);
 
     reply_t reply = control_connection_.recv();
@@ -576,7 +1809,8 @@ inline bool endWith(const std::string& str, const std::string& cmp) {
     return true;
 }
 
-detail::reply_t client::send_command_s(const std::string & command, const std::string& args)
+template<typename Transport>
+detail::reply_t basic_client<Transport>::send_command_s(const std::string & command, const std::string& args)
 {
     if(!endWith(command, "_S")) 
 	{
@@ -592,18 +1826,8 @@ detail::reply_t client::send_command_s(const std::string & command, const std::s
 	}
 	else
 	{
-		int nBufSize = command.length() + 10 + args.length() * 2;
-		std::unique_ptr<char[]> spBuffer(new char[nBufSize]);
-		memset(spBuffer.get(), 0x00, nBufSize);
-		int nOffset = sprintf(spBuffer.get(), "%s 20", command.c_str());
-		if(!args.empty())
-		{
-			if(token_.empty())
-				RC4EncryptStr(spBuffer.get() + nOffset, args.c_str(), args.length(), "tipray", strlen("tipray"));
-			else
-				RC4EncryptStr(spBuffer.get() + nOffset, args.c_str(), args.length(), token_.c_str(), token_.length());
-		}
-		control_connection_.send(std::string(spBuffer.get()));
+		collect_prefetched();
+		control_connection_.send(command_line_s(command, args));
 	}
     reply_t reply = control_connection_.recv();
 
@@ -611,12 +1835,31 @@ detail::reply_t client::send_command_s(const std::string & command, const std::s
     return reply;
 }
 
-const std::string & client::getToken()
+template<typename Transport>
+string basic_client<Transport>::command_line_s(const string & command, const string & args) const
+{
+	int nBufSize = command.length() + 10 + args.length() * 2;
+	std::unique_ptr<char[]> spBuffer(new char[nBufSize]);
+	memset(spBuffer.get(), 0x00, nBufSize);
+	int nOffset = sprintf(spBuffer.get(), "%s 20", command.c_str());
+	if(!args.empty())
+	{
+		if(token_.empty())
+			RC4EncryptStr(spBuffer.get() + nOffset, args.c_str(), args.length(), "tipray", strlen("tipray"));
+		else
+			RC4EncryptStr(spBuffer.get() + nOffset, args.c_str(), args.length(), token_.c_str(), token_.length());
+	}
+	return string(spBuffer.get());
+}
+
+template<typename Transport>
+const std::string & basic_client<Transport>::getToken()
 {
 	return token_;
 }
 
-reply_t client::recv()
+template<typename Transport>
+reply_t basic_client<Transport>::recv()
 {
     reply_t reply = control_connection_.recv();
 
@@ -625,8 +1868,12 @@ reply_t client::recv()
     return reply;
 }
 
-void client::reset_connection()
+template<typename Transport>
+void basic_client<Transport>::reset_connection()
 {
+    drop_prefetched();
+    data_listener_.reset();
+
     try
     {
         control_connection_.close();
@@ -636,13 +1883,129 @@ void client::reset_connection()
     }
 }
 
-unique_ptr<data_connection> client::establish_data_connection(const string & command)
+/* RFC 4217: 'AUTH TLS' secures the control connection, 'PBSZ 0' and
+ * 'PROT P' ask for data connections secured as well. A server that refuses
+ * any of them doesn't get to see the credentials in plain text, the session
+ * is closed.
+ */
+template<typename Transport>
+bool basic_client<Transport>::start_tls()
+{
+    if constexpr (Transport::is_tls)
+    {
+        reply_t reply = send_command("AUTH TLS");
+
+        if (reply.status_code != 234)
+        {
+            reset_connection();
+            return false;
+        }
+
+        control_connection_.start_tls(*tls_context_);
+        ++tls_stats_.control_handshakes;
+
+        if (!send_command("PBSZ 0").is_positive() || !send_command("PROT P").is_positive())
+        {
+            reset_connection();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename Transport>
+void basic_client<Transport>::start_tls(data_connection & connection)
+{
+    if constexpr (Transport::is_tls)
+    {
+        connection.start_tls(*tls_context_, control_connection_.host(), control_connection_.tls_session().get());
+        ++tls_stats_.data_handshakes;
+
+        if (connection.tls_resumed())
+        {
+            ++tls_stats_.resumed;
+        }
+
+        if (connection.is_kernel_tls())
+        {
+            ++tls_stats_.kernel_tx;
+        }
+    }
+}
+
+template<typename Transport>
+auto basic_client<Transport>::establish_data_connection(const string & command, string *early_data)
+    -> unique_ptr<data_connection>
 {
     if (!is_open())
     {
         throw ftp_exception("Connection is not open.");
     }
 
+    if (transfer_mode_ == transfer_mode::active)
+    {
+        return establish_active_data_connection(command);
+    }
+
+    unique_ptr<data_connection> connection = take_prefetched();
+    bool prefetched = connection != nullptr;
+
+    if (!connection && fast_open_ && !Transport::is_tls && !data_cipher_ && early_data && !early_data->empty())
+    {
+        /* The data goes out with the SYN, before the command. The server
+         * keeps it in the socket until it starts reading the upload.
+         */
+        connection = open_passive_data_connection(true);
+        connection->open();
+        connection->send(early_data->data(), early_data->size());
+        early_data->clear();
+    }
+    else if (!connection)
+    {
+        connection = open_passive_data_connection();
+
+        if (!overlap_data_connect_)
+        {
+            connection->open();
+        }
+    }
+
+    reply_t reply = send_command_s(command, "1.txt");
+
+    if (prefetched && reply.status_code == 425)
+    {
+        /* The server has given up on the prefetched port after all, start
+         * over the usual way.
+         */
+        connection = open_passive_data_connection();
+
+        if (!overlap_data_connect_)
+        {
+            connection->open();
+        }
+
+        reply = send_command_s(command, "1.txt");
+    }
+
+    if (!reply.is_positive())
+    {
+        return nullptr;
+    }
+
+    /* Joins the handshake if it ran alongside the command. */
+    connection->open();
+    start_tls(*connection);
+
+    return connection;
+}
+
+/* Negotiates a passive port and starts connecting to it. The connection is
+ * ready to use once 'open' returns.
+ */
+template<typename Transport>
+auto basic_client<Transport>::open_passive_data_connection(bool fast_open) -> unique_ptr<data_connection>
+{
     reply_t reply = send_command_s("EPSV_S", "");
 
     // if (!reply.is_positive())
@@ -650,6 +2013,13 @@ unique_ptr<data_connection> client::establish_data_connection(const string & com
     //     return nullptr;
     // }
 
+    return passive_data_connection(reply, fast_open);
+}
+
+template<typename Transport>
+auto basic_client<Transport>::passive_data_connection(const reply_t & reply, bool fast_open)
+    -> unique_ptr<data_connection>
+{
 	std::cout << reply.status_line << std::endl;
     std::unique_ptr<char[]> spPlainText(new char[reply.status_line.length()]);
     memset(spPlainText.get(), 0x00, reply.status_line.length());
@@ -666,18 +2036,232 @@ unique_ptr<data_connection> client::establish_data_connection(const string & com
 
     unique_ptr<data_connection> connection = make_unique<data_connection>(control_connection_.ip(), port);
 
-    connection->open();
+    connection->set_timeouts(control_connection_.connect_timeout(),
+                             control_connection_.data_inactivity_timeout());
+    connection->set_timer_service(control_connection_.get_timer_service());
+    connection->set_socket_options(socket_profile_.data);
+    connection->set_source_pool(source_address_pool_);
+    connection->set_fast_open(fast_open);
+    connection->set_kernel_tls(kernel_tls_);
+    set_checksums(*connection);
+    connection->set_md5(content_md5_);
+    connection->start_open();
 
-    reply = send_command_s(command, "1.txt");
+    return connection;
+}
 
-    if (!reply.is_positive())
+/* Returns the oldest prefetched connection that is still usable. Those the
+ * server may have forgotten about, or has closed, are dropped.
+ */
+template<typename Transport>
+auto basic_client<Transport>::take_prefetched() -> unique_ptr<data_connection>
+{
+    collect_prefetched();
+
+    while (!prefetched_.empty())
+    {
+        prefetched_t entry = std::move(prefetched_.front());
+        prefetched_.pop_front();
+
+        if (std::chrono::steady_clock::now() - entry.negotiated > max_prefetched_age)
+        {
+            continue;
+        }
+
+        try
+        {
+            /* Usually the handshake has long completed. */
+            entry.connection->open();
+        }
+        catch (const connection_exception &)
+        {
+            continue;
+        }
+
+        if (!entry.connection->is_alive())
+        {
+            continue;
+        }
+
+        return std::move(entry.connection);
+    }
+
+    return nullptr;
+}
+
+/* Called once a transfer is done. Whatever goes wrong here is left to the
+ * next command to find out, the transfer has succeeded.
+ */
+template<typename Transport>
+void basic_client<Transport>::refill_prefetched()
+{
+    if (transfer_mode_ != transfer_mode::passive || !control_connection_.is_open())
+    {
+        return;
+    }
+
+    try
+    {
+        while (prefetched_.size() + prefetch_requests_ < prefetch_depth_)
+        {
+            control_connection_.send(command_line_s("EPSV_S", ""), false);
+            ++prefetch_requests_;
+        }
+    }
+    catch (const connection_exception &)
+    {
+        /* Timeouts included. The next command finds the connection closed. */
+        reset_connection();
+    }
+}
+
+template<typename Transport>
+void basic_client<Transport>::collect_prefetched()
+{
+    while (prefetch_requests_ > 0)
+    {
+        --prefetch_requests_;
+
+        reply_t reply = recv();
+
+        if (prefetched_.size() >= prefetch_depth_)
+        {
+            continue;
+        }
+
+        try
+        {
+            prefetched_.push_back({ passive_data_connection(reply, false), std::chrono::steady_clock::now() });
+        }
+        catch (const ftp_exception &)
+        {
+            /* Refused, the next transfer negotiates its own connection. */
+        }
+    }
+}
+
+template<typename Transport>
+void basic_client<Transport>::drop_prefetched()
+{
+    /* The connections close quietly, they haven't been used for anything. */
+    prefetched_.clear();
+    prefetch_requests_ = 0;
+}
+
+template<typename Transport>
+auto basic_client<Transport>::establish_active_data_connection(const string & command)
+    -> unique_ptr<data_connection>
+{
+    if (!data_listener_ || !data_listener_->is_open())
+    {
+        /* The server has reached us at this address, so it can connect to
+         * it again.
+         */
+        data_listener_ = make_unique<data_listener>(control_connection_.local_endpoint().address());
+    }
+
+    if (!advertise_listener(data_listener_->local_endpoint()))
     {
         return nullptr;
     }
 
+    unique_ptr<data_connection> connection = make_unique<data_connection>(control_connection_.ip(), 0);
+
+    connection->set_timeouts(control_connection_.connect_timeout(),
+                             control_connection_.data_inactivity_timeout());
+    connection->set_timer_service(control_connection_.get_timer_service());
+    connection->set_socket_options(socket_profile_.data);
+    connection->set_kernel_tls(kernel_tls_);
+    set_checksums(*connection);
+    connection->set_md5(content_md5_);
+
+    reply_t reply = send_command_s(command, "1.txt");
+
+    try
+    {
+        if (!reply.is_positive())
+        {
+            /* The server may have connected before it refused, start over
+             * with a clean listener rather than accept a stale connection
+             * for the next transfer.
+             */
+            data_listener_.reset();
+            return nullptr;
+        }
+
+        connection->accept(*data_listener_);
+    }
+    catch (...)
+    {
+        data_listener_.reset();
+        throw;
+    }
+
+    /* The client is the TLS client on data connections either way. */
+    start_tls(*connection);
+
     return connection;
 }
 
+/* RFC 2428: EPRT |<net-prt>|<net-addr>|<tcp-port>|, where the network
+ * protocol is 1 for IPv4 and 2 for IPv6. Servers that don't implement it
+ * reply 500 or 502, and IPv4 listeners can still be advertised with
+ * PORT h1,h2,h3,h4,p1,p2 (RFC 959).
+ */
+template<typename Transport>
+bool basic_client<Transport>::advertise_listener(const boost::asio::ip::tcp::endpoint & endpoint)
+{
+    boost::asio::ip::address address = endpoint.address();
+
+    if (eprt_supported_)
+    {
+        string protocol = address.is_v4() ? "1" : "2";
+        string host;
+
+        if (address.is_v4())
+        {
+            host = address.to_string();
+        }
+        else
+        {
+            /* The scope id has no meaning for the server. */
+            boost::asio::ip::address_v6 address_v6 = address.to_v6();
+            address_v6.scope_id(0);
+            host = address_v6.to_string();
+        }
+
+        reply_t reply = send_command("EPRT |" + protocol + "|" + host + "|" + std::to_string(endpoint.port()) + "|");
+
+        if (reply.is_positive())
+        {
+            return true;
+        }
+
+        if (reply.status_code != 500 && reply.status_code != 502)
+        {
+            return false;
+        }
+
+        eprt_supported_ = false;
+    }
+
+    if (!address.is_v4())
+    {
+        return false;
+    }
+
+    string argument;
+
+    for (unsigned char byte : address.to_v4().to_bytes())
+    {
+        argument += std::to_string(byte) + ",";
+    }
+
+    argument += std::to_string(endpoint.port() >> 8) + "," + std::to_string(endpoint.port() & 0xff);
+
+    return send_command("PORT " + argument).is_positive();
+}
+
 /* The text returned in response to the EPSV command MUST be:
  *
  *     <text indicating server is entering extended passive mode> \
@@ -696,7 +2280,8 @@ unique_ptr<data_connection> client::establish_data_connection(const string & com
  *
  * RFC 2428: https://tools.ietf.org/html/rfc2428
  */
-bool client::try_parse_server_port(const string & epsv_reply, uint16_t & port)
+template<typename Transport>
+bool basic_client<Transport>::try_parse_server_port(const string & epsv_reply, uint16_t & port)
 {
     size_t begin = epsv_reply.find('|');
     if (begin == string::npos)
@@ -727,17 +2312,136 @@ bool client::try_parse_server_port(const string & epsv_reply, uint16_t & port)
     return boost::conversion::try_lexical_convert(port_str, port);
 }
 
-void client::subscribe(event_observer *observer)
+template<typename Transport>
+void basic_client<Transport>::subscribe(event_observer *observer)
 {
     observers_.push_back(observer);
 }
 
-void client::unsubscribe(event_observer *observer)
+template<typename Transport>
+void basic_client<Transport>::unsubscribe(event_observer *observer)
 {
     observers_.remove(observer);
 }
 
-void client::report_reply(const string & reply)
+/* 'XCRC' replies '250 <crc>', 'HASH' replies '213 CRC32C <range> <crc>
+ * <file>', the checksum in hex.
+ */
+static optional<std::uint32_t> parse_checksum(const string & status_line, std::size_t word)
+{
+    std::istringstream words(status_line.substr(std::min<std::size_t>(status_line.size(), 4)));
+    string checksum;
+
+    for (std::size_t i = 0; i <= word; i++)
+    {
+        if (!(words >> checksum))
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (checksum.empty() || checksum.size() > 8 ||
+        checksum.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+    {
+        return std::nullopt;
+    }
+
+    return static_cast<std::uint32_t>(std::stoul(checksum, nullptr, 16));
+}
+
+/* Replies to commands the server doesn't know. */
+static bool is_unknown_command(const reply_t & reply)
+{
+    return reply.status_code == 500 || reply.status_code == 502 || reply.status_code == 504;
+}
+
+template<typename Transport>
+void basic_client<Transport>::set_checksums(data_connection & connection) const
+{
+    bool verify = verify_transfers_ && !data_cipher_;
+
+    connection.set_checksum(verify && hash_supported_);
+
+    /* Servers answer XCRC with the IEEE CRC-32. It is only needed until
+     * HASH is known to work.
+     */
+    connection.set_crc32(verify && xcrc_supported_ && !hash_selected_);
+}
+
+template<typename Transport>
+auto basic_client<Transport>::server_checksum(const data_connection & connection,
+                                              const string & remote_file) -> server_checksums
+{
+    const transfer_result & result = connection.result();
+    server_checksums checksums;
+
+    if (result.crc32c && hash_supported_ && !hash_selected_)
+    {
+        reply_t reply = send_command("OPTS HASH CRC32C");
+
+        hash_supported_ = reply.is_positive();
+        hash_selected_ = reply.is_positive();
+    }
+
+    if (result.crc32c && hash_supported_)
+    {
+        reply_t reply = send_command("HASH " + remote_file);
+
+        if (reply.is_positive())
+        {
+            checksums.crc32c = parse_checksum(reply.status_line, 2);
+            return checksums;
+        }
+        else if (!is_unknown_command(reply))
+        {
+            return checksums;
+        }
+
+        hash_supported_ = false;
+    }
+
+    if (result.crc32 && xcrc_supported_)
+    {
+        reply_t reply = send_command("XCRC " + remote_file);
+
+        if (reply.is_positive())
+        {
+            checksums.crc32 = parse_checksum(reply.status_line, 0);
+        }
+        else if (is_unknown_command(reply))
+        {
+            xcrc_supported_ = false;
+        }
+    }
+
+    return checksums;
+}
+
+template<typename Transport>
+void basic_client<Transport>::report_transfer(data_connection & connection, const string & command,
+                                              const reply_t & reply, const server_checksums & checksums)
+{
+    last_transfer_ = connection.result();
+    last_transfer_->command = command;
+    last_transfer_->success = reply.is_positive();
+    last_transfer_->server_crc32c = checksums.crc32c;
+    last_transfer_->server_crc32 = checksums.crc32;
+
+    if ((checksums.crc32c && last_transfer_->crc32c != checksums.crc32c) ||
+        (checksums.crc32 && last_transfer_->crc32 != checksums.crc32))
+    {
+        last_transfer_->success = false;
+    }
+
+    for (const auto & observer : observers_)
+    {
+        if (observer)
+            observer->on_transfer(*last_transfer_);
+    }
+}
+
+template<typename Transport>
+void basic_client<Transport>::report_reply(const string & reply)
 {
     for (const auto & observer : observers_)
     {
@@ -746,7 +2450,8 @@ void client::report_reply(const string & reply)
     }
 }
 
-void client::report_reply(const reply_t & reply)
+template<typename Transport>
+void basic_client<Transport>::report_reply(const reply_t & reply)
 {
     for (const auto & observer : observers_)
     {
@@ -755,4 +2460,9 @@ void client::report_reply(const reply_t & reply)
     }
 }
 
+template class basic_client<tcp_transport>;
+template class basic_client<unix_transport>;
+template class basic_client<memory_transport>;
+template class basic_client<tls_transport>;
+
 } // namespace ftp
@@ -27,28 +27,138 @@
 
 #include "detail/control_connection.hpp"
 #include "detail/data_connection.hpp"
+#include "data_cipher.hpp"
+#include "download_cache.hpp"
+#include "list_entry.hpp"
+#include "metadata_cache.hpp"
+#include "socket_profile.hpp"
+#include "source_address_pool.hpp"
+#include "timeouts.hpp"
+#include "tls_transport.hpp"
+#include "transfer_result.hpp"
+#include "transport.hpp"
+#include "upload_manifest.hpp"
+#include <chrono>
+#include <deque>
+#include <filesystem>
 #include <string>
 #include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 namespace ftp
 {
 
-class client
+/* How 'ls' with structured output fetches the listing:
+ *
+ *  - data_connection: LIST over a passive data connection.
+ *  - control_connection: STAT <path>, the listing comes inline in the reply.
+ *  - adaptive: STAT for directories known (or assumed) to be small, LIST for
+ *    large ones and for servers that don't support STAT with a path.
+ */
+enum class listing_mode
+{
+    data_connection,
+    control_connection,
+    adaptive
+};
+
+/* How data connections are established:
+ *
+ *  - passive: the client connects to a port the server opens (EPSV).
+ *  - active: the server connects to a listener of the client (EPRT, or PORT
+ *    for servers that don't know EPRT). The listener is kept for the whole
+ *    session.
+ */
+enum class transfer_mode
+{
+    passive,
+    active
+};
+
+class event_observer
 {
 public:
-    class event_observer
+    virtual void on_reply(const std::string & reply) = 0;
+
+    /* Called when a transfer over a data connection has ended. */
+    virtual void on_transfer(const transfer_result &)
     {
-    public:
-        virtual void on_reply(const std::string & reply) = 0;
+    }
 
-        virtual ~event_observer() = default;
-    };
+    virtual ~event_observer() = default;
+};
+
+struct fast_open_stats
+{
+    /* Data connections opened with TCP Fast Open enabled. */
+    std::uint64_t attempts;
+    /* Those whose SYN carried data the server acknowledged. */
+    std::uint64_t accepted;
+};
+
+struct tls_stats
+{
+    /* TLS handshakes of control connections. */
+    std::uint64_t control_handshakes;
+    /* TLS handshakes of data connections. */
+    std::uint64_t data_handshakes;
+    /* Those that resumed the session of the control connection. */
+    std::uint64_t resumed;
+    /* Those whose encryption the kernel took over. */
+    std::uint64_t kernel_tx;
+
+    /* Zero before the first data connection. */
+    double resumption_rate() const
+    {
+        return data_handshakes == 0 ? 0.0 : static_cast<double>(resumed) / data_handshakes;
+    }
+};
+
+struct dedup_stats
+{
+    /* Objects whose existence was asked for. */
+    std::uint64_t checked;
+    /* Those the server had already, so they weren't uploaded. */
+    std::uint64_t skipped;
+    /* Their sizes. */
+    std::uint64_t bytes_saved;
+};
+
+/* The client over any transport (see transport.hpp). Options that concern
+ * TCP only, such as socket profiles, Fast Open, source address pools and
+ * active mode, have no effect on, or fail with, other transports.
+ *
+ * Over tls_transport the client speaks explicit FTPS (RFC 4217): 'open'
+ * secures the control connection with 'AUTH TLS' and asks for protected
+ * data connections with 'PBSZ 0' and 'PROT P'. Each data connection then
+ * starts TLS once the server has accepted the transfer command, resuming
+ * the session of the control connection, which spares the server a full
+ * handshake per transfer and is what servers that check that both
+ * connections belong to the same client require. Fast Open doesn't apply
+ * to TLS data connections.
+ */
+template<typename Transport>
+class basic_client
+{
+public:
+    using event_observer = ftp::event_observer;
+
+    using fast_open_stats = ftp::fast_open_stats;
 
-    explicit client(client::event_observer *observer = nullptr);
+    using tls_stats = ftp::tls_stats;
 
-    client(const client &) = delete;
+    using control_connection = detail::basic_control_connection<Transport>;
 
-    client & operator=(const client &) = delete;
+    using data_connection = detail::basic_data_connection<Transport>;
+
+    explicit basic_client(event_observer *observer = nullptr);
+
+    basic_client(const basic_client &) = delete;
+
+    basic_client & operator=(const basic_client &) = delete;
 
     bool open(const std::string & hostname, uint16_t port = 21);
 
@@ -56,18 +166,180 @@ public:
 
     bool is_open();
 
+    /* Checks without a round trip that the control connection is usable. */
+    bool is_alive();
+
     bool login(const std::string & username, const std::string & password);
 
     bool cd(const std::string & remote_directory);
 
     bool ls(const std::optional<std::string> & remote_directory = std::nullopt);
 
+    bool ls(const std::optional<std::string> & remote_directory,
+            std::vector<list_entry> & entries,
+            listing_mode mode = listing_mode::adaptive);
+
+    void set_stat_listing_threshold(std::size_t max_entries);
+
+    /* Caches 'size', 'stat' and structured 'ls' results by server, user and
+     * absolute path; relative paths are resolved against the working
+     * directory, which takes a 'PWD' after each 'cd'. The cache may be
+     * shared with other clients. Pass nullptr to disable caching.
+     */
+    void set_metadata_cache(std::shared_ptr<metadata_cache> cache);
+
+    /* Operations that miss their deadline throw ftp::timeout_exception and
+     * close the connection.
+     */
+    void set_timeouts(const timeouts & timeouts);
+
+    /* Runs the deadlines of this client on a timer service shared with other
+     * clients instead of on timers of its own.
+     */
+    void set_timer_service(std::shared_ptr<timer_service> timers);
+
+    void set_transfer_mode(transfer_mode mode);
+
+    /* Takes effect for connections opened afterwards. The default is
+     * socket_profile::lan().
+     */
+    void set_socket_profile(const socket_profile & profile);
+
+    /* Binds passive data connections to the addresses of the pool in turn,
+     * so a high rate of transfers to one server spreads over the ephemeral
+     * ports of several local addresses. The pool may be shared among
+     * clients. Active data connections are accepted on the address of the
+     * control connection and don't use it.
+     */
+    void set_source_address_pool(std::shared_ptr<source_address_pool> pool);
+
+    /* Sends the transfer command while the TCP handshake of the passive
+     * data connection is still in progress instead of after it, which saves
+     * a round trip per transfer. The server must accept the command before
+     * the data connection arrives, as RFC 959 allows; most servers do.
+     */
+    void set_overlap_data_connect(bool enabled);
+
+    /* Opens passive data connections of uploads with TCP Fast Open, so the
+     * first bytes of the file ride on the SYN when the server has handed
+     * out a cookie before. Without a cookie, or where the system doesn't
+     * support it, the connection is opened the usual way.
+     *
+     * Only uploads use it: the server speaks first on the control
+     * connection and on download data connections, so they have nothing to
+     * put into the SYN.
+     */
+    void set_fast_open(bool enabled);
+
+    fast_open_stats get_fast_open_stats() const;
+
+    /* The TLS context of FTPS connections, which decides whether and how the
+     * server's certificate is verified. The default trusts the certificate
+     * authorities of the system and checks the certificate against the host
+     * passed to 'open'. Takes effect for connections opened afterwards.
+     */
+    void set_tls_context(std::shared_ptr<boost::asio::ssl::context> context);
+
+    tls_stats get_tls_stats() const;
+
+    /* Lets the kernel encrypt what is sent over TLS data connections, so
+     * uploads are sent with sendfile as they are without TLS. Needs Linux
+     * with the 'tls' module, and AES-GCM or ChaCha20-Poly1305 with TLS 1.2
+     * or 1.3. Otherwise OpenSSL encrypts as before. With TLS 1.3 the keys
+     * come from a key log callback, which is only installed on the default
+     * TLS context; connections of a context set with 'set_tls_context' are
+     * left to OpenSSL then.
+     */
+    void set_kernel_tls(bool enabled);
+
+    /* Checks each upload and download against the server: the CRC-32C
+     * computed while the data passed is compared with what the server
+     * reports for the file in reply to 'HASH <file>' after 'OPTS HASH
+     * CRC32C'. Where HASH isn't known, the IEEE CRC-32 is computed instead
+     * and compared with the reply to 'XCRC <file>'. A mismatch fails the
+     * transfer. Servers that can't tell leave it unchecked, and so are
+     * transfers under a data cipher.
+     */
+    void set_verify_transfers(bool enabled);
+
+    /* Computes the MD5 of the contents of each transfer while it passes,
+     * so files don't have to be read once more to name their objects. It
+     * ends up in the result of the transfer.
+     */
+    void set_content_md5(bool enabled);
+
+    /* Ciphers for the contents of uploads and downloads, most preferred
+     * first (see data_cipher.hpp). After login they are offered in turn
+     * with 'DCPH <name> <nonce>', the nonce in hex, until the server
+     * accepts one. Where none is accepted, contents go as they are.
+     * Listings are never encrypted. Fast Open doesn't apply to encrypted
+     * uploads. RC4 isn't offered, see set_content_rc4.
+     */
+    void set_data_ciphers(const std::vector<std::string> & names);
+
+    /* Applies RC4 keyed by the token of the login (see getToken) to the
+     * contents of uploads and downloads, the way the server stores them
+     * with RC4EncryptContent. Nothing is negotiated, the server expects
+     * it. Takes the place of the ciphers of set_data_ciphers.
+     */
+    void set_content_rc4(bool enabled);
+
+    /* The cipher of the session, if any. */
+    const std::optional<std::string> & negotiated_data_cipher() const;
+
+    /* Keeps up to 'depth' passive data connections negotiated and connected
+     * ahead of time. A transfer then starts without waiting for 'EPSV' and
+     * the TCP handshake. Zero disables it.
+     *
+     * Once a transfer is done the client asks for replacements without
+     * waiting for the replies; they are read before the next command, so
+     * neither their round trip nor their failure falls on the transfer.
+     *
+     * Most servers keep only the last passive port open, so a depth above
+     * one only pays off with servers that keep several.
+     */
+    void set_prefetch_depth(std::size_t depth);
+
+    /* The result of the last upload, download or listing over a data
+     * connection.
+     */
+    const std::optional<transfer_result> & last_transfer() const;
+
+    /* Zero until the first round trip has been measured. */
+    std::chrono::microseconds smoothed_rtt() const;
+
     bool upload(const std::string & local_file, const std::string & remote_file);
 
-    bool upload_cache(detail::data_connection* pDataConn, const char* pszBuffer, std::size_t uBufferSize);
+    /* Uploads each file as the object named by its contents,
+     * '<directory>/<MD5>_<size>', unless the server has that object
+     * already. Recently hashed files are hashed again only once their size
+     * or modification time changes, and the existence checks ('MLST
+     * <object>') go out together, so they take a single round trip.
+     * Returns the object of each file, or nothing where its upload failed.
+     */
+    std::vector<std::optional<std::string>> upload_objects(const std::vector<std::string> & local_files,
+                                                           const std::string & directory);
+
+    dedup_stats get_dedup_stats() const;
+
+    /* Remembers the files upload_objects has uploaded or found on the
+     * server, so they aren't hashed again after a restart. The manifest
+     * may be shared with other clients. Pass nullptr to disable it.
+     */
+    void set_upload_manifest(std::shared_ptr<upload_manifest> manifest);
+
+    bool upload_cache(data_connection* pDataConn, const char* pszBuffer, std::size_t uBufferSize);
 
     bool download(const std::string & remote_file, const std::string & local_file);
 
+    /* Serves downloads from the cache when it has the file, without a data
+     * connection. Objects named by their contents ('<MD5>_<size>') are
+     * cached by name; other files by server, absolute path, size and
+     * modification time, which take one round trip to check. The cache may be shared
+     * with other clients. Pass nullptr to disable it.
+     */
+    void set_download_cache(std::shared_ptr<download_cache> cache);
+
     bool pwd();
 
     bool mkdir(const std::string & directory_name);
@@ -92,7 +364,7 @@ public:
 
     void unsubscribe(event_observer *observer);
 
-    std::unique_ptr<detail::data_connection> prepare_upload(const std::string & remote_file);
+    std::unique_ptr<data_connection> prepare_upload(const std::string & remote_file);
 
     detail::reply_t send_command(const std::string & command);
 
@@ -100,24 +372,177 @@ public:
 
 	const std::string& getToken();
 private:
+    /* The line that sends an encrypted command. */
+    std::string command_line_s(const std::string & command, const std::string & args) const;
 
     detail::reply_t recv();
 
     void reset_connection();
 
-    std::unique_ptr<detail::data_connection> establish_data_connection(const std::string & command);
+    /* Secures the session right after the greeting. Does nothing without
+     * TLS.
+     */
+    bool start_tls();
+
+    void start_tls(data_connection & connection);
+
+    void negotiate_data_cipher();
+
+    /* Sets the cipher of the session, if any, on the connection of an
+     * upload or download.
+     */
+    void encrypt_transfer(data_connection & connection);
+
+    /* The early data, if any, may be sent before the command. It is cleared
+     * if it has been.
+     */
+    std::unique_ptr<data_connection> establish_data_connection(const std::string & command,
+                                                               std::string *early_data = nullptr);
+
+    std::unique_ptr<data_connection> open_passive_data_connection(bool fast_open = false);
+
+    /* Starts connecting to the port of an 'EPSV' reply. */
+    std::unique_ptr<data_connection> passive_data_connection(const detail::reply_t & reply, bool fast_open);
+
+    std::unique_ptr<data_connection> take_prefetched();
+
+    /* Asks for the connections missing, without reading the replies. */
+    void refill_prefetched();
+
+    /* Reads the replies to the refill, if any are due. */
+    void collect_prefetched();
+
+    void drop_prefetched();
+
+    std::unique_ptr<data_connection> establish_active_data_connection(const std::string & command);
+
+    bool advertise_listener(const boost::asio::ip::tcp::endpoint & endpoint);
 
     static bool try_parse_server_port(const std::string & epsv_reply, uint16_t & port);
 
+    bool use_stat_listing(const std::string & path, listing_mode mode) const;
+
+    void remember_listing_size(const std::string & path, std::size_t entries);
+
+    std::string cache_key(const std::string & path);
+
+    void invalidate_cached(const std::string & path);
+
+    /* The path resolved against the working directory, if that is known or
+     * the server reports it.
+     */
+    std::optional<std::string> absolute_path(const std::string & path);
+
+    void new_cache_scope();
+
+    struct content_hash
+    {
+        std::uintmax_t size;
+        std::filesystem::file_time_type modified;
+        std::string md5;
+        std::list<std::string>::iterator lru;
+    };
+
+    /* Of the file as it is now, hashed again only if it has changed. */
+    content_hash hash_content(const std::string & local_file);
+
+    void remember_content_hash(const std::string & local_file, content_hash hash);
+
+    /* What the file is cached by, if it can be. */
+    std::optional<std::string> download_cache_key(const std::string & remote_file);
+
+    /* Sends the commands at once, then reads a reply to each. */
+    std::vector<detail::reply_t> send_pipelined(const std::vector<std::string> & commands);
+
+    /* What the server reports for a file: the CRC-32C in reply to 'HASH',
+     * or the IEEE CRC-32 in reply to 'XCRC'.
+     */
+    struct server_checksums
+    {
+        std::optional<std::uint32_t> crc32c;
+        std::optional<std::uint32_t> crc32;
+    };
+
+    /* Has the data connection compute what the server may be asked for. */
+    void set_checksums(data_connection & connection) const;
+
+    /* What the server reports for the file, if the transfer was checked
+     * and the server can tell.
+     */
+    server_checksums server_checksum(const data_connection & connection, const std::string & remote_file);
+
+    /* Fails the transfer if a checksum of the server differs. */
+    void report_transfer(data_connection & connection,
+                         const std::string & command,
+                         const detail::reply_t & reply,
+                         const server_checksums & checksums = server_checksums());
+
     void report_reply(const std::string & reply);
 
     void report_reply(const detail::reply_t & reply);
 
-    detail::control_connection control_connection_;
+    control_connection control_connection_;
+    transfer_mode transfer_mode_;
+    socket_profile socket_profile_;
+    std::shared_ptr<source_address_pool> source_address_pool_;
+    std::unique_ptr<detail::data_listener> data_listener_;
+    bool eprt_supported_;
+
+    struct prefetched_t
+    {
+        std::unique_ptr<data_connection> connection;
+        std::chrono::steady_clock::time_point negotiated;
+    };
+
+    std::size_t prefetch_depth_;
+    std::deque<prefetched_t> prefetched_;
+    /* Sent for the refill, their replies haven't been read yet. */
+    std::size_t prefetch_requests_;
+    bool overlap_data_connect_;
+    bool fast_open_;
+    fast_open_stats fast_open_stats_;
+    std::shared_ptr<boost::asio::ssl::context> tls_context_;
+    tls_stats tls_stats_;
+    bool kernel_tls_;
+    std::vector<std::string> data_ciphers_;
+    std::optional<std::string> data_cipher_;
+    std::uint32_t data_cipher_nonce_;
+    std::uint32_t data_cipher_transfers_;
+    bool verify_transfers_;
+    bool content_md5_;
+    bool content_rc4_;
+    dedup_stats dedup_stats_;
+
+    /* By path, of the files recently hashed for upload_objects. */
+    std::unordered_map<std::string, content_hash> content_hashes_;
+    /* Most recently used paths are at the front. */
+    std::list<std::string> content_lru_;
+    std::shared_ptr<upload_manifest> upload_manifest_;
+    std::shared_ptr<download_cache> download_cache_;
+    bool xcrc_supported_;
+    bool hash_supported_;
+    bool hash_selected_;
     std::list<event_observer *> observers_;
+    std::optional<transfer_result> last_transfer_;
 
 	std::string token_;
+
+    bool stat_listing_supported_;
+    std::size_t stat_listing_threshold_;
+    std::unordered_map<std::string, std::size_t> listing_sizes_;
+
+    std::shared_ptr<metadata_cache> metadata_cache_;
+    /* Identifies the server and working directory that relative paths are
+     * resolved against, for servers that don't report it. Changes on every
+     * 'open' and successful 'cd'.
+     */
+    std::uint64_t cache_scope_;
+    std::string username_;
+    /* As the server last reported it; unknown after a 'cd'. */
+    std::optional<std::string> working_directory_;
 };
 
+using client = basic_client<tcp_transport>;
+
 } // namespace ftp
 #endif //FTP_CLIENT_HPP
@@ -0,0 +1,230 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "data_cipher.hpp"
+#include "ftp_exception.hpp"
+#include "utils/RC4.h"
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <mutex>
+#include <unordered_map>
+
+namespace ftp
+{
+
+using std::string;
+using std::unique_ptr;
+
+/* A 256-bit key per session, never the token itself. */
+static std::array<unsigned char, 32> derive_key(const string & token)
+{
+    static const string label = "ftp data cipher ";
+    string input = label + token;
+    std::array<unsigned char, 32> key;
+
+    SHA256(reinterpret_cast<const unsigned char *>(input.data()), input.size(), key.data());
+
+    return key;
+}
+
+static void put_uint32(unsigned char *out, std::uint32_t value)
+{
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+}
+
+/* A stream cipher of OpenSSL's EVP interface, which picks the fastest
+ * implementation for the CPU.
+ */
+class evp_data_cipher : public data_cipher
+{
+public:
+    evp_data_cipher(const EVP_CIPHER *cipher, const data_cipher_params & params, std::size_t nonce_offset)
+        : context_(EVP_CIPHER_CTX_new())
+    {
+        std::array<unsigned char, 32> key = derive_key(params.token);
+        std::array<unsigned char, 16> iv = {};
+
+        put_uint32(iv.data() + nonce_offset, params.nonce);
+        put_uint32(iv.data() + nonce_offset + 4, params.transfer);
+
+        if (!context_ || EVP_EncryptInit_ex(context_, cipher, nullptr, key.data(), iv.data()) != 1)
+        {
+            EVP_CIPHER_CTX_free(context_);
+            throw ftp_exception("Cannot initialize data cipher.");
+        }
+    }
+
+    evp_data_cipher(const evp_data_cipher &) = delete;
+
+    evp_data_cipher & operator=(const evp_data_cipher &) = delete;
+
+    ~evp_data_cipher() override
+    {
+        EVP_CIPHER_CTX_free(context_);
+    }
+
+    void apply(char *data, std::size_t size) override
+    {
+        auto *bytes = reinterpret_cast<unsigned char *>(data);
+
+        while (size > 0)
+        {
+            int chunk = static_cast<int>(std::min<std::size_t>(size, INT_MAX / 2));
+            int len = 0;
+
+            EVP_EncryptUpdate(context_, bytes, &len, bytes, chunk);
+
+            bytes += chunk;
+            size -= chunk;
+        }
+    }
+
+private:
+    EVP_CIPHER_CTX *context_;
+};
+
+/* RC4 the way the server stores contents with RC4EncryptContent: keyed by
+ * the token itself and started afresh every 512 bytes. So the keystream
+ * repeats every section and is computed once; applying it is a plain XOR
+ * at any chunk size. Nonce and transfer don't matter here.
+ */
+class rc4_data_cipher : public data_cipher
+{
+public:
+    explicit rc4_data_cipher(const data_cipher_params & params)
+        : position_(0)
+    {
+        keystream_.fill(0);
+
+        /* Without a key RC4EncryptContent leaves the contents as they are. */
+        if (!params.token.empty())
+        {
+            string key = params.token;
+
+            RC4_Section(keystream_.data(), section_size, reinterpret_cast<unsigned char *>(&key[0]), key.size());
+        }
+    }
+
+    void apply(char *data, std::size_t size) override
+    {
+        while (size > 0)
+        {
+            std::size_t chunk = std::min(size, section_size - position_);
+            const unsigned char *key = keystream_.data() + position_;
+
+            for (std::size_t i = 0; i < chunk; i++)
+            {
+                data[i] ^= key[i];
+            }
+
+            position_ = (position_ + chunk) % section_size;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+private:
+    static const std::size_t section_size = 512;
+
+    std::array<unsigned char, section_size> keystream_;
+    std::size_t position_;
+};
+
+struct data_cipher_registry
+{
+    std::mutex mutex;
+    std::unordered_map<string, data_cipher_factory> factories;
+};
+
+static data_cipher_registry & registry()
+{
+    static data_cipher_registry registry
+    {
+        {},
+        {
+            /* The counter block is the nonce, the transfer and a 64-bit
+             * block counter.
+             */
+            { "AES-256-CTR", [](const data_cipher_params & params) -> unique_ptr<data_cipher>
+            {
+                return std::make_unique<evp_data_cipher>(EVP_aes_256_ctr(), params, 0);
+            }},
+            /* OpenSSL takes a 32-bit block counter, then the 96-bit nonce. */
+            { "CHACHA20", [](const data_cipher_params & params) -> unique_ptr<data_cipher>
+            {
+                return std::make_unique<evp_data_cipher>(EVP_chacha20(), params, 4);
+            }},
+            { "RC4", [](const data_cipher_params & params) -> unique_ptr<data_cipher>
+            {
+                return std::make_unique<rc4_data_cipher>(params);
+            }}
+        }
+    };
+
+    return registry;
+}
+
+void register_data_cipher(const string & name, data_cipher_factory factory)
+{
+    data_cipher_registry & ciphers = registry();
+    std::lock_guard<std::mutex> lock(ciphers.mutex);
+
+    ciphers.factories[name] = std::move(factory);
+}
+
+bool is_data_cipher(const string & name)
+{
+    data_cipher_registry & ciphers = registry();
+    std::lock_guard<std::mutex> lock(ciphers.mutex);
+
+    return ciphers.factories.count(name) != 0;
+}
+
+unique_ptr<data_cipher> make_data_cipher(const string & name, const data_cipher_params & params)
+{
+    data_cipher_factory factory;
+
+    {
+        data_cipher_registry & ciphers = registry();
+        std::lock_guard<std::mutex> lock(ciphers.mutex);
+        auto it = ciphers.factories.find(name);
+
+        if (it == ciphers.factories.end())
+        {
+            return nullptr;
+        }
+
+        factory = it->second;
+    }
+
+    return factory(params);
+}
+
+} // namespace ftp
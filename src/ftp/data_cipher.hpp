@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_DATA_CIPHER_HPP
+#define FTP_DATA_CIPHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace ftp
+{
+
+/* Encrypts the contents of a transfer as it passes through the data
+ * connection, for servers that store them encrypted. Only stream ciphers
+ * fit: encrypting and decrypting are the same operation and don't change
+ * the size, so chunks are processed in place as they come.
+ */
+class data_cipher
+{
+public:
+    /* Applies the keystream in place, continuing where the last call
+     * stopped.
+     */
+    virtual void apply(char *data, std::size_t size) = 0;
+
+    virtual ~data_cipher() = default;
+};
+
+/* What the cipher of a transfer is made from. Client and server know all
+ * of it, so no keys are sent.
+ */
+struct data_cipher_params
+{
+    /* The secret the server handed out at login. */
+    std::string token;
+    /* Chosen by the client when the cipher was negotiated. */
+    std::uint32_t nonce;
+    /* Counts the transfers of the session that used the cipher, from
+     * zero, so no two of them share a keystream.
+     */
+    std::uint32_t transfer;
+};
+
+using data_cipher_factory = std::function<std::unique_ptr<data_cipher>(const data_cipher_params &)>;
+
+/* Makes a cipher known under the name it is negotiated with. Built in are
+ * 'AES-256-CTR' and 'CHACHA20' (OpenSSL, with AES-NI or AVX2 where the
+ * CPU has them), and 'RC4', which matches contents the server encrypted
+ * with RC4EncryptContent and the token. RC4 is never negotiated, clients
+ * turn it on with set_content_rc4. Registering a name again replaces the
+ * cipher.
+ */
+void register_data_cipher(const std::string & name, data_cipher_factory factory);
+
+bool is_data_cipher(const std::string & name);
+
+/* Null if no cipher has the name. */
+std::unique_ptr<data_cipher> make_data_cipher(const std::string & name, const data_cipher_params & params);
+
+} // namespace ftp
+#endif //FTP_DATA_CIPHER_HPP
@@ -62,5 +62,18 @@ private:
     std::string message_;
 };
 
+/* An operation didn't complete before its deadline. The connection is closed,
+ * the operation may be retried on a new one.
+ */
+class timeout_exception : public connection_exception
+{
+public:
+    template<typename ...Args>
+    explicit timeout_exception(const std::string & fmt, Args && ...args)
+        : connection_exception(fmt, std::forward<Args>(args)...)
+    {
+    }
+};
+
 } // namespace ftp::detail
 #endif //FTP_CONNECTION_EXCEPTION_HPP
@@ -24,17 +24,45 @@
 
 #include "control_connection.hpp"
 #include "connection_exception.hpp"
+#include "deadline.hpp"
+#include "socket_tuning.hpp"
+#include "../memory_transport.hpp"
 #include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/read_until.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/lexical_cast/try_lexical_convert.hpp>
 #include <iostream>
+#include <functional>
+
 namespace ftp::detail
 {
 
 using std::uint16_t;
 using std::string;
+using std::vector;
+using std::optional;
+using std::unique_ptr;
+using std::make_unique;
 using std::to_string;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using boost::asio::ip::tcp;
+
+/* Deadlines derived from the retransmission timeout are kept within these
+ * bounds. The lower bounds leave room for the server to do some work, e.g.
+ * to flush a stored file before replying.
+ */
+static const milliseconds min_connect_timeout = seconds(3);
+static const milliseconds min_reply_timeout = seconds(10);
+static const milliseconds min_data_inactivity_timeout = seconds(10);
+static const milliseconds max_timeout = seconds(120);
+
+/* RFC 8305 section 8 recommends 250 ms between connection attempts. */
+static const milliseconds connection_attempt_delay = milliseconds(250);
 
 static bool try_parse_status_code(const string & line, uint16_t & status_code)
 {
@@ -46,65 +74,263 @@ static bool try_parse_status_code(const string & line, uint16_t & status_code)
     return boost::conversion::try_lexical_convert(line.substr(0, 3), status_code);
 }
 
-control_connection::control_connection()
-    : io_context_(),
-      socket_(io_context_)
+/* Happy Eyeballs (RFC 8305). The attempts are started one after another,
+ * the next one when the previous fails or hasn't succeeded within the
+ * connection attempt delay. The first attempt to succeed wins, the others
+ * are abandoned. A server which has both IPv6 and IPv4 addresses is reached
+ * as fast as its fastest address allows.
+ */
+static tcp::socket race_connect(boost::asio::io_context & io_context,
+                                const vector<tcp::endpoint> & endpoints,
+                                const socket_options & options,
+                                milliseconds timeout,
+                                timer_service *timers,
+                                steady_clock::time_point & started)
 {
-}
+    struct attempt_t
+    {
+        tcp::socket socket;
+        steady_clock::time_point started;
+    };
+
+    vector<tcp::endpoint> candidates = interleave_families(endpoints);
+    vector<unique_ptr<attempt_t>> attempts;
+    boost::asio::steady_timer delay_timer(io_context);
+    boost::asio::steady_timer deadline(io_context);
+    optional<size_t> winner;
+    boost::system::error_code last_error = boost::asio::error::host_not_found;
+    size_t pending = 0;
+    bool finished = false;
+    bool expired = false;
+
+    auto finish = [&]()
+    {
+        finished = true;
+        delay_timer.cancel();
+        deadline.cancel();
 
-void control_connection::open(const string & hostname, uint16_t port)
-{
-    boost::system::error_code ec;
+        for (size_t i = 0; i < attempts.size(); ++i)
+        {
+            if (!winner || *winner != i)
+            {
+                boost::system::error_code ignored;
+                attempts[i]->socket.close(ignored);
+            }
+        }
+    };
 
-    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::from_string(hostname), port);
-    socket_.connect(endpoint, ec);
-    if (ec)
+    std::function<void()> start_next = [&]()
     {
-        boost::system::error_code ignored;
-        std::cerr << ec.message() << std::endl;
-        /* If the connect fails, and the socket was automatically opened,
-         * the socket is not returned to the closed state.
-         *
-         * https://www.boost.org/doc/libs/1_70_0/doc/html/boost_asio/reference/basic_stream_socket/connect/overload2.html
+        if (finished)
+        {
+            return;
+        }
+
+        if (attempts.size() == candidates.size())
+        {
+            if (pending == 0)
+            {
+                /* Every address has failed. */
+                finish();
+            }
+
+            return;
+        }
+
+        size_t index = attempts.size();
+        attempts.push_back(make_unique<attempt_t>(attempt_t{ tcp::socket(io_context), steady_clock::now() }));
+        ++pending;
+
+        boost::system::error_code ec;
+        attempts[index]->socket.open(candidates[index].protocol(), ec);
+
+        /* If the socket cannot be opened, the connect reports why. */
+        if (!ec)
+        {
+            apply_socket_options(attempts[index]->socket, options);
+        }
+
+        attempts[index]->socket.async_connect(candidates[index],
+            [&, index](const boost::system::error_code & error)
+        {
+            --pending;
+
+            if (finished)
+            {
+                return;
+            }
+
+            if (!error)
+            {
+                winner = index;
+                finish();
+                return;
+            }
+
+            /* Don't wait for the delay to expire, the next address may be
+             * reachable.
+             */
+            last_error = error;
+            start_next();
+        });
+
+        if (attempts.size() < candidates.size())
+        {
+            delay_timer.expires_after(connection_attempt_delay);
+            delay_timer.async_wait([&](const boost::system::error_code & error)
+            {
+                if (!error)
+                {
+                    start_next();
+                }
+            });
+        }
+    };
+
+    auto expire = [&]()
+    {
+        if (!finished)
+        {
+            expired = true;
+            finish();
+        }
+    };
+
+    optional<timer_service::timer_id> timer;
+
+    io_context.restart();
+
+    if (timers)
+    {
+        /* The callback runs on the thread of the service, let the
+         * io_context run the expiration.
          */
-        socket_.close(ignored);
+        timer = timers->schedule(timeout, [&io_context, &expire]()
+        {
+            boost::asio::post(io_context, expire);
+        });
+    }
+    else
+    {
+        deadline.expires_after(timeout);
+        deadline.async_wait([&](const boost::system::error_code & error)
+        {
+            if (!error)
+            {
+                expire();
+            }
+        });
+    }
+
+    start_next();
+    io_context.run();
 
-        throw connection_exception(ec, "Cannot open connection");
+    if (timer)
+    {
+        timers->cancel(*timer);
+
+        /* Run the expiration if it has been posted in the meantime. */
+        io_context.restart();
+        io_context.poll();
     }
+
+    if (!winner)
+    {
+        if (expired)
+        {
+            throw timeout_exception("Cannot open connection: no response in %1% ms", timeout.count());
+        }
+
+        throw connection_exception(last_error, "Cannot open connection");
+    }
+
+    started = attempts[*winner]->started;
+
+    return std::move(attempts[*winner]->socket);
 }
 
-void control_connection::open_v6(const std::string & hostname, uint16_t port)
+template<typename Transport>
+basic_control_connection<Transport>::basic_control_connection()
+    : io_context_(),
+      socket_(io_context_),
+      port_(0)
 {
-    boost::system::error_code ec;
-    //TODO: ipv6 address support
-    //"fe80::1205:14e1:f17a:8b8a%ens33"
-    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::from_string(hostname), port);
-    socket_.connect(endpoint, ec);
-    if (ec)
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::open(const string & hostname, uint16_t port)
+{
+    connect(hostname, port, address_family::any);
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::open_v6(const string & hostname, uint16_t port)
+{
+    connect(hostname, port, address_family::v6);
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::connect(const string & hostname, uint16_t port, address_family family)
+{
+    /* A new session, possibly to another server. */
+    rtt_.reset();
+    command_sent_.reset();
+    buffer_.clear();
+    host_ = hostname;
+    port_ = port;
+
+    /* Drops the previous connection, if any, along with its TLS state. */
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+
+    if constexpr (Transport::is_tcp)
     {
-        boost::system::error_code ignored;
-        std::cerr << ec.message() << std::endl;
-        /* If the connect fails, and the socket was automatically opened,
-         * the socket is not returned to the closed state.
-         *
-         * https://www.boost.org/doc/libs/1_70_0/doc/html/boost_asio/reference/basic_stream_socket/connect/overload2.html
-         */
-        socket_.close(ignored);
+        steady_clock::time_point started;
+
+        Transport::tcp_layer(socket_) = race_connect(io_context_,
+                               resolver::shared().resolve(hostname, port, family),
+                               options_,
+                               connect_timeout(),
+                               timers_.get(),
+                               started);
 
-        throw connection_exception(ec, "Cannot open connection");
+        /* The three-way handshake takes one round trip. */
+        rtt_.sample(duration_cast<rtt_estimator::duration>(steady_clock::now() - started));
+    }
+    else
+    {
+        boost::system::error_code ec;
+
+        Transport::connect(socket_, hostname, port, ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot open connection");
+        }
     }
 }
 
-bool control_connection::is_open() const
+template<typename Transport>
+bool basic_control_connection<Transport>::is_open() const
 {
     return socket_.is_open();
 }
 
-void control_connection::close()
+template<typename Transport>
+bool basic_control_connection<Transport>::is_alive()
+{
+    /* Either the server has closed the connection or there is an
+     * unsolicited reply waiting.
+     */
+    return buffer_.empty() && Transport::is_alive(socket_);
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::close()
 {
     boost::system::error_code ec;
 
-    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    socket_.shutdown(boost::asio::socket_base::shutdown_both, ec);
 
     if (ec == boost::asio::error::not_connected)
     {
@@ -126,38 +352,139 @@ void control_connection::close()
     }
 }
 
-string control_connection::ip() const
+template<typename Transport>
+string basic_control_connection<Transport>::ip() const
 {
-    boost::system::error_code ec;
+    if constexpr (Transport::is_tcp)
+    {
+        boost::system::error_code ec;
 
-    boost::asio::ip::tcp::endpoint remote_endpoint = socket_.remote_endpoint(ec);
+        boost::asio::ip::tcp::endpoint remote_endpoint = Transport::tcp_layer(socket_).remote_endpoint(ec);
 
-    if (ec)
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot get ip address");
+        }
+
+        string ip = remote_endpoint.address().to_string(ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot get ip address");
+        }
+
+        return ip;
+    }
+    else
     {
-        throw connection_exception(ec, "Cannot get ip address");
+        return host_;
     }
+}
 
-    string ip = remote_endpoint.address().to_string(ec);
+template<typename Transport>
+const string & basic_control_connection<Transport>::host() const
+{
+    return host_;
+}
 
-    if (ec)
+template<typename Transport>
+uint16_t basic_control_connection<Transport>::port() const
+{
+    return port_;
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::start_tls(boost::asio::ssl::context & context)
+{
+    if constexpr (Transport::is_tls)
+    {
+        /* Replies to commands sent in plain text must not be read as TLS. */
+        if (!buffer_.empty())
+        {
+            throw connection_exception("Cannot start TLS: unexpected data from the server");
+        }
+
+        Transport::start_tls(socket_, context, host_, nullptr);
+
+        boost::system::error_code ec;
+
+        socket_.stream().async_handshake(boost::asio::ssl::stream_base::client,
+                                         [&ec](const boost::system::error_code & error)
+        {
+            ec = error;
+        });
+
+        if (!run_with_deadline(io_context_, socket_, connect_timeout(), timers_.get()))
+        {
+            throw timeout_exception("Cannot start TLS: no response in %1% ms", connect_timeout().count());
+        }
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot start TLS");
+        }
+    }
+    else
     {
-        throw connection_exception(ec, "Cannot get ip address");
+        throw connection_exception("Cannot start TLS: the transport has no TLS");
+    }
+}
+
+template<typename Transport>
+std::shared_ptr<SSL_SESSION> basic_control_connection<Transport>::tls_session()
+{
+    if constexpr (Transport::is_tls)
+    {
+        if (socket_.is_secure())
+        {
+            /* Taken anew each time: with TLS 1.3 the resumable session comes
+             * in a ticket after the handshake.
+             */
+            return std::shared_ptr<SSL_SESSION>(SSL_get1_session(socket_.stream().native_handle()),
+                                                SSL_SESSION_free);
+        }
     }
 
-    return ip;
+    return nullptr;
+}
+
+template<typename Transport>
+tcp::endpoint basic_control_connection<Transport>::local_endpoint() const
+{
+    if constexpr (Transport::is_tcp)
+    {
+        boost::system::error_code ec;
+
+        tcp::endpoint endpoint = Transport::tcp_layer(socket_).local_endpoint(ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot get local address");
+        }
+
+        return endpoint;
+    }
+    else
+    {
+        throw connection_exception("Cannot get local address: the transport has no IP addresses");
+    }
 }
 
-reply_t control_connection::recv()
+template<typename Transport>
+reply_t basic_control_connection<Transport>::recv()
 {
-    uint16_t status_code;
+    uint16_t status_code = 0;
     string status_line;
 
     status_line = read_line();
 
-    // if (!try_parse_status_code(status_line, status_code))
-    // {
-    //     throw connection_exception("Invalid server reply: %1%", status_line);
-    // }
+    /* Encrypted replies don't start with a status code, so the code is
+     * left as zero for them instead of rejecting the reply.
+     */
+    if (!try_parse_status_code(status_line, status_code))
+    {
+        status_code = 0;
+    }
 
     /* Thus the format for multi-line replies is that the first line
      * will begin with the exact required reply code, followed
@@ -172,6 +499,11 @@ reply_t control_connection::recv()
         {
             string line = read_line();
 
+            if (line.empty())
+            {
+                throw connection_exception("Connection closed in the middle of a reply");
+            }
+
             status_line += line;
 
             if (is_last_line(line, status_code))
@@ -206,7 +538,8 @@ reply_t control_connection::recv()
  *
  * RFC 959: https://tools.ietf.org/html/rfc959
  */
-bool control_connection::is_last_line(const string & line, uint16_t status_code)
+template<typename Transport>
+bool basic_control_connection<Transport>::is_last_line(const string & line, uint16_t status_code)
 {
     if (line.size() < 4)
     {
@@ -227,23 +560,115 @@ bool control_connection::is_last_line(const string & line, uint16_t status_code)
     return code == status_code;
 }
 
-void control_connection::send(const string & command)
+template<typename Transport>
+void basic_control_connection<Transport>::send(const string & command, bool timed)
 {
     boost::system::error_code ec;
+    string line = command + "\r\n";
+    milliseconds timeout = reply_timeout();
+
+    boost::asio::async_write(socket_, boost::asio::buffer(line),
+                             [&ec](const boost::system::error_code & error, size_t)
+    {
+        ec = error;
+    });
 
-    boost::asio::write(socket_, boost::asio::buffer(command + "\r\n"), ec);
+    if (!run_with_deadline(io_context_, socket_, timeout, timers_.get()))
+    {
+        throw timeout_exception("Cannot send command: no progress in %1% ms", timeout.count());
+    }
 
     if (ec)
     {
         throw connection_exception(ec, "Cannot send command");
     }
+
+    if (timed)
+    {
+        command_sent_ = steady_clock::now();
+    }
+    else
+    {
+        command_sent_.reset();
+    }
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::set_timeouts(const timeouts & timeouts)
+{
+    timeouts_ = timeouts;
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::set_socket_options(const socket_options & options)
+{
+    options_ = options;
+}
+
+template<typename Transport>
+milliseconds basic_control_connection<Transport>::connect_timeout() const
+{
+    return timeouts_.connect.value_or(rtt_.deadline(3, min_connect_timeout, max_timeout));
+}
+
+template<typename Transport>
+milliseconds basic_control_connection<Transport>::reply_timeout() const
+{
+    return timeouts_.reply.value_or(rtt_.deadline(4, min_reply_timeout, max_timeout));
+}
+
+template<typename Transport>
+milliseconds basic_control_connection<Transport>::data_inactivity_timeout() const
+{
+    return timeouts_.data_inactivity.value_or(rtt_.deadline(4, min_data_inactivity_timeout, max_timeout));
+}
+
+template<typename Transport>
+const rtt_estimator & basic_control_connection<Transport>::rtt() const
+{
+    return rtt_;
+}
+
+template<typename Transport>
+void basic_control_connection<Transport>::set_timer_service(std::shared_ptr<timer_service> timers)
+{
+    timers_ = std::move(timers);
 }
 
-string control_connection::read_line()
+template<typename Transport>
+const std::shared_ptr<timer_service> & basic_control_connection<Transport>::get_timer_service() const
+{
+    return timers_;
+}
+
+template<typename Transport>
+string basic_control_connection<Transport>::read_line()
 {
     boost::system::error_code ec;
+    size_t len = 0;
+    milliseconds timeout = reply_timeout();
+
+    boost::asio::async_read_until(socket_, boost::asio::dynamic_buffer(buffer_), '\n',
+                                  [&ec, &len](const boost::system::error_code & error, size_t length)
+    {
+        ec = error;
+        len = length;
+    });
+
+    if (!run_with_deadline(io_context_, socket_, timeout, timers_.get()))
+    {
+        throw timeout_exception("Cannot receive reply: no response in %1% ms", timeout.count());
+    }
 
-    size_t len = boost::asio::read_until(socket_, boost::asio::dynamic_buffer(buffer_), '\n', ec);
+    /* The first line of the reply to a command completes a round trip. It
+     * includes the time the server spent on the command, which keeps the
+     * derived deadlines on the safe side.
+     */
+    if (command_sent_ && !ec)
+    {
+        rtt_.sample(duration_cast<rtt_estimator::duration>(steady_clock::now() - command_sent_.value()));
+        command_sent_.reset();
+    }
 
     if (ec == boost::asio::error::eof)
     {
@@ -260,4 +685,9 @@ string control_connection::read_line()
     return line;
 }
 
+template class basic_control_connection<tcp_transport>;
+template class basic_control_connection<unix_transport>;
+template class basic_control_connection<memory_transport>;
+template class basic_control_connection<tls_transport>;
+
 } // namespace ftp::detail
@@ -26,43 +26,124 @@
 #define FTP_CONTROL_CONNECTION_HPP
 
 #include "reply.hpp"
+#include "resolver.hpp"
+#include "rtt_estimator.hpp"
+#include "../socket_profile.hpp"
+#include "../timeouts.hpp"
+#include "../timer_service.hpp"
+#include "../tls_transport.hpp"
+#include "../transport.hpp"
 #include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
 
 namespace ftp::detail
 {
 
-class control_connection
+template<typename Transport>
+class basic_control_connection
 {
 public:
-    control_connection();
+    basic_control_connection();
 
-    control_connection(const control_connection &) = delete;
+    basic_control_connection(const basic_control_connection &) = delete;
 
-    control_connection & operator=(const control_connection &) = delete;
+    basic_control_connection & operator=(const basic_control_connection &) = delete;
 
+    /* Over TCP the host may be a name or an address literal. Names resolving
+     * to several addresses are raced as RFC 8305 describes.
+     */
     void open(const std::string & hostname, uint16_t port);
 
+    /* The same, but only IPv6 addresses of a name are tried. Link-local
+     * literals take a scope id, e.g. 'fe80::1%eth0'.
+     */
     void open_v6(const std::string & hostname, uint16_t port);
 
     bool is_open() const;
 
+    /* Checks without a round trip that the server hasn't closed the
+     * connection or sent anything we didn't ask for, e.g. a 421 reply.
+     */
+    bool is_alive();
+
     void close();
 
+    /* The address of the server, or its host for transports without IP
+     * addresses.
+     */
     std::string ip() const;
 
-    void send(const std::string & command);
+    /* The host the connection was opened to, a name or an address. */
+    const std::string & host() const;
+
+    /* The port the connection was opened to. */
+    uint16_t port() const;
+
+    /* Secures the connection with a TLS handshake, once the server has
+     * accepted 'AUTH TLS'. TLS transports only.
+     */
+    void start_tls(boost::asio::ssl::context & context);
+
+    /* The TLS session for data connections to resume. Null before TLS has
+     * started.
+     */
+    std::shared_ptr<SSL_SESSION> tls_session();
+
+    /* Only TCP connections have one. */
+    boost::asio::ip::tcp::endpoint local_endpoint() const;
+
+    /* The reply to an untimed command is left out of the round trip
+     * estimate. Commands whose replies are read later, pipelined ones and
+     * prefetches, would otherwise count the time in between.
+     */
+    void send(const std::string & command, bool timed = true);
 
     reply_t recv();
 
+    void set_timeouts(const timeouts & timeouts);
+
+    /* Applied when the connection is opened. */
+    void set_socket_options(const socket_options & options);
+
+    std::chrono::milliseconds connect_timeout() const;
+
+    std::chrono::milliseconds reply_timeout() const;
+
+    std::chrono::milliseconds data_inactivity_timeout() const;
+
+    const rtt_estimator & rtt() const;
+
+    /* Deadlines are timers of the shared service instead of the connection's
+     * own io_context. Pass nullptr to switch back.
+     */
+    void set_timer_service(std::shared_ptr<timer_service> timers);
+
+    const std::shared_ptr<timer_service> & get_timer_service() const;
+
 private:
+    void connect(const std::string & hostname, uint16_t port, address_family family);
+
     std::string read_line();
 
     static bool is_last_line(const std::string & line, uint16_t status_code);
 
     std::string buffer_;
     boost::asio::io_context io_context_;
-    boost::asio::ip::tcp::socket socket_;
+    typename Transport::socket socket_;
+    std::string host_;
+    uint16_t port_;
+    timeouts timeouts_;
+    socket_options options_;
+    rtt_estimator rtt_;
+    std::shared_ptr<timer_service> timers_;
+    /* When the last command was sent, if its reply hasn't arrived yet. */
+    std::optional<std::chrono::steady_clock::time_point> command_sent_;
 };
 
+using control_connection = basic_control_connection<tcp_transport>;
+
 } // namespace ftp::detail
 #endif //FTP_CONTROL_CONNECTION_HPP
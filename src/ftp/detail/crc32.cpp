@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "crc32.hpp"
+#include <array>
+
+namespace ftp::detail
+{
+
+/* The reflected IEEE 802.3 polynomial. */
+static const std::uint32_t polynomial = 0xedb88320;
+
+using tables_t = std::array<std::array<std::uint32_t, 256>, 8>;
+
+/* tables[k][b] is the CRC of byte b followed by k zero bytes. */
+static tables_t make_tables()
+{
+    tables_t tables;
+
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        std::uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+        }
+
+        tables[0][i] = crc;
+    }
+
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        for (std::size_t k = 1; k < tables.size(); k++)
+        {
+            tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+        }
+    }
+
+    return tables;
+}
+
+crc32::crc32()
+    : state_(0xffffffff)
+{
+}
+
+void crc32::update(const char *data, std::size_t size)
+{
+    static const tables_t tables = make_tables();
+
+    auto *bytes = reinterpret_cast<const unsigned char *>(data);
+    std::uint32_t crc = state_;
+
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        std::uint32_t low = crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+                                   static_cast<std::uint32_t>(bytes[3]) << 24);
+
+        crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^
+              tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24] ^
+              tables[3][bytes[4]] ^ tables[2][bytes[5]] ^
+              tables[1][bytes[6]] ^ tables[0][bytes[7]];
+    }
+
+    for (; size > 0; bytes++, size--)
+    {
+        crc = tables[0][(crc ^ *bytes) & 0xff] ^ (crc >> 8);
+    }
+
+    state_ = crc;
+}
+
+std::uint32_t crc32::value() const
+{
+    return ~state_;
+}
+
+} // namespace ftp::detail
@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "crc32c.hpp"
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace ftp::detail
+{
+
+/* The reflected Castagnoli polynomial. */
+static const std::uint32_t polynomial = 0x82f63b78;
+
+static std::array<std::uint32_t, 256> make_table()
+{
+    std::array<std::uint32_t, 256> table;
+
+    for (std::uint32_t i = 0; i < table.size(); i++)
+    {
+        std::uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+static std::uint32_t update_table(std::uint32_t crc, const unsigned char *data, std::size_t size)
+{
+    static const std::array<std::uint32_t, 256> table = make_table();
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static std::uint32_t update_sse42(std::uint32_t crc, const unsigned char *data, std::size_t size)
+{
+    std::uint64_t crc64 = crc;
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        std::uint64_t word;
+
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = static_cast<std::uint32_t>(crc64);
+
+    for (; size > 0; data++, size--)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+
+    return crc;
+}
+#endif
+
+using update_function = std::uint32_t (*)(std::uint32_t, const unsigned char *, std::size_t);
+
+static update_function select_update()
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return update_sse42;
+    }
+#endif
+
+    return update_table;
+}
+
+crc32c::crc32c()
+    : state_(0xffffffff)
+{
+}
+
+void crc32c::update(const char *data, std::size_t size)
+{
+    static const update_function update = select_update();
+
+    state_ = update(state_, reinterpret_cast<const unsigned char *>(data), size);
+}
+
+std::uint32_t crc32c::value() const
+{
+    return ~state_;
+}
+
+} // namespace ftp::detail
@@ -0,0 +1,52 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_CRC32C_HPP
+#define FTP_CRC32C_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ftp::detail
+{
+
+/* CRC-32C (Castagnoli, as in iSCSI and SCTP) of data that comes in
+ * chunks. Uses the crc32 instruction of SSE 4.2 where the CPU has it,
+ * which keeps up with any network, and a table otherwise.
+ */
+class crc32c
+{
+public:
+    crc32c();
+
+    void update(const char *data, std::size_t size);
+
+    std::uint32_t value() const;
+
+private:
+    std::uint32_t state_;
+};
+
+} // namespace ftp::detail
+#endif //FTP_CRC32C_HPP
@@ -24,9 +24,26 @@
 
 #include "data_connection.hpp"
 #include "connection_exception.hpp"
+#include "deadline.hpp"
+#include "kernel_tls.hpp"
+#include "socket_tuning.hpp"
+#include "tcp_info.hpp"
+#include "../memory_transport.hpp"
 #include <boost/asio/read.hpp>
 #include <boost/asio/write.hpp>
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/in.h>
+#endif
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace ftp::detail
 {
@@ -34,31 +51,85 @@ namespace ftp::detail
 using std::string;
 using std::ifstream;
 using std::ofstream;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
 
-data_connection::data_connection(const string & ip, uint16_t port)
+/* Large buffers are written in chunks of this size, each with its own
+ * inactivity deadline.
+ */
+static const size_t max_write_chunk = 64 * 1024;
+
+template<typename Transport>
+basic_data_connection<Transport>::basic_data_connection(const string & ip, uint16_t port)
     : io_context_(),
       socket_(io_context_),
       ip_(ip),
-      port_(port)
+      port_(port),
+      connect_timeout_(seconds(30)),
+      inactivity_timeout_(seconds(60)),
+      connecting_(false),
+      fast_open_(false),
+      sample_interval_(seconds(1)),
+      transferring_(false),
+      sent_data_(false),
+      peer_closed_(false),
+      tls_resumed_(false),
+      kernel_tls_(false)
 {
 }
 
-void data_connection::open()
+template<typename Transport>
+basic_data_connection<Transport>::~basic_data_connection()
 {
-    boost::system::error_code ec;
+    if (socket_.is_open())
+    {
+        bool abortive = may_abort();
 
-    boost::asio::ip::address address = boost::asio::ip::address::from_string(ip_, ec);
+        if (abortive)
+        {
+            set_abortive_linger();
+        }
 
-    if (ec)
+        release_source(!abortive && is_established() && !peer_closed_);
+    }
+    else
     {
-        throw connection_exception(ec, "Cannot get ip address");
+        release_source(false);
     }
+}
 
-    boost::asio::ip::tcp::endpoint remote_endpoint(address, port_);
-    socket_.connect(remote_endpoint, ec);
+template<typename Transport>
+void basic_data_connection<Transport>::set_timeouts(milliseconds connect, milliseconds inactivity)
+{
+    connect_timeout_ = connect;
+    inactivity_timeout_ = inactivity;
+}
 
-    if (ec)
+template<typename Transport>
+void basic_data_connection<Transport>::set_timer_service(std::shared_ptr<timer_service> timers)
+{
+    timers_ = std::move(timers);
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::open()
+{
+    if (!connecting_ && !socket_.is_open())
     {
+        start_open();
+    }
+
+    if (connecting_ && !run_with_deadline(io_context_, socket_, connect_timeout_, timers_.get()))
+    {
+        throw timeout_exception("Cannot open data connection: no response in %1% ms", connect_timeout_.count());
+    }
+
+    if (connect_error_)
+    {
+        boost::system::error_code ec = connect_error_;
         boost::system::error_code ignored;
 		std::cout << ec.message() << std::endl;
         /* If the connect fails, and the socket was automatically opened,
@@ -72,16 +143,424 @@ void data_connection::open()
     }
 }
 
-bool data_connection::is_open() const
+template<typename Transport>
+void basic_data_connection<Transport>::start_open()
+{
+    if constexpr (Transport::is_tcp)
+    {
+        boost::system::error_code ec;
+
+        boost::asio::ip::address address = boost::asio::ip::address::from_string(ip_, ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot get ip address");
+        }
+
+        boost::asio::ip::tcp::endpoint remote_endpoint(address, port_);
+
+        boost::asio::ip::tcp::socket & socket = Transport::tcp_layer(socket_);
+
+        socket.open(remote_endpoint.protocol(), ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot open connection");
+        }
+
+        apply_socket_options(socket, options_);
+        bind_source(socket, remote_endpoint.protocol());
+
+        if (fast_open_)
+        {
+#ifdef TCP_FASTOPEN_CONNECT
+            int enabled = 1;
+
+            /* Older kernels don't know the option, they connect the usual way. */
+            fast_open_ = ::setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                                      &enabled, sizeof(enabled)) == 0;
+#else
+            fast_open_ = false;
+#endif
+        }
+
+        connecting_ = true;
+        connect_error_.clear();
+
+        socket.async_connect(remote_endpoint, [this](const boost::system::error_code & error)
+        {
+            connecting_ = false;
+            connect_error_ = error;
+        });
+    }
+    else
+    {
+        /* Connecting completes at once. */
+        fast_open_ = false;
+        Transport::connect_data(socket_, ip_, port_, connect_error_);
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_socket_options(const socket_options & options)
+{
+    options_ = options;
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_fast_open(bool enabled)
+{
+    fast_open_ = enabled;
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::is_fast_open() const
+{
+    return fast_open_;
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::fast_open_accepted()
+{
+#ifdef TCPI_OPT_SYN_DATA
+    if constexpr (Transport::is_tcp)
+    {
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+
+        if (!fast_open_ || ::getsockopt(Transport::tcp_layer(socket_).native_handle(),
+                                        IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+        {
+            return false;
+        }
+
+        return (info.tcpi_options & TCPI_OPT_SYN_DATA) != 0;
+    }
+#endif
+
+    return false;
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_source_pool(std::shared_ptr<source_address_pool> pool)
+{
+    source_pool_ = std::move(pool);
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::bind_source(boost::asio::ip::tcp::socket & socket,
+                                                   const boost::asio::ip::tcp & protocol)
+{
+    if (!source_pool_)
+    {
+        return;
+    }
+
+    source_index_ = source_pool_->acquire(protocol);
+
+    if (!source_index_)
+    {
+        /* No address of this family, let the system choose. */
+        return;
+    }
+
+#ifdef __linux__
+    /* Leave the choice of the port to connect, where the whole four-tuple
+     * is known and a port can be shared among servers.
+     */
+    int enabled = 1;
+    ::setsockopt(socket.native_handle(), IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enabled, sizeof(enabled));
+#endif
+
+    boost::system::error_code ec;
+
+    socket.bind(boost::asio::ip::tcp::endpoint(source_pool_->address(*source_index_), 0), ec);
+
+    if (ec)
+    {
+        release_source(false);
+        throw connection_exception(ec, "Cannot bind to source address");
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::release_source(bool time_wait)
+{
+    if (source_pool_ && source_index_)
+    {
+        source_pool_->release(*source_index_, time_wait);
+        source_index_.reset();
+    }
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::is_established() const
+{
+    return socket_.is_open() && !connecting_ && !connect_error_;
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::may_abort() const
+{
+    return Transport::is_tcp && options_.closing == close_mode::abortive_when_safe && (peer_closed_ || !sent_data_);
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_abortive_linger()
+{
+    if constexpr (Transport::is_tcp)
+    {
+        boost::system::error_code ignored;
+
+        Transport::tcp_layer(socket_).set_option(boost::asio::socket_base::linger(true, 0), ignored);
+    }
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::is_alive()
+{
+    return Transport::is_alive(socket_);
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::accept(data_listener & listener)
+{
+    if constexpr (Transport::is_tcp)
+    {
+        boost::system::error_code ec;
+
+        boost::asio::ip::address address = boost::asio::ip::address::from_string(ip_, ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot get ip address");
+        }
+
+        if (!listener.accept(Transport::tcp_layer(socket_), address, connect_timeout_, timers_.get()))
+        {
+            throw timeout_exception("Cannot accept data connection: no connection in %1% ms", connect_timeout_.count());
+        }
+
+        /* Too late for the window scale, but the other options still apply. */
+        apply_socket_options(Transport::tcp_layer(socket_), options_);
+    }
+    else
+    {
+        throw connection_exception("Cannot accept data connection: active mode needs a TCP transport");
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::start_tls(boost::asio::ssl::context & context,
+                                                 const string & host,
+                                                 SSL_SESSION *session)
+{
+    if constexpr (Transport::is_tls)
+    {
+        Transport::start_tls(socket_, context, host, session);
+
+        if (kernel_tls_)
+        {
+            socket_.prepare_kernel_tx();
+        }
+
+        boost::system::error_code ec;
+
+        socket_.stream().async_handshake(boost::asio::ssl::stream_base::client,
+                                         [&ec](const boost::system::error_code & error)
+        {
+            ec = error;
+        });
+
+        if (!run_with_deadline(io_context_, socket_, connect_timeout_, timers_.get()))
+        {
+            throw timeout_exception("Cannot start TLS on data connection: no response in %1% ms",
+                                    connect_timeout_.count());
+        }
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot start TLS on data connection");
+        }
+
+        tls_resumed_ = SSL_session_reused(socket_.stream().native_handle()) == 1;
+
+        if (kernel_tls_)
+        {
+            socket_.start_kernel_tx();
+        }
+    }
+    else
+    {
+        throw connection_exception("Cannot start TLS on data connection: the transport has no TLS");
+    }
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::tls_resumed() const
+{
+    return tls_resumed_;
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_cipher(std::unique_ptr<data_cipher> cipher)
+{
+    cipher_ = std::move(cipher);
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_checksum(bool enabled)
+{
+    if (enabled)
+    {
+        checksum_.emplace();
+    }
+    else
+    {
+        checksum_.reset();
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_crc32(bool enabled)
+{
+    if (enabled)
+    {
+        crc32_.emplace();
+    }
+    else
+    {
+        crc32_.reset();
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_md5(bool enabled)
+{
+    md5_ = enabled ? std::make_unique<md5>() : nullptr;
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_kernel_tls(bool enabled)
+{
+    kernel_tls_ = enabled;
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::is_kernel_tls() const
+{
+    if constexpr (Transport::is_tls)
+    {
+        return socket_.is_kernel_tx();
+    }
+
+    return false;
+}
+
+/* RFC 4217, section 12.2: the end of the data is marked by a close_notify
+ * alert, without it a server can't tell a complete upload from a truncated
+ * one. Waits for the server's alert, or for it to close the connection,
+ * which ends a download anyway.
+ */
+template<typename Transport>
+bool basic_data_connection<Transport>::shutdown_tls()
+{
+    if constexpr (Transport::is_tls)
+    {
+        boost::system::error_code ignored;
+
+        socket_.stream().async_shutdown([&ignored](const boost::system::error_code & error)
+        {
+            /* The server may have closed the connection right after its
+             * own alert.
+             */
+            ignored = error;
+        });
+
+        return run_with_deadline(io_context_, socket_, inactivity_timeout_, timers_.get());
+    }
+
+    return true;
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::is_open() const
 {
     return socket_.is_open();
 }
 
-void data_connection::close()
+template<typename Transport>
+void basic_data_connection<Transport>::close()
 {
     boost::system::error_code ec;
 
-    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    if (transferring_ && socket_.is_open())
+    {
+        tcp_sample sample;
+
+        if (take_sample(sample))
+        {
+            result_.final_sample = sample;
+        }
+
+        result_.duration = duration_cast<microseconds>(steady_clock::now() - transfer_started_);
+        transferring_ = false;
+    }
+
+    if (checksum_)
+    {
+        result_.crc32c = checksum_->value();
+    }
+
+    if (crc32_)
+    {
+        result_.crc32 = crc32_->value();
+    }
+
+    if (md5_ && !result_.md5)
+    {
+        result_.md5 = md5_->hex_digest();
+    }
+
+    if (socket_.is_open() && may_abort())
+    {
+        release_source(false);
+        set_abortive_linger();
+
+        socket_.close(ec);
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot close connection");
+        }
+
+        return;
+    }
+
+    if constexpr (Transport::is_tls)
+    {
+        if (socket_.is_open() && socket_.is_kernel_tx())
+        {
+            /* The record state of OpenSSL is stale, the kernel has sent the
+             * records since the handshake. So the kernel sends the alert,
+             * and the server's isn't waited for.
+             */
+            send_kernel_close_notify(Transport::tcp_layer(socket_).native_handle());
+        }
+        else if (socket_.is_open() && socket_.is_secure() && !shutdown_tls())
+        {
+            /* The server neither answered the close_notify nor closed the
+             * connection. Whether it has the data is up to its reply.
+             */
+            release_source(false);
+            return;
+        }
+    }
+
+    /* If we close first, the port stays in TIME_WAIT. */
+    release_source(is_established() && !peer_closed_);
+
+    socket_.shutdown(boost::asio::socket_base::shutdown_both, ec);
 
     if (ec == boost::asio::error::not_connected)
     {
@@ -103,52 +582,275 @@ void data_connection::close()
     }
 }
 
-void data_connection::send(ifstream & file)
+template<typename Transport>
+void basic_data_connection<Transport>::send(ifstream & file)
 {
-    boost::system::error_code ec;
-
     for (;;)
     {
+        steady_clock::time_point started = steady_clock::now();
         file.read(buffer_.data(), buffer_.size());
+        result_.file_time += duration_cast<microseconds>(steady_clock::now() - started);
 
         if (file.fail() && !file.eof())
         {
             throw connection_exception("Cannot read data from file");
         }
 
-        boost::asio::write(socket_, boost::asio::buffer(buffer_, file.gcount()), ec);
+        digest(buffer_.data(), file.gcount());
+
+        if (cipher_)
+        {
+            cipher_->apply(buffer_.data(), file.gcount());
+        }
+
+        write(buffer_.data(), file.gcount());
+
+        if (file.eof())
+        {
+            break;
+        }
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::send(const char* pszBuffer, std::size_t uBufferSize)
+{
+    digest(pszBuffer, uBufferSize);
+
+    if (!cipher_)
+    {
+        write(pszBuffer, uBufferSize);
+        return;
+    }
+
+    /* The caller's buffer stays as it is. */
+    while (uBufferSize > 0)
+    {
+        size_t chunk = std::min(uBufferSize, buffer_.size());
+
+        std::copy(pszBuffer, pszBuffer + chunk, buffer_.data());
+        cipher_->apply(buffer_.data(), chunk);
+        write(buffer_.data(), chunk);
+
+        pszBuffer += chunk;
+        uBufferSize -= chunk;
+    }
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::send_in_place(char *data, std::size_t size)
+{
+    digest(data, size);
+
+    if (cipher_)
+    {
+        cipher_->apply(data, size);
+    }
+
+    write(data, size);
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::send_file(const string & path, std::uint64_t offset)
+{
+    if constexpr (Transport::is_tcp)
+    {
+        if (cipher_)
+        {
+            /* The data must pass through user space. */
+            return false;
+        }
+
+        if constexpr (Transport::is_tls)
+        {
+            if (socket_.is_secure() && !socket_.is_kernel_tx())
+            {
+                return false;
+            }
+        }
+
+        int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (file < 0)
+        {
+            return false;
+        }
+
+        try
+        {
+            std::uint64_t end = offset;
+            bool sent = write_file(file, offset, end);
+
+            if (sent && (checksum_ || crc32_ || md5_))
+            {
+                digest_file(file, offset, end);
+            }
+
+            ::close(file);
+
+            return sent;
+        }
+        catch (...)
+        {
+            ::close(file);
+            throw;
+        }
+    }
+
+    return false;
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::write_file(int file, std::uint64_t offset, std::uint64_t & end)
+{
+    if constexpr (Transport::is_tcp)
+    {
+        struct stat info;
+
+        if (::fstat(file, &info) != 0)
+        {
+            return false;
+        }
+
+        boost::asio::ip::tcp::socket & socket = Transport::tcp_layer(socket_);
+        boost::system::error_code ec;
+        off_t position = static_cast<off_t>(offset);
+
+        /* Waits for room in the send buffer with a deadline, like other
+         * writes, instead of blocking in sendfile.
+         */
+        socket.non_blocking(true, ec);
 
         if (ec)
         {
             throw connection_exception(ec, "Cannot send data over data connection");
         }
 
-        if (file.eof())
+        while (position < info.st_size)
+        {
+            steady_clock::time_point started = begin_io();
+            ssize_t sent = ::sendfile(socket.native_handle(), file, &position, info.st_size - position);
+
+            if (sent > 0)
+            {
+                end_io(started, sent);
+                sent_data_ = true;
+                continue;
+            }
+            else if (sent == 0)
+            {
+                /* The file has become shorter. */
+                break;
+            }
+
+            int error = errno;
+
+            if (error == EINTR)
+            {
+                continue;
+            }
+            else if (error == EAGAIN)
+            {
+                socket.async_wait(boost::asio::socket_base::wait_write,
+                                  [&ec](const boost::system::error_code & error)
+                {
+                    ec = error;
+                });
+
+                if (!run_with_deadline(io_context_, socket_, inactivity_timeout_, timers_.get()))
+                {
+                    throw timeout_exception("Cannot send data over data connection: no progress in %1% ms",
+                                            inactivity_timeout_.count());
+                }
+
+                end_io(started, 0);
+
+                if (ec)
+                {
+                    throw connection_exception(ec, "Cannot send data over data connection");
+                }
+
+                continue;
+            }
+            else if (position == static_cast<off_t>(offset) && (error == EINVAL || error == ENOSYS))
+            {
+                /* Files sendfile can't read, e.g. some in /proc. */
+                return false;
+            }
+
+            ec.assign(error, boost::system::system_category());
+
+            throw connection_exception(ec, "Cannot send data over data connection");
+        }
+
+        end = static_cast<std::uint64_t>(position);
+
+        return true;
+    }
+
+    return false;
+}
+
+/* The file is still in the page cache after sendfile, so this costs a copy
+ * but no disk reads.
+ */
+template<typename Transport>
+void basic_data_connection<Transport>::digest_file(int file, std::uint64_t offset, std::uint64_t end)
+{
+    steady_clock::time_point started = steady_clock::now();
+
+    while (offset < end)
+    {
+        std::size_t size = static_cast<std::size_t>(std::min<std::uint64_t>(buffer_.size(), end - offset));
+        ssize_t len = ::pread(file, buffer_.data(), size, static_cast<off_t>(offset));
+
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (len < 0)
+        {
+            throw connection_exception("Cannot read data from file");
+        }
+        else if (len == 0)
         {
             break;
         }
+
+        digest(buffer_.data(), len);
+        offset += len;
     }
+
+    result_.file_time += duration_cast<microseconds>(steady_clock::now() - started);
 }
 
-void data_connection::send(const char* pszBuffer, std::size_t uBufferSize)
+template<typename Transport>
+void basic_data_connection<Transport>::digest(const char *data, std::size_t size)
 {
-    boost::system::error_code ec;
+    if (checksum_)
+    {
+        checksum_->update(data, size);
+    }
 
-    boost::asio::write(socket_, boost::asio::buffer(pszBuffer, uBufferSize), ec);
+    if (crc32_)
+    {
+        crc32_->update(data, size);
+    }
 
-    if (ec)
+    if (md5_)
     {
-        throw connection_exception(ec, "Cannot send data over data connection");
+        md5_->update(data, size);
     }
 }
 
-void data_connection::recv(ofstream & file)
+template<typename Transport>
+void basic_data_connection<Transport>::recv(ofstream & file)
 {
     boost::system::error_code ec;
 
     for (;;)
     {
-        size_t len = socket_.read_some(boost::asio::buffer(buffer_), ec);
+        size_t len = read_some(buffer_.data(), buffer_.size(), ec);
 
         if (ec == boost::asio::error::eof)
         {
@@ -159,7 +861,16 @@ void data_connection::recv(ofstream & file)
             throw connection_exception(ec, "Cannot receive data over data connection");
         }
 
+        if (cipher_)
+        {
+            cipher_->apply(buffer_.data(), len);
+        }
+
+        digest(buffer_.data(), len);
+
+        steady_clock::time_point started = steady_clock::now();
         file.write(buffer_.data(), len);
+        result_.file_time += duration_cast<microseconds>(steady_clock::now() - started);
 
         if (file.fail())
         {
@@ -168,23 +879,179 @@ void data_connection::recv(ofstream & file)
     }
 }
 
-string data_connection::recv()
+template<typename Transport>
+string basic_data_connection<Transport>::recv()
 {
     boost::system::error_code ec;
     string reply;
 
-    boost::asio::read(socket_, boost::asio::dynamic_buffer(reply), ec);
+    for (;;)
+    {
+        size_t len = read_some(buffer_.data(), buffer_.size(), ec);
 
-    if (ec == boost::asio::error::eof)
+        if (ec == boost::asio::error::eof)
+        {
+            break;
+        }
+        else if (ec)
+        {
+            throw connection_exception(ec, "Cannot receive data through data connection");
+        }
+
+        if (cipher_)
+        {
+            cipher_->apply(buffer_.data(), len);
+        }
+
+        digest(buffer_.data(), len);
+
+        reply.append(buffer_.data(), len);
+    }
+
+    return reply;
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::write(const char *data, size_t size)
+{
+    boost::system::error_code ec;
+
+    /* The deadline applies to each chunk, so a slow but steady transfer of
+     * a large buffer doesn't time out.
+     */
+    while (size > 0)
     {
-        /* Ignore eof. */
+        size_t chunk = std::min(size, max_write_chunk);
+        size_t written = 0;
+        steady_clock::time_point started = begin_io();
+
+        boost::asio::async_write(socket_, boost::asio::buffer(data, chunk),
+                                 [&ec, &written](const boost::system::error_code & error, size_t length)
+        {
+            ec = error;
+            written = length;
+        });
+
+        if (!run_with_deadline(io_context_, socket_, inactivity_timeout_, timers_.get()))
+        {
+            throw timeout_exception("Cannot send data over data connection: no progress in %1% ms",
+                                    inactivity_timeout_.count());
+        }
+
+        end_io(started, written);
+
+        if (written > 0)
+        {
+            sent_data_ = true;
+        }
+
+        if (ec)
+        {
+            throw connection_exception(ec, "Cannot send data over data connection");
+        }
+
+        data += written;
+        size -= written;
     }
-    else if (ec)
+}
+
+template<typename Transport>
+void basic_data_connection<Transport>::set_sample_interval(milliseconds interval)
+{
+    sample_interval_ = interval;
+}
+
+template<typename Transport>
+const transfer_result & basic_data_connection<Transport>::result() const
+{
+    return result_;
+}
+
+template<typename Transport>
+steady_clock::time_point basic_data_connection<Transport>::begin_io()
+{
+    steady_clock::time_point now = steady_clock::now();
+
+    if (!transferring_)
     {
-        throw connection_exception(ec, "Cannot receive data through data connection");
+        transferring_ = true;
+        transfer_started_ = now;
+        last_sample_ = now;
     }
 
-    return reply;
+    return now;
 }
 
+template<typename Transport>
+void basic_data_connection<Transport>::end_io(steady_clock::time_point started, size_t bytes)
+{
+    steady_clock::time_point now = steady_clock::now();
+
+    result_.network_time += duration_cast<microseconds>(now - started);
+    result_.bytes += bytes;
+
+    if (now - last_sample_ >= sample_interval_ && socket_.is_open())
+    {
+        tcp_sample sample;
+
+        if (take_sample(sample))
+        {
+            result_.samples.push_back(sample);
+        }
+
+        last_sample_ = now;
+    }
+}
+
+template<typename Transport>
+bool basic_data_connection<Transport>::take_sample(tcp_sample & sample)
+{
+    if constexpr (!Transport::is_tcp)
+    {
+        return false;
+    }
+    else if (!sample_tcp_info(Transport::tcp_layer(socket_).native_handle(), sample))
+    {
+        return false;
+    }
+
+    sample.elapsed = duration_cast<microseconds>(steady_clock::now() - transfer_started_);
+
+    return true;
+}
+
+template<typename Transport>
+size_t basic_data_connection<Transport>::read_some(char *data, size_t size, boost::system::error_code & ec)
+{
+    size_t len = 0;
+    steady_clock::time_point started = begin_io();
+
+    socket_.async_read_some(boost::asio::buffer(data, size),
+                            [&ec, &len](const boost::system::error_code & error, size_t length)
+    {
+        ec = error;
+        len = length;
+    });
+
+    if (!run_with_deadline(io_context_, socket_, inactivity_timeout_, timers_.get()))
+    {
+        throw timeout_exception("Cannot receive data over data connection: no progress in %1% ms",
+                                inactivity_timeout_.count());
+    }
+
+    end_io(started, len);
+
+    if (ec == boost::asio::error::eof)
+    {
+        peer_closed_ = true;
+    }
+
+    return len;
+}
+
+template class basic_data_connection<tcp_transport>;
+template class basic_data_connection<unix_transport>;
+template class basic_data_connection<memory_transport>;
+template class basic_data_connection<tls_transport>;
+
 } // namespace ftp::detail
@@ -25,42 +25,220 @@
 #ifndef FTP_DATA_CONNECTION_HPP
 #define FTP_DATA_CONNECTION_HPP
 
+#include "data_listener.hpp"
+#include "../data_cipher.hpp"
+#include "crc32.hpp"
+#include "crc32c.hpp"
+#include "md5.hpp"
+#include "../socket_profile.hpp"
+#include "../source_address_pool.hpp"
+#include "../timer_service.hpp"
+#include "../tls_transport.hpp"
+#include "../transfer_result.hpp"
+#include "../transport.hpp"
 #include <boost/asio/ip/tcp.hpp>
+#include <chrono>
 #include <fstream>
+#include <memory>
+#include <optional>
 
 namespace ftp::detail
 {
 
-class data_connection
+template<typename Transport>
+class basic_data_connection
 {
 public:
-    data_connection(const std::string & ip, uint16_t port);
+    basic_data_connection(const std::string & ip, uint16_t port);
 
-    data_connection(const data_connection &) = delete;
+    ~basic_data_connection();
 
-    data_connection & operator=(const data_connection &) = delete;
+    basic_data_connection(const basic_data_connection &) = delete;
+
+    basic_data_connection & operator=(const basic_data_connection &) = delete;
 
     void open();
 
+    /* Starts connecting without waiting, the handshake completes in the
+     * background. 'open' waits for it.
+     */
+    void start_open();
+
+    /* Checks without blocking that the peer hasn't closed the connection or
+     * sent anything yet.
+     */
+    bool is_alive();
+
+    /* Active mode: waits until the server connects to the listener. Only a
+     * connection from the server's address is accepted. TCP only.
+     */
+    void accept(data_listener & listener);
+
+    /* Secures the connection with a TLS handshake as the client, offering
+     * to resume the session if there is one. TLS transports only.
+     */
+    void start_tls(boost::asio::ssl::context & context, const std::string & host, SSL_SESSION *session);
+
+    /* The handshake has resumed the session instead of negotiating a new
+     * one.
+     */
+    bool tls_resumed() const;
+
+    /* Encrypts what is sent and decrypts what is received from now on, in
+     * place in the transfer buffer.
+     */
+    void set_cipher(std::unique_ptr<data_cipher> cipher);
+
+    /* Computes the CRC-32C of the contents as they pass, before the cipher
+     * on the way out and after it on the way in. It ends up in the result.
+     */
+    void set_checksum(bool enabled);
+
+    /* Computes the IEEE CRC-32 of the contents, like the checksum. */
+    void set_crc32(bool enabled);
+
+    /* Computes the MD5 of the contents as they pass, like the checksum. */
+    void set_md5(bool enabled);
+
+    /* After the TLS handshake, hands the encryption of what is sent to the
+     * kernel where it supports it, so send_file works over TLS too. Where
+     * it doesn't, OpenSSL goes on encrypting. Must be called before
+     * 'start_tls'.
+     */
+    void set_kernel_tls(bool enabled);
+
+    bool is_kernel_tls() const;
+
     bool is_open() const;
 
+    /* Over TLS, sends a close_notify alert first. */
     void close();
 
     void send(std::ifstream & file);
 
     void send(const char* pszBuffer, std::size_t uBufferSize);
 
+    /* Like 'send', but applies the cipher in the caller's buffer instead
+     * of a copy, so the buffer is left encrypted.
+     */
+    void send_in_place(char *data, std::size_t size);
+
+    /* Sends the file from the offset on with sendfile, so its data goes from
+     * the page cache to the socket without a copy through user space. TCP
+     * connections only, in plain text or with kernel TLS, and without a
+     * data cipher. With a checksum or MD5, the file is read once more from
+     * the page cache for them.
+     * False if the file can't be sent this way, nothing has been sent
+     * then.
+     */
+    bool send_file(const std::string & path, std::uint64_t offset);
+
     void recv(std::ofstream & file);
 
     std::string recv();
 
+    /* Deadlines for establishing the connection and for each read or write
+     * while transferring data.
+     */
+    void set_timeouts(std::chrono::milliseconds connect, std::chrono::milliseconds inactivity);
+
+    void set_timer_service(std::shared_ptr<timer_service> timers);
+
+    /* How often TCP_INFO is sampled while data moves. */
+    void set_sample_interval(std::chrono::milliseconds interval);
+
+    /* Byte counts, timings and TCP_INFO samples of the transfer. Complete
+     * once the connection is closed.
+     */
+    const transfer_result & result() const;
+
+    /* Must be called before the connection is opened. */
+    void set_socket_options(const socket_options & options);
+
+    /* Binds the connection to the next address of the pool. Must be called
+     * before the connection is opened.
+     */
+    void set_source_pool(std::shared_ptr<source_address_pool> pool);
+
+    /* Connects with TCP Fast Open (RFC 7413) where the system supports it.
+     * With a cookie cached from an earlier connection to the server, the
+     * connect completes at once and the first data sent goes out with the
+     * SYN. So data must be sent before anything is awaited from the server.
+     * Must be called before the connection is opened.
+     */
+    void set_fast_open(bool enabled);
+
+    bool is_fast_open() const;
+
+    /* The server has acknowledged the data sent with the SYN. */
+    bool fast_open_accepted();
+
 private:
+    void write(const char *data, std::size_t size);
+
+    /* Sets end to where sending stopped, the file may have changed since
+     * its size was taken.
+     */
+    bool write_file(int file, std::uint64_t offset, std::uint64_t & end);
+
+    /* Feeds the contents to the checksums and MD5, if any. */
+    void digest(const char *data, std::size_t size);
+
+    /* Feeds what was sent from the file, up to end. */
+    void digest_file(int file, std::uint64_t offset, std::uint64_t end);
+
+    std::size_t read_some(char *data, std::size_t size, boost::system::error_code & ec);
+
+    std::chrono::steady_clock::time_point begin_io();
+
+    void end_io(std::chrono::steady_clock::time_point started, std::size_t bytes);
+
+    bool take_sample(tcp_sample & sample);
+
+    void bind_source(boost::asio::ip::tcp::socket & socket, const boost::asio::ip::tcp & protocol);
+
+    void release_source(bool time_wait);
+
+    bool is_established() const;
+
+    /* Whether the close mode allows a RST right now. */
+    bool may_abort() const;
+
+    void set_abortive_linger();
+
+    /* Whether it completed before the inactivity deadline. */
+    bool shutdown_tls();
+
     boost::asio::io_context io_context_;
-    boost::asio::ip::tcp::socket socket_;
+    typename Transport::socket socket_;
     std::array<char, 8192> buffer_;
     std::string ip_;
     uint16_t port_;
+    std::chrono::milliseconds connect_timeout_;
+    std::chrono::milliseconds inactivity_timeout_;
+    std::shared_ptr<timer_service> timers_;
+    bool connecting_;
+    bool fast_open_;
+    socket_options options_;
+    transfer_result result_;
+    std::chrono::milliseconds sample_interval_;
+    bool transferring_;
+    std::chrono::steady_clock::time_point transfer_started_;
+    std::chrono::steady_clock::time_point last_sample_;
+    std::shared_ptr<source_address_pool> source_pool_;
+    std::optional<std::size_t> source_index_;
+    bool sent_data_;
+    bool peer_closed_;
+    boost::system::error_code connect_error_;
+    bool tls_resumed_;
+    bool kernel_tls_;
+    std::unique_ptr<data_cipher> cipher_;
+    std::optional<crc32c> checksum_;
+    std::optional<crc32> crc32_;
+    std::unique_ptr<md5> md5_;
 };
 
+using data_connection = basic_data_connection<tcp_transport>;
+
 } // namespace ftp::detail
 #endif //FTP_DATA_CONNECTION_HPP
@@ -0,0 +1,199 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "data_listener.hpp"
+#include "connection_exception.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <functional>
+#include <optional>
+
+namespace ftp::detail
+{
+
+using std::optional;
+using std::chrono::milliseconds;
+using boost::asio::ip::address;
+using boost::asio::ip::tcp;
+
+data_listener::data_listener(const address & address)
+    : io_context_(),
+      acceptor_(io_context_)
+{
+    boost::system::error_code ec;
+    tcp::endpoint endpoint(address, 0);
+
+    acceptor_.open(endpoint.protocol(), ec);
+
+    if (!ec)
+    {
+        acceptor_.bind(endpoint, ec);
+    }
+
+    if (!ec)
+    {
+        /* Only the server of this session connects, one at a time. */
+        acceptor_.listen(4, ec);
+    }
+
+    if (ec)
+    {
+        boost::system::error_code ignored;
+        acceptor_.close(ignored);
+
+        throw connection_exception(ec, "Cannot listen for data connections");
+    }
+}
+
+bool data_listener::is_open() const
+{
+    return acceptor_.is_open();
+}
+
+void data_listener::close()
+{
+    boost::system::error_code ec;
+
+    acceptor_.close(ec);
+
+    if (ec)
+    {
+        throw connection_exception(ec, "Cannot close listener");
+    }
+}
+
+tcp::endpoint data_listener::local_endpoint() const
+{
+    boost::system::error_code ec;
+
+    tcp::endpoint endpoint = acceptor_.local_endpoint(ec);
+
+    if (ec)
+    {
+        throw connection_exception(ec, "Cannot get listener address");
+    }
+
+    return endpoint;
+}
+
+bool data_listener::accept(tcp::socket & socket,
+                           const address & expected,
+                           milliseconds timeout,
+                           timer_service *timers)
+{
+    boost::asio::steady_timer deadline(io_context_);
+    tcp::endpoint peer;
+    boost::system::error_code ec;
+    bool finished = false;
+    bool expired = false;
+
+    std::function<void()> start_accept = [&]()
+    {
+        acceptor_.async_accept(socket, peer, [&](const boost::system::error_code & error)
+        {
+            if (!error && peer.address() != expected)
+            {
+                /* Someone else has found the port, don't let them inject
+                 * or steal the data.
+                 */
+                boost::system::error_code ignored;
+                socket.close(ignored);
+
+                if (!expired)
+                {
+                    start_accept();
+                    return;
+                }
+            }
+
+            finished = true;
+            ec = error;
+            deadline.cancel();
+        });
+    };
+
+    auto expire = [&]()
+    {
+        if (!finished)
+        {
+            expired = true;
+
+            /* The listener survives, only the pending accept is aborted. */
+            boost::system::error_code ignored;
+            acceptor_.cancel(ignored);
+        }
+    };
+
+    optional<timer_service::timer_id> timer;
+
+    io_context_.restart();
+
+    if (timers)
+    {
+        /* The callback runs on the thread of the service, let the
+         * io_context run the expiration.
+         */
+        timer = timers->schedule(timeout, [this, &expire]()
+        {
+            boost::asio::post(io_context_, expire);
+        });
+    }
+    else
+    {
+        deadline.expires_after(timeout);
+        deadline.async_wait([&](const boost::system::error_code & error)
+        {
+            if (!error)
+            {
+                expire();
+            }
+        });
+    }
+
+    start_accept();
+    io_context_.run();
+
+    if (timer)
+    {
+        timers->cancel(*timer);
+
+        /* Run the expiration if it has been posted in the meantime. */
+        io_context_.restart();
+        io_context_.poll();
+    }
+
+    if (expired)
+    {
+        return false;
+    }
+
+    if (ec)
+    {
+        throw connection_exception(ec, "Cannot accept data connection");
+    }
+
+    return true;
+}
+
+} // namespace ftp::detail
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_DATA_LISTENER_HPP
+#define FTP_DATA_LISTENER_HPP
+
+#include "../timer_service.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+
+namespace ftp::detail
+{
+
+/* The listening socket of active mode transfers. One listener serves all
+ * transfers of a session, so a transfer costs neither a bind nor a listen.
+ */
+class data_listener
+{
+public:
+    /* Listens on an ephemeral port of the given local address, it should be
+     * the address the control connection uses.
+     */
+    explicit data_listener(const boost::asio::ip::address & address);
+
+    data_listener(const data_listener &) = delete;
+
+    data_listener & operator=(const data_listener &) = delete;
+
+    bool is_open() const;
+
+    void close();
+
+    boost::asio::ip::tcp::endpoint local_endpoint() const;
+
+    /* Accepts the next connection onto the socket. Only connections from
+     * the expected address are accepted, others are dropped (RFC 2577).
+     * Returns false if none arrives in time, the listener stays open.
+     */
+    bool accept(boost::asio::ip::tcp::socket & socket,
+                const boost::asio::ip::address & expected,
+                std::chrono::milliseconds timeout,
+                timer_service *timers);
+
+private:
+    boost::asio::io_context io_context_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+};
+
+} // namespace ftp::detail
+#endif //FTP_DATA_LISTENER_HPP
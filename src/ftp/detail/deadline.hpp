@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_DEADLINE_HPP
+#define FTP_DEADLINE_HPP
+
+#include "../timer_service.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+#include <atomic>
+#include <chrono>
+#include <sys/socket.h>
+
+namespace ftp::detail
+{
+
+/* Returns a function which aborts the pending operations of the socket and
+ * may be called from any thread. Unlike closing the socket, shutting it down
+ * is safe from another thread, it completes the pending operation with an
+ * error. Transports with sockets of their own overload it.
+ */
+template<typename Socket>
+auto interrupter(Socket & socket)
+{
+    auto handle = socket.native_handle();
+
+    return [handle]()
+    {
+        ::shutdown(handle, SHUT_RDWR);
+    };
+}
+
+/* Runs the io_context until the asynchronous operations started on the socket
+ * complete or the timeout expires. In the latter case the socket is closed,
+ * which aborts the pending operations, and false is returned.
+ *
+ * https://www.boost.org/doc/libs/1_70_0/doc/html/boost_asio/example/cpp11/timeouts/blocking_tcp_client.cpp
+ */
+template<typename Socket, typename Rep, typename Period>
+bool run_with_deadline(boost::asio::io_context & io_context,
+                       Socket & socket,
+                       const std::chrono::duration<Rep, Period> & timeout)
+{
+    io_context.restart();
+    io_context.run_for(timeout);
+
+    if (io_context.stopped())
+    {
+        return true;
+    }
+
+    boost::system::error_code ignored;
+    socket.close(ignored);
+
+    /* Let the aborted operations complete. */
+    io_context.run();
+
+    return false;
+}
+
+/* The same, but the deadline is a timer of the shared timer service instead
+ * of a timer queue of the io_context. When there is no timer service, falls
+ * back to the io_context.
+ */
+template<typename Socket, typename Rep, typename Period>
+bool run_with_deadline(boost::asio::io_context & io_context,
+                       Socket & socket,
+                       const std::chrono::duration<Rep, Period> & timeout,
+                       timer_service *timers)
+{
+    if (!timers)
+    {
+        return run_with_deadline(io_context, socket, timeout);
+    }
+
+    std::atomic<bool> expired(false);
+    auto interrupt = interrupter(socket);
+
+    timer_service::timer_id id = timers->schedule(
+        std::chrono::ceil<std::chrono::milliseconds>(timeout),
+        [&expired, &interrupt]()
+    {
+        expired = true;
+        interrupt();
+    });
+
+    io_context.restart();
+    io_context.run();
+
+    /* Waits for the callback if it is running right now, 'expired' lives on
+     * this stack frame.
+     */
+    timers->cancel(id);
+
+    if (!expired)
+    {
+        return true;
+    }
+
+    boost::system::error_code ignored;
+    socket.close(ignored);
+
+    return false;
+}
+
+} // namespace ftp::detail
+#endif //FTP_DEADLINE_HPP
@@ -0,0 +1,416 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "kernel_tls.hpp"
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <cstring>
+#include <string>
+#ifdef __linux__
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#endif
+#include <sys/socket.h>
+
+namespace ftp::detail
+{
+
+using std::string;
+using std::vector;
+
+/* Where a connection keeps the secret of its first application traffic
+ * key with TLS 1.3.
+ */
+static int secret_index()
+{
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+        [](void *, void *secret, CRYPTO_EX_DATA *, int, long, void *)
+    {
+        delete static_cast<vector<unsigned char> *>(secret);
+    });
+
+    return index;
+}
+
+/* Marks owned contexts. Holds the key log callback set before ours, if any,
+ * once ours is installed.
+ */
+struct context_state
+{
+    SSL_CTX_keylog_cb_func previous = nullptr;
+};
+
+static int context_index()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr,
+        [](void *, void *state, CRYPTO_EX_DATA *, int, long, void *)
+    {
+        delete static_cast<context_state *>(state);
+    });
+
+    return index;
+}
+
+static bool from_hex(const string & hex, vector<unsigned char> & bytes)
+{
+    if (hex.size() % 2 != 0)
+    {
+        return false;
+    }
+
+    bytes.clear();
+
+    for (size_t i = 0; i < hex.size(); i += 2)
+    {
+        bytes.push_back(static_cast<unsigned char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+
+    return true;
+}
+
+/* Key log lines are '<label> <client random> <secret>' (NSS key log
+ * format).
+ */
+static void keep_secret(const SSL *ssl, const char *line)
+{
+    static const string label = "CLIENT_TRAFFIC_SECRET_0 ";
+
+    auto *secret = static_cast<vector<unsigned char> *>(SSL_get_ex_data(ssl, secret_index()));
+
+    if (secret && std::strncmp(line, label.c_str(), label.size()) == 0)
+    {
+        const char *value = std::strrchr(line, ' ');
+
+        if (value)
+        {
+            from_hex(value + 1, *secret);
+        }
+    }
+
+    auto *state = static_cast<context_state *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), context_index()));
+
+    if (state && state->previous)
+    {
+        state->previous(ssl, line);
+    }
+}
+
+bool request_openssl_ktls(SSL *ssl)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+
+    return true;
+#else
+    (void) ssl;
+
+    return false;
+#endif
+}
+
+bool is_openssl_ktls_tx(SSL *ssl)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+    BIO *bio = SSL_get_wbio(ssl);
+
+    return bio && BIO_get_ktls_send(bio);
+#else
+    (void) ssl;
+
+    return false;
+#endif
+}
+
+void own_tls_context(SSL_CTX *context)
+{
+    if (!SSL_CTX_get_ex_data(context, context_index()))
+    {
+        SSL_CTX_set_ex_data(context, context_index(), new context_state());
+    }
+}
+
+void keep_tls_secrets(SSL *ssl)
+{
+    SSL_CTX *context = SSL_get_SSL_CTX(ssl);
+    auto *state = static_cast<context_state *>(SSL_CTX_get_ex_data(context, context_index()));
+
+    if (!state)
+    {
+        return;
+    }
+
+    if (!SSL_get_ex_data(ssl, secret_index()))
+    {
+        SSL_set_ex_data(ssl, secret_index(), new vector<unsigned char>());
+    }
+
+    SSL_CTX_keylog_cb_func current = SSL_CTX_get_keylog_callback(context);
+
+    if (current != keep_secret)
+    {
+        state->previous = current;
+        SSL_CTX_set_keylog_callback(context, keep_secret);
+    }
+}
+
+/* RFC 8446, section 7.1: HKDF-Expand-Label with an empty context. */
+static bool expand_label(const EVP_MD *md,
+                         const vector<unsigned char> & secret,
+                         const string & label,
+                         size_t length,
+                         vector<unsigned char> & out)
+{
+    string full_label = "tls13 " + label;
+    vector<unsigned char> info;
+
+    info.push_back(static_cast<unsigned char>(length >> 8));
+    info.push_back(static_cast<unsigned char>(length));
+    info.push_back(static_cast<unsigned char>(full_label.size()));
+    info.insert(info.end(), full_label.begin(), full_label.end());
+    info.push_back(0);
+
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+
+    out.resize(length);
+
+    bool derived = context
+        && EVP_PKEY_derive_init(context) > 0
+        && EVP_PKEY_CTX_hkdf_mode(context, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0
+        && EVP_PKEY_CTX_set_hkdf_md(context, md) > 0
+        && EVP_PKEY_CTX_set1_hkdf_key(context, secret.data(), secret.size()) > 0
+        && EVP_PKEY_CTX_add1_hkdf_info(context, info.data(), info.size()) > 0
+        && EVP_PKEY_derive(context, out.data(), &length) > 0;
+
+    EVP_PKEY_CTX_free(context);
+
+    return derived;
+}
+
+/* RFC 5246, section 6.3: the key block of TLS 1.2. */
+static bool key_block(SSL *ssl, const EVP_MD *md, size_t length, vector<unsigned char> & out)
+{
+    unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+    unsigned char client_random[SSL3_RANDOM_SIZE];
+    unsigned char server_random[SSL3_RANDOM_SIZE];
+    static const unsigned char label[] = "key expansion";
+
+    size_t master_size = SSL_SESSION_get_master_key(SSL_get_session(ssl), master, sizeof(master));
+
+    SSL_get_client_random(ssl, client_random, sizeof(client_random));
+    SSL_get_server_random(ssl, server_random, sizeof(server_random));
+
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr);
+
+    out.resize(length);
+
+    bool derived = context
+        && EVP_PKEY_derive_init(context) > 0
+        && EVP_PKEY_CTX_set_tls1_prf_md(context, md) > 0
+        && EVP_PKEY_CTX_set1_tls1_prf_secret(context, master, master_size) > 0
+        && EVP_PKEY_CTX_add1_tls1_prf_seed(context, label, sizeof(label) - 1) > 0
+        && EVP_PKEY_CTX_add1_tls1_prf_seed(context, server_random, sizeof(server_random)) > 0
+        && EVP_PKEY_CTX_add1_tls1_prf_seed(context, client_random, sizeof(client_random)) > 0
+        && EVP_PKEY_derive(context, out.data(), &length) > 0;
+
+    EVP_PKEY_CTX_free(context);
+    OPENSSL_cleanse(master, sizeof(master));
+
+    return derived;
+}
+
+bool derive_tx_keys(SSL *ssl, tls_tx_keys & keys)
+{
+#ifdef __linux__
+    const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+
+    if (!cipher)
+    {
+        return false;
+    }
+
+    size_t key_size;
+    size_t iv_size;
+
+    switch (SSL_CIPHER_get_cipher_nid(cipher))
+    {
+    case NID_aes_128_gcm:
+        keys.cipher = TLS_CIPHER_AES_GCM_128;
+        key_size = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+        iv_size = TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+        break;
+    case NID_aes_256_gcm:
+        keys.cipher = TLS_CIPHER_AES_GCM_256;
+        key_size = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+        iv_size = TLS_CIPHER_AES_GCM_256_SALT_SIZE;
+        break;
+    case NID_chacha20_poly1305:
+        keys.cipher = TLS_CIPHER_CHACHA20_POLY1305;
+        key_size = TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE;
+        iv_size = TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE;
+        break;
+    default:
+        return false;
+    }
+
+    const EVP_MD *md = SSL_CIPHER_get_handshake_digest(cipher);
+    keys.version = SSL_version(ssl);
+
+    if (keys.version == TLS1_3_VERSION)
+    {
+        auto *secret = static_cast<vector<unsigned char> *>(SSL_get_ex_data(ssl, secret_index()));
+
+        /* The client's finished message went out under the handshake keys. */
+        keys.sequence = 0;
+
+        return secret && !secret->empty()
+            && expand_label(md, *secret, "key", key_size, keys.key)
+            && expand_label(md, *secret, "iv", 12, keys.iv);
+    }
+    else if (keys.version == TLS1_2_VERSION)
+    {
+        vector<unsigned char> block;
+
+        /* The finished message was the first record under these keys. */
+        keys.sequence = 1;
+
+        /* client key, server key, client IV, server IV: AEAD ciphers have no
+         * MAC keys.
+         */
+        if (!key_block(ssl, md, 2 * key_size + 2 * iv_size, block))
+        {
+            return false;
+        }
+
+        keys.key.assign(block.begin(), block.begin() + key_size);
+        keys.iv.assign(block.begin() + 2 * key_size, block.begin() + 2 * key_size + iv_size);
+
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+#ifdef __linux__
+template<typename CryptoInfo>
+static bool set_tx(int handle, CryptoInfo & info, const tls_tx_keys & keys)
+{
+    unsigned char sequence[8];
+
+    for (int i = 0; i < 8; ++i)
+    {
+        sequence[i] = static_cast<unsigned char>(keys.sequence >> (56 - 8 * i));
+    }
+
+    info.info.version = keys.version == TLS1_3_VERSION ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+    info.info.cipher_type = keys.cipher;
+    std::memcpy(info.key, keys.key.data(), sizeof(info.key));
+    std::memcpy(info.rec_seq, sequence, sizeof(info.rec_seq));
+
+    if constexpr (sizeof(info.salt) == 0)
+    {
+        /* ChaCha20-Poly1305 takes the whole nonce as the IV. */
+        std::memcpy(info.iv, keys.iv.data(), sizeof(info.iv));
+    }
+    else if (keys.version == TLS1_3_VERSION)
+    {
+        std::memcpy(info.salt, keys.iv.data(), sizeof(info.salt));
+        std::memcpy(info.iv, keys.iv.data() + sizeof(info.salt), sizeof(info.iv));
+    }
+    else
+    {
+        /* The explicit part of the nonce is the sequence number, as OpenSSL
+         * does it.
+         */
+        std::memcpy(info.salt, keys.iv.data(), sizeof(info.salt));
+        std::memcpy(info.iv, sequence, sizeof(info.iv));
+    }
+
+    return ::setsockopt(handle, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+}
+#endif
+
+bool install_kernel_tx(int handle, const tls_tx_keys & keys)
+{
+#ifdef __linux__
+    /* Fails with ENOENT without the module. Until TX keys are set, the ULP
+     * passes everything through.
+     */
+    if (::setsockopt(handle, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+    {
+        return false;
+    }
+
+    switch (keys.cipher)
+    {
+    case TLS_CIPHER_AES_GCM_128:
+    {
+        tls12_crypto_info_aes_gcm_128 info = {};
+        return set_tx(handle, info, keys);
+    }
+    case TLS_CIPHER_AES_GCM_256:
+    {
+        tls12_crypto_info_aes_gcm_256 info = {};
+        return set_tx(handle, info, keys);
+    }
+    case TLS_CIPHER_CHACHA20_POLY1305:
+    {
+        tls12_crypto_info_chacha20_poly1305 info = {};
+        return set_tx(handle, info, keys);
+    }
+    }
+#endif
+
+    return false;
+}
+
+bool send_kernel_close_notify(int handle)
+{
+#ifdef __linux__
+    /* A warning level close_notify alert. */
+    unsigned char alert[2] = { 1, 0 };
+    char control[CMSG_SPACE(sizeof(unsigned char))] = {};
+    iovec data = { alert, sizeof(alert) };
+    msghdr message = {};
+
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+
+    header->cmsg_level = SOL_TLS;
+    header->cmsg_type = TLS_SET_RECORD_TYPE;
+    header->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(header) = 21;
+
+    return ::sendmsg(handle, &message, MSG_NOSIGNAL) == sizeof(alert);
+#else
+    return false;
+#endif
+}
+
+} // namespace ftp::detail
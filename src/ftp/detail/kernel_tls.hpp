@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_KERNEL_TLS_HPP
+#define FTP_KERNEL_TLS_HPP
+
+#include <openssl/ssl.h>
+#include <cstdint>
+#include <vector>
+
+namespace ftp::detail
+{
+
+/* Kernel TLS (Linux 4.13+, the 'tls' module): once the handshake is done in
+ * user space, the keys of the records a connection sends are handed to the
+ * kernel, which encrypts whatever is written to the socket from then on,
+ * including what sendfile and splice put there.
+ *
+ * OpenSSL 3.0 and later, when built with kTLS, hands the keys over itself,
+ * but only for connections that write to a socket BIO. Streams of asio write
+ * to a BIO pair instead, so for those the keys are derived here.
+ */
+
+/* Before the handshake: asks OpenSSL to hand the keys to the kernel. False
+ * if this OpenSSL can't.
+ */
+bool request_openssl_ktls(SSL *ssl);
+
+/* After the handshake: whether OpenSSL has handed the keys of the records
+ * sent to the kernel.
+ */
+bool is_openssl_ktls_tx(SSL *ssl);
+
+/* The state of the sending side of a connection, as the kernel takes it. */
+struct tls_tx_keys
+{
+    /* TLS1_2_VERSION or TLS1_3_VERSION. */
+    int version;
+    /* TLS_CIPHER_AES_GCM_128, TLS_CIPHER_AES_GCM_256 or
+     * TLS_CIPHER_CHACHA20_POLY1305 of linux/tls.h.
+     */
+    int cipher;
+    std::vector<unsigned char> key;
+    /* The fixed part of the nonce: 4 bytes for AES-GCM with TLS 1.2,
+     * 12 bytes otherwise.
+     */
+    std::vector<unsigned char> iv;
+    /* Of the next record. */
+    std::uint64_t sequence;
+};
+
+/* Marks a context its owner lets keep_tls_secrets install a key log
+ * callback on. Contexts of the application are left alone.
+ */
+void own_tls_context(SSL_CTX *context);
+
+/* Must be called before the handshake: TLS 1.3 secrets can't be had
+ * afterwards. Installs a key log callback on the context of the connection
+ * if it is an owned one, chained to the callback set before. Other
+ * connections of the context are passed on to that callback untouched.
+ */
+void keep_tls_secrets(SSL *ssl);
+
+/* Right after the handshake, before anything has been sent. False for
+ * versions and ciphers the kernel doesn't know.
+ */
+bool derive_tx_keys(SSL *ssl, tls_tx_keys & keys);
+
+/* False if the kernel can't take over, e.g. because the module is missing.
+ * The connection is left as it was then.
+ */
+bool install_kernel_tx(int handle, const tls_tx_keys & keys);
+
+/* Sends the close_notify alert through the kernel. */
+bool send_kernel_close_notify(int handle);
+
+} // namespace ftp::detail
+#endif //FTP_KERNEL_TLS_HPP
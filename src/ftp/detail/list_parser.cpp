@@ -0,0 +1,303 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "list_parser.hpp"
+#include <boost/lexical_cast/try_lexical_convert.hpp>
+#include <array>
+#include <cctype>
+
+namespace ftp::detail
+{
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+struct token_t
+{
+    size_t begin;
+    size_t end;
+};
+
+static vector<token_t> tokenize(const string & line)
+{
+    vector<token_t> tokens;
+    size_t pos = 0;
+
+    while (pos < line.size())
+    {
+        while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos])))
+        {
+            ++pos;
+        }
+
+        if (pos == line.size())
+        {
+            break;
+        }
+
+        size_t begin = pos;
+
+        while (pos < line.size() && !std::isspace(static_cast<unsigned char>(line[pos])))
+        {
+            ++pos;
+        }
+
+        tokens.push_back({ begin, pos });
+    }
+
+    return tokens;
+}
+
+static string token_str(const string & line, const token_t & token)
+{
+    return line.substr(token.begin, token.end - token.begin);
+}
+
+static bool is_month(const string & str)
+{
+    static const std::array<const char *, 12> months = {
+        "jan", "feb", "mar", "apr", "may", "jun",
+        "jul", "aug", "sep", "oct", "nov", "dec"
+    };
+
+    if (str.size() != 3)
+    {
+        return false;
+    }
+
+    for (const char *month : months)
+    {
+        if (std::tolower(static_cast<unsigned char>(str[0])) == month[0] &&
+            std::tolower(static_cast<unsigned char>(str[1])) == month[1] &&
+            std::tolower(static_cast<unsigned char>(str[2])) == month[2])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static string strip_line_ending(const string & line)
+{
+    size_t end = line.find_last_not_of("\r\n");
+
+    if (end == string::npos)
+    {
+        return string();
+    }
+
+    return line.substr(0, end + 1);
+}
+
+/* Unix-style listing, as produced by 'ls -l':
+ *
+ *     drwxr-xr-x   2 owner    group        4096 Jan 01 00:00 name
+ *     -rw-r--r--   1 owner    group      370692 Jan 01  2019 name with spaces
+ *     lrwxrwxrwx   1 owner    group          11 Jan 01 00:00 link -> target
+ *
+ * Some servers omit the group column, so the date is located by its month
+ * name rather than by a fixed column number.
+ */
+static bool try_parse_unix_line(const string & line, const vector<token_t> & tokens, list_entry & entry)
+{
+    string permissions = token_str(line, tokens[0]);
+
+    if (permissions.size() < 10)
+    {
+        return false;
+    }
+
+    size_t month = 0;
+
+    for (size_t i = 2; i + 3 < tokens.size(); ++i)
+    {
+        if (is_month(token_str(line, tokens[i])))
+        {
+            month = i;
+            break;
+        }
+    }
+
+    if (month == 0)
+    {
+        return false;
+    }
+
+    uint64_t size;
+    if (!boost::conversion::try_lexical_convert(token_str(line, tokens[month - 1]), size))
+    {
+        return false;
+    }
+
+    switch (permissions[0])
+    {
+    case 'd':
+        entry.type = list_entry::entry_type::directory;
+        break;
+    case 'l':
+        entry.type = list_entry::entry_type::link;
+        break;
+    case '-':
+        entry.type = list_entry::entry_type::file;
+        break;
+    default:
+        entry.type = list_entry::entry_type::unknown;
+        break;
+    }
+
+    entry.permissions = permissions;
+    entry.size = size;
+    entry.modified = line.substr(tokens[month].begin, tokens[month + 2].end - tokens[month].begin);
+    entry.name = line.substr(tokens[month + 3].begin);
+    entry.link_target.clear();
+
+    if (entry.type == list_entry::entry_type::link)
+    {
+        size_t arrow = entry.name.find(" -> ");
+
+        if (arrow != string::npos)
+        {
+            entry.link_target = entry.name.substr(arrow + 4);
+            entry.name.erase(arrow);
+        }
+    }
+
+    return !entry.name.empty();
+}
+
+/* MS-DOS style listing, as produced by IIS:
+ *
+ *     01-16-02  11:14AM       <DIR>          directory
+ *     01-16-02  11:14AM               370692 file name
+ */
+static bool try_parse_dos_line(const string & line, const vector<token_t> & tokens, list_entry & entry)
+{
+    string date = token_str(line, tokens[0]);
+
+    if (date.size() < 8 || !std::isdigit(static_cast<unsigned char>(date[0])) || date[2] != '-')
+    {
+        return false;
+    }
+
+    string size = token_str(line, tokens[2]);
+
+    if (size == "<DIR>")
+    {
+        entry.type = list_entry::entry_type::directory;
+        entry.size = 0;
+    }
+    else if (boost::conversion::try_lexical_convert(size, entry.size))
+    {
+        entry.type = list_entry::entry_type::file;
+    }
+    else
+    {
+        return false;
+    }
+
+    entry.permissions.clear();
+    entry.link_target.clear();
+    entry.modified = line.substr(tokens[0].begin, tokens[1].end - tokens[0].begin);
+    entry.name = line.substr(tokens[3].begin);
+
+    return !entry.name.empty();
+}
+
+bool try_parse_list_line(const string & line, list_entry & entry)
+{
+    string stripped = strip_line_ending(line);
+    vector<token_t> tokens = tokenize(stripped);
+
+    if (tokens.size() < 4)
+    {
+        return false;
+    }
+
+    if (std::isdigit(static_cast<unsigned char>(stripped[tokens[0].begin])))
+    {
+        return try_parse_dos_line(stripped, tokens, entry);
+    }
+
+    return try_parse_unix_line(stripped, tokens, entry);
+}
+
+vector<list_entry> parse_list(const string & listing)
+{
+    vector<list_entry> entries;
+    size_t begin = 0;
+
+    while (begin < listing.size())
+    {
+        size_t end = listing.find('\n', begin);
+
+        if (end == string::npos)
+        {
+            end = listing.size();
+        }
+
+        list_entry entry;
+
+        /* Skip lines like 'total 42' and anything we don't understand. */
+        if (try_parse_list_line(listing.substr(begin, end - begin), entry))
+        {
+            entries.push_back(std::move(entry));
+        }
+
+        begin = end + 1;
+    }
+
+    return entries;
+}
+
+/* The reply to 'STAT <path>' carries a directory listing between the first
+ * and the last line of a multi-line reply:
+ *
+ *     213-Status of "/dir":
+ *     -rw-r--r--   1 owner    group         42 Jan 01 00:00 file
+ *     213 End of status.
+ *
+ * RFC 959: https://tools.ietf.org/html/rfc959
+ */
+vector<list_entry> parse_stat_listing(const string & stat_reply)
+{
+    size_t first_line_end = stat_reply.find('\n');
+
+    if (first_line_end == string::npos)
+    {
+        return vector<list_entry>();
+    }
+
+    size_t last_line_begin = stat_reply.rfind('\n', stat_reply.size() >= 2 ? stat_reply.size() - 2 : 0);
+
+    if (last_line_begin == string::npos || last_line_begin <= first_line_end)
+    {
+        return vector<list_entry>();
+    }
+
+    return parse_list(stat_reply.substr(first_line_end + 1, last_line_begin - first_line_end));
+}
+
+} // namespace ftp::detail
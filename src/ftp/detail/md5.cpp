@@ -0,0 +1,114 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "md5.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace ftp::detail
+{
+
+md5::md5(md5_engine & engine)
+    : engine_(engine),
+      state_{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 },
+      partial_size_(0),
+      length_(0)
+{
+    engine_.attach();
+}
+
+md5::~md5()
+{
+    engine_.detach();
+}
+
+void md5::update(const char *data, std::size_t size)
+{
+    auto *bytes = reinterpret_cast<const unsigned char *>(data);
+
+    length_ += size;
+
+    if (partial_size_ > 0)
+    {
+        std::size_t fill = std::min(size, partial_.size() - partial_size_);
+
+        std::memcpy(partial_.data() + partial_size_, bytes, fill);
+        partial_size_ += fill;
+        bytes += fill;
+        size -= fill;
+
+        if (partial_size_ < partial_.size())
+        {
+            return;
+        }
+
+        engine_.hash(state_, partial_.data(), 1);
+        partial_size_ = 0;
+    }
+
+    engine_.hash(state_, bytes, size / 64);
+
+    partial_size_ = size % 64;
+    std::memcpy(partial_.data(), bytes + size - partial_size_, partial_size_);
+}
+
+std::string md5::hex_digest()
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    /* RFC 1321, 3.1 and 3.2: a one bit, zeros up to 56 bytes of the last
+     * block, and the length in bits.
+     */
+    unsigned char padding[128] = { 0x80 };
+    std::size_t padding_size = (partial_size_ < 56 ? 56 : 120) - partial_size_;
+    std::uint64_t bits = length_ * 8;
+
+    for (std::size_t i = 0; i < 8; i++)
+    {
+        padding[padding_size + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    unsigned char last[128];
+
+    std::memcpy(last, partial_.data(), partial_size_);
+    std::memcpy(last + partial_size_, padding, padding_size + 8);
+    md5_compress(state_, last, (partial_size_ + padding_size + 8) / 64);
+
+    std::string hex;
+
+    for (std::uint32_t word : state_)
+    {
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            unsigned char byte = static_cast<unsigned char>(word >> (8 * i));
+
+            hex += digits[byte >> 4];
+            hex += digits[byte & 0xf];
+        }
+    }
+
+    return hex;
+}
+
+} // namespace ftp::detail
@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_MD5_HPP
+#define FTP_MD5_HPP
+
+#include "md5_engine.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ftp::detail
+{
+
+/* MD5 of data that comes in chunks. Whole blocks are hashed by the engine,
+ * alongside other streams where there are enough of them.
+ */
+class md5
+{
+public:
+    explicit md5(md5_engine & engine = md5_engine::shared());
+
+    md5(const md5 &) = delete;
+
+    md5 & operator=(const md5 &) = delete;
+
+    ~md5();
+
+    void update(const char *data, std::size_t size);
+
+    /* In upper-case hex, as in the names the server gives objects. Ends
+     * the computation.
+     */
+    std::string hex_digest();
+
+private:
+    md5_engine & engine_;
+    std::uint32_t state_[4];
+    std::array<unsigned char, 64> partial_;
+    std::size_t partial_size_;
+    std::uint64_t length_;
+};
+
+} // namespace ftp::detail
+#endif //FTP_MD5_HPP
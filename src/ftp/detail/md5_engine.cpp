@@ -0,0 +1,474 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "md5_engine.hpp"
+#include <algorithm>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace ftp::detail
+{
+
+/* RFC 1321, 3.4. */
+static const std::uint32_t md5_k[64] =
+{
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const int md5_s[64] =
+{
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+/* The word of the block each step adds. */
+static int md5_g(int i)
+{
+    if (i < 16)
+    {
+        return i;
+    }
+    else if (i < 32)
+    {
+        return (5 * i + 1) & 15;
+    }
+    else if (i < 48)
+    {
+        return (3 * i + 5) & 15;
+    }
+
+    return (7 * i) & 15;
+}
+
+static std::uint32_t rotate_left(std::uint32_t x, int s)
+{
+    return (x << s) | (x >> (32 - s));
+}
+
+void md5_compress(std::uint32_t state[4], const unsigned char *data, std::size_t blocks)
+{
+    for (; blocks > 0; blocks--, data += 64)
+    {
+        std::uint32_t w[16];
+
+        for (int j = 0; j < 16; j++)
+        {
+            const unsigned char *p = data + 4 * j;
+
+            w[j] = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+        }
+
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+#pragma GCC unroll 64
+        for (int i = 0; i < 64; i++)
+        {
+            std::uint32_t f;
+
+            if (i < 16)
+            {
+                f = d ^ (b & (c ^ d));
+            }
+            else if (i < 32)
+            {
+                f = c ^ (d & (b ^ c));
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+            }
+
+            std::uint32_t t = a + f + md5_k[i] + w[md5_g(i)];
+
+            a = d;
+            d = c;
+            c = b;
+            b = b + rotate_left(t, md5_s[i]);
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+}
+
+#if defined(__x86_64__)
+
+/* Turns the rows of eight lanes into a row per word. */
+#define MD5_TRANSPOSE(r, w)                                                     \
+    {                                                                           \
+        __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);                         \
+        __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);                         \
+        __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);                         \
+        __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);                         \
+        __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);                         \
+        __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);                         \
+        __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);                         \
+        __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);                         \
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2);                             \
+        __m256i u1 = _mm256_unpackhi_epi64(t0, t2);                             \
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3);                             \
+        __m256i u3 = _mm256_unpackhi_epi64(t1, t3);                             \
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6);                             \
+        __m256i u5 = _mm256_unpackhi_epi64(t4, t6);                             \
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7);                             \
+        __m256i u7 = _mm256_unpackhi_epi64(t5, t7);                             \
+        w[0] = _mm256_permute2x128_si256(u0, u4, 0x20);                         \
+        w[1] = _mm256_permute2x128_si256(u1, u5, 0x20);                         \
+        w[2] = _mm256_permute2x128_si256(u2, u6, 0x20);                         \
+        w[3] = _mm256_permute2x128_si256(u3, u7, 0x20);                         \
+        w[4] = _mm256_permute2x128_si256(u0, u4, 0x31);                         \
+        w[5] = _mm256_permute2x128_si256(u1, u5, 0x31);                         \
+        w[6] = _mm256_permute2x128_si256(u2, u6, 0x31);                         \
+        w[7] = _mm256_permute2x128_si256(u3, u7, 0x31);                         \
+    }
+
+#define MD5_STEP(f, i)                                                          \
+    {                                                                           \
+        __m256i t = _mm256_add_epi32(_mm256_add_epi32(a, f),                    \
+                                     _mm256_add_epi32(_mm256_set1_epi32(md5_k[i]), w[md5_g(i)])); \
+        a = d;                                                                  \
+        d = c;                                                                  \
+        c = b;                                                                  \
+        b = _mm256_add_epi32(b, _mm256_or_si256(                                \
+                _mm256_sll_epi32(t, _mm_cvtsi32_si128(md5_s[i])),               \
+                _mm256_srl_epi32(t, _mm_cvtsi32_si128(32 - md5_s[i]))));        \
+    }
+
+__attribute__((target("avx2")))
+static void compress_lanes_avx2(std::uint32_t state[4][md5_engine::lanes],
+                                const unsigned char *data[md5_engine::lanes],
+                                std::size_t blocks)
+{
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state[0]));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state[1]));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state[2]));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state[3]));
+    const __m256i ones = _mm256_set1_epi32(-1);
+
+    for (std::size_t n = 0; n < blocks; n++)
+    {
+        __m256i w[16];
+
+        /* MD5 words are little-endian, like the loads. */
+        for (std::size_t half = 0; half < 2; half++)
+        {
+            __m256i r[md5_engine::lanes];
+
+            for (std::size_t lane = 0; lane < md5_engine::lanes; lane++)
+            {
+                r[lane] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data[lane] + 64 * n + 32 * half));
+            }
+
+            MD5_TRANSPOSE(r, (w + 8 * half));
+        }
+
+        __m256i aa = a, bb = b, cc = c, dd = d;
+
+        for (int i = 0; i < 16; i++)
+        {
+            __m256i f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+            MD5_STEP(f, i);
+        }
+
+        for (int i = 16; i < 32; i++)
+        {
+            __m256i f = _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)));
+            MD5_STEP(f, i);
+        }
+
+        for (int i = 32; i < 48; i++)
+        {
+            __m256i f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+            MD5_STEP(f, i);
+        }
+
+        for (int i = 48; i < 64; i++)
+        {
+            __m256i f = _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, ones)));
+            MD5_STEP(f, i);
+        }
+
+        a = _mm256_add_epi32(a, aa);
+        b = _mm256_add_epi32(b, bb);
+        c = _mm256_add_epi32(c, cc);
+        d = _mm256_add_epi32(d, dd);
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[0]), a);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[1]), b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[2]), c);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[3]), d);
+}
+
+#undef MD5_STEP
+#undef MD5_TRANSPOSE
+
+#endif
+
+bool md5_has_lanes()
+{
+#if defined(__x86_64__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void md5_compress_lanes(std::uint32_t state[4][md5_engine::lanes],
+                        const unsigned char *data[md5_engine::lanes],
+                        std::size_t blocks)
+{
+#if defined(__x86_64__)
+    compress_lanes_avx2(state, data, blocks);
+#endif
+}
+
+md5_engine::md5_engine(std::size_t max_threads)
+    : max_threads_(std::max<std::size_t>(max_threads, 1)),
+      threads_(0),
+      streams_(0)
+{
+}
+
+void md5_engine::attach()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ++streams_;
+}
+
+void md5_engine::detach()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    --streams_;
+}
+
+md5_engine & md5_engine::shared()
+{
+    static md5_engine engine(std::thread::hardware_concurrency());
+
+    return engine;
+}
+
+void md5_engine::hash(std::uint32_t state[4], const unsigned char *data, std::size_t blocks)
+{
+    if (blocks == 0)
+    {
+        return;
+    }
+
+    job own{ state, data, blocks, false, false, {} };
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    queue_.push_back(&own);
+
+    while (!own.done)
+    {
+        if (own.taken || threads_ >= max_threads_)
+        {
+            own.wake.wait(lock);
+            continue;
+        }
+
+        own.taken = true;
+        ++threads_;
+
+        /* Where other streams may be about to hand in blocks, lets them
+         * run first, so their jobs join this one in the lanes.
+         */
+        if (queue_.size() < lanes && streams_ > queue_.size())
+        {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+
+        /* The own job and those that have waited longest. */
+        std::vector<job *> batch{ &own };
+
+        for (job *waiting : queue_)
+        {
+            if (batch.size() < lanes && !waiting->taken)
+            {
+                waiting->taken = true;
+                batch.push_back(waiting);
+            }
+        }
+
+        queue_.erase(std::remove_if(queue_.begin(), queue_.end(), [](job *queued)
+        {
+            return queued->taken;
+        }), queue_.end());
+
+        lock.unlock();
+
+        stats hashed = run(batch);
+
+        lock.lock();
+        --threads_;
+        stats_.blocks += hashed.blocks;
+        stats_.shared_blocks += hashed.shared_blocks;
+
+        /* Under the lock: a job is gone as soon as its thread sees it done. */
+        for (job *finished : batch)
+        {
+            finished->done = true;
+            finished->wake.notify_one();
+        }
+
+        /* The thread was hashing, so one more may now. */
+        if (!queue_.empty())
+        {
+            queue_.front()->wake.notify_one();
+        }
+    }
+}
+
+/* Jobs share the lanes until only one is left, which finishes on its own. */
+auto md5_engine::run(std::vector<job *> & batch) -> stats
+{
+    stats hashed;
+
+    if (batch.size() > 1 && md5_has_lanes())
+    {
+        alignas(32) std::uint32_t state[4][lanes] = {};
+        const unsigned char *data[lanes];
+        std::size_t remaining[lanes] = {};
+        std::size_t active = batch.size();
+
+        for (std::size_t lane = 0; lane < batch.size(); lane++)
+        {
+            for (std::size_t word = 0; word < 4; word++)
+            {
+                state[word][lane] = batch[lane]->state[word];
+            }
+
+            data[lane] = batch[lane]->data;
+            remaining[lane] = batch[lane]->blocks;
+        }
+
+        while (active > 1)
+        {
+            std::size_t step = 0;
+            std::size_t busy = 0;
+
+            for (std::size_t lane = 0; lane < lanes; lane++)
+            {
+                if (remaining[lane] > 0 && (step == 0 || remaining[lane] < step))
+                {
+                    step = remaining[lane];
+                    busy = lane;
+                }
+            }
+
+            /* Idle lanes hash a busy lane's blocks, the result is dropped. */
+            for (std::size_t lane = 0; lane < lanes; lane++)
+            {
+                if (remaining[lane] == 0)
+                {
+                    data[lane] = data[busy];
+                }
+            }
+
+            md5_compress_lanes(state, data, step);
+
+            for (std::size_t lane = 0; lane < lanes; lane++)
+            {
+                data[lane] += 64 * step;
+
+                if (remaining[lane] > 0)
+                {
+                    hashed.blocks += step;
+                    hashed.shared_blocks += step;
+                    remaining[lane] -= step;
+
+                    if (remaining[lane] == 0)
+                    {
+                        /* From now on the lane hashes for nothing. */
+                        for (std::size_t word = 0; word < 4; word++)
+                        {
+                            batch[lane]->state[word] = state[word][lane];
+                        }
+
+                        --active;
+                    }
+                }
+            }
+        }
+
+        for (std::size_t lane = 0; lane < batch.size(); lane++)
+        {
+            if (remaining[lane] > 0)
+            {
+                for (std::size_t word = 0; word < 4; word++)
+                {
+                    batch[lane]->state[word] = state[word][lane];
+                }
+
+                md5_compress(batch[lane]->state, data[lane], remaining[lane]);
+                hashed.blocks += remaining[lane];
+            }
+        }
+    }
+    else
+    {
+        for (job *queued : batch)
+        {
+            md5_compress(queued->state, queued->data, queued->blocks);
+            hashed.blocks += queued->blocks;
+        }
+    }
+
+    return hashed;
+}
+
+auto md5_engine::get_stats() const -> stats
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return stats_;
+}
+
+} // namespace ftp::detail
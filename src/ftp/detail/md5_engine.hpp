@@ -0,0 +1,127 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_MD5_ENGINE_HPP
+#define FTP_MD5_ENGINE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace ftp::detail
+{
+
+/* Runs the MD5 compression function for many streams at once. Streams hand
+ * in their whole blocks as jobs. A thread that finds fewer than the
+ * allowed number of threads hashing takes its own job and up to seven
+ * more that are waiting, and hashes them in the lanes of AVX2, a block of
+ * each per step. Where other streams are attached, it yields once first,
+ * so they can hand in their jobs. Otherwise it waits until another thread
+ * has done its job or it can take its turn.
+ *
+ * So as long as there are no more hashing streams than threads allowed,
+ * each hashes on its own as before. With more, the waiting jobs are
+ * gathered into lanes and hashed at several times the throughput per
+ * core. Without AVX2, jobs are hashed one after another.
+ */
+class md5_engine
+{
+public:
+    /* Lanes hashed together. */
+    static const std::size_t lanes = 8;
+
+    struct stats
+    {
+        /* Runs of the compression function over a block of a job. */
+        std::uint64_t blocks = 0;
+        /* Of them, those that ran in lanes alongside other jobs. */
+        std::uint64_t shared_blocks = 0;
+    };
+
+    /* At most 'max_threads' threads hash at the same time, at least one. */
+    explicit md5_engine(std::size_t max_threads);
+
+    md5_engine(const md5_engine &) = delete;
+
+    md5_engine & operator=(const md5_engine &) = delete;
+
+    /* For the whole process, allowing as many threads as there are
+     * processors.
+     */
+    static md5_engine & shared();
+
+    /* Streams that will hand in blocks, whether or not they are hashing
+     * right now.
+     */
+    void attach();
+
+    void detach();
+
+    /* Updates 'state' with the 64-byte blocks at 'data'. Returns once they
+     * have been hashed, by this thread or another one.
+     */
+    void hash(std::uint32_t state[4], const unsigned char *data, std::size_t blocks);
+
+    stats get_stats() const;
+
+private:
+    struct job
+    {
+        std::uint32_t *state;
+        const unsigned char *data;
+        std::size_t blocks;
+        bool taken;
+        bool done;
+        /* Signalled when the job is done, or when it may take its turn. */
+        std::condition_variable wake;
+    };
+
+    stats run(std::vector<job *> & batch);
+
+    const std::size_t max_threads_;
+    mutable std::mutex mutex_;
+    /* Jobs nobody has taken yet, the oldest first. */
+    std::vector<job *> queue_;
+    std::size_t threads_;
+    std::size_t streams_;
+    stats stats_;
+};
+
+/* One MD5 compression per block, on a single stream. */
+void md5_compress(std::uint32_t state[4], const unsigned char *data, std::size_t blocks);
+
+/* Whether md5_compress_lanes runs on AVX2. */
+bool md5_has_lanes();
+
+/* Compresses 'blocks' blocks of each of eight streams in lock-step. The
+ * states are by word, then by lane: state[word][lane]. Needs AVX2.
+ */
+void md5_compress_lanes(std::uint32_t state[4][md5_engine::lanes],
+                        const unsigned char *data[md5_engine::lanes],
+                        std::size_t blocks);
+
+} // namespace ftp::detail
+#endif //FTP_MD5_ENGINE_HPP
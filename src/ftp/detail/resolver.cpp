@@ -0,0 +1,232 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "resolver.hpp"
+#include "connection_exception.hpp"
+#include <boost/asio/io_context.hpp>
+
+namespace ftp::detail
+{
+
+using std::string;
+using std::vector;
+using std::lock_guard;
+using std::mutex;
+using std::chrono::steady_clock;
+using boost::asio::ip::address;
+using boost::asio::ip::tcp;
+
+resolver::resolver(std::chrono::milliseconds positive_ttl,
+                   std::chrono::milliseconds negative_ttl,
+                   std::size_t max_entries)
+    : positive_ttl_(positive_ttl),
+      negative_ttl_(negative_ttl),
+      max_entries_(max_entries > 0 ? max_entries : 1)
+{
+}
+
+vector<tcp::endpoint> resolver::resolve(const string & hostname, uint16_t port, address_family family)
+{
+    vector<address> addresses;
+    boost::system::error_code ec;
+
+    /* A literal is used as is, whatever family was asked for. Scope ids of
+     * link-local addresses may be given as an interface name or an index.
+     */
+    address literal = boost::asio::ip::make_address(hostname, ec);
+
+    if (!ec)
+    {
+        addresses.push_back(literal);
+    }
+    else
+    {
+        addresses = lookup(hostname, family);
+    }
+
+    vector<tcp::endpoint> endpoints;
+    endpoints.reserve(addresses.size());
+
+    for (const address & address : addresses)
+    {
+        endpoints.emplace_back(address, port);
+    }
+
+    return endpoints;
+}
+
+vector<address> resolver::lookup(const string & hostname, address_family family)
+{
+    string key = hostname;
+    key += static_cast<char>('0' + static_cast<int>(family));
+
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        auto it = entries_.find(key);
+
+        if (it != entries_.end())
+        {
+            if (it->second.expires > steady_clock::now())
+            {
+                lru_.splice(lru_.begin(), lru_, it->second.lru);
+
+                if (it->second.error)
+                {
+                    throw connection_exception(it->second.error, "Cannot resolve '%1%'", hostname);
+                }
+
+                return it->second.addresses;
+            }
+
+            lru_.erase(it->second.lru);
+            entries_.erase(it);
+        }
+    }
+
+    /* The lookup itself is done without the lock, it may take a while. */
+    boost::asio::io_context io_context;
+    tcp::resolver resolver(io_context);
+    tcp::resolver::results_type results;
+    boost::system::error_code ec;
+
+    switch (family)
+    {
+    case address_family::v4:
+        results = resolver.resolve(tcp::v4(), hostname, "", ec);
+        break;
+    case address_family::v6:
+        results = resolver.resolve(tcp::v6(), hostname, "", ec);
+        break;
+    default:
+        results = resolver.resolve(hostname, "", tcp::resolver::address_configured, ec);
+        break;
+    }
+
+    entry_t entry;
+
+    if (ec == boost::asio::error::host_not_found || ec == boost::asio::error::no_data)
+    {
+        /* The host doesn't exist, this answer is worth remembering. */
+        entry.error = ec;
+        entry.expires = steady_clock::now() + negative_ttl_;
+        store(key, entry);
+    }
+
+    if (ec)
+    {
+        throw connection_exception(ec, "Cannot resolve '%1%'", hostname);
+    }
+
+    for (const auto & result : results)
+    {
+        entry.addresses.push_back(result.endpoint().address());
+    }
+
+    if (entry.addresses.empty())
+    {
+        throw connection_exception("Cannot resolve '%1%': no addresses", hostname);
+    }
+
+    entry.expires = steady_clock::now() + positive_ttl_;
+    store(key, entry);
+
+    return entry.addresses;
+}
+
+void resolver::store(const string & key, entry_t entry)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    auto it = entries_.find(key);
+
+    if (it != entries_.end())
+    {
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+    }
+
+    while (entries_.size() >= max_entries_)
+    {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+
+    lru_.push_front(key);
+    entry.lru = lru_.begin();
+    entries_.emplace(key, std::move(entry));
+}
+
+void resolver::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+
+    entries_.clear();
+    lru_.clear();
+}
+
+resolver & resolver::shared()
+{
+    static resolver instance;
+
+    return instance;
+}
+
+vector<tcp::endpoint> interleave_families(const vector<tcp::endpoint> & endpoints)
+{
+    vector<tcp::endpoint> first;
+    vector<tcp::endpoint> second;
+
+    for (const tcp::endpoint & endpoint : endpoints)
+    {
+        if (endpoint.protocol() == endpoints.front().protocol())
+        {
+            first.push_back(endpoint);
+        }
+        else
+        {
+            second.push_back(endpoint);
+        }
+    }
+
+    vector<tcp::endpoint> result;
+    result.reserve(endpoints.size());
+
+    for (size_t i = 0; i < first.size() || i < second.size(); ++i)
+    {
+        if (i < first.size())
+        {
+            result.push_back(first[i]);
+        }
+
+        if (i < second.size())
+        {
+            result.push_back(second[i]);
+        }
+    }
+
+    return result;
+}
+
+} // namespace ftp::detail
@@ -0,0 +1,109 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_RESOLVER_HPP
+#define FTP_RESOLVER_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ftp::detail
+{
+
+enum class address_family
+{
+    any,
+    v4,
+    v6
+};
+
+/* Resolves host names to addresses and remembers the answers. Successful
+ * lookups are kept for 'positive_ttl', hosts that don't exist for
+ * 'negative_ttl' (RFC 2308). Temporary failures are not cached.
+ *
+ * Address literals, including IPv6 ones with a scope id such as
+ * 'fe80::1%eth0', never reach the resolver. All methods are thread-safe.
+ */
+class resolver
+{
+public:
+    explicit resolver(std::chrono::milliseconds positive_ttl = std::chrono::seconds(60),
+                      std::chrono::milliseconds negative_ttl = std::chrono::seconds(5),
+                      std::size_t max_entries = 256);
+
+    resolver(const resolver &) = delete;
+
+    resolver & operator=(const resolver &) = delete;
+
+    /* Addresses in the order getaddrinfo sorted them (RFC 6724). Throws
+     * connection_exception if the host cannot be resolved.
+     */
+    std::vector<boost::asio::ip::tcp::endpoint> resolve(const std::string & hostname,
+                                                        std::uint16_t port,
+                                                        address_family family);
+
+    void clear();
+
+    /* The resolver all connections share. */
+    static resolver & shared();
+
+private:
+    struct entry_t
+    {
+        std::vector<boost::asio::ip::address> addresses;
+        boost::system::error_code error;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator lru;
+    };
+
+    std::vector<boost::asio::ip::address> lookup(const std::string & hostname,
+                                                 address_family family);
+
+    void store(const std::string & key, entry_t entry);
+
+    const std::chrono::milliseconds positive_ttl_;
+    const std::chrono::milliseconds negative_ttl_;
+    const std::size_t max_entries_;
+
+    std::mutex mutex_;
+    std::map<std::string, entry_t> entries_;
+    /* Most recently used keys are at the front. */
+    std::list<std::string> lru_;
+};
+
+/* Orders addresses for connection attempts as RFC 8305 section 4 suggests:
+ * alternates between the families, starting with the family of the first
+ * address.
+ */
+std::vector<boost::asio::ip::tcp::endpoint> interleave_families(
+    const std::vector<boost::asio::ip::tcp::endpoint> & endpoints);
+
+} // namespace ftp::detail
+#endif //FTP_RESOLVER_HPP
@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rtt_estimator.hpp"
+#include <algorithm>
+
+namespace ftp::detail
+{
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+/* (2.1) Until a round-trip time measurement has been made, the RTO is one
+ *       second.
+ * (2.4) Whenever RTO is computed, if it is less than 1 second, then the RTO
+ *       SHOULD be rounded up to 1 second.
+ * (2.5) A maximum value MAY be placed on RTO provided it is at least 60
+ *       seconds.
+ */
+static const rtt_estimator::duration initial_rto = seconds(1);
+static const rtt_estimator::duration min_rto = seconds(1);
+static const rtt_estimator::duration max_rto = seconds(60);
+
+/* Clock granularity G. */
+static const rtt_estimator::duration granularity = milliseconds(1);
+
+rtt_estimator::rtt_estimator()
+{
+    reset();
+}
+
+void rtt_estimator::reset()
+{
+    has_samples_ = false;
+    srtt_ = duration::zero();
+    rttvar_ = duration::zero();
+    rto_ = initial_rto;
+}
+
+/* (2.2) When the first RTT measurement R is made, the host MUST set
+ *
+ *     SRTT <- R
+ *     RTTVAR <- R/2
+ *     RTO <- SRTT + max (G, K*RTTVAR)
+ *
+ * (2.3) When a subsequent RTT measurement R' is made, a host MUST set
+ *
+ *     RTTVAR <- (1 - beta) * RTTVAR + beta * |SRTT - R'|
+ *     SRTT <- (1 - alpha) * SRTT + alpha * R'
+ *
+ * where K = 4, alpha = 1/8 and beta = 1/4.
+ */
+void rtt_estimator::sample(duration rtt)
+{
+    if (rtt < duration::zero())
+    {
+        return;
+    }
+
+    if (!has_samples_)
+    {
+        srtt_ = rtt;
+        rttvar_ = rtt / 2;
+        has_samples_ = true;
+    }
+    else
+    {
+        duration delta = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+
+        rttvar_ = (3 * rttvar_ + delta) / 4;
+        srtt_ = (7 * srtt_ + rtt) / 8;
+    }
+
+    rto_ = std::clamp(srtt_ + std::max(granularity, 4 * rttvar_), min_rto, max_rto);
+}
+
+bool rtt_estimator::has_samples() const
+{
+    return has_samples_;
+}
+
+rtt_estimator::duration rtt_estimator::srtt() const
+{
+    return srtt_;
+}
+
+rtt_estimator::duration rtt_estimator::rttvar() const
+{
+    return rttvar_;
+}
+
+rtt_estimator::duration rtt_estimator::rto() const
+{
+    return rto_;
+}
+
+milliseconds rtt_estimator::deadline(unsigned int multiplier, milliseconds floor, milliseconds ceiling) const
+{
+    milliseconds value = duration_cast<milliseconds>(rto_ * multiplier);
+
+    return std::clamp(value, floor, std::max(floor, ceiling));
+}
+
+} // namespace ftp::detail
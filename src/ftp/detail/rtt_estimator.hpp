@@ -0,0 +1,70 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_RTT_ESTIMATOR_HPP
+#define FTP_RTT_ESTIMATOR_HPP
+
+#include <chrono>
+
+namespace ftp::detail
+{
+
+/* Smoothed round-trip time and retransmission timeout, computed as described
+ * in RFC 6298: https://tools.ietf.org/html/rfc6298
+ */
+class rtt_estimator
+{
+public:
+    using duration = std::chrono::microseconds;
+
+    rtt_estimator();
+
+    void reset();
+
+    void sample(duration rtt);
+
+    bool has_samples() const;
+
+    duration srtt() const;
+
+    duration rttvar() const;
+
+    duration rto() const;
+
+    /* A deadline of 'multiplier' retransmission timeouts, but never shorter
+     * than 'floor' and never longer than 'ceiling'.
+     */
+    std::chrono::milliseconds deadline(unsigned int multiplier,
+                                       std::chrono::milliseconds floor,
+                                       std::chrono::milliseconds ceiling) const;
+
+private:
+    bool has_samples_;
+    duration srtt_;
+    duration rttvar_;
+    duration rto_;
+};
+
+} // namespace ftp::detail
+#endif //FTP_RTT_ESTIMATOR_HPP
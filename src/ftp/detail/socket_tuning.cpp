@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "socket_tuning.hpp"
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace ftp::detail
+{
+
+static void set_option(int fd, int level, int name, int value)
+{
+    /* Best effort, see the header. */
+    ::setsockopt(fd, level, name, &value, sizeof(value));
+}
+
+void apply_socket_options(boost::asio::ip::tcp::socket & socket, const socket_options & options)
+{
+    int fd = socket.native_handle();
+
+    if (options.no_delay)
+    {
+        set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+    }
+
+    /* The window scale is negotiated with the SYN, so the buffers must be
+     * sized before connecting.
+     */
+    if (options.send_buffer)
+    {
+        set_option(fd, SOL_SOCKET, SO_SNDBUF, *options.send_buffer);
+    }
+
+    if (options.receive_buffer)
+    {
+        set_option(fd, SOL_SOCKET, SO_RCVBUF, *options.receive_buffer);
+    }
+
+#ifdef TCP_NOTSENT_LOWAT
+    if (options.not_sent_lowat)
+    {
+        set_option(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, *options.not_sent_lowat);
+    }
+#endif
+
+#ifdef TCP_CONGESTION
+    if (options.congestion_control)
+    {
+        const std::string & name = *options.congestion_control;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name.data(), name.size());
+    }
+#endif
+
+    if (options.keepalive_idle || options.keepalive_interval || options.keepalive_count)
+    {
+        set_option(fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+
+#ifdef TCP_KEEPIDLE
+        if (options.keepalive_idle)
+        {
+            set_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(options.keepalive_idle->count()));
+        }
+#endif
+
+#ifdef TCP_KEEPINTVL
+        if (options.keepalive_interval)
+        {
+            set_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(options.keepalive_interval->count()));
+        }
+#endif
+
+#ifdef TCP_KEEPCNT
+        if (options.keepalive_count)
+        {
+            set_option(fd, IPPROTO_TCP, TCP_KEEPCNT, *options.keepalive_count);
+        }
+#endif
+    }
+
+    if (options.dscp)
+    {
+        /* The code point is the upper six bits of the former TOS byte. */
+        int tos = *options.dscp << 2;
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::endpoint endpoint = socket.local_endpoint(ec);
+
+        if (!ec && endpoint.address().is_v6())
+        {
+            set_option(fd, IPPROTO_IPV6, IPV6_TCLASS, tos);
+        }
+        else
+        {
+            set_option(fd, IPPROTO_IP, IP_TOS, tos);
+        }
+    }
+
+#ifdef SO_PRIORITY
+    if (options.priority)
+    {
+        set_option(fd, SOL_SOCKET, SO_PRIORITY, *options.priority);
+    }
+#endif
+}
+
+} // namespace ftp::detail
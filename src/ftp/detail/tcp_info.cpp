@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tcp_info.hpp"
+
+#ifdef __linux__
+#include <netinet/in.h>
+/* The kernel header, unlike <netinet/tcp.h>, has the newer fields. */
+#include <linux/tcp.h>
+#include <sys/socket.h>
+#include <cstddef>
+#include <cstring>
+#endif
+
+namespace ftp::detail
+{
+
+using std::chrono::microseconds;
+
+#ifdef __linux__
+
+/* Older kernels fill in only a prefix of the structure. */
+#define HAS_FIELD(field) (len >= offsetof(struct tcp_info, field) + sizeof(info.field))
+
+bool sample_tcp_info(int socket, tcp_sample & sample)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    std::memset(&info, 0, sizeof(info));
+
+    if (::getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+    {
+        return false;
+    }
+
+    sample.rtt = microseconds(info.tcpi_rtt);
+    sample.rtt_var = microseconds(info.tcpi_rttvar);
+    sample.cwnd = info.tcpi_snd_cwnd;
+    sample.mss = info.tcpi_snd_mss;
+    sample.total_retransmits = info.tcpi_total_retrans;
+
+    if (HAS_FIELD(tcpi_bytes_received))
+    {
+        sample.bytes_acked = info.tcpi_bytes_acked;
+        sample.bytes_received = info.tcpi_bytes_received;
+    }
+
+    if (HAS_FIELD(tcpi_min_rtt))
+    {
+        sample.min_rtt = microseconds(info.tcpi_min_rtt);
+    }
+
+    if (HAS_FIELD(tcpi_delivery_rate))
+    {
+        sample.delivery_rate = info.tcpi_delivery_rate;
+    }
+
+    if (HAS_FIELD(tcpi_sndbuf_limited))
+    {
+        sample.busy_time = microseconds(info.tcpi_busy_time);
+        sample.rwnd_limited = microseconds(info.tcpi_rwnd_limited);
+        sample.sndbuf_limited = microseconds(info.tcpi_sndbuf_limited);
+    }
+
+    return true;
+}
+
+#undef HAS_FIELD
+
+#else
+
+bool sample_tcp_info(int, tcp_sample &)
+{
+    return false;
+}
+
+#endif
+
+} // namespace ftp::detail
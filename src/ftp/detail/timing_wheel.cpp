@@ -0,0 +1,312 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "timing_wheel.hpp"
+#include <algorithm>
+
+namespace ftp::detail
+{
+
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+using std::pair;
+
+timing_wheel::timing_wheel(uint64_t start_tick)
+    : current_(start_tick),
+      size_(0)
+{
+    heads_.fill(nil);
+    occupied_.fill(0);
+}
+
+timing_wheel::timer_id timing_wheel::schedule(uint64_t delay, callback handler)
+{
+    uint32_t index = allocate();
+    node_t & node = nodes_[index];
+
+    node.expires = current_ + (delay > 0 ? delay : 1);
+    node.handler = std::move(handler);
+
+    link(index);
+    ++size_;
+
+    return make_id(index, node.generation);
+}
+
+bool timing_wheel::cancel(timer_id id)
+{
+    uint32_t index = static_cast<uint32_t>(id);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+    if (index >= nodes_.size())
+    {
+        return false;
+    }
+
+    node_t & node = nodes_[index];
+
+    /* Released nodes have their generation bumped, so a stale id never
+     * matches a node that was reused for another timer.
+     */
+    if (node.generation != generation || node.slot == nil)
+    {
+        return false;
+    }
+
+    unlink(index);
+    release(index);
+    --size_;
+
+    return true;
+}
+
+void timing_wheel::advance(uint64_t tick, vector<pair<timer_id, callback>> & expired)
+{
+    while (current_ < tick)
+    {
+        uint64_t block_end = current_ | slot_mask;
+
+        if (current_ < block_end)
+        {
+            /* Jump to the next occupied slot of level 0 within this round. */
+            uint64_t until = std::min(block_end, tick);
+            uint32_t slot = find_occupied(static_cast<uint32_t>(current_ & slot_mask) + 1,
+                                          static_cast<uint32_t>(until & slot_mask));
+
+            if (slot == nil)
+            {
+                current_ = until;
+                continue;
+            }
+
+            current_ = (current_ & ~uint64_t(slot_mask)) | slot;
+        }
+        else
+        {
+            /* Level 0 wraps around, bring the next round down from above. */
+            ++current_;
+            cascade();
+        }
+
+        expire(static_cast<uint32_t>(current_ & slot_mask), expired);
+    }
+}
+
+void timing_wheel::expire(uint32_t slot, vector<pair<timer_id, callback>> & expired)
+{
+    uint32_t index = heads_[slot];
+
+    while (index != nil)
+    {
+        uint32_t next = nodes_[index].next;
+        node_t & node = nodes_[index];
+
+        expired.emplace_back(make_id(index, node.generation), std::move(node.handler));
+
+        unlink(index);
+        release(index);
+        --size_;
+
+        index = next;
+    }
+}
+
+uint32_t timing_wheel::find_occupied(uint32_t from, uint32_t to) const
+{
+    while (from <= to)
+    {
+        uint64_t word = occupied_[from / 64] >> (from % 64);
+
+        if (word != 0)
+        {
+            uint32_t slot = from + static_cast<uint32_t>(__builtin_ctzll(word));
+
+            return slot <= to ? slot : nil;
+        }
+
+        from = (from / 64 + 1) * 64;
+    }
+
+    return nil;
+}
+
+void timing_wheel::mark(uint32_t slot, bool occupied)
+{
+    uint64_t bit = uint64_t(1) << (slot % 64);
+
+    if (occupied)
+    {
+        occupied_[slot / 64] |= bit;
+    }
+    else
+    {
+        occupied_[slot / 64] &= ~bit;
+    }
+}
+
+uint64_t timing_wheel::now() const
+{
+    return current_;
+}
+
+std::size_t timing_wheel::size() const
+{
+    return size_;
+}
+
+uint32_t timing_wheel::allocate()
+{
+    if (!free_.empty())
+    {
+        uint32_t index = free_.back();
+        free_.pop_back();
+
+        return index;
+    }
+
+    nodes_.push_back(node_t { 0, callback(), nil, nil, nil, 1 });
+
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void timing_wheel::release(uint32_t index)
+{
+    node_t & node = nodes_[index];
+
+    node.handler = nullptr;
+    node.slot = nil;
+    ++node.generation;
+
+    free_.push_back(index);
+}
+
+/* A timer 'delta' ticks away goes to the lowest level whose range covers
+ * the delta. The slot is picked by the bits of the expiration tick for that
+ * level, so the slot is reached exactly when the level above cascades it.
+ */
+void timing_wheel::link(uint32_t index)
+{
+    node_t & node = nodes_[index];
+
+    uint64_t expires = node.expires;
+    uint64_t delta = expires > current_ ? expires - current_ : 0;
+    uint32_t level = 0;
+
+    while (level + 1 < levels && delta >= (uint64_t(1) << ((level + 1) * slot_bits)))
+    {
+        ++level;
+    }
+
+    if (level + 1 == levels && delta >= (uint64_t(1) << (levels * slot_bits)))
+    {
+        /* Further away than the wheel reaches. Park it in the farthest slot,
+         * it is linked again with its real expiration tick when cascaded.
+         */
+        expires = current_ + (uint64_t(1) << (levels * slot_bits)) - 1;
+    }
+    else if (delta == 0)
+    {
+        /* Already due, e.g. cascaded in the tick it expires. */
+        expires = current_;
+    }
+
+    uint32_t slot = level * slots + static_cast<uint32_t>((expires >> (level * slot_bits)) & slot_mask);
+
+    node.slot = slot;
+    node.prev = nil;
+    node.next = heads_[slot];
+
+    if (node.next != nil)
+    {
+        nodes_[node.next].prev = index;
+    }
+
+    heads_[slot] = index;
+    mark(slot, true);
+}
+
+void timing_wheel::unlink(uint32_t index)
+{
+    node_t & node = nodes_[index];
+
+    if (node.prev != nil)
+    {
+        nodes_[node.prev].next = node.next;
+    }
+    else
+    {
+        heads_[node.slot] = node.next;
+
+        if (node.next == nil)
+        {
+            mark(node.slot, false);
+        }
+    }
+
+    if (node.next != nil)
+    {
+        nodes_[node.next].prev = node.prev;
+    }
+
+    node.prev = nil;
+    node.next = nil;
+}
+
+/* Moves the timers of the current slot of each higher level one level down,
+ * as long as the lower level has just wrapped around.
+ */
+void timing_wheel::cascade()
+{
+    for (uint32_t level = 1; level < levels; ++level)
+    {
+        uint32_t position = static_cast<uint32_t>((current_ >> (level * slot_bits)) & slot_mask);
+        uint32_t slot = level * slots + position;
+        uint32_t index = heads_[slot];
+
+        heads_[slot] = nil;
+        mark(slot, false);
+
+        while (index != nil)
+        {
+            uint32_t next = nodes_[index].next;
+
+            link(index);
+
+            index = next;
+        }
+
+        if (position != 0)
+        {
+            break;
+        }
+    }
+}
+
+timing_wheel::timer_id timing_wheel::make_id(uint32_t index, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | index;
+}
+
+} // namespace ftp::detail
@@ -0,0 +1,120 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_TIMING_WHEEL_HPP
+#define FTP_TIMING_WHEEL_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace ftp::detail
+{
+
+/* Hierarchical timing wheel: scheduling and cancelling a timer is O(1), and
+ * advancing the wheel by one tick costs O(1) plus the expired timers. Timers
+ * further away than the lowest level can hold are kept on coarser levels and
+ * moved down as their time comes closer. Empty slots are skipped with the
+ * help of an occupancy bitmap, so idle stretches cost next to nothing.
+ *
+ * Varghese, Lauck: Hashed and Hierarchical Timing Wheels, 1987.
+ *
+ * Not thread-safe, see timer_service.
+ */
+class timing_wheel
+{
+public:
+    using callback = std::function<void()>;
+
+    /* Zero is never a valid id. */
+    using timer_id = std::uint64_t;
+
+    explicit timing_wheel(std::uint64_t start_tick = 0);
+
+    timing_wheel(const timing_wheel &) = delete;
+
+    timing_wheel & operator=(const timing_wheel &) = delete;
+
+    /* Schedules the callback to expire 'delay' ticks from now, at least one. */
+    timer_id schedule(std::uint64_t delay, callback handler);
+
+    /* Returns false if the timer has already expired or been cancelled. */
+    bool cancel(timer_id id);
+
+    /* Advances the wheel up to and including 'tick'. Callbacks of the expired
+     * timers are appended to 'expired' with their ids, in expiration order.
+     */
+    void advance(std::uint64_t tick, std::vector<std::pair<timer_id, callback>> & expired);
+
+    std::uint64_t now() const;
+
+    std::size_t size() const;
+
+private:
+    static constexpr unsigned int slot_bits = 8;
+    static constexpr unsigned int levels = 4;
+    static constexpr std::uint32_t slots = 1u << slot_bits;
+    static constexpr std::uint32_t slot_mask = slots - 1;
+    static constexpr std::uint32_t nil = UINT32_MAX;
+
+    struct node_t
+    {
+        std::uint64_t expires;
+        callback handler;
+        std::uint32_t prev;
+        std::uint32_t next;
+        std::uint32_t slot;
+        std::uint32_t generation;
+    };
+
+    std::uint32_t allocate();
+
+    void release(std::uint32_t index);
+
+    void link(std::uint32_t index);
+
+    void unlink(std::uint32_t index);
+
+    void cascade();
+
+    void expire(std::uint32_t slot, std::vector<std::pair<timer_id, callback>> & expired);
+
+    /* The first occupied slot of level 0 in [from, to], or 'nil'. */
+    std::uint32_t find_occupied(std::uint32_t from, std::uint32_t to) const;
+
+    void mark(std::uint32_t slot, bool occupied);
+
+    static timer_id make_id(std::uint32_t index, std::uint32_t generation);
+
+    std::uint64_t current_;
+    std::size_t size_;
+    std::vector<node_t> nodes_;
+    std::vector<std::uint32_t> free_;
+    std::array<std::uint32_t, levels * slots> heads_;
+    std::array<std::uint64_t, levels * slots / 64> occupied_;
+};
+
+} // namespace ftp::detail
+#endif //FTP_TIMING_WHEEL_HPP
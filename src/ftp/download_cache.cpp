@@ -0,0 +1,413 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "download_cache.hpp"
+#include "ftp_exception.hpp"
+#include "detail/md5.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ftp
+{
+
+using std::string;
+
+namespace
+{
+
+enum class placement
+{
+    none,
+    reflink,
+    hard_link,
+    copy
+};
+
+} // namespace
+
+static bool copy_contents(int from, int to)
+{
+    bool copied = false;
+
+    /* In the kernel, and by sharing extents where the file system can. */
+    for (;;)
+    {
+        ssize_t len = ::copy_file_range(from, nullptr, to, nullptr, 1 << 30, 0);
+
+        if (len == 0)
+        {
+            return true;
+        }
+        else if (len > 0)
+        {
+            copied = true;
+        }
+        else if (errno != EINTR)
+        {
+            break;
+        }
+    }
+
+    if (copied)
+    {
+        return false;
+    }
+
+    std::vector<char> buffer(64 * 1024);
+
+    for (;;)
+    {
+        ssize_t len = ::read(from, buffer.data(), buffer.size());
+
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (len <= 0)
+        {
+            return len == 0;
+        }
+
+        for (ssize_t written = 0; written < len;)
+        {
+            ssize_t n = ::write(to, buffer.data() + written, len - written);
+
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (n <= 0)
+            {
+                return false;
+            }
+
+            written += n;
+        }
+    }
+}
+
+static placement clone_or_copy(int from, int to)
+{
+    if (::ioctl(to, FICLONE, from) == 0)
+    {
+        return placement::reflink;
+    }
+
+    return copy_contents(from, to) ? placement::copy : placement::none;
+}
+
+download_cache::download_cache(const string & directory, std::uint64_t max_bytes)
+    : directory_(directory),
+      max_bytes_(max_bytes),
+      bytes_(0),
+      temporaries_(0),
+      allow_hard_links_(false),
+      hits_(0),
+      misses_(0),
+      reflinks_(0),
+      hard_links_(0),
+      copies_(0),
+      stores_(0),
+      evictions_(0)
+{
+    load();
+}
+
+bool download_cache::fetch(const string & key, const string & local_file)
+{
+    const string name = file_name(key);
+    const string path = file_path(name);
+    bool hard_link;
+    int from;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(name);
+
+        if (it == entries_.end())
+        {
+            ++misses_;
+            return false;
+        }
+
+        from = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (from < 0)
+        {
+            /* Deleted by someone else. */
+            bytes_ -= it->second.size;
+            lru_.erase(it->second.lru);
+            entries_.erase(it);
+            ++misses_;
+            return false;
+        }
+
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        hard_link = allow_hard_links_;
+
+        /* So the order survives a restart. */
+        ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    }
+
+    /* The cached copy may be evicted from here on, but stays readable
+     * through 'from'.
+     */
+    placement placed = placement::none;
+    int to = ::open(local_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (to >= 0)
+    {
+        if (::ioctl(to, FICLONE, from) == 0)
+        {
+            placed = placement::reflink;
+        }
+        else if (hard_link)
+        {
+            ::close(to);
+            ::unlink(local_file.c_str());
+
+            if (::link(path.c_str(), local_file.c_str()) == 0)
+            {
+                placed = placement::hard_link;
+                to = -1;
+            }
+            else
+            {
+                to = ::open(local_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+                if (to >= 0 && copy_contents(from, to))
+                {
+                    placed = placement::copy;
+                }
+            }
+        }
+        else if (copy_contents(from, to))
+        {
+            placed = placement::copy;
+        }
+
+        if (to >= 0)
+        {
+            ::close(to);
+        }
+
+        if (placed == placement::none)
+        {
+            ::unlink(local_file.c_str());
+        }
+    }
+
+    ::close(from);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    switch (placed)
+    {
+    case placement::none:
+        ++misses_;
+        return false;
+    case placement::reflink:
+        ++reflinks_;
+        break;
+    case placement::hard_link:
+        ++hard_links_;
+        break;
+    case placement::copy:
+        ++copies_;
+        break;
+    }
+
+    ++hits_;
+
+    return true;
+}
+
+bool download_cache::store(const string & key, const string & local_file)
+{
+    const string name = file_name(key);
+    string temporary;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        temporary = file_path(name + ".tmp." + std::to_string(temporaries_++));
+    }
+
+    struct stat info;
+    int from = ::open(local_file.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (from < 0)
+    {
+        return false;
+    }
+
+    if (::fstat(from, &info) != 0 || static_cast<std::uint64_t>(info.st_size) > max_bytes_)
+    {
+        ::close(from);
+        return false;
+    }
+
+    /* Read-only, as hits may be hard links to it. */
+    int to = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0444);
+    bool written = to >= 0 && clone_or_copy(from, to) != placement::none && ::fdatasync(to) == 0;
+
+    ::close(from);
+
+    if (to >= 0)
+    {
+        ::close(to);
+    }
+
+    if (!written)
+    {
+        ::unlink(temporary.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (std::rename(temporary.c_str(), file_path(name).c_str()) != 0)
+    {
+        ::unlink(temporary.c_str());
+        return false;
+    }
+
+    auto it = entries_.find(name);
+
+    if (it != entries_.end())
+    {
+        bytes_ -= it->second.size;
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+    }
+
+    lru_.push_front(name);
+    entries_.emplace(name, entry_t{ static_cast<std::uint64_t>(info.st_size), lru_.begin() });
+    bytes_ += info.st_size;
+    ++stores_;
+    evict();
+
+    return true;
+}
+
+void download_cache::set_hard_links(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    allow_hard_links_ = enabled;
+}
+
+download_cache::stats download_cache::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return { hits_, misses_, reflinks_, hard_links_, copies_, stores_, evictions_, bytes_, entries_.size() };
+}
+
+string download_cache::file_name(const string & key)
+{
+    detail::md5 hash;
+
+    hash.update(key.data(), key.size());
+
+    return hash.hex_digest();
+}
+
+string download_cache::file_path(const string & name) const
+{
+    return directory_ + "/" + name;
+}
+
+void download_cache::load()
+{
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    std::vector<std::tuple<fs::file_time_type, string, std::uint64_t>> files;
+
+    fs::create_directories(directory_, ec);
+
+    for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec))
+    {
+        string name = it->path().filename().string();
+        std::error_code file_ec;
+
+        if (name.find(".tmp.") != string::npos)
+        {
+            /* Left by a store that didn't finish. */
+            fs::remove(it->path(), file_ec);
+        }
+        else if (name.size() == 32 && name.find_first_not_of("0123456789ABCDEF") == string::npos &&
+                 it->is_regular_file(file_ec))
+        {
+            std::uint64_t size = it->file_size(file_ec);
+            fs::file_time_type used = it->last_write_time(file_ec);
+
+            if (!file_ec)
+            {
+                files.emplace_back(used, name, size);
+            }
+        }
+    }
+
+    if (ec)
+    {
+        throw ftp_exception("Cannot open cache directory '%1%'.", directory_);
+    }
+
+    std::sort(files.begin(), files.end());
+
+    for (const auto & file : files)
+    {
+        lru_.push_front(std::get<1>(file));
+        entries_.emplace(std::get<1>(file), entry_t{ std::get<2>(file), lru_.begin() });
+        bytes_ += std::get<2>(file);
+    }
+
+    evict();
+}
+
+void download_cache::evict()
+{
+    while (bytes_ > max_bytes_ && !lru_.empty())
+    {
+        auto it = entries_.find(lru_.back());
+
+        ::unlink(file_path(it->first).c_str());
+        bytes_ -= it->second.size;
+        entries_.erase(it);
+        lru_.pop_back();
+        ++evictions_;
+    }
+}
+
+} // namespace ftp
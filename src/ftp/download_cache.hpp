@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_DOWNLOAD_CACHE_HPP
+#define FTP_DOWNLOAD_CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ftp
+{
+
+/* Keeps copies of downloaded files in a directory, by key, so a file
+ * downloaded before is placed again without a transfer. A hit is a reflink
+ * of the cached copy where the file system supports it, else a copy.
+ *
+ * Copies are written to a temporary file and renamed into place, so a
+ * cached file is always whole. The least recently used copies are deleted
+ * when the cache holds more than 'max_bytes'. The directory may be reused
+ * after a restart.
+ *
+ * A cache may be shared by several clients, all methods are thread-safe.
+ * It must not be used by several processes at once.
+ */
+class download_cache
+{
+public:
+    struct stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        /* How hits were placed. */
+        std::uint64_t reflinks;
+        std::uint64_t hard_links;
+        std::uint64_t copies;
+        std::uint64_t stores;
+        std::uint64_t evictions;
+        std::uint64_t bytes;
+        std::size_t entries;
+    };
+
+    download_cache(const std::string & directory, std::uint64_t max_bytes);
+
+    download_cache(const download_cache &) = delete;
+
+    download_cache & operator=(const download_cache &) = delete;
+
+    /* Places the file cached by the key at 'local_file', which must not
+     * exist. False if there is none.
+     */
+    bool fetch(const std::string & key, const std::string & local_file);
+
+    /* Caches the contents of the file by the key, replacing what was
+     * cached by it. False if the file can't be cached.
+     */
+    bool store(const std::string & key, const std::string & local_file);
+
+    /* Lets hits be hard links to the cached copy where reflinks aren't
+     * supported, which saves the copy. The file placed is then the cached
+     * copy itself and read-only; make a copy of it before changing it.
+     * Off by default.
+     */
+    void set_hard_links(bool enabled);
+
+    stats get_stats() const;
+
+private:
+    struct entry_t
+    {
+        std::uint64_t size;
+        std::list<std::string>::iterator lru;
+    };
+
+    /* The file a key is cached in, named by the MD5 of the key. */
+    static std::string file_name(const std::string & key);
+
+    std::string file_path(const std::string & name) const;
+
+    void load();
+
+    /* Deletes the least recently used copies until the budget is met. */
+    void evict();
+
+    const std::string directory_;
+    const std::uint64_t max_bytes_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, entry_t> entries_;
+    /* Most recently used names are at the front. */
+    std::list<std::string> lru_;
+    std::uint64_t bytes_;
+    std::uint64_t temporaries_;
+    bool allow_hard_links_;
+    std::uint64_t hits_;
+    std::uint64_t misses_;
+    std::uint64_t reflinks_;
+    std::uint64_t hard_links_;
+    std::uint64_t copies_;
+    std::uint64_t stores_;
+    std::uint64_t evictions_;
+};
+
+} // namespace ftp
+#endif //FTP_DOWNLOAD_CACHE_HPP
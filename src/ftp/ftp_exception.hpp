@@ -54,5 +54,17 @@ private:
     std::string message_;
 };
 
+/* An operation didn't complete before its deadline and the connection was
+ * closed. Open a new connection to retry.
+ */
+class timeout_exception : public ftp_exception
+{
+public:
+    explicit timeout_exception(const detail::timeout_exception & ex)
+        : ftp_exception(ex)
+    {
+    }
+};
+
 } // namespace ftp
 #endif //FTP_EXCEPTION_HPP
@@ -0,0 +1,66 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_LIST_ENTRY_HPP
+#define FTP_LIST_ENTRY_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace ftp
+{
+
+struct list_entry
+{
+    enum class entry_type
+    {
+        file,
+        directory,
+        link,
+        unknown
+    };
+
+    list_entry()
+        : type(entry_type::unknown),
+          size(0)
+    {
+    }
+
+    bool is_directory() const
+    {
+        return type == entry_type::directory;
+    }
+
+    std::string name;
+    entry_type type;
+    std::uint64_t size;
+    std::string permissions;
+    /* Modification time as printed by the server, e.g. 'Jan 01 00:00'. */
+    std::string modified;
+    /* Only set for symbolic links. */
+    std::string link_target;
+};
+
+} // namespace ftp
+#endif //FTP_LIST_ENTRY_HPP
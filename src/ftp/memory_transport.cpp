@@ -0,0 +1,639 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "memory_transport.hpp"
+#include <boost/asio/error.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/system/system_error.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ftp
+{
+
+namespace detail
+{
+
+/* One direction of a connection. */
+struct memory_pipe
+{
+    std::mutex mutex;
+    std::condition_variable readable;
+    std::condition_variable writable;
+    /* A ring buffer, allocated on the first write. */
+    std::vector<char> data;
+    /* Where the unread data starts, and how much there is. */
+    std::size_t head = 0;
+    std::size_t size = 0;
+    /* The writer has shut down, the reader gets eof once the data is
+     * drained.
+     */
+    bool write_closed = false;
+    /* The reader has shut down, writes fail. */
+    bool read_closed = false;
+    /* Asynchronous operations waiting for the state to change. They are
+     * retried with the mutex held and return true once they have completed.
+     */
+    std::function<bool()> pending_read;
+    std::function<bool()> pending_write;
+};
+
+struct memory_listener
+{
+    std::string host;
+    std::uint16_t port;
+    std::mutex mutex;
+    std::condition_variable arrived;
+    /* Connections waiting to be accepted, as the pipes of the server's end. */
+    std::deque<std::pair<std::shared_ptr<memory_pipe>, std::shared_ptr<memory_pipe>>> backlog;
+    bool closed = false;
+};
+
+} // namespace detail
+
+using std::size_t;
+using std::string;
+using std::uint16_t;
+using std::shared_ptr;
+using std::make_shared;
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+using detail::memory_pipe;
+using detail::memory_listener;
+
+/* What a socket buffer of a loopback connection typically holds. */
+static const size_t pipe_capacity = 256 * 1024;
+
+/* Ports chosen for acceptors listening on port zero. */
+static const uint16_t first_ephemeral_port = 49152;
+
+using listener_key = std::pair<string, uint16_t>;
+
+static mutex registry_mutex;
+
+static std::map<listener_key, shared_ptr<memory_listener>> & registry()
+{
+    static std::map<listener_key, shared_ptr<memory_listener>> listeners;
+
+    return listeners;
+}
+
+static size_t available(const memory_pipe & pipe)
+{
+    return pipe.size;
+}
+
+static bool try_read(memory_pipe & pipe, char *data, size_t size, size_t & len, boost::system::error_code & ec)
+{
+    len = 0;
+
+    if (pipe.read_closed)
+    {
+        ec = boost::asio::error::operation_aborted;
+        return true;
+    }
+
+    if (available(pipe) > 0)
+    {
+        len = std::min(size, available(pipe));
+
+        size_t first = std::min(len, pipe_capacity - pipe.head);
+        std::memcpy(data, pipe.data.data() + pipe.head, first);
+        std::memcpy(data + first, pipe.data.data(), len - first);
+
+        pipe.head = (pipe.head + len) % pipe_capacity;
+        pipe.size -= len;
+
+        ec.clear();
+        return true;
+    }
+
+    if (pipe.write_closed)
+    {
+        ec = boost::asio::error::eof;
+        return true;
+    }
+
+    return false;
+}
+
+static bool try_write(memory_pipe & pipe, const char *data, size_t size, size_t & len, boost::system::error_code & ec)
+{
+    len = 0;
+
+    if (pipe.write_closed || pipe.read_closed)
+    {
+        ec = boost::asio::error::broken_pipe;
+        return true;
+    }
+
+    /* Like the low-water mark of a socket, the writer waits for room for
+     * a good part of its data rather than trickling it in, which would wake
+     * it up for every read.
+     */
+    if (pipe_capacity - available(pipe) < std::min(size, pipe_capacity / 2))
+    {
+        return false;
+    }
+
+    len = std::min(size, pipe_capacity - available(pipe));
+    pipe.data.resize(pipe_capacity);
+
+    size_t tail = (pipe.head + pipe.size) % pipe_capacity;
+    size_t first = std::min(len, pipe_capacity - tail);
+    std::memcpy(pipe.data.data() + tail, data, first);
+    std::memcpy(pipe.data.data(), data + first, len - first);
+
+    pipe.size += len;
+
+    ec.clear();
+    return true;
+}
+
+/* Retries the pending operations until neither makes progress, a read may
+ * make room for a write and a write may feed a read. Called with the mutex
+ * held.
+ */
+static void progress(memory_pipe & pipe)
+{
+    bool progressed = true;
+
+    while (progressed)
+    {
+        progressed = false;
+
+        if (pipe.pending_read && pipe.pending_read())
+        {
+            pipe.pending_read = nullptr;
+            progressed = true;
+        }
+
+        if (pipe.pending_write && pipe.pending_write())
+        {
+            pipe.pending_write = nullptr;
+            progressed = true;
+        }
+    }
+
+    /* Blocked writers wait for half of the pipe to drain, see 'try_write'.
+     * Waking them up earlier would only put them back to sleep.
+     */
+    bool closed = pipe.read_closed || pipe.write_closed;
+
+    if (available(pipe) > 0 || closed)
+    {
+        pipe.readable.notify_all();
+    }
+
+    if (available(pipe) <= pipe_capacity / 2 || closed)
+    {
+        pipe.writable.notify_all();
+    }
+}
+
+static void close_reading(memory_pipe & pipe)
+{
+    lock_guard<mutex> lock(pipe.mutex);
+
+    pipe.read_closed = true;
+    progress(pipe);
+}
+
+static void close_writing(memory_pipe & pipe)
+{
+    lock_guard<mutex> lock(pipe.mutex);
+
+    pipe.write_closed = true;
+    progress(pipe);
+}
+
+void memory_transport::connect(socket & socket,
+                               const string & host,
+                               uint16_t port,
+                               boost::system::error_code & ec)
+{
+    if (socket.is_open())
+    {
+        ec = boost::asio::error::already_connected;
+        return;
+    }
+
+    shared_ptr<memory_listener> listener;
+
+    {
+        lock_guard<mutex> lock(registry_mutex);
+
+        auto it = registry().find(listener_key(host, port));
+
+        if (it != registry().end())
+        {
+            listener = it->second;
+        }
+    }
+
+    shared_ptr<memory_pipe> to_server = make_shared<memory_pipe>();
+    shared_ptr<memory_pipe> to_client = make_shared<memory_pipe>();
+
+    if (listener)
+    {
+        lock_guard<mutex> lock(listener->mutex);
+
+        if (!listener->closed)
+        {
+            listener->backlog.emplace_back(to_server, to_client);
+            listener->arrived.notify_one();
+
+            socket.attach(to_client, to_server);
+            ec.clear();
+            return;
+        }
+    }
+
+    ec = boost::asio::error::connection_refused;
+}
+
+void memory_transport::connect_data(socket & socket,
+                                    const string & host,
+                                    uint16_t port,
+                                    boost::system::error_code & ec)
+{
+    connect(socket, host, port, ec);
+}
+
+bool memory_transport::is_alive(socket & socket)
+{
+    if (!socket.is_open())
+    {
+        return false;
+    }
+
+    lock_guard<mutex> lock(socket.in_->mutex);
+
+    return available(*socket.in_) == 0 && !socket.in_->write_closed && !socket.in_->read_closed;
+}
+
+memory_transport::socket::socket(boost::asio::io_context & io_context)
+    : io_context_(io_context)
+{
+}
+
+memory_transport::socket::~socket()
+{
+    boost::system::error_code ignored;
+
+    close(ignored);
+}
+
+memory_transport::socket::executor_type memory_transport::socket::get_executor()
+{
+    return io_context_.get_executor();
+}
+
+bool memory_transport::socket::is_open() const
+{
+    return in_ != nullptr;
+}
+
+void memory_transport::socket::close()
+{
+    boost::system::error_code ec;
+
+    close(ec);
+    throw_if(ec);
+}
+
+void memory_transport::socket::close(boost::system::error_code & ec)
+{
+    if (in_)
+    {
+        /* Pending operations complete with an error, the peer reads eof. */
+        close_reading(*in_);
+        close_writing(*out_);
+
+        in_.reset();
+        out_.reset();
+    }
+
+    ec.clear();
+}
+
+void memory_transport::socket::shutdown(boost::asio::socket_base::shutdown_type what,
+                                        boost::system::error_code & ec)
+{
+    if (!is_open())
+    {
+        ec = boost::asio::error::bad_descriptor;
+        return;
+    }
+
+    if (what != boost::asio::socket_base::shutdown_send)
+    {
+        close_reading(*in_);
+    }
+
+    if (what != boost::asio::socket_base::shutdown_receive)
+    {
+        close_writing(*out_);
+    }
+
+    ec.clear();
+}
+
+void memory_transport::socket::throw_if(const boost::system::error_code & ec)
+{
+    if (ec)
+    {
+        throw boost::system::system_error(ec);
+    }
+}
+
+void memory_transport::socket::attach(shared_ptr<memory_pipe> in, shared_ptr<memory_pipe> out)
+{
+    in_ = std::move(in);
+    out_ = std::move(out);
+}
+
+size_t memory_transport::socket::read(char *data, size_t size, boost::system::error_code & ec)
+{
+    if (!is_open())
+    {
+        ec = boost::asio::error::bad_descriptor;
+        return 0;
+    }
+
+    size_t len = 0;
+
+    if (size == 0)
+    {
+        ec.clear();
+        return len;
+    }
+
+    unique_lock<mutex> lock(in_->mutex);
+
+    in_->readable.wait(lock, [&]()
+    {
+        return try_read(*in_, data, size, len, ec);
+    });
+
+    progress(*in_);
+
+    return len;
+}
+
+size_t memory_transport::socket::write(const char *data, size_t size, boost::system::error_code & ec)
+{
+    if (!is_open())
+    {
+        ec = boost::asio::error::bad_descriptor;
+        return 0;
+    }
+
+    size_t len = 0;
+
+    if (size == 0)
+    {
+        ec.clear();
+        return len;
+    }
+
+    unique_lock<mutex> lock(out_->mutex);
+
+    out_->writable.wait(lock, [&]()
+    {
+        return try_write(*out_, data, size, len, ec);
+    });
+
+    progress(*out_);
+
+    return len;
+}
+
+void memory_transport::socket::start_read(char *data, size_t size, completion complete)
+{
+    boost::asio::io_context & io_context = io_context_;
+
+    if (!is_open() || size == 0)
+    {
+        boost::system::error_code ec;
+
+        if (!is_open())
+        {
+            ec = boost::asio::error::bad_descriptor;
+        }
+
+        boost::asio::post(io_context, [complete, ec]()
+        {
+            complete(ec, 0);
+        });
+
+        return;
+    }
+
+    /* Keeps the io_context running while the read waits for data. */
+    auto work = make_shared<boost::asio::executor_work_guard<executor_type>>(io_context.get_executor());
+    memory_pipe *pipe = in_.get();
+
+    auto attempt = [pipe, data, size, complete, work, &io_context]()
+    {
+        size_t len;
+        boost::system::error_code ec;
+
+        if (!try_read(*pipe, data, size, len, ec))
+        {
+            return false;
+        }
+
+        boost::asio::post(io_context, [complete, ec, len]()
+        {
+            complete(ec, len);
+        });
+
+        return true;
+    };
+
+    lock_guard<mutex> lock(pipe->mutex);
+
+    pipe->pending_read = attempt;
+    progress(*pipe);
+}
+
+void memory_transport::socket::start_write(const char *data, size_t size, completion complete)
+{
+    boost::asio::io_context & io_context = io_context_;
+
+    if (!is_open() || size == 0)
+    {
+        boost::system::error_code ec;
+
+        if (!is_open())
+        {
+            ec = boost::asio::error::bad_descriptor;
+        }
+
+        boost::asio::post(io_context, [complete, ec]()
+        {
+            complete(ec, 0);
+        });
+
+        return;
+    }
+
+    auto work = make_shared<boost::asio::executor_work_guard<executor_type>>(io_context.get_executor());
+    memory_pipe *pipe = out_.get();
+
+    auto attempt = [pipe, data, size, complete, work, &io_context]()
+    {
+        size_t len;
+        boost::system::error_code ec;
+
+        if (!try_write(*pipe, data, size, len, ec))
+        {
+            return false;
+        }
+
+        boost::asio::post(io_context, [complete, ec, len]()
+        {
+            complete(ec, len);
+        });
+
+        return true;
+    };
+
+    lock_guard<mutex> lock(pipe->mutex);
+
+    pipe->pending_write = attempt;
+    progress(*pipe);
+}
+
+memory_transport::acceptor::acceptor(const string & host, uint16_t port)
+    : listener_(make_shared<memory_listener>())
+{
+    lock_guard<mutex> lock(registry_mutex);
+
+    if (port == 0)
+    {
+        for (uint32_t candidate = first_ephemeral_port; candidate <= UINT16_MAX; ++candidate)
+        {
+            if (registry().count(listener_key(host, candidate)) == 0)
+            {
+                port = static_cast<uint16_t>(candidate);
+                break;
+            }
+        }
+    }
+
+    if (port == 0 || registry().count(listener_key(host, port)) > 0)
+    {
+        throw boost::system::system_error(boost::asio::error::address_in_use);
+    }
+
+    listener_->host = host;
+    listener_->port = port;
+    registry()[listener_key(host, port)] = listener_;
+}
+
+memory_transport::acceptor::~acceptor()
+{
+    close();
+}
+
+uint16_t memory_transport::acceptor::port() const
+{
+    return listener_->port;
+}
+
+void memory_transport::acceptor::accept(socket & peer)
+{
+    if (peer.is_open())
+    {
+        throw boost::system::system_error(boost::asio::error::already_open);
+    }
+
+    unique_lock<mutex> lock(listener_->mutex);
+
+    listener_->arrived.wait(lock, [this]()
+    {
+        return !listener_->backlog.empty() || listener_->closed;
+    });
+
+    if (listener_->backlog.empty())
+    {
+        throw boost::system::system_error(boost::asio::error::operation_aborted);
+    }
+
+    peer.attach(listener_->backlog.front().first, listener_->backlog.front().second);
+    listener_->backlog.pop_front();
+}
+
+void memory_transport::acceptor::close()
+{
+    {
+        lock_guard<mutex> lock(registry_mutex);
+
+        auto it = registry().find(listener_key(listener_->host, listener_->port));
+
+        if (it != registry().end() && it->second == listener_)
+        {
+            registry().erase(it);
+        }
+    }
+
+    lock_guard<mutex> lock(listener_->mutex);
+
+    listener_->closed = true;
+
+    for (auto & [in, out] : listener_->backlog)
+    {
+        close_reading(*in);
+        close_writing(*out);
+    }
+
+    listener_->backlog.clear();
+    listener_->arrived.notify_all();
+}
+
+std::function<void()> interrupter(memory_transport::socket & socket)
+{
+    shared_ptr<memory_pipe> in = socket.in_;
+    shared_ptr<memory_pipe> out = socket.out_;
+
+    return [in, out]()
+    {
+        if (in)
+        {
+            close_reading(*in);
+            close_writing(*out);
+        }
+    };
+}
+
+} // namespace ftp
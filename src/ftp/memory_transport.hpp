@@ -0,0 +1,264 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FTP_MEMORY_TRANSPORT_HPP
+#define FTP_MEMORY_TRANSPORT_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace ftp
+{
+
+namespace detail
+{
+
+struct memory_pipe;
+struct memory_listener;
+
+} // namespace detail
+
+/* Connections within the process, so the client can be tested and
+ * benchmarked without kernel sockets or a server process. Acceptors listen
+ * on a host and port of their own namespace, unrelated to the system's
+ * addresses, and 'connect' reaches them there.
+ *
+ * A connection is a pair of bounded pipes. A full pipe holds up the writer
+ * like a full socket buffer does, so a fast writer can't run away from a
+ * slow reader.
+ */
+class memory_transport
+{
+public:
+    class socket;
+
+    class acceptor;
+
+    static constexpr bool is_tcp = false;
+
+    static constexpr bool is_tls = false;
+
+    /* Fails with 'connection_refused' if nobody listens on the host and
+     * port.
+     */
+    static void connect(socket & socket,
+                        const std::string & host,
+                        std::uint16_t port,
+                        boost::system::error_code & ec);
+
+    /* Data connections go to host and port like control connections. */
+    static void connect_data(socket & socket,
+                             const std::string & host,
+                             std::uint16_t port,
+                             boost::system::error_code & ec);
+
+    static bool is_alive(socket & socket);
+};
+
+/* The asynchronous operations complete on the io_context the socket was
+ * created with, the blocking ones are meant for servers running on threads
+ * of their own. Like with asio's sockets, only one read and one write may
+ * be pending at a time.
+ */
+class memory_transport::socket
+{
+public:
+    using executor_type = boost::asio::io_context::executor_type;
+
+    explicit socket(boost::asio::io_context & io_context);
+
+    ~socket();
+
+    socket(const socket &) = delete;
+
+    socket & operator=(const socket &) = delete;
+
+    executor_type get_executor();
+
+    bool is_open() const;
+
+    void close();
+
+    void close(boost::system::error_code & ec);
+
+    void shutdown(boost::asio::socket_base::shutdown_type what, boost::system::error_code & ec);
+
+    template<typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence & buffers, boost::system::error_code & ec)
+    {
+        boost::asio::mutable_buffer buffer = first_buffer<boost::asio::mutable_buffer>(buffers);
+
+        return read(static_cast<char *>(buffer.data()), buffer.size(), ec);
+    }
+
+    template<typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence & buffers)
+    {
+        boost::system::error_code ec;
+        std::size_t len = read_some(buffers, ec);
+
+        throw_if(ec);
+
+        return len;
+    }
+
+    template<typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence & buffers, boost::system::error_code & ec)
+    {
+        boost::asio::const_buffer buffer = first_buffer<boost::asio::const_buffer>(buffers);
+
+        return write(static_cast<const char *>(buffer.data()), buffer.size(), ec);
+    }
+
+    template<typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence & buffers)
+    {
+        boost::system::error_code ec;
+        std::size_t len = write_some(buffers, ec);
+
+        throw_if(ec);
+
+        return len;
+    }
+
+    template<typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(const MutableBufferSequence & buffers, ReadHandler && handler)
+    {
+        boost::asio::mutable_buffer buffer = first_buffer<boost::asio::mutable_buffer>(buffers);
+
+        start_read(static_cast<char *>(buffer.data()), buffer.size(),
+                   wrap(std::forward<ReadHandler>(handler)));
+    }
+
+    template<typename ConstBufferSequence, typename WriteHandler>
+    void async_write_some(const ConstBufferSequence & buffers, WriteHandler && handler)
+    {
+        boost::asio::const_buffer buffer = first_buffer<boost::asio::const_buffer>(buffers);
+
+        start_write(static_cast<const char *>(buffer.data()), buffer.size(),
+                    wrap(std::forward<WriteHandler>(handler)));
+    }
+
+private:
+    friend class memory_transport;
+
+    friend class acceptor;
+
+    friend std::function<void()> interrupter(socket & socket);
+
+    using completion = std::function<void(const boost::system::error_code &, std::size_t)>;
+
+    /* Like asio's sockets, an operation on a sequence of buffers only uses
+     * the first one that isn't empty.
+     */
+    template<typename Buffer, typename BufferSequence>
+    static Buffer first_buffer(const BufferSequence & buffers)
+    {
+        auto end = boost::asio::buffer_sequence_end(buffers);
+
+        for (auto it = boost::asio::buffer_sequence_begin(buffers); it != end; ++it)
+        {
+            Buffer buffer(*it);
+
+            if (buffer.size() > 0)
+            {
+                return buffer;
+            }
+        }
+
+        return Buffer();
+    }
+
+    /* Handlers may be move-only, the completion must be copyable. */
+    template<typename Handler>
+    static completion wrap(Handler && handler)
+    {
+        auto shared = std::make_shared<std::decay_t<Handler>>(std::forward<Handler>(handler));
+
+        return [shared](const boost::system::error_code & ec, std::size_t len)
+        {
+            (*shared)(ec, len);
+        };
+    }
+
+    static void throw_if(const boost::system::error_code & ec);
+
+    void attach(std::shared_ptr<detail::memory_pipe> in, std::shared_ptr<detail::memory_pipe> out);
+
+    std::size_t read(char *data, std::size_t size, boost::system::error_code & ec);
+
+    std::size_t write(const char *data, std::size_t size, boost::system::error_code & ec);
+
+    void start_read(char *data, std::size_t size, completion complete);
+
+    void start_write(const char *data, std::size_t size, completion complete);
+
+    boost::asio::io_context & io_context_;
+    std::shared_ptr<detail::memory_pipe> in_;
+    std::shared_ptr<detail::memory_pipe> out_;
+};
+
+class memory_transport::acceptor
+{
+public:
+    /* Listens on the host and port, on an unused port if it is zero. Throws
+     * boost::system::system_error if somebody listens there already.
+     */
+    explicit acceptor(const std::string & host, std::uint16_t port = 0);
+
+    ~acceptor();
+
+    acceptor(const acceptor &) = delete;
+
+    acceptor & operator=(const acceptor &) = delete;
+
+    std::uint16_t port() const;
+
+    /* Waits for the next connection and attaches the socket to it. Throws
+     * boost::system::system_error once the acceptor is closed.
+     */
+    void accept(socket & peer);
+
+    /* Stops listening. Pending accepts fail, connections not accepted yet
+     * are closed.
+     */
+    void close();
+
+private:
+    std::shared_ptr<detail::memory_listener> listener_;
+};
+
+/* Aborts the pending operations of the socket, from any thread. Deadlines
+ * use it.
+ */
+std::function<void()> interrupter(memory_transport::socket & socket);
+
+} // namespace ftp
+#endif //FTP_MEMORY_TRANSPORT_HPP
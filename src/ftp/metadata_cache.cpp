@@ -0,0 +1,233 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "metadata_cache.hpp"
+
+namespace ftp
+{
+
+using std::string;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::lock_guard;
+using std::mutex;
+using std::chrono::steady_clock;
+
+using namespace ftp::detail;
+
+/* Separates the path from the kind of the cached data. It sorts before '/',
+ * so all keys of a path and of the paths below it form one range of the map.
+ */
+static const char kind_separator = '\x01';
+
+metadata_cache::metadata_cache(std::chrono::milliseconds ttl, std::size_t max_entries)
+    : ttl_(ttl),
+      max_entries_(max_entries > 0 ? max_entries : 1),
+      hits_(0),
+      misses_(0),
+      evictions_(0),
+      invalidations_(0)
+{
+}
+
+optional<reply_t> metadata_cache::find_size(const string & path)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    entry_t *entry = find(make_key(path, kind::size));
+
+    if (!entry)
+    {
+        return nullopt;
+    }
+
+    return entry->reply;
+}
+
+void metadata_cache::store_size(const string & path, const reply_t & reply)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    store(make_key(path, kind::size)).reply = reply;
+}
+
+optional<reply_t> metadata_cache::find_stat(const string & path)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    entry_t *entry = find(make_key(path, kind::stat));
+
+    if (!entry)
+    {
+        return nullopt;
+    }
+
+    return entry->reply;
+}
+
+void metadata_cache::store_stat(const string & path, const reply_t & reply)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    store(make_key(path, kind::stat)).reply = reply;
+}
+
+optional<vector<list_entry>> metadata_cache::find_listing(const string & path)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    entry_t *entry = find(make_key(path, kind::listing));
+
+    if (!entry)
+    {
+        return nullopt;
+    }
+
+    return entry->entries;
+}
+
+void metadata_cache::store_listing(const string & path, const vector<list_entry> & entries)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    store(make_key(path, kind::listing)).entries = entries;
+}
+
+void metadata_cache::invalidate(const string & path)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    string self = path + kind_separator;
+    string children = !path.empty() && path.back() == '/' ? path : path + '/';
+
+    for (const string & prefix : { self, children })
+    {
+        auto it = entries_.lower_bound(prefix);
+
+        while (it != entries_.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            erase(it++);
+            ++invalidations_;
+        }
+    }
+}
+
+void metadata_cache::invalidate_listing(const string & path)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    for (kind kind : { kind::listing, kind::stat })
+    {
+        auto it = entries_.find(make_key(path, kind));
+
+        if (it != entries_.end())
+        {
+            erase(it);
+            ++invalidations_;
+        }
+    }
+}
+
+void metadata_cache::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+
+    entries_.clear();
+    lru_.clear();
+}
+
+metadata_cache::stats metadata_cache::get_stats() const
+{
+    lock_guard<mutex> lock(mutex_);
+
+    return stats { hits_, misses_, evictions_, invalidations_, entries_.size() };
+}
+
+string metadata_cache::make_key(const string & path, kind kind)
+{
+    string key = path;
+    key += kind_separator;
+    key += static_cast<char>(kind);
+
+    return key;
+}
+
+metadata_cache::entry_t * metadata_cache::find(const string & key)
+{
+    auto it = entries_.find(key);
+
+    if (it == entries_.end())
+    {
+        ++misses_;
+        return nullptr;
+    }
+
+    if (it->second.expires <= steady_clock::now())
+    {
+        erase(it);
+        ++misses_;
+        return nullptr;
+    }
+
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    ++hits_;
+
+    return &it->second;
+}
+
+metadata_cache::entry_t & metadata_cache::store(const string & key)
+{
+    auto it = entries_.find(key);
+
+    if (it == entries_.end())
+    {
+        while (entries_.size() >= max_entries_)
+        {
+            erase(entries_.find(lru_.back()));
+            ++evictions_;
+        }
+
+        lru_.push_front(key);
+
+        it = entries_.emplace(key, entry_t()).first;
+        it->second.lru = lru_.begin();
+    }
+    else
+    {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+    }
+
+    it->second.expires = steady_clock::now() + ttl_;
+
+    return it->second;
+}
+
+void metadata_cache::erase(std::map<string, entry_t>::iterator it)
+{
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+} // namespace ftp
@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_METADATA_CACHE_HPP
+#define FTP_METADATA_CACHE_HPP
+
+#include "detail/reply.hpp"
+#include "list_entry.hpp"
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ftp
+{
+
+/* Caches replies to 'SIZE' and 'STAT' and parsed directory listings by
+ * remote path. Entries expire after a fixed time to live, and the least
+ * recently used entry is evicted when the cache is full.
+ *
+ * A cache may be shared by several clients, all methods are thread-safe.
+ * Clients invalidate what they change themselves; changes made by anyone
+ * else become visible when the entries expire.
+ */
+class metadata_cache
+{
+public:
+    struct stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::uint64_t invalidations;
+        std::size_t entries;
+    };
+
+    explicit metadata_cache(std::chrono::milliseconds ttl = std::chrono::seconds(30),
+                            std::size_t max_entries = 4096);
+
+    metadata_cache(const metadata_cache &) = delete;
+
+    metadata_cache & operator=(const metadata_cache &) = delete;
+
+    std::optional<detail::reply_t> find_size(const std::string & path);
+
+    void store_size(const std::string & path, const detail::reply_t & reply);
+
+    std::optional<detail::reply_t> find_stat(const std::string & path);
+
+    void store_stat(const std::string & path, const detail::reply_t & reply);
+
+    std::optional<std::vector<list_entry>> find_listing(const std::string & path);
+
+    void store_listing(const std::string & path, const std::vector<list_entry> & entries);
+
+    /* Drops everything cached for the path and for paths below it. */
+    void invalidate(const std::string & path);
+
+    /* Drops what is cached about the contents of the directory: its
+     * listing and its 'STAT' reply, which lists it as well.
+     */
+    void invalidate_listing(const std::string & path);
+
+    void clear();
+
+    stats get_stats() const;
+
+private:
+    enum class kind : char
+    {
+        size = 's',
+        stat = 't',
+        listing = 'l'
+    };
+
+    struct entry_t
+    {
+        detail::reply_t reply;
+        std::vector<list_entry> entries;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::string make_key(const std::string & path, kind kind);
+
+    entry_t * find(const std::string & key);
+
+    entry_t & store(const std::string & key);
+
+    void erase(std::map<std::string, entry_t>::iterator it);
+
+    const std::chrono::milliseconds ttl_;
+    const std::size_t max_entries_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, entry_t> entries_;
+    /* Most recently used keys are at the front. */
+    std::list<std::string> lru_;
+    std::uint64_t hits_;
+    std::uint64_t misses_;
+    std::uint64_t evictions_;
+    std::uint64_t invalidations_;
+};
+
+} // namespace ftp
+#endif //FTP_METADATA_CACHE_HPP
@@ -0,0 +1,505 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "session_pool.hpp"
+#include "ftp_exception.hpp"
+#include "memory_transport.hpp"
+#include "detail/md5.hpp"
+#include <algorithm>
+
+namespace ftp
+{
+
+using std::string;
+using std::unique_ptr;
+using std::make_unique;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::chrono::steady_clock;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::duration_cast;
+using std::chrono::ceil;
+
+template<typename Transport>
+basic_session_pool<Transport>::lease::lease(basic_session_pool *pool, string key, unique_ptr<client> client)
+    : pool_(pool),
+      key_(std::move(key)),
+      client_(std::move(client)),
+      discard_(false)
+{
+}
+
+template<typename Transport>
+basic_session_pool<Transport>::lease::lease(lease && other) noexcept
+    : pool_(other.pool_),
+      key_(std::move(other.key_)),
+      client_(std::move(other.client_)),
+      discard_(other.discard_)
+{
+    other.pool_ = nullptr;
+}
+
+template<typename Transport>
+auto basic_session_pool<Transport>::lease::operator=(lease && other) noexcept -> lease &
+{
+    if (this != &other)
+    {
+        release();
+
+        pool_ = other.pool_;
+        key_ = std::move(other.key_);
+        client_ = std::move(other.client_);
+        discard_ = other.discard_;
+
+        other.pool_ = nullptr;
+    }
+
+    return *this;
+}
+
+template<typename Transport>
+basic_session_pool<Transport>::lease::~lease()
+{
+    release();
+}
+
+template<typename Transport>
+auto basic_session_pool<Transport>::lease::operator*() const -> client &
+{
+    return *client_;
+}
+
+template<typename Transport>
+auto basic_session_pool<Transport>::lease::operator->() const -> client *
+{
+    return client_.get();
+}
+
+template<typename Transport>
+void basic_session_pool<Transport>::lease::discard()
+{
+    discard_ = true;
+}
+
+template<typename Transport>
+void basic_session_pool<Transport>::lease::release()
+{
+    if (pool_ && client_)
+    {
+        pool_->release(key_, std::move(client_), discard_);
+    }
+
+    pool_ = nullptr;
+}
+
+template<typename Transport>
+basic_session_pool<Transport>::basic_session_pool(const options & options)
+    : options_(options),
+      next_id_(1),
+      stop_(false),
+      hits_(0),
+      misses_(0),
+      evictions_(0),
+      keepalives_(0),
+      waits_(0),
+      total_wait_(0),
+      max_wait_(0),
+      leased_(0),
+      timers_(options.timers ? options.timers : std::make_shared<timer_service>(milliseconds(100)))
+{
+    keepalive_thread_ = std::thread(&basic_session_pool::keepalive_loop, this);
+}
+
+template<typename Transport>
+basic_session_pool<Transport>::~basic_session_pool()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    due_changed_.notify_all();
+    released_.notify_all();
+    keepalive_thread_.join();
+
+    /* Leases must not outlive the pool, so only idle sessions are left. */
+    for (auto & [key, bucket] : buckets_)
+    {
+        for (session_t & session : bucket.idle)
+        {
+            timers_->cancel(session.timer);
+            close_quietly(*session.ftp_client);
+        }
+    }
+}
+
+template<typename Transport>
+auto basic_session_pool<Transport>::acquire(const string & hostname,
+                                             uint16_t port,
+                                             const string & username,
+                                             const string & password) -> lease
+{
+    string key = make_key(hostname, port, username, password);
+    steady_clock::time_point started = steady_clock::now();
+    steady_clock::time_point deadline = started + options_.acquire_timeout;
+    bool waited = false;
+
+    auto record_wait = [&]()
+    {
+        if (!waited)
+        {
+            return;
+        }
+
+        microseconds wait = duration_cast<microseconds>(steady_clock::now() - started);
+
+        ++waits_;
+        total_wait_ += wait;
+        max_wait_ = std::max(max_wait_, wait);
+    };
+
+    unique_lock<mutex> lock(mutex_);
+
+    for (;;)
+    {
+        if (stop_)
+        {
+            throw ftp_exception("The session pool is shutting down.");
+        }
+
+        /* Buckets are never erased, but look the bucket up again after the
+         * lock was released anyway, it is cheap.
+         */
+        while (!buckets_[key].idle.empty())
+        {
+            session_t session = take_idle(key, buckets_[key].idle.begin());
+
+            lock.unlock();
+
+            /* Outside of the lock, a running keepalive callback takes it. */
+            timers_->cancel(session.timer);
+            bool valid = validate(session);
+
+            lock.lock();
+
+            if (valid)
+            {
+                ++hits_;
+                ++leased_;
+                record_wait();
+
+                return lease(this, key, std::move(session.ftp_client));
+            }
+
+            --buckets_[key].total;
+            ++evictions_;
+
+            lock.unlock();
+            close_quietly(*session.ftp_client);
+            session.ftp_client.reset();
+            lock.lock();
+        }
+
+        if (buckets_[key].total < options_.max_sessions_per_key)
+        {
+            ++buckets_[key].total;
+            lock.unlock();
+
+            unique_ptr<client> session;
+
+            try
+            {
+                session = make_unique<client>();
+                session->set_timer_service(timers_);
+
+                if (!session->open(hostname, port))
+                {
+                    throw ftp_exception("Cannot open connection to '%1%'.", hostname);
+                }
+
+                if (!session->login(username, password))
+                {
+                    close_quietly(*session);
+                    throw ftp_exception("Cannot log in as '%1%'.", username);
+                }
+            }
+            catch (...)
+            {
+                lock.lock();
+                --buckets_[key].total;
+                released_.notify_one();
+                throw;
+            }
+
+            lock.lock();
+
+            ++misses_;
+            ++leased_;
+            record_wait();
+
+            return lease(this, key, std::move(session));
+        }
+
+        waited = true;
+
+        if (released_.wait_until(lock, deadline) == std::cv_status::timeout)
+        {
+            record_wait();
+
+            throw ftp_exception("No session to '%1%' was released in %2% ms.",
+                                hostname, options_.acquire_timeout.count());
+        }
+    }
+}
+
+template<typename Transport>
+auto basic_session_pool<Transport>::get_stats() const -> stats
+{
+    lock_guard<mutex> lock(mutex_);
+
+    return stats { hits_, misses_, evictions_, keepalives_, waits_, total_wait_, max_wait_, idle_index_.size(), leased_ };
+}
+
+template<typename Transport>
+string basic_session_pool<Transport>::make_key(const string & hostname,
+                                               uint16_t port,
+                                               const string & username,
+                                               const string & password)
+{
+    detail::md5 digest;
+
+    digest.update(password.data(), password.size());
+
+    return detail::utils::format("%1%:%2%:%3%:%4%", hostname, port, username, digest.hex_digest());
+}
+
+/* Looking at the socket is enough for a session that was used a moment ago.
+ * A session that has been idle for a while could have been dropped by a
+ * middlebox without the server telling us, so it must answer 'NOOP'.
+ */
+template<typename Transport>
+bool basic_session_pool<Transport>::validate(session_t & session) const
+{
+    if (!session.ftp_client->is_alive())
+    {
+        return false;
+    }
+
+    if (steady_clock::now() - session.last_used < options_.validation_interval)
+    {
+        return true;
+    }
+
+    try
+    {
+        return session.ftp_client->noop();
+    }
+    catch (const ftp_exception &)
+    {
+        return false;
+    }
+}
+
+template<typename Transport>
+void basic_session_pool<Transport>::release(const string & key, unique_ptr<client> client, bool discard)
+{
+    bool keep = !discard && client->is_alive();
+
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        --leased_;
+
+        if (keep && !stop_)
+        {
+            steady_clock::time_point now = steady_clock::now();
+            make_idle(key, session_t { std::move(client), now, now, next_id_++, 0 });
+        }
+        else
+        {
+            --buckets_[key].total;
+        }
+    }
+
+    released_.notify_one();
+
+    if (client)
+    {
+        close_quietly(*client);
+    }
+}
+
+template<typename Transport>
+void basic_session_pool<Transport>::make_idle(const string & key, session_t session)
+{
+    bucket_t & bucket = buckets_[key];
+
+    steady_clock::time_point now = steady_clock::now();
+    steady_clock::time_point next = std::min(session.last_keepalive + options_.keepalive_interval,
+                                             session.last_used + options_.max_idle);
+    uint64_t id = session.id;
+
+    session.timer = timers_->schedule(ceil<milliseconds>(std::max(next - now, steady_clock::duration::zero())),
+                                      [this, id]()
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            due_.push_back(id);
+        }
+
+        due_changed_.notify_one();
+    });
+
+    auto position = std::find_if(bucket.idle.begin(), bucket.idle.end(),
+                                 [&session](const session_t & other)
+    {
+        return other.last_used <= session.last_used;
+    });
+
+    auto it = bucket.idle.insert(position, std::move(session));
+    idle_index_[id] = std::make_pair(key, it);
+}
+
+template<typename Transport>
+auto basic_session_pool<Transport>::take_idle(const string & key, typename std::list<session_t>::iterator it) -> session_t
+{
+    session_t session = std::move(*it);
+
+    buckets_[key].idle.erase(it);
+    idle_index_.erase(session.id);
+
+    return session;
+}
+
+/* Does the blocking part of keepalives, so the timer thread never waits on
+ * a server.
+ */
+template<typename Transport>
+void basic_session_pool<Transport>::keepalive_loop()
+{
+    unique_lock<mutex> lock(mutex_);
+
+    for (;;)
+    {
+        due_changed_.wait(lock, [this]()
+        {
+            return stop_ || !due_.empty();
+        });
+
+        if (stop_)
+        {
+            break;
+        }
+
+        std::vector<uint64_t> due;
+        due.swap(due_);
+
+        for (uint64_t id : due)
+        {
+            auto found = idle_index_.find(id);
+
+            /* Lent out since the timer expired. */
+            if (found == idle_index_.end())
+            {
+                continue;
+            }
+
+            string key = found->second.first;
+            session_t session = take_idle(key, found->second.second);
+
+            lock.unlock();
+            keepalive(key, std::move(session));
+            lock.lock();
+        }
+    }
+}
+
+template<typename Transport>
+void basic_session_pool<Transport>::keepalive(const string & key, session_t session)
+{
+    bool expired = steady_clock::now() - session.last_used >= options_.max_idle;
+    bool alive = false;
+
+    if (!expired)
+    {
+        try
+        {
+            alive = session.ftp_client->is_alive() && session.ftp_client->noop();
+        }
+        catch (const ftp_exception &)
+        {
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        if (!expired)
+        {
+            ++keepalives_;
+        }
+
+        if (alive && !stop_)
+        {
+            session.last_keepalive = steady_clock::now();
+            make_idle(key, std::move(session));
+        }
+        else
+        {
+            --buckets_[key].total;
+            ++evictions_;
+        }
+    }
+
+    released_.notify_one();
+
+    if (session.ftp_client)
+    {
+        close_quietly(*session.ftp_client);
+    }
+}
+
+template<typename Transport>
+void basic_session_pool<Transport>::close_quietly(client & client)
+{
+    try
+    {
+        if (client.is_open())
+        {
+            client.close();
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+template class basic_session_pool<tcp_transport>;
+template class basic_session_pool<unix_transport>;
+template class basic_session_pool<memory_transport>;
+template class basic_session_pool<tls_transport>;
+
+} // namespace ftp
@@ -0,0 +1,243 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_SESSION_POOL_HPP
+#define FTP_SESSION_POOL_HPP
+
+#include "client.hpp"
+#include "timer_service.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ftp
+{
+
+/* Keeps logged in clients around between jobs, so a job doesn't pay for
+ * connecting and logging in again. Sessions are pooled by host, port, user
+ * and password, so only the credentials a session logged in with get it
+ * back. Idle sessions are kept alive with 'NOOP' and closed when they have
+ * been idle for too long.
+ *
+ * All methods are thread-safe.
+ */
+template<typename Transport>
+class basic_session_pool
+{
+public:
+    using client = basic_client<Transport>;
+
+    struct options
+    {
+        options()
+            : max_sessions_per_key(8),
+              keepalive_interval(std::chrono::seconds(30)),
+              max_idle(std::chrono::minutes(5)),
+              validation_interval(std::chrono::seconds(2)),
+              acquire_timeout(std::chrono::seconds(30))
+        {
+        }
+
+        /* Sessions per host, port, user and password, both idle and lent
+         * out.
+         */
+        std::size_t max_sessions_per_key;
+
+        /* Idle sessions send 'NOOP' this often to keep the server from
+         * closing them.
+         */
+        std::chrono::milliseconds keepalive_interval;
+
+        /* Idle sessions are closed after this time. */
+        std::chrono::milliseconds max_idle;
+
+        /* Sessions idle for longer than this are checked with 'NOOP' before
+         * they are lent out. Others only get a local check of the socket.
+         */
+        std::chrono::milliseconds validation_interval;
+
+        /* How long 'acquire' waits for a session when the limit is reached. */
+        std::chrono::milliseconds acquire_timeout;
+
+        /* Drives keepalives, and the deadlines of the pooled clients. The
+         * pool creates one if none is given.
+         */
+        std::shared_ptr<timer_service> timers;
+    };
+
+    struct stats
+    {
+        /* Acquired sessions that were taken from the pool. */
+        std::uint64_t hits;
+        /* Acquired sessions that had to be opened. */
+        std::uint64_t misses;
+        /* Pooled sessions closed because they were dead or idle for too long. */
+        std::uint64_t evictions;
+        std::uint64_t keepalives;
+        /* Acquires that had to wait for a session to be released. */
+        std::uint64_t waits;
+        std::chrono::microseconds total_wait;
+        std::chrono::microseconds max_wait;
+        std::size_t idle;
+        std::size_t leased;
+    };
+
+    class lease
+    {
+    public:
+        lease(lease && other) noexcept;
+
+        lease & operator=(lease && other) noexcept;
+
+        lease(const lease &) = delete;
+
+        lease & operator=(const lease &) = delete;
+
+        ~lease();
+
+        client & operator*() const;
+
+        client * operator->() const;
+
+        /* Don't return the session to the pool, e.g. after an error left
+         * the control connection in an unknown state.
+         */
+        void discard();
+
+    private:
+        friend class basic_session_pool;
+
+        lease(basic_session_pool *pool, std::string key, std::unique_ptr<client> client);
+
+        void release();
+
+        basic_session_pool *pool_;
+        std::string key_;
+        std::unique_ptr<client> client_;
+        bool discard_;
+    };
+
+    explicit basic_session_pool(const options & options = basic_session_pool::options());
+
+    basic_session_pool(const basic_session_pool &) = delete;
+
+    basic_session_pool & operator=(const basic_session_pool &) = delete;
+
+    ~basic_session_pool();
+
+    /* Lends out a logged in session. Throws ftp_exception if no session can
+     * be opened or none is released within the acquire timeout.
+     */
+    lease acquire(const std::string & hostname,
+                  uint16_t port,
+                  const std::string & username,
+                  const std::string & password);
+
+    stats get_stats() const;
+
+private:
+    struct session_t
+    {
+        std::unique_ptr<client> ftp_client;
+        std::chrono::steady_clock::time_point last_used;
+        std::chrono::steady_clock::time_point last_keepalive;
+        std::uint64_t id;
+        timer_service::timer_id timer;
+    };
+
+    struct bucket_t
+    {
+        bucket_t()
+            : total(0)
+        {
+        }
+
+        /* Most recently used sessions are at the front. */
+        std::list<session_t> idle;
+        /* Idle, lent out and being opened or kept alive. */
+        std::size_t total;
+    };
+
+    /* The password only as its digest, the key isn't secret. */
+    static std::string make_key(const std::string & hostname,
+                                uint16_t port,
+                                const std::string & username,
+                                const std::string & password);
+
+    bool validate(session_t & session) const;
+
+    void release(const std::string & key, std::unique_ptr<client> client, bool discard);
+
+    /* Puts the session back on the idle list of the bucket, ordered by last
+     * use, and schedules its next keepalive. Requires the lock.
+     */
+    void make_idle(const std::string & key, session_t session);
+
+    /* Takes the session off the idle list. Requires the lock. */
+    session_t take_idle(const std::string & key, typename std::list<session_t>::iterator it);
+
+    void keepalive_loop();
+
+    void keepalive(const std::string & key, session_t session);
+
+    static void close_quietly(client & client);
+
+    const options options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    std::condition_variable due_changed_;
+    std::map<std::string, bucket_t> buckets_;
+    /* Where to find each idle session by its id. */
+    std::unordered_map<std::uint64_t, std::pair<std::string, typename std::list<session_t>::iterator>> idle_index_;
+    /* Idle sessions whose keepalive timer has expired. */
+    std::vector<std::uint64_t> due_;
+    std::uint64_t next_id_;
+    bool stop_;
+
+    std::uint64_t hits_;
+    std::uint64_t misses_;
+    std::uint64_t evictions_;
+    std::uint64_t keepalives_;
+    std::uint64_t waits_;
+    std::chrono::microseconds total_wait_;
+    std::chrono::microseconds max_wait_;
+    std::size_t leased_;
+
+    std::shared_ptr<timer_service> timers_;
+    std::thread keepalive_thread_;
+};
+
+using session_pool = basic_session_pool<tcp_transport>;
+
+} // namespace ftp
+#endif //FTP_SESSION_POOL_HPP
@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "socket_profile.hpp"
+
+namespace ftp
+{
+
+using std::string;
+using std::optional;
+using std::nullopt;
+using std::chrono::seconds;
+
+/* DSCP values (RFC 4594): AF11 for bulk transfers, AF21 for low-latency
+ * data, CS2 for the control connection (OAM).
+ */
+static const int dscp_af11 = 10;
+static const int dscp_af21 = 18;
+static const int dscp_cs2 = 16;
+
+/* TC_PRIO_INTERACTIVE of the Linux traffic control. */
+static const int priority_interactive = 6;
+
+socket_profile socket_profile::lan()
+{
+    socket_profile profile;
+
+    profile.control.no_delay = true;
+    profile.control.keepalive_idle = seconds(60);
+    profile.control.keepalive_interval = seconds(10);
+    profile.control.keepalive_count = 5;
+
+    return profile;
+}
+
+socket_profile socket_profile::wan_high_bdp()
+{
+    socket_profile profile;
+
+    /* Many NATs drop idle TCP mappings after a few minutes. */
+    profile.control.no_delay = true;
+    profile.control.keepalive_idle = seconds(30);
+    profile.control.keepalive_interval = seconds(10);
+    profile.control.keepalive_count = 6;
+    profile.control.dscp = dscp_cs2;
+
+    /* 4 MiB covers 320 Mbit/s at 100 ms of round-trip time. */
+    profile.data.send_buffer = 4 * 1024 * 1024;
+    profile.data.receive_buffer = 4 * 1024 * 1024;
+    profile.data.not_sent_lowat = 256 * 1024;
+    profile.data.congestion_control = string("bbr");
+    profile.data.dscp = dscp_af11;
+
+    return profile;
+}
+
+socket_profile socket_profile::low_latency()
+{
+    socket_profile profile;
+
+    profile.control.no_delay = true;
+    profile.control.keepalive_idle = seconds(15);
+    profile.control.keepalive_interval = seconds(5);
+    profile.control.keepalive_count = 3;
+    profile.control.dscp = dscp_af21;
+    profile.control.priority = priority_interactive;
+
+    profile.data.no_delay = true;
+    profile.data.not_sent_lowat = 16 * 1024;
+    profile.data.dscp = dscp_af21;
+    profile.data.priority = priority_interactive;
+
+    return profile;
+}
+
+optional<socket_profile> socket_profile::find(const string & name)
+{
+    if (name == "lan")
+    {
+        return lan();
+    }
+    else if (name == "wan-high-bdp")
+    {
+        return wan_high_bdp();
+    }
+    else if (name == "low-latency")
+    {
+        return low_latency();
+    }
+
+    return nullopt;
+}
+
+} // namespace ftp
@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_SOCKET_PROFILE_HPP
+#define FTP_SOCKET_PROFILE_HPP
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace ftp
+{
+
+/* How data connections are closed:
+ *
+ *  - graceful: with a FIN. Whoever closes first keeps the port in TIME_WAIT
+ *    for a minute, which is the client after uploads and aborted transfers.
+ *  - abortive_when_safe: with a RST (SO_LINGER with a zero timeout), which
+ *    leaves no TIME_WAIT behind, wherever no data can be lost: after the
+ *    server has closed its side, and on connections we haven't sent
+ *    anything over. Uploads still end with a FIN, the server needs it as
+ *    the end of the file.
+ */
+enum class close_mode
+{
+    graceful,
+    abortive_when_safe
+};
+
+/* Options set on a socket before it connects. Options that aren't set keep
+ * the system defaults. They are hints: an option the system rejects, e.g.
+ * a congestion control algorithm that isn't loaded, is skipped.
+ */
+struct socket_options
+{
+    /* Disables Nagle's algorithm. */
+    bool no_delay = false;
+
+    /* SO_SNDBUF and SO_RCVBUF in bytes. Setting them turns off the
+     * automatic tuning of the system.
+     */
+    std::optional<int> send_buffer;
+    std::optional<int> receive_buffer;
+
+    /* TCP_NOTSENT_LOWAT: how much data may wait unsent in the socket. */
+    std::optional<int> not_sent_lowat;
+
+    /* TCP_CONGESTION, e.g. "bbr" or "cubic". */
+    std::optional<std::string> congestion_control;
+
+    /* Keepalive probes: when the first one is sent, how often the following
+     * ones are, and how many may go unanswered.
+     */
+    std::optional<std::chrono::seconds> keepalive_idle;
+    std::optional<std::chrono::seconds> keepalive_interval;
+    std::optional<int> keepalive_count;
+
+    /* Differentiated services code point (RFC 2474) of the packets. */
+    std::optional<int> dscp;
+
+    /* SO_PRIORITY, the queueing priority on the local host. */
+    std::optional<int> priority;
+
+    /* Only data connections use it. */
+    close_mode closing = close_mode::graceful;
+};
+
+/* Tuning of the control and the data connections for a kind of network:
+ *
+ *  - lan: no Nagle delays on commands, the system tunes the buffers.
+ *  - wan-high-bdp: large buffers and BBR for long fat pipes, keepalives
+ *    frequent enough to keep NAT bindings of an idle control connection.
+ *  - low-latency: little data queued in the sockets, interactive priority.
+ */
+struct socket_profile
+{
+    socket_options control;
+    socket_options data;
+
+    static socket_profile lan();
+
+    static socket_profile wan_high_bdp();
+
+    static socket_profile low_latency();
+
+    /* The profile named 'lan', 'wan-high-bdp' or 'low-latency'. */
+    static std::optional<socket_profile> find(const std::string & name);
+};
+
+} // namespace ftp
+#endif //FTP_SOCKET_PROFILE_HPP
@@ -0,0 +1,171 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "source_address_pool.hpp"
+#include "ftp_exception.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace ftp
+{
+
+using std::string;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::lock_guard;
+using std::mutex;
+using std::size_t;
+using std::chrono::steady_clock;
+using boost::asio::ip::tcp;
+
+/* TIME_WAIT lasts 60 seconds on Linux (TCP_TIMEWAIT_LEN). */
+static const std::chrono::seconds time_wait_period(60);
+
+/* The Linux default of net.ipv4.ip_local_port_range, 32768 to 60999. */
+static const size_t default_port_range = 28232;
+
+static size_t read_port_range()
+{
+    std::ifstream file("/proc/sys/net/ipv4/ip_local_port_range");
+    size_t low = 0;
+    size_t high = 0;
+
+    if (file >> low >> high && high >= low)
+    {
+        return high - low + 1;
+    }
+
+    return default_port_range;
+}
+
+double source_address_pool::address_stats::port_usage() const
+{
+    if (port_range == 0)
+    {
+        return 1;
+    }
+
+    return static_cast<double>(active + time_wait) / port_range;
+}
+
+source_address_pool::source_address_pool(const vector<string> & addresses)
+    : port_range_(read_port_range()),
+      next_(0)
+{
+    for (const string & address : addresses)
+    {
+        boost::system::error_code ec;
+        boost::asio::ip::address parsed = boost::asio::ip::make_address(address, ec);
+
+        if (ec)
+        {
+            throw ftp_exception("Invalid source address '%1%'.", address);
+        }
+
+        entries_.push_back({ parsed, 0, 0, {} });
+    }
+}
+
+optional<size_t> source_address_pool::acquire(const tcp & protocol)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+        size_t index = (next_ + i) % entries_.size();
+        entry_t & entry = entries_[index];
+
+        if (entry.address.is_v6() != (protocol == tcp::v6()))
+        {
+            continue;
+        }
+
+        next_ = index + 1;
+        ++entry.connections;
+        ++entry.active;
+
+        return index;
+    }
+
+    return nullopt;
+}
+
+const boost::asio::ip::address & source_address_pool::address(size_t index) const
+{
+    /* Addresses never change after construction. */
+    return entries_.at(index).address;
+}
+
+void source_address_pool::release(size_t index, bool time_wait)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    entry_t & entry = entries_.at(index);
+    steady_clock::time_point now = steady_clock::now();
+
+    if (entry.active > 0)
+    {
+        --entry.active;
+    }
+
+    expire_time_wait(entry, now);
+
+    if (time_wait)
+    {
+        entry.time_wait.push_back(now);
+    }
+}
+
+vector<source_address_pool::address_stats> source_address_pool::get_stats() const
+{
+    lock_guard<mutex> lock(mutex_);
+
+    vector<address_stats> stats;
+    steady_clock::time_point now = steady_clock::now();
+
+    for (const entry_t & entry : entries_)
+    {
+        /* The times are in order, skip those that have run out. */
+        auto current = std::upper_bound(entry.time_wait.begin(), entry.time_wait.end(), now - time_wait_period);
+
+        stats.push_back({ entry.address.to_string(),
+                          entry.connections,
+                          entry.active,
+                          static_cast<size_t>(entry.time_wait.end() - current),
+                          port_range_ });
+    }
+
+    return stats;
+}
+
+void source_address_pool::expire_time_wait(entry_t & entry, steady_clock::time_point now)
+{
+    while (!entry.time_wait.empty() && now - entry.time_wait.front() >= time_wait_period)
+    {
+        entry.time_wait.pop_front();
+    }
+}
+
+} // namespace ftp
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_SOURCE_ADDRESS_POOL_HPP
+#define FTP_SOURCE_ADDRESS_POOL_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ftp
+{
+
+/* Local addresses data connections are bound to, taken in turn. Each local
+ * address has its own range of ephemeral ports towards a server, so several
+ * addresses multiply the number of connections that may be open or in
+ * TIME_WAIT at the same time.
+ *
+ * Only the address is bound, the port is chosen when connecting
+ * (IP_BIND_ADDRESS_NO_PORT), so a port can be used towards several servers.
+ *
+ * The pool may be shared by several clients, all methods are thread-safe.
+ */
+class source_address_pool
+{
+public:
+    struct address_stats
+    {
+        std::string address;
+        /* Connections opened from the address so far. */
+        std::uint64_t connections;
+        std::size_t active;
+        /* Connections we closed first within the last TIME_WAIT period.
+         * Their ports can't be used towards the same server yet.
+         */
+        std::size_t time_wait;
+        /* Ephemeral ports available to each server address. */
+        std::size_t port_range;
+
+        /* Of the ports towards a single server, the share that is taken
+         * if all connections went to it. 1 means exhausted.
+         */
+        double port_usage() const;
+    };
+
+    /* Throws ftp_exception if an address is invalid. */
+    explicit source_address_pool(const std::vector<std::string> & addresses);
+
+    source_address_pool(const source_address_pool &) = delete;
+
+    source_address_pool & operator=(const source_address_pool &) = delete;
+
+    /* The next address of the protocol's family, if the pool has one. */
+    std::optional<std::size_t> acquire(const boost::asio::ip::tcp & protocol);
+
+    const boost::asio::ip::address & address(std::size_t index) const;
+
+    /* The connection from the address is closed. 'time_wait' tells whether
+     * we closed it first, leaving the port in TIME_WAIT.
+     */
+    void release(std::size_t index, bool time_wait);
+
+    std::vector<address_stats> get_stats() const;
+
+private:
+    struct entry_t
+    {
+        boost::asio::ip::address address;
+        std::uint64_t connections;
+        std::size_t active;
+        std::deque<std::chrono::steady_clock::time_point> time_wait;
+    };
+
+    static void expire_time_wait(entry_t & entry, std::chrono::steady_clock::time_point now);
+
+    const std::size_t port_range_;
+
+    mutable std::mutex mutex_;
+    std::vector<entry_t> entries_;
+    std::size_t next_;
+};
+
+} // namespace ftp
+#endif //FTP_SOURCE_ADDRESS_POOL_HPP
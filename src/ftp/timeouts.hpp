@@ -0,0 +1,50 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_TIMEOUTS_HPP
+#define FTP_TIMEOUTS_HPP
+
+#include <chrono>
+#include <optional>
+
+namespace ftp
+{
+
+/* Deadlines for blocking operations. A value that isn't set is derived from
+ * the round-trip time measured on the control connection.
+ */
+struct timeouts
+{
+    /* Establishing the control or a data connection. */
+    std::optional<std::chrono::milliseconds> connect;
+
+    /* Waiting for the first line of a reply. */
+    std::optional<std::chrono::milliseconds> reply;
+
+    /* Time without progress while transferring data. */
+    std::optional<std::chrono::milliseconds> data_inactivity;
+};
+
+} // namespace ftp
+#endif //FTP_TIMEOUTS_HPP
@@ -0,0 +1,172 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "timer_service.hpp"
+
+namespace ftp
+{
+
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::vector;
+using std::pair;
+using std::function;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+
+timer_service::timer_service(milliseconds resolution)
+    : resolution_(resolution.count() > 0 ? resolution : milliseconds(1)),
+      started_(steady_clock::now()),
+      running_(0),
+      stop_(false)
+{
+    thread_ = std::thread(&timer_service::run, this);
+}
+
+timer_service::~timer_service()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    thread_.join();
+}
+
+timer_service::timer_id timer_service::schedule(milliseconds delay, function<void()> callback)
+{
+    /* Round up, a timer must never expire early. */
+    std::uint64_t ticks = (delay.count() + resolution_.count() - 1) / resolution_.count();
+
+    lock_guard<mutex> lock(mutex_);
+
+    /* The wheel may lag behind the clock by up to a tick. Count from the
+     * wheel's position, so the delay isn't cut short.
+     */
+    std::uint64_t lag = current_tick() - wheel_.now();
+
+    return wheel_.schedule(ticks + lag + 1, std::move(callback));
+}
+
+bool timer_service::cancel(timer_id id)
+{
+    unique_lock<mutex> lock(mutex_);
+
+    if (wheel_.cancel(id))
+    {
+        return true;
+    }
+
+    if (pending_.erase(id) > 0)
+    {
+        return true;
+    }
+
+    /* Don't return while the callback runs, the caller may be about to
+     * release what the callback uses. A callback must not cancel itself.
+     */
+    finished_.wait(lock, [this, id]()
+    {
+        return running_ != id;
+    });
+
+    return false;
+}
+
+std::size_t timer_service::size() const
+{
+    lock_guard<mutex> lock(mutex_);
+
+    return wheel_.size() + pending_.size();
+}
+
+std::uint64_t timer_service::current_tick() const
+{
+    return duration_cast<milliseconds>(steady_clock::now() - started_).count() / resolution_.count();
+}
+
+void timer_service::run()
+{
+    vector<pair<timer_id, function<void()>>> expired;
+    steady_clock::time_point next_tick = steady_clock::now() + resolution_;
+
+    for (;;)
+    {
+        std::this_thread::sleep_until(next_tick);
+        next_tick += resolution_;
+
+        {
+            lock_guard<mutex> lock(mutex_);
+
+            if (stop_)
+            {
+                return;
+            }
+
+            wheel_.advance(current_tick(), expired);
+
+            for (const auto & timer : expired)
+            {
+                pending_.insert(timer.first);
+            }
+        }
+
+        for (auto & [id, callback] : expired)
+        {
+            {
+                lock_guard<mutex> lock(mutex_);
+
+                /* Cancelled after it expired. */
+                if (pending_.erase(id) == 0)
+                {
+                    continue;
+                }
+
+                running_ = id;
+            }
+
+            try
+            {
+                callback();
+            }
+            catch (...)
+            {
+                /* Don't let one callback take down the timers of everyone. */
+            }
+
+            {
+                lock_guard<mutex> lock(mutex_);
+                running_ = 0;
+            }
+
+            finished_.notify_all();
+        }
+
+        expired.clear();
+    }
+}
+
+} // namespace ftp
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_TIMER_SERVICE_HPP
+#define FTP_TIMER_SERVICE_HPP
+
+#include "detail/timing_wheel.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace ftp
+{
+
+/* Timers shared by many sessions, backed by a hierarchical timing wheel that
+ * one thread advances every tick. Used for keepalives and for the deadlines
+ * of control and data connection operations.
+ *
+ * Callbacks run on the timer thread and must not block.
+ */
+class timer_service
+{
+public:
+    using timer_id = detail::timing_wheel::timer_id;
+
+    explicit timer_service(std::chrono::milliseconds resolution = std::chrono::milliseconds(10));
+
+    timer_service(const timer_service &) = delete;
+
+    timer_service & operator=(const timer_service &) = delete;
+
+    ~timer_service();
+
+    /* The callback runs no earlier than 'delay' from now, rounded up to the
+     * resolution.
+     */
+    timer_id schedule(std::chrono::milliseconds delay, std::function<void()> callback);
+
+    /* Returns true if the callback won't run. Otherwise it has run already,
+     * or it is running and cancel() waits for it to return.
+     */
+    bool cancel(timer_id id);
+
+    std::size_t size() const;
+
+private:
+    std::uint64_t current_tick() const;
+
+    void run();
+
+    const std::chrono::milliseconds resolution_;
+    const std::chrono::steady_clock::time_point started_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable finished_;
+    detail::timing_wheel wheel_;
+    /* Expired, but their callbacks haven't started yet. */
+    std::unordered_set<timer_id> pending_;
+    timer_id running_;
+    bool stop_;
+
+    std::thread thread_;
+};
+
+} // namespace ftp
+#endif //FTP_TIMER_SERVICE_HPP
@@ -0,0 +1,182 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tls_transport.hpp"
+#include "transport.hpp"
+#include "detail/kernel_tls.hpp"
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <sys/socket.h>
+
+namespace ftp
+{
+
+using boost::asio::ip::tcp;
+
+boost::asio::ip::tcp::socket & tls_transport::tcp_layer(socket & socket)
+{
+    return socket.tcp_layer();
+}
+
+const boost::asio::ip::tcp::socket & tls_transport::tcp_layer(const socket & socket)
+{
+    return socket.tcp_layer();
+}
+
+void tls_transport::start_tls(socket & socket,
+                              boost::asio::ssl::context & context,
+                              const std::string & host,
+                              SSL_SESSION *session)
+{
+    socket.start_tls(context);
+
+    SSL *ssl = socket.stream().native_handle();
+    boost::system::error_code ec;
+
+    boost::asio::ip::address::from_string(host, ec);
+
+    if (ec)
+    {
+        /* RFC 6066 doesn't allow address literals in SNI. */
+        SSL_set_tlsext_host_name(ssl, host.c_str());
+        SSL_set1_host(ssl, host.c_str());
+    }
+    else
+    {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str());
+    }
+
+    if (session)
+    {
+        SSL_set_session(ssl, session);
+    }
+}
+
+bool tls_transport::is_alive(socket & socket)
+{
+    return tcp_transport::is_alive(socket.tcp_layer());
+}
+
+tls_transport::socket::socket(boost::asio::io_context & io_context)
+    : socket_(io_context),
+      secure_(false),
+      kernel_tx_(false)
+{
+}
+
+tls_transport::socket::executor_type tls_transport::socket::get_executor()
+{
+    return socket_.get_executor();
+}
+
+tcp::socket & tls_transport::socket::tcp_layer()
+{
+    return stream_ ? stream_->next_layer() : socket_;
+}
+
+const tcp::socket & tls_transport::socket::tcp_layer() const
+{
+    return stream_ ? stream_->next_layer() : socket_;
+}
+
+void tls_transport::socket::start_tls(boost::asio::ssl::context & context)
+{
+    /* Nothing refers to the stream of the previous connection anymore. */
+    stream_ = std::make_unique<stream_type>(std::move(tcp_layer()), context);
+    secure_ = true;
+    kernel_tx_ = false;
+}
+
+bool tls_transport::socket::is_secure() const
+{
+    return secure_;
+}
+
+void tls_transport::socket::prepare_kernel_tx()
+{
+    SSL *ssl = stream_->native_handle();
+
+    detail::request_openssl_ktls(ssl);
+    detail::keep_tls_secrets(ssl);
+}
+
+bool tls_transport::socket::start_kernel_tx()
+{
+    SSL *ssl = stream_->native_handle();
+
+    if (detail::is_openssl_ktls_tx(ssl))
+    {
+        kernel_tx_ = true;
+
+        return kernel_tx_;
+    }
+
+    detail::tls_tx_keys keys;
+
+    kernel_tx_ = detail::derive_tx_keys(ssl, keys)
+        && detail::install_kernel_tx(tcp_layer().native_handle(), keys);
+
+    OPENSSL_cleanse(keys.key.data(), keys.key.size());
+
+    return kernel_tx_;
+}
+
+bool tls_transport::socket::is_kernel_tx() const
+{
+    return kernel_tx_;
+}
+
+tls_transport::socket::stream_type & tls_transport::socket::stream()
+{
+    return *stream_;
+}
+
+bool tls_transport::socket::is_open() const
+{
+    return tcp_layer().is_open();
+}
+
+void tls_transport::socket::shutdown(boost::asio::socket_base::shutdown_type what, boost::system::error_code & ec)
+{
+    tcp_layer().shutdown(what, ec);
+}
+
+void tls_transport::socket::close(boost::system::error_code & ec)
+{
+    secure_ = false;
+    kernel_tx_ = false;
+    tcp_layer().close(ec);
+}
+
+std::function<void()> interrupter(tls_transport::socket & socket)
+{
+    int handle = socket.tcp_layer().native_handle();
+
+    return [handle]()
+    {
+        ::shutdown(handle, SHUT_RDWR);
+    };
+}
+
+} // namespace ftp
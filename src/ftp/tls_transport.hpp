@@ -0,0 +1,164 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_TLS_TRANSPORT_HPP
+#define FTP_TLS_TRANSPORT_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/asio/ssl/stream.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace ftp
+{
+
+/* TCP that can be secured with TLS, for explicit FTPS (RFC 4217). A socket
+ * starts in plain text and turns into TLS with start_tls: the control
+ * connection after the server has accepted 'AUTH TLS', a data connection
+ * after the server has accepted the transfer command. The TLS handshake
+ * itself is up to the connection.
+ */
+struct tls_transport
+{
+    class socket;
+
+    static constexpr bool is_tcp = true;
+
+    static constexpr bool is_tls = true;
+
+    static boost::asio::ip::tcp::socket & tcp_layer(socket & socket);
+
+    static const boost::asio::ip::tcp::socket & tcp_layer(const socket & socket);
+
+    /* Prepares the socket for a client handshake with the host: sets SNI and
+     * checks the name in the server's certificate (if the context verifies
+     * it at all). With a session, the handshake offers to resume it.
+     */
+    static void start_tls(socket & socket,
+                          boost::asio::ssl::context & context,
+                          const std::string & host,
+                          SSL_SESSION *session);
+
+    /* Peeks at the TCP layer, so a TLS record nobody asked for, such as a
+     * late session ticket, counts as unsolicited data.
+     */
+    static bool is_alive(socket & socket);
+};
+
+class tls_transport::socket
+{
+public:
+    using executor_type = boost::asio::ip::tcp::socket::executor_type;
+
+    using stream_type = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+
+    explicit socket(boost::asio::io_context & io_context);
+
+    socket(const socket &) = delete;
+
+    socket & operator=(const socket &) = delete;
+
+    executor_type get_executor();
+
+    boost::asio::ip::tcp::socket & tcp_layer();
+
+    const boost::asio::ip::tcp::socket & tcp_layer() const;
+
+    /* Reads and writes go through TLS from now on, until the socket is
+     * closed.
+     */
+    void start_tls(boost::asio::ssl::context & context);
+
+    bool is_secure() const;
+
+    /* Must be called before the handshake if the kernel is to take over
+     * the encryption afterwards (see detail/kernel_tls.hpp).
+     */
+    void prepare_kernel_tx();
+
+    /* Right after the handshake: writes go to the TCP socket as they are
+     * and the kernel encrypts them, so sendfile works as well. False if the
+     * kernel can't, writes go through OpenSSL then. Reads always do.
+     */
+    bool start_kernel_tx();
+
+    bool is_kernel_tx() const;
+
+    /* Valid once TLS has started. */
+    stream_type & stream();
+
+    bool is_open() const;
+
+    void shutdown(boost::asio::socket_base::shutdown_type what, boost::system::error_code & ec);
+
+    /* Closes the TCP socket. The TLS state is kept until TLS starts on the
+     * next connection, operations aborted by the close may still refer to
+     * it.
+     */
+    void close(boost::system::error_code & ec);
+
+    template<typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(const MutableBufferSequence & buffers, ReadHandler && handler)
+    {
+        if (secure_)
+        {
+            stream_->async_read_some(buffers, std::forward<ReadHandler>(handler));
+        }
+        else
+        {
+            tcp_layer().async_read_some(buffers, std::forward<ReadHandler>(handler));
+        }
+    }
+
+    template<typename ConstBufferSequence, typename WriteHandler>
+    void async_write_some(const ConstBufferSequence & buffers, WriteHandler && handler)
+    {
+        if (secure_ && !kernel_tx_)
+        {
+            stream_->async_write_some(buffers, std::forward<WriteHandler>(handler));
+        }
+        else
+        {
+            tcp_layer().async_write_some(buffers, std::forward<WriteHandler>(handler));
+        }
+    }
+
+private:
+    /* Holds the connection until TLS starts, then the stream does. */
+    boost::asio::ip::tcp::socket socket_;
+    std::unique_ptr<stream_type> stream_;
+    bool secure_;
+    bool kernel_tx_;
+};
+
+/* Aborts the pending operations of the socket, from any thread. Deadlines
+ * use it.
+ */
+std::function<void()> interrupter(tls_transport::socket & socket);
+
+} // namespace ftp
+#endif //FTP_TLS_TRANSPORT_HPP
@@ -0,0 +1,120 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_TRANSFER_RESULT_HPP
+#define FTP_TRANSFER_RESULT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ftp
+{
+
+/* The state of the data connection as the kernel sees it (TCP_INFO). Fields
+ * the kernel doesn't report are zero.
+ */
+struct tcp_sample
+{
+    /* When the sample was taken, since the transfer started. */
+    std::chrono::microseconds elapsed{0};
+
+    std::chrono::microseconds rtt{0};
+    std::chrono::microseconds rtt_var{0};
+    std::chrono::microseconds min_rtt{0};
+
+    /* Congestion window in segments of 'mss' bytes. */
+    std::uint32_t cwnd = 0;
+    std::uint32_t mss = 0;
+
+    std::uint32_t total_retransmits = 0;
+
+    /* Bytes per second, as estimated by the sender. */
+    std::uint64_t delivery_rate = 0;
+
+    /* How long the connection has been sending, and for how much of that
+     * time it was held back by the receive window of the peer or by our
+     * own send buffer.
+     */
+    std::chrono::microseconds busy_time{0};
+    std::chrono::microseconds rwnd_limited{0};
+    std::chrono::microseconds sndbuf_limited{0};
+
+    std::uint64_t bytes_acked = 0;
+    std::uint64_t bytes_received = 0;
+};
+
+/* What happened during a transfer over a data connection. The time spent
+ * waiting for the socket and the time spent reading or writing the local
+ * file tell whether the network and the server, or the disk held it up.
+ * The samples tell which of the two the network was.
+ */
+struct transfer_result
+{
+    /* The command that started the transfer, e.g. 'RETR file'. */
+    std::string command;
+
+    bool success = false;
+
+    std::uint64_t bytes = 0;
+
+    std::chrono::microseconds duration{0};
+    std::chrono::microseconds network_time{0};
+    std::chrono::microseconds file_time{0};
+
+    /* Taken periodically while data moves. */
+    std::vector<tcp_sample> samples;
+
+    /* Taken when the transfer ends, if the system supports TCP_INFO. */
+    std::optional<tcp_sample> final_sample;
+
+    /* MD5 of the contents in upper-case hex, if it was asked for. With the
+     * size it makes the name the server gives the object: '<md5>_<size>'.
+     */
+    std::optional<std::string> md5;
+
+    /* CRC-32C of the contents, if the transfer was checked. */
+    std::optional<std::uint32_t> crc32c;
+
+    /* What the server reported for the file in reply to 'HASH', if it
+     * could tell. The transfer has failed if the two differ.
+     */
+    std::optional<std::uint32_t> server_crc32c;
+
+    /* The IEEE CRC-32 of the contents, while it isn't known yet whether
+     * the server answers 'HASH', or once it is known it only answers
+     * 'XCRC'.
+     */
+    std::optional<std::uint32_t> crc32;
+
+    /* What the server reported in reply to 'XCRC'. The transfer has failed
+     * if the two differ.
+     */
+    std::optional<std::uint32_t> server_crc32;
+};
+
+} // namespace ftp
+#endif //FTP_TRANSFER_RESULT_HPP
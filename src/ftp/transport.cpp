@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "transport.hpp"
+#include <sys/socket.h>
+#include <cerrno>
+
+namespace ftp
+{
+
+/* Peeks without blocking. */
+static bool is_alive(int handle)
+{
+    char byte;
+    ssize_t len = ::recv(handle, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    if (len >= 0)
+    {
+        /* Either the peer has closed the connection or there is data
+         * nobody asked for.
+         */
+        return false;
+    }
+
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+bool tcp_transport::is_alive(socket & socket)
+{
+    return socket.is_open() && ftp::is_alive(socket.native_handle());
+}
+
+void unix_transport::connect(socket & socket,
+                             const std::string & path,
+                             std::uint16_t,
+                             boost::system::error_code & ec)
+{
+    socket.connect(boost::asio::local::stream_protocol::endpoint(path), ec);
+}
+
+void unix_transport::connect_data(socket & socket,
+                                  const std::string & path,
+                                  std::uint16_t port,
+                                  boost::system::error_code & ec)
+{
+    socket.connect(boost::asio::local::stream_protocol::endpoint(data_path(path, port)), ec);
+}
+
+std::string unix_transport::data_path(const std::string & path, std::uint16_t port)
+{
+    return path + "." + std::to_string(port);
+}
+
+bool unix_transport::is_alive(socket & socket)
+{
+    return socket.is_open() && ftp::is_alive(socket.native_handle());
+}
+
+} // namespace ftp
@@ -0,0 +1,113 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FTP_TRANSPORT_HPP
+#define FTP_TRANSPORT_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <cstdint>
+#include <string>
+
+namespace ftp
+{
+
+/* Connections and the client are templates over a transport, the kind of
+ * stream they run on. Since the transport is known at compile time, the
+ * reads and writes of a transfer are direct calls into its socket. A
+ * transport provides:
+ *
+ *  - socket: a stream with the parts of the interface of asio's sockets the
+ *    connections use: it is constructed from an io_context and has
+ *    get_executor, async_read_some, async_write_some, is_open, shutdown
+ *    and close. A deadline aborts pending operations with interrupter(),
+ *    found by argument-dependent lookup.
+ *  - is_tcp: whether the socket runs on TCP. Only connections over TCP
+ *    resolve names, race addresses, tune their sockets, sample TCP_INFO,
+ *    use Fast Open and source address pools, and accept active data
+ *    connections. They reach the TCP socket with tcp_layer(socket).
+ *  - is_tls: whether the connections can be secured with TLS, see
+ *    tls_transport.hpp.
+ *  - connect(socket, host, port, ec) and connect_data(socket, host, port,
+ *    ec): how control and data connections of transports other than TCP
+ *    reach the server. The host and port of a data connection are those of
+ *    the control connection and the port of the reply to 'EPSV'.
+ *  - is_alive(socket): whether the peer has neither closed the connection
+ *    nor sent anything, checked without blocking.
+ */
+struct tcp_transport
+{
+    using socket = boost::asio::ip::tcp::socket;
+
+    static constexpr bool is_tcp = true;
+
+    static constexpr bool is_tls = false;
+
+    static socket & tcp_layer(socket & socket)
+    {
+        return socket;
+    }
+
+    static const socket & tcp_layer(const socket & socket)
+    {
+        return socket;
+    }
+
+    static bool is_alive(socket & socket);
+};
+
+/* Unix-domain stream sockets, for servers on the same host. They skip the
+ * TCP stack of a loopback connection: no segmentation, checksums,
+ * acknowledgements or congestion control.
+ *
+ * The host is the path of the server's control socket, the port of the
+ * control connection is ignored. The data connection of a passive transfer
+ * goes to the control socket's path followed by a dot and the port of the
+ * reply to 'EPSV', e.g. '/run/ftpd.sock.50000', where the server listens
+ * for the transfer.
+ */
+struct unix_transport
+{
+    using socket = boost::asio::local::stream_protocol::socket;
+
+    static constexpr bool is_tcp = false;
+
+    static constexpr bool is_tls = false;
+
+    static void connect(socket & socket,
+                        const std::string & path,
+                        std::uint16_t port,
+                        boost::system::error_code & ec);
+
+    static void connect_data(socket & socket,
+                             const std::string & path,
+                             std::uint16_t port,
+                             boost::system::error_code & ec);
+
+    static std::string data_path(const std::string & path, std::uint16_t port);
+
+    static bool is_alive(socket & socket);
+};
+
+} // namespace ftp
+#endif //FTP_TRANSPORT_HPP
@@ -0,0 +1,765 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "upload_manifest.hpp"
+#include "ftp_exception.hpp"
+#include "detail/crc32c.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ftp
+{
+
+using std::string;
+using std::optional;
+using std::uint64_t;
+
+static const uint64_t index_magic = 0x31584449464e414d;
+static const std::uint32_t record_magic = 0x4345524d;
+
+/* Slots of each table in a new index. */
+static const std::size_t initial_capacity = 1024;
+
+struct upload_manifest::index_header
+{
+    uint64_t magic;
+    uint64_t capacity;
+    uint64_t files;
+    uint64_t contents;
+    /* How much of the log has been indexed. */
+    uint64_t log_size;
+    /* Whether the index was closed properly. */
+    uint64_t clean;
+};
+
+/* 'offset' is one past the offset of the record, so zero marks an empty
+ * slot.
+ */
+struct upload_manifest::slot
+{
+    uint64_t key;
+    uint64_t offset;
+};
+
+/* In host byte order, followed by the path and the remote name. */
+struct record_header
+{
+    std::uint32_t magic;
+    /* CRC-32C of the rest of the record. */
+    std::uint32_t crc;
+    std::uint32_t path_size;
+    std::uint32_t remote_size;
+    uint64_t inode;
+    std::int64_t mtime;
+    uint64_t size;
+    unsigned char md5[16];
+};
+
+static const std::size_t checked_offset = offsetof(record_header, path_size);
+
+/* The finalizer of SplitMix64. */
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+
+    return x;
+}
+
+static uint64_t file_key(uint64_t inode, std::int64_t mtime, uint64_t size)
+{
+    return mix(inode ^ mix(static_cast<uint64_t>(mtime) ^ mix(size)));
+}
+
+static bool parse_md5(const string & hex, unsigned char md5[16])
+{
+    if (hex.size() != 32 || hex.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < 16; i++)
+    {
+        md5[i] = static_cast<unsigned char>(std::stoul(hex.substr(2 * i, 2), nullptr, 16));
+    }
+
+    return true;
+}
+
+static string format_md5(const unsigned char md5[16])
+{
+    static const char digits[] = "0123456789ABCDEF";
+    string hex;
+
+    for (std::size_t i = 0; i < 16; i++)
+    {
+        hex += digits[md5[i] >> 4];
+        hex += digits[md5[i] & 0xf];
+    }
+
+    return hex;
+}
+
+/* MD5 is spread well enough already. */
+static uint64_t content_key(const unsigned char md5[16])
+{
+    uint64_t key;
+
+    std::memcpy(&key, md5, sizeof(key));
+
+    return key;
+}
+
+static bool read_all(int fd, void *data, std::size_t size, uint64_t offset)
+{
+    auto *bytes = static_cast<char *>(data);
+
+    while (size > 0)
+    {
+        ssize_t len = ::pread(fd, bytes, size, static_cast<off_t>(offset));
+
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (len <= 0)
+        {
+            return false;
+        }
+
+        bytes += len;
+        size -= len;
+        offset += len;
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, const void *data, std::size_t size, uint64_t offset)
+{
+    auto *bytes = static_cast<const char *>(data);
+
+    while (size > 0)
+    {
+        ssize_t len = ::pwrite(fd, bytes, size, static_cast<off_t>(offset));
+
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (len <= 0)
+        {
+            return false;
+        }
+
+        bytes += len;
+        size -= len;
+        offset += len;
+    }
+
+    return true;
+}
+
+std::size_t upload_manifest::index_bytes(std::size_t capacity)
+{
+    return sizeof(index_header) + 2 * capacity * sizeof(slot);
+}
+
+upload_manifest::upload_manifest(const string & path, bool sync)
+    : path_(path),
+      index_path_(path + ".index"),
+      sync_(sync),
+      log_fd_(-1),
+      log_size_(0),
+      index_(nullptr),
+      index_size_(0)
+{
+    struct stat info;
+
+    log_fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (log_fd_ < 0 || ::fstat(log_fd_, &info) != 0)
+    {
+        if (log_fd_ >= 0)
+        {
+            ::close(log_fd_);
+        }
+
+        throw ftp_exception("Cannot open manifest '%1%'.", path);
+    }
+
+    log_size_ = info.st_size;
+
+    try
+    {
+        open_index();
+    }
+    catch (...)
+    {
+        unmap_index();
+        ::close(log_fd_);
+        throw;
+    }
+}
+
+upload_manifest::~upload_manifest()
+{
+    /* The log must be on disk before the index says it is indexed. */
+    if (index_ && ::fdatasync(log_fd_) == 0)
+    {
+        static_cast<index_header *>(index_)->clean = 1;
+        ::msync(index_, index_size_, MS_SYNC);
+    }
+
+    unmap_index();
+    ::close(log_fd_);
+}
+
+void upload_manifest::open_index()
+{
+    int fd = ::open(index_path_.c_str(), O_RDWR | O_CLOEXEC);
+
+    if (fd >= 0)
+    {
+        struct stat info;
+        index_header header;
+
+        bool valid = ::fstat(fd, &info) == 0 &&
+                     read_all(fd, &header, sizeof(header), 0) &&
+                     header.magic == index_magic &&
+                     header.capacity >= initial_capacity &&
+                     (header.capacity & (header.capacity - 1)) == 0 &&
+                     static_cast<uint64_t>(info.st_size) == index_bytes(header.capacity) &&
+                     header.clean == 1 &&
+                     header.log_size <= log_size_;
+
+        if (valid)
+        {
+            map_index(fd, header.capacity);
+            ::close(fd);
+
+            /* Until it is closed properly again. */
+            static_cast<index_header *>(index_)->clean = 0;
+            replay(header.log_size);
+            return;
+        }
+
+        ::close(fd);
+    }
+
+    create_index(initial_capacity);
+    replay(0);
+}
+
+void upload_manifest::create_index(std::size_t capacity)
+{
+    /* Written beside the current index, which may still be mapped. */
+    string temporary = index_path_ + ".tmp";
+    int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0 || ::ftruncate(fd, index_bytes(capacity)) != 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+
+        throw ftp_exception("Cannot create manifest index '%1%'.", index_path_);
+    }
+
+    try
+    {
+        map_index(fd, capacity);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+
+    index_header *header = static_cast<index_header *>(index_);
+
+    header->magic = index_magic;
+    header->capacity = capacity;
+
+    if (std::rename(temporary.c_str(), index_path_.c_str()) != 0)
+    {
+        throw ftp_exception("Cannot create manifest index '%1%'.", index_path_);
+    }
+}
+
+void upload_manifest::map_index(int fd, std::size_t capacity)
+{
+    std::size_t size = index_bytes(capacity);
+    void *index = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (index == MAP_FAILED)
+    {
+        throw ftp_exception("Cannot map manifest index '%1%'.", index_path_);
+    }
+
+    index_ = index;
+    index_size_ = size;
+}
+
+void upload_manifest::unmap_index()
+{
+    if (index_)
+    {
+        ::munmap(index_, index_size_);
+        index_ = nullptr;
+        index_size_ = 0;
+    }
+}
+
+void upload_manifest::replay(uint64_t offset)
+{
+    while (offset < log_size_)
+    {
+        uint64_t size = 0;
+        optional<manifest_entry> entry = read_record(offset, &size);
+
+        if (!entry)
+        {
+            if (::ftruncate(log_fd_, offset) != 0)
+            {
+                throw ftp_exception("Cannot repair manifest '%1%'.", path_);
+            }
+
+            log_size_ = offset;
+            break;
+        }
+
+        index_record(*entry, offset);
+        offset += size;
+    }
+
+    static_cast<index_header *>(index_)->log_size = log_size_;
+}
+
+/* Keeps the tables at most half full, so probes stay short. */
+void upload_manifest::grow()
+{
+    const index_header old_header = *static_cast<index_header *>(index_);
+    void *old_index = index_;
+    std::size_t old_size = index_size_;
+    const slot *old_slots = reinterpret_cast<const slot *>(static_cast<const char *>(old_index) + sizeof(index_header));
+
+    index_ = nullptr;
+
+    try
+    {
+        create_index(old_header.capacity * 2);
+    }
+    catch (...)
+    {
+        unmap_index();
+        index_ = old_index;
+        index_size_ = old_size;
+        throw;
+    }
+
+    index_header *header = static_cast<index_header *>(index_);
+    const std::size_t mask = header->capacity - 1;
+
+    for (table which : { table::files, table::contents })
+    {
+        const slot *from = old_slots + (which == table::contents ? old_header.capacity : 0);
+        slot *to = slots(which);
+
+        for (std::size_t i = 0; i < old_header.capacity; i++)
+        {
+            if (from[i].offset == 0)
+            {
+                continue;
+            }
+
+            std::size_t j = from[i].key & mask;
+
+            while (to[j].offset != 0)
+            {
+                j = (j + 1) & mask;
+            }
+
+            to[j] = from[i];
+        }
+    }
+
+    header->files = old_header.files;
+    header->contents = old_header.contents;
+    header->log_size = old_header.log_size;
+
+    ::munmap(old_index, old_size);
+}
+
+auto upload_manifest::slots(table which) const -> slot *
+{
+    const index_header *header = static_cast<const index_header *>(index_);
+    slot *first = reinterpret_cast<slot *>(static_cast<char *>(index_) + sizeof(index_header));
+
+    return which == table::files ? first : first + header->capacity;
+}
+
+static bool matches(bool files, const manifest_entry & a, const manifest_entry & b)
+{
+    if (files)
+    {
+        return a.inode == b.inode && a.mtime == b.mtime && a.size == b.size;
+    }
+
+    return a.md5 == b.md5;
+}
+
+void upload_manifest::index_record(const manifest_entry & entry, uint64_t offset)
+{
+    index_header *header = static_cast<index_header *>(index_);
+
+    if ((std::max(header->files, header->contents) + 1) * 2 > header->capacity)
+    {
+        grow();
+        header = static_cast<index_header *>(index_);
+    }
+
+    unsigned char md5[16];
+
+    parse_md5(entry.md5, md5);
+
+    insert(table::files, file_key(entry.inode, entry.mtime, entry.size), offset, entry);
+    insert(table::contents, content_key(md5), offset, entry);
+}
+
+void upload_manifest::insert(table which, uint64_t key, uint64_t offset, const manifest_entry & entry)
+{
+    index_header *header = static_cast<index_header *>(index_);
+    const std::size_t mask = header->capacity - 1;
+    slot *table = slots(which);
+
+    for (std::size_t i = key & mask;; i = (i + 1) & mask)
+    {
+        if (table[i].offset == 0)
+        {
+            table[i].key = key;
+            table[i].offset = offset + 1;
+            ++(which == table::files ? header->files : header->contents);
+            return;
+        }
+
+        if (table[i].key == key)
+        {
+            optional<manifest_entry> found = read_record(table[i].offset - 1);
+
+            if (found && matches(which == table::files, *found, entry))
+            {
+                table[i].offset = offset + 1;
+                return;
+            }
+        }
+    }
+}
+
+optional<manifest_entry> upload_manifest::find(table which, uint64_t key, const manifest_entry & wanted) const
+{
+    const index_header *header = static_cast<const index_header *>(index_);
+    const std::size_t mask = header->capacity - 1;
+    const slot *table = slots(which);
+
+    for (std::size_t i = key & mask; table[i].offset != 0; i = (i + 1) & mask)
+    {
+        if (table[i].key == key)
+        {
+            optional<manifest_entry> found = read_record(table[i].offset - 1);
+
+            if (found && matches(which == table::files, *found, wanted))
+            {
+                return found;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+optional<manifest_entry> upload_manifest::read_record(uint64_t offset, uint64_t *size) const
+{
+    record_header header;
+
+    if (offset + sizeof(header) > log_size_ ||
+        !read_all(log_fd_, &header, sizeof(header), offset) ||
+        header.magic != record_magic)
+    {
+        return std::nullopt;
+    }
+
+    uint64_t total = sizeof(header) + static_cast<uint64_t>(header.path_size) + header.remote_size;
+
+    if (offset + total > log_size_)
+    {
+        return std::nullopt;
+    }
+
+    string strings(header.path_size + static_cast<std::size_t>(header.remote_size), '\0');
+
+    if (!strings.empty() && !read_all(log_fd_, &strings[0], strings.size(), offset + sizeof(header)))
+    {
+        return std::nullopt;
+    }
+
+    detail::crc32c crc;
+
+    crc.update(reinterpret_cast<const char *>(&header) + checked_offset, sizeof(header) - checked_offset);
+    crc.update(strings.data(), strings.size());
+
+    if (crc.value() != header.crc)
+    {
+        return std::nullopt;
+    }
+
+    manifest_entry entry;
+
+    entry.path = strings.substr(0, header.path_size);
+    entry.inode = header.inode;
+    entry.mtime = header.mtime;
+    entry.size = header.size;
+    entry.md5 = format_md5(header.md5);
+    entry.remote_name = strings.substr(header.path_size);
+
+    if (size)
+    {
+        *size = total;
+    }
+
+    return entry;
+}
+
+optional<manifest_entry> upload_manifest::find_file(uint64_t inode, std::int64_t mtime, uint64_t size) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    manifest_entry wanted;
+
+    wanted.inode = inode;
+    wanted.mtime = mtime;
+    wanted.size = size;
+
+    return find(table::files, file_key(inode, mtime, size), wanted);
+}
+
+optional<manifest_entry> upload_manifest::find_content(const string & md5) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsigned char binary[16];
+    manifest_entry wanted;
+
+    if (!parse_md5(md5, binary))
+    {
+        return std::nullopt;
+    }
+
+    wanted.md5 = format_md5(binary);
+
+    return find(table::contents, content_key(binary), wanted);
+}
+
+void upload_manifest::add(const manifest_entry & entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    record_header header{};
+
+    if (!parse_md5(entry.md5, header.md5))
+    {
+        throw ftp_exception("Invalid MD5 '%1%'.", entry.md5);
+    }
+
+    header.magic = record_magic;
+    header.path_size = static_cast<std::uint32_t>(entry.path.size());
+    header.remote_size = static_cast<std::uint32_t>(entry.remote_name.size());
+    header.inode = entry.inode;
+    header.mtime = entry.mtime;
+    header.size = entry.size;
+
+    string strings = entry.path + entry.remote_name;
+    detail::crc32c crc;
+
+    crc.update(reinterpret_cast<const char *>(&header) + checked_offset, sizeof(header) - checked_offset);
+    crc.update(strings.data(), strings.size());
+    header.crc = crc.value();
+
+    string record(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    record += strings;
+
+    if (!write_all(log_fd_, record.data(), record.size(), log_size_) || (sync_ && ::fdatasync(log_fd_) != 0))
+    {
+        throw ftp_exception("Cannot write manifest '%1%'.", path_);
+    }
+
+    uint64_t offset = log_size_;
+    manifest_entry normalized = entry;
+
+    normalized.md5 = format_md5(header.md5);
+    log_size_ += record.size();
+    index_record(normalized, offset);
+    static_cast<index_header *>(index_)->log_size = log_size_;
+}
+
+void upload_manifest::compact()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const index_header *header = static_cast<const index_header *>(index_);
+    std::vector<uint64_t> offsets;
+
+    for (table which : { table::files, table::contents })
+    {
+        const slot *table = slots(which);
+
+        for (std::size_t i = 0; i < header->capacity; i++)
+        {
+            if (table[i].offset != 0)
+            {
+                offsets.push_back(table[i].offset - 1);
+            }
+        }
+    }
+
+    /* In the order they were added. */
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+    string temporary = path_ + ".tmp";
+    int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    uint64_t size = 0;
+    std::size_t records = 0;
+    bool written = fd >= 0;
+
+    for (std::size_t i = 0; written && i < offsets.size(); i++)
+    {
+        uint64_t record_size = 0;
+        string record;
+
+        /* A damaged record isn't worth keeping, nor is its entry. */
+        if (!read_record(offsets[i], &record_size))
+        {
+            continue;
+        }
+
+        record.resize(record_size);
+
+        written = read_all(log_fd_, &record[0], record.size(), offsets[i]) &&
+                  write_all(fd, record.data(), record.size(), size);
+        size += record_size;
+        ++records;
+    }
+
+    if (!written || ::fsync(fd) != 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            std::remove(temporary.c_str());
+        }
+
+        throw ftp_exception("Cannot compact manifest '%1%'.", path_);
+    }
+
+    std::size_t capacity = initial_capacity;
+
+    while (records * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+
+    /* The new index is made before the log is replaced, so the old one
+     * still goes with the log if either fails. The index file on disk
+     * isn't clean until it is closed, it is rebuilt from the log should
+     * the process stop in between.
+     */
+    void *old_index = index_;
+    std::size_t old_size = index_size_;
+
+    index_ = nullptr;
+
+    try
+    {
+        create_index(capacity);
+
+        if (std::rename(temporary.c_str(), path_.c_str()) != 0)
+        {
+            throw ftp_exception("Cannot compact manifest '%1%'.", path_);
+        }
+    }
+    catch (...)
+    {
+        unmap_index();
+        index_ = old_index;
+        index_size_ = old_size;
+        ::close(fd);
+        std::remove(temporary.c_str());
+        throw;
+    }
+
+    ::munmap(old_index, old_size);
+    ::close(log_fd_);
+    log_fd_ = fd;
+    log_size_ = size;
+
+    replay(0);
+}
+
+auto upload_manifest::get_stats() const -> stats
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const index_header *header = static_cast<const index_header *>(index_);
+
+    return { header->files, header->contents, log_size_, header->capacity };
+}
+
+bool upload_manifest::identify(const string & path, uint64_t & inode, std::int64_t & mtime, uint64_t & size)
+{
+    struct stat info;
+
+    if (::stat(path.c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    inode = info.st_ino;
+    mtime = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    size = info.st_size;
+
+    return true;
+}
+
+} // namespace ftp
@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_UPLOAD_MANIFEST_HPP
+#define FTP_UPLOAD_MANIFEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace ftp
+{
+
+/* A local file that has been uploaded, and where to. */
+struct manifest_entry
+{
+    std::string path;
+
+    /* What tells whether the file has changed since. */
+    std::uint64_t inode = 0;
+    /* Nanoseconds since the epoch. */
+    std::int64_t mtime = 0;
+    std::uint64_t size = 0;
+
+    /* Of the contents, in upper-case hex. */
+    std::string md5;
+
+    std::string remote_name;
+};
+
+/* Remembers uploaded files across restarts, so they are neither hashed nor
+ * uploaded again. Entries are appended to a log at 'path', each with a
+ * CRC-32C, and indexed in 'path.index', two open-addressing hash tables
+ * mapped into memory: one by inode, modification time and size, one by
+ * the MD5 of the contents. A lookup probes a table and reads the record it
+ * finds, no matter how many entries there are.
+ *
+ * A record cut short by a crash is dropped when the manifest is opened
+ * again. The index is rebuilt from the log if it wasn't closed properly.
+ * Later entries of a file replace earlier ones, which stay in the log
+ * until it is compacted.
+ *
+ * A manifest may be shared by several clients, all methods are
+ * thread-safe. It must not be opened by several processes at once.
+ */
+class upload_manifest
+{
+public:
+    struct stats
+    {
+        /* Files and distinct contents indexed. */
+        std::size_t files;
+        std::size_t contents;
+        std::uint64_t log_bytes;
+        /* Slots of each table. */
+        std::size_t capacity;
+    };
+
+    /* Opens the manifest, creating it if needed. With 'sync', each entry is
+     * on disk before 'add' returns.
+     */
+    explicit upload_manifest(const std::string & path, bool sync = false);
+
+    upload_manifest(const upload_manifest &) = delete;
+
+    upload_manifest & operator=(const upload_manifest &) = delete;
+
+    ~upload_manifest();
+
+    std::optional<manifest_entry> find_file(std::uint64_t inode, std::int64_t mtime, std::uint64_t size) const;
+
+    /* The latest entry with the contents. */
+    std::optional<manifest_entry> find_content(const std::string & md5) const;
+
+    void add(const manifest_entry & entry);
+
+    /* Rewrites the log without the entries that have been replaced. */
+    void compact();
+
+    stats get_stats() const;
+
+    /* What find_file takes, of a local file. False if it can't be stat'ed. */
+    static bool identify(const std::string & path, std::uint64_t & inode, std::int64_t & mtime, std::uint64_t & size);
+
+private:
+    struct index_header;
+    struct slot;
+
+    enum class table
+    {
+        files,
+        contents
+    };
+
+    static std::size_t index_bytes(std::size_t capacity);
+
+    void open_index();
+
+    /* Creates an empty index with the capacity, replacing the current one. */
+    void create_index(std::size_t capacity);
+
+    void map_index(int fd, std::size_t capacity);
+
+    void unmap_index();
+
+    /* Indexes the records from the offset on. A record cut short or
+     * damaged ends the log there.
+     */
+    void replay(std::uint64_t offset);
+
+    void grow();
+
+    slot * slots(table which) const;
+
+    /* Points both tables at the record, growing them first if needed. */
+    void index_record(const manifest_entry & entry, std::uint64_t offset);
+
+    void insert(table which, std::uint64_t key, std::uint64_t offset, const manifest_entry & entry);
+
+    std::optional<manifest_entry> find(table which, std::uint64_t key, const manifest_entry & wanted) const;
+
+    /* The record at the offset and its size, if it is whole. */
+    std::optional<manifest_entry> read_record(std::uint64_t offset, std::uint64_t *size = nullptr) const;
+
+    const std::string path_;
+    const std::string index_path_;
+    const bool sync_;
+
+    mutable std::mutex mutex_;
+    int log_fd_;
+    std::uint64_t log_size_;
+    void *index_;
+    std::size_t index_size_;
+};
+
+} // namespace ftp
+#endif //FTP_UPLOAD_MANIFEST_HPP
@@ -0,0 +1,242 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/memory_transport.hpp"
+#include "ftp/detail/crc32.hpp"
+#include "ftp/detail/crc32c.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+
+using ftp::memory_transport;
+using ftp::detail::crc32;
+using ftp::detail::crc32c;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+static std::uint32_t checksum(const string & data)
+{
+    crc32c crc;
+
+    crc.update(data.data(), data.size());
+
+    return crc.value();
+}
+
+static std::uint32_t ieee_checksum(const string & data)
+{
+    crc32 crc;
+
+    crc.update(data.data(), data.size());
+
+    return crc.value();
+}
+
+static string hex(std::uint32_t value)
+{
+    std::ostringstream out;
+
+    out << std::hex << std::setw(8) << std::setfill('0') << value;
+
+    return out.str();
+}
+
+TEST(Crc32cTest, KnownValuesTest)
+{
+    /* RFC 3720, B.4. */
+    EXPECT_EQ(0xe3069283u, checksum("123456789"));
+    EXPECT_EQ(0x8a9136aau, checksum(string(32, '\0')));
+    EXPECT_EQ(0x62a8ab43u, checksum(string(32, '\xff')));
+    EXPECT_EQ(0u, checksum(""));
+}
+
+TEST(Crc32cTest, ChunksTest)
+{
+    string data(100000, '\0');
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<char>(i * 131 + 17);
+    }
+
+    crc32c crc;
+
+    for (size_t offset = 0, size = 1; offset < data.size(); offset += size, size = size * 2 + 1)
+    {
+        crc.update(data.data() + offset, std::min(size, data.size() - offset));
+    }
+
+    EXPECT_EQ(checksum(data), crc.value());
+}
+
+TEST(Crc32cTest, Crc32KnownValuesTest)
+{
+    EXPECT_EQ(0xcbf43926u, ieee_checksum("123456789"));
+    EXPECT_EQ(0x190a55adu, ieee_checksum(string(32, '\0')));
+    EXPECT_EQ(0xff6cab0bu, ieee_checksum(string(32, '\xff')));
+    EXPECT_EQ(0u, ieee_checksum(""));
+}
+
+TEST(Crc32cTest, Crc32ChunksTest)
+{
+    string data(100000, '\0');
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<char>(i * 131 + 17);
+    }
+
+    crc32 crc;
+
+    for (size_t offset = 0, size = 1; offset < data.size(); offset += size, size = size * 2 + 1)
+    {
+        crc.update(data.data() + offset, std::min(size, data.size() - offset));
+    }
+
+    EXPECT_EQ(ieee_checksum(data), crc.value());
+}
+
+/* The server reports the upload correctly and the download wrongly. XCRC
+ * isn't asked, as HASH works.
+ */
+TEST(Crc32cTest, ClientTest)
+{
+    fake_server server("crc.example.com");
+    const string contents(200000, 'c');
+
+    server.set_file("down.bin", contents);
+    server.on("OPTS", [&server](const string &)
+    {
+        server.reply("200 CRC32C selected.");
+    });
+    server.on("HASH", [&server, &contents](const string & line)
+    {
+        if (line == "HASH up.bin")
+        {
+            const string & received = server.stored().at("up.bin");
+
+            server.reply("213 CRC32C 0-" + std::to_string(received.size()) + " " + hex(checksum(received)) + " up.bin");
+        }
+        else
+        {
+            server.reply("213 CRC32C 0-" + std::to_string(contents.size()) + " " + hex(checksum(contents) ^ 1) + " down.bin");
+        }
+    });
+    server.start();
+
+    const string upload_file = "/tmp/crc32c_test_up_" + std::to_string(::getpid());
+    const string download_file = "/tmp/crc32c_test_down_" + std::to_string(::getpid());
+
+    std::ofstream(upload_file, std::ios_base::binary) << contents;
+
+    memory_client client;
+
+    client.set_verify_transfers(true);
+
+    ASSERT_TRUE(client.open("crc.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+
+    EXPECT_TRUE(client.upload(upload_file, "up.bin"));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_EQ(checksum(contents), client.last_transfer()->crc32c);
+    EXPECT_EQ(checksum(contents), client.last_transfer()->server_crc32c);
+
+    EXPECT_FALSE(client.download("down.bin", download_file));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_FALSE(client.last_transfer()->success);
+    EXPECT_EQ(checksum(contents), client.last_transfer()->crc32c);
+    EXPECT_EQ(checksum(contents) ^ 1, client.last_transfer()->server_crc32c);
+
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::remove(upload_file.c_str());
+    std::remove(download_file.c_str());
+
+    /* OPTS is sent once per session. */
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "EPSV_S", "STOR", "OPTS", "HASH",
+                                    "EPSV_S", "RETR", "HASH", "QUIT" }), server.commands());
+}
+
+/* A server without HASH answers XCRC with the IEEE CRC-32, which the
+ * client computes as well until it knows HASH doesn't work, and then
+ * instead of the CRC-32C.
+ */
+TEST(Crc32cTest, XcrcTest)
+{
+    fake_server server("xcrc.example.com");
+    const string contents(200000, 'x');
+
+    server.set_file("down.bin", contents);
+    server.on("XCRC", [&server, &contents](const string & line)
+    {
+        const string & data = line == "XCRC up.bin" ? server.stored().at("up.bin") : contents;
+
+        server.reply("250 " + hex(ieee_checksum(data)));
+    });
+    server.start();
+
+    const string upload_file = "/tmp/crc32c_test_xcrc_up_" + std::to_string(::getpid());
+    const string download_file = "/tmp/crc32c_test_xcrc_down_" + std::to_string(::getpid());
+
+    std::ofstream(upload_file, std::ios_base::binary) << contents;
+
+    memory_client client;
+
+    client.set_verify_transfers(true);
+
+    ASSERT_TRUE(client.open("xcrc.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+
+    EXPECT_TRUE(client.upload(upload_file, "up.bin"));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_EQ(ieee_checksum(contents), client.last_transfer()->crc32);
+    EXPECT_EQ(ieee_checksum(contents), client.last_transfer()->server_crc32);
+    EXPECT_FALSE(client.last_transfer()->server_crc32c);
+
+    EXPECT_TRUE(client.download("down.bin", download_file));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_TRUE(client.last_transfer()->success);
+    EXPECT_FALSE(client.last_transfer()->crc32c);
+    EXPECT_EQ(ieee_checksum(contents), client.last_transfer()->server_crc32);
+
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::remove(upload_file.c_str());
+    std::remove(download_file.c_str());
+
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "EPSV_S", "STOR", "OPTS", "XCRC",
+                                    "EPSV_S", "RETR", "XCRC", "QUIT" }), server.commands());
+}
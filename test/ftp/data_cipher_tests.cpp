@@ -0,0 +1,251 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/data_cipher.hpp"
+#include "ftp/memory_transport.hpp"
+#include "utils/RC4.h"
+#include "fake_server.hpp"
+
+using std::string;
+
+using ftp::memory_transport;
+using ftp::data_cipher_params;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+static string sample(size_t size)
+{
+    string data(size, '\0');
+
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = static_cast<char>(i * 31 + 7);
+    }
+
+    return data;
+}
+
+static string apply(const string & name, const data_cipher_params & params, string data)
+{
+    std::unique_ptr<ftp::data_cipher> cipher = ftp::make_data_cipher(name, params);
+
+    cipher->apply(&data[0], data.size());
+
+    return data;
+}
+
+TEST(DataCipherTest, ChunksTest)
+{
+    const data_cipher_params params{ "token", 0x01020304, 0 };
+    const string plain = sample(100000);
+
+    for (const string name : { "AES-256-CTR", "CHACHA20" })
+    {
+        std::unique_ptr<ftp::data_cipher> cipher = ftp::make_data_cipher(name, params);
+        string chunked = plain;
+
+        /* Sizes that don't line up with the block size. */
+        for (size_t offset = 0, size = 1; offset < chunked.size(); offset += size, size = size * 3 + 1)
+        {
+            cipher->apply(&chunked[offset], std::min(size, chunked.size() - offset));
+        }
+
+        EXPECT_EQ(apply(name, params, plain), chunked) << name;
+        EXPECT_NE(plain, chunked) << name;
+        EXPECT_EQ(plain, apply(name, params, chunked)) << name;
+    }
+}
+
+TEST(DataCipherTest, Rc4Test)
+{
+    string token = "0123456789abcdef";
+    const string plain = sample(5000);
+    string whole = plain;
+
+    RC4EncryptContent(&whole[0], whole.size(), &token[0], token.size());
+
+    std::unique_ptr<ftp::data_cipher> cipher = ftp::make_data_cipher("RC4", { token, 1, 2 });
+    string chunked = plain;
+
+    /* Chunks that cross the 512-byte sections anywhere. */
+    for (size_t offset = 0, size = 1; offset < chunked.size(); offset += size, size = size * 2 + 3)
+    {
+        cipher->apply(&chunked[offset], std::min(size, chunked.size() - offset));
+    }
+
+    EXPECT_EQ(whole, chunked);
+    EXPECT_EQ(plain, apply("RC4", { "", 0, 0 }, plain));
+}
+
+TEST(DataCipherTest, KeystreamTest)
+{
+    const string plain = sample(64);
+
+    for (const string name : { "AES-256-CTR", "CHACHA20" })
+    {
+        string first = apply(name, { "token", 1, 0 }, plain);
+
+        EXPECT_NE(first, apply(name, { "token", 1, 1 }, plain)) << name;
+        EXPECT_NE(first, apply(name, { "token", 2, 0 }, plain)) << name;
+        EXPECT_NE(first, apply(name, { "other", 1, 0 }, plain)) << name;
+    }
+}
+
+TEST(DataCipherTest, RegistryTest)
+{
+    struct xor_cipher : ftp::data_cipher
+    {
+        void apply(char *data, size_t size) override
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                data[i] ^= 0x5a;
+            }
+        }
+    };
+
+    EXPECT_FALSE(ftp::is_data_cipher("XOR"));
+    EXPECT_FALSE(ftp::make_data_cipher("XOR", { "token", 0, 0 }));
+
+    ftp::register_data_cipher("XOR", [](const data_cipher_params &)
+    {
+        return std::make_unique<xor_cipher>();
+    });
+
+    EXPECT_TRUE(ftp::is_data_cipher("XOR"));
+    EXPECT_EQ(string("\x5a\x5b", 2), apply("XOR", { "token", 0, 0 }, string("\0\1", 2)));
+}
+
+TEST(DataCipherTest, ClientTest)
+{
+    fake_server server("cipher.example.com");
+    const string contents = sample(300000);
+    std::vector<string> offered;
+    uint32_t nonce = 0;
+
+    server.on("DCPH", [&](const string & line)
+    {
+        string name = line.substr(5, line.rfind(' ') - 5);
+
+        offered.push_back(name);
+
+        if (name == "AES-256-CTR")
+        {
+            nonce = std::stoul(line.substr(line.rfind(' ') + 1), nullptr, 16);
+            server.reply("200 Cipher accepted.");
+        }
+        else
+        {
+            server.reply("504 Cipher not supported.");
+        }
+    });
+    server.on("RETR", [&](const string &)
+    {
+        std::unique_ptr<memory_transport::socket> data = server.accept_data();
+
+        server.reply("150 Opening data connection.");
+        server.reply("150 Opening data connection.");
+        write_line(*data, apply("AES-256-CTR", { server.token(), nonce, 0 }, contents));
+        data->close();
+        server.reply("226 Done.");
+    });
+    server.start();
+
+    const string local_file = "/tmp/data_cipher_test_" + std::to_string(::getpid());
+    memory_client client;
+
+    client.set_data_ciphers({ "CHACHA20", "UNKNOWN", "AES-256-CTR" });
+
+    ASSERT_TRUE(client.open("cipher.example.com"));
+    EXPECT_FALSE(client.negotiated_data_cipher());
+    ASSERT_TRUE(client.login("user", "password"));
+    ASSERT_TRUE(client.negotiated_data_cipher());
+    EXPECT_EQ("AES-256-CTR", *client.negotiated_data_cipher());
+    ASSERT_TRUE(client.download("file.bin", local_file));
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::ifstream file(local_file, std::ios_base::binary);
+    string downloaded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::remove(local_file.c_str());
+
+    /* Unknown names aren't offered. */
+    EXPECT_EQ((std::vector<string>{ "CHACHA20", "AES-256-CTR" }), offered);
+    EXPECT_EQ(contents, downloaded);
+}
+
+/* The server doesn't know DCPH. Contents go encrypted with RC4 and the
+ * token both ways all the same, as the caller asked for it.
+ */
+TEST(DataCipherTest, ContentRc4Test)
+{
+    fake_server server("rc4.example.com");
+    const string contents = sample(3000);
+    string encrypted = contents;
+    string token = server.token();
+
+    RC4EncryptContent(&encrypted[0], encrypted.size(), &token[0], token.size());
+    server.set_file("down.bin", encrypted);
+    server.start();
+
+    const string upload_file = "/tmp/data_cipher_test_rc4_up_" + std::to_string(::getpid());
+    const string download_file = "/tmp/data_cipher_test_rc4_down_" + std::to_string(::getpid());
+
+    std::ofstream(upload_file, std::ios_base::binary) << contents;
+
+    memory_client client;
+
+    client.set_data_ciphers({ "RC4" });
+    client.set_content_rc4(true);
+
+    ASSERT_TRUE(client.open("rc4.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_EQ(std::optional<string>("RC4"), client.negotiated_data_cipher());
+    EXPECT_TRUE(client.upload(upload_file, "up.bin"));
+    EXPECT_TRUE(client.download("down.bin", download_file));
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::ifstream file(download_file, std::ios_base::binary);
+    string downloaded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::remove(upload_file.c_str());
+    std::remove(download_file.c_str());
+
+    EXPECT_EQ(encrypted, server.stored().at("up.bin"));
+    EXPECT_EQ(contents, downloaded);
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "EPSV_S", "STOR", "EPSV_S", "RETR", "QUIT" }),
+              server.commands());
+}
@@ -0,0 +1,196 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "ftp/detail/connection_exception.hpp"
+#include "ftp/detail/crc32c.hpp"
+#include "ftp/detail/data_connection.hpp"
+#include "ftp/detail/md5.hpp"
+
+using boost::asio::ip::tcp;
+
+using ftp::detail::data_connection;
+
+TEST(DataConnectionTest, StartOpenTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    data_connection connection("127.0.0.1", acceptor.local_endpoint().port());
+    connection.start_open();
+
+    /* The handshake completes without anyone waiting for it. */
+    tcp::socket peer(io_context);
+    acceptor.accept(peer);
+
+    connection.open();
+
+    EXPECT_TRUE(connection.is_open());
+    EXPECT_TRUE(connection.is_alive());
+
+    peer.close();
+
+    /* Let the FIN arrive. */
+    for (int i = 0; i < 100 && connection.is_alive(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    EXPECT_FALSE(connection.is_alive());
+}
+
+TEST(DataConnectionTest, StartOpenRefusedTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    uint16_t port = acceptor.local_endpoint().port();
+
+    acceptor.close();
+
+    data_connection connection("127.0.0.1", port);
+    connection.start_open();
+
+    EXPECT_THROW(connection.open(), ftp::detail::connection_exception);
+    EXPECT_FALSE(connection.is_open());
+}
+
+TEST(DataConnectionTest, FastOpenTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    /* Whether or not the system and the listener support Fast Open, the data
+     * must arrive.
+     */
+    for (int i = 0; i < 2; ++i)
+    {
+        data_connection connection("127.0.0.1", acceptor.local_endpoint().port());
+        connection.set_fast_open(true);
+        connection.open();
+        connection.send("hello", 5);
+
+        tcp::socket peer(io_context);
+        acceptor.accept(peer);
+
+        std::array<char, 5> data;
+        boost::asio::read(peer, boost::asio::buffer(data));
+
+        EXPECT_EQ("hello", std::string(data.data(), data.size()));
+
+        connection.close();
+    }
+}
+
+TEST(DataConnectionTest, TransferResultTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    data_connection connection("127.0.0.1", acceptor.local_endpoint().port());
+    connection.set_sample_interval(std::chrono::milliseconds(0));
+    connection.open();
+
+    tcp::socket peer(io_context);
+    acceptor.accept(peer);
+
+    std::thread writer([&peer]()
+    {
+        std::vector<char> data(1024 * 1024, 'x');
+        boost::asio::write(peer, boost::asio::buffer(data));
+        peer.close();
+    });
+
+    std::string data = connection.recv();
+    connection.close();
+    writer.join();
+
+    const ftp::transfer_result & result = connection.result();
+
+    EXPECT_EQ(1024u * 1024u, data.size());
+    EXPECT_EQ(1024u * 1024u, result.bytes);
+    EXPECT_LE(result.network_time, result.duration);
+    EXPECT_FALSE(result.samples.empty());
+    ASSERT_TRUE(result.final_sample);
+    /* The kernel counts the FIN as well. */
+    EXPECT_LE(1024u * 1024u, result.final_sample->bytes_received);
+}
+
+TEST(DataConnectionTest, SendFileTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              ("ftp_send_file_test_" + std::to_string(::getpid()))).string();
+    std::string data(4 * 1024 * 1024, 'x');
+
+    data.replace(0, 5, "hello");
+    std::ofstream(path, std::ios_base::binary) << data;
+
+    data_connection connection("127.0.0.1", acceptor.local_endpoint().port());
+    connection.set_checksum(true);
+    connection.set_md5(true);
+    connection.open();
+
+    tcp::socket peer(io_context);
+    acceptor.accept(peer);
+
+    /* Reads while the connection sends, the file doesn't fit into the
+     * socket buffers.
+     */
+    std::string received;
+    std::thread reader([&peer, &received]()
+    {
+        boost::system::error_code ec;
+
+        boost::asio::read(peer, boost::asio::dynamic_buffer(received), ec);
+    });
+
+    EXPECT_TRUE(connection.send_file(path, 5));
+    connection.close();
+    reader.join();
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(data.substr(5), received);
+    EXPECT_EQ(data.size() - 5, connection.result().bytes);
+
+    ftp::detail::crc32c crc;
+
+    crc.update(received.data(), received.size());
+    EXPECT_EQ(crc.value(), connection.result().crc32c);
+
+    ftp::detail::md5 hash;
+
+    hash.update(received.data(), received.size());
+    EXPECT_EQ(hash.hex_digest(), connection.result().md5);
+}
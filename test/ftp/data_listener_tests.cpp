@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include "ftp/detail/data_listener.hpp"
+
+using std::chrono::milliseconds;
+using boost::asio::ip::make_address;
+using boost::asio::ip::tcp;
+
+using ftp::detail::data_listener;
+
+TEST(DataListenerTest, AcceptTest)
+{
+    data_listener listener(make_address("127.0.0.1"));
+    boost::asio::io_context io_context;
+
+    /* The listener is reused for each transfer. */
+    for (int i = 0; i < 3; ++i)
+    {
+        tcp::socket client(io_context);
+        tcp::socket server(io_context);
+
+        client.connect(listener.local_endpoint());
+
+        ASSERT_TRUE(listener.accept(server, make_address("127.0.0.1"), milliseconds(1000), nullptr));
+        EXPECT_EQ(client.local_endpoint(), server.remote_endpoint());
+    }
+
+    EXPECT_TRUE(listener.is_open());
+}
+
+TEST(DataListenerTest, UnexpectedPeerTest)
+{
+    data_listener listener(make_address("127.0.0.1"));
+    boost::asio::io_context io_context;
+    tcp::socket intruder(io_context);
+    tcp::socket client(io_context);
+    tcp::socket server(io_context);
+
+    intruder.open(tcp::v4());
+    intruder.bind(tcp::endpoint(make_address("127.0.0.2"), 0));
+    intruder.connect(listener.local_endpoint());
+    client.connect(listener.local_endpoint());
+
+    ASSERT_TRUE(listener.accept(server, make_address("127.0.0.1"), milliseconds(1000), nullptr));
+    EXPECT_EQ(client.local_endpoint(), server.remote_endpoint());
+}
+
+TEST(DataListenerTest, TimeoutTest)
+{
+    data_listener listener(make_address("127.0.0.1"));
+    boost::asio::io_context io_context;
+    tcp::socket server(io_context);
+    ftp::timer_service timers(milliseconds(10));
+
+    EXPECT_FALSE(listener.accept(server, make_address("127.0.0.1"), milliseconds(50), nullptr));
+    EXPECT_FALSE(listener.accept(server, make_address("127.0.0.1"), milliseconds(50), &timers));
+
+    /* The listener survives a timeout. */
+    tcp::socket client(io_context);
+    client.connect(listener.local_endpoint());
+
+    EXPECT_TRUE(listener.accept(server, make_address("127.0.0.1"), milliseconds(1000), &timers));
+}
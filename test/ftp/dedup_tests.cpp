@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/memory_transport.hpp"
+#include "ftp/detail/md5.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+
+using ftp::memory_transport;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+static string object_name(const string & contents)
+{
+    ftp::detail::md5 hash;
+
+    hash.update(contents.data(), contents.size());
+
+    return hash.hex_digest() + "_" + std::to_string(contents.size());
+}
+
+/* The server has the first file. The other two have the same contents,
+ * which are uploaded once.
+ */
+TEST(DedupTest, UploadObjectsTest)
+{
+    fake_server server("dedup.example.com");
+    const std::vector<string> contents{ string(1000, 'a'), string(5000, 'b'), string(5000, 'b') };
+    const string present = "objects/" + object_name(contents[0]);
+    std::vector<string> checks;
+
+    server.on("MLST", [&](const string & line)
+    {
+        /* Replies only once all checks have arrived, which they do only if
+         * they were sent without waiting.
+         */
+        checks.push_back(line.substr(5));
+
+        if (checks.size() == contents.size())
+        {
+            for (const string & object : checks)
+            {
+                if (object == present)
+                {
+                    server.reply_encrypted("250 type=file;size=1000; " + object);
+                }
+                else
+                {
+                    server.reply("550 No such object.");
+                }
+            }
+        }
+    });
+    server.start();
+
+    std::vector<string> local_files;
+
+    for (size_t i = 0; i < contents.size(); i++)
+    {
+        local_files.push_back("/tmp/dedup_test_" + std::to_string(::getpid()) + "_" + std::to_string(i));
+        std::ofstream(local_files.back(), std::ios_base::binary) << contents[i];
+    }
+
+    memory_client client;
+
+    ASSERT_TRUE(client.open("dedup.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+
+    std::vector<std::optional<string>> objects = client.upload_objects(local_files, "objects");
+
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    for (const string & local_file : local_files)
+    {
+        std::remove(local_file.c_str());
+    }
+
+    const string uploaded = "objects/" + object_name(contents[1]);
+
+    EXPECT_EQ((std::vector<std::optional<string>>{ present, uploaded, uploaded }), objects);
+    EXPECT_EQ(1u, server.stored().size());
+    EXPECT_EQ(1u, server.stored().count(uploaded));
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "MLST", "MLST", "MLST", "EPSV_S", "STOR", "QUIT" }),
+              server.commands());
+
+    ftp::dedup_stats stats = client.get_dedup_stats();
+
+    EXPECT_EQ(3u, stats.checked);
+    EXPECT_EQ(2u, stats.skipped);
+    EXPECT_EQ(contents[0].size() + contents[2].size(), stats.bytes_saved);
+}
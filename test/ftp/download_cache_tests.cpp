@@ -0,0 +1,244 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/download_cache.hpp"
+#include "ftp/memory_transport.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+
+using ftp::download_cache;
+using ftp::memory_transport;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+class DownloadCacheTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        directory_ = "/tmp/download_cache_test_" + std::to_string(::getpid());
+        std::filesystem::remove_all(directory_);
+        std::filesystem::create_directories(directory_ + "/files");
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(directory_);
+    }
+
+    string cache_directory() const
+    {
+        return directory_ + "/cache";
+    }
+
+    /* Writes a file below the test directory and returns its path. */
+    string write_file(const string & name, const string & contents) const
+    {
+        string path = directory_ + "/files/" + name;
+
+        std::ofstream(path, std::ios_base::binary) << contents;
+
+        return path;
+    }
+
+    string local_file(const string & name) const
+    {
+        return directory_ + "/files/" + name;
+    }
+
+    static string read_file(const string & path)
+    {
+        std::ifstream file(path, std::ios_base::binary);
+        std::ostringstream contents;
+
+        contents << file.rdbuf();
+
+        return contents.str();
+    }
+
+    string directory_;
+};
+
+TEST_F(DownloadCacheTest, FetchTest)
+{
+    download_cache cache(cache_directory(), 1024 * 1024);
+
+    EXPECT_FALSE(cache.fetch("a", local_file("missing")));
+    EXPECT_FALSE(std::filesystem::exists(local_file("missing")));
+
+    ASSERT_TRUE(cache.store("a", write_file("a", "contents of a")));
+    ASSERT_TRUE(cache.fetch("a", local_file("a1")));
+    EXPECT_EQ("contents of a", read_file(local_file("a1")));
+
+    /* The target must not exist. */
+    EXPECT_FALSE(cache.fetch("a", local_file("a1")));
+
+    download_cache::stats stats = cache.get_stats();
+
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(0u, stats.hard_links);
+    EXPECT_EQ(1u, stats.reflinks + stats.copies);
+    EXPECT_EQ(1u, stats.stores);
+    EXPECT_EQ(13u, stats.bytes);
+    EXPECT_EQ(1u, stats.entries);
+}
+
+/* Without hard links, the file placed is the caller's to change. */
+TEST_F(DownloadCacheTest, HardLinksTest)
+{
+    download_cache cache(cache_directory(), 1024 * 1024);
+
+    ASSERT_TRUE(cache.store("a", write_file("a", "contents of a")));
+    ASSERT_TRUE(cache.fetch("a", local_file("a1")));
+
+    EXPECT_EQ(1u, std::filesystem::hard_link_count(local_file("a1")));
+    EXPECT_NE(std::filesystem::perms::none,
+              std::filesystem::status(local_file("a1")).permissions() & std::filesystem::perms::owner_write);
+
+    cache.set_hard_links(true);
+
+    ASSERT_TRUE(cache.fetch("a", local_file("a2")));
+    EXPECT_EQ("contents of a", read_file(local_file("a2")));
+
+    download_cache::stats stats = cache.get_stats();
+
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(2u, stats.reflinks + stats.hard_links + stats.copies);
+    EXPECT_EQ(stats.hard_links == 1 ? 2u : 1u, std::filesystem::hard_link_count(local_file("a2")));
+}
+
+TEST_F(DownloadCacheTest, ReplaceTest)
+{
+    download_cache cache(cache_directory(), 1024 * 1024);
+
+    ASSERT_TRUE(cache.store("a", write_file("old", "old")));
+    ASSERT_TRUE(cache.store("a", write_file("new", "newer")));
+    ASSERT_TRUE(cache.fetch("a", local_file("a")));
+    EXPECT_EQ("newer", read_file(local_file("a")));
+    EXPECT_EQ(5u, cache.get_stats().bytes);
+    EXPECT_EQ(1u, cache.get_stats().entries);
+}
+
+TEST_F(DownloadCacheTest, EvictionTest)
+{
+    download_cache cache(cache_directory(), 1000);
+    const string contents(400, 'x');
+
+    ASSERT_TRUE(cache.store("a", write_file("a", contents)));
+    ASSERT_TRUE(cache.store("b", write_file("b", contents)));
+
+    /* Makes 'b' the least recently used. */
+    ASSERT_TRUE(cache.fetch("a", local_file("a1")));
+    ASSERT_TRUE(cache.store("c", write_file("c", contents)));
+
+    EXPECT_FALSE(cache.fetch("b", local_file("b1")));
+    EXPECT_TRUE(cache.fetch("a", local_file("a2")));
+    EXPECT_TRUE(cache.fetch("c", local_file("c1")));
+
+    /* Larger than the whole cache. */
+    EXPECT_FALSE(cache.store("d", write_file("d", string(1001, 'x'))));
+
+    download_cache::stats stats = cache.get_stats();
+
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_EQ(800u, stats.bytes);
+    EXPECT_EQ(2u, stats.entries);
+}
+
+TEST_F(DownloadCacheTest, ReopenTest)
+{
+    {
+        download_cache cache(cache_directory(), 1024 * 1024);
+
+        ASSERT_TRUE(cache.store("a", write_file("a", "contents of a")));
+    }
+
+    /* As if a store was interrupted. */
+    std::ofstream(cache_directory() + "/0123.tmp.0") << "partial";
+
+    download_cache cache(cache_directory(), 1024 * 1024);
+
+    EXPECT_TRUE(cache.fetch("a", local_file("a1")));
+    EXPECT_EQ("contents of a", read_file(local_file("a1")));
+    EXPECT_EQ(1u, cache.get_stats().entries);
+    EXPECT_FALSE(std::filesystem::exists(cache_directory() + "/0123.tmp.0"));
+}
+
+/* The second download of each file comes from the cache. A file is checked
+ * by its size and modification time, an object by its name alone.
+ */
+TEST_F(DownloadCacheTest, ClientTest)
+{
+    fake_server server("cache.example.com");
+    const string contents(3000, 'c');
+    const string object = "objects/0123456789ABCDEF0123456789ABCDEF_3000";
+
+    server.set_file("/data/file", contents);
+    server.set_file(object, contents);
+    server.on("SIZE", [&](const string &)
+    {
+        server.reply_encrypted("213 " + std::to_string(contents.size()));
+    });
+    server.on("MDTM", [&](const string &)
+    {
+        server.reply("213 20261019120000");
+    });
+    server.start();
+
+    memory_client client;
+
+    client.set_download_cache(std::make_shared<download_cache>(cache_directory(), 1024 * 1024));
+
+    ASSERT_TRUE(client.open("cache.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+
+    EXPECT_TRUE(client.download("/data/file", local_file("file1")));
+    EXPECT_TRUE(client.download("/data/file", local_file("file2")));
+    EXPECT_TRUE(client.download(object, local_file("object1")));
+    EXPECT_TRUE(client.download(object, local_file("object2")));
+
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    for (const char *name : { "file1", "file2", "object1", "object2" })
+    {
+        EXPECT_EQ(contents, read_file(local_file(name))) << name;
+    }
+
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S",
+                                    "SIZE", "MDTM", "EPSV_S", "RETR",
+                                    "SIZE", "MDTM",
+                                    "EPSV_S", "RETR",
+                                    "QUIT" }), server.commands());
+}
@@ -0,0 +1,412 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FTP_TEST_FAKE_SERVER_HPP
+#define FTP_TEST_FAKE_SERVER_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ftp/memory_transport.hpp"
+#include "utils/RC4.h"
+
+/* Replies the client decrypts are hex-encoded RC4 after a two character
+ * prefix.
+ */
+inline std::string encrypted_reply(const std::string & text, const std::string & key)
+{
+    std::string hex(text.size() * 2 + 1, '\0');
+
+    RC4EncryptStr(&hex[0], text.data(), text.size(), key.data(), key.size());
+    hex.resize(text.size() * 2);
+
+    return "20" + hex + "\r\n";
+}
+
+/* A line without its CRLF, or an empty string once the peer is gone. */
+template<typename Stream>
+std::string read_command(Stream & stream, std::string & buffer)
+{
+    boost::system::error_code ec;
+    std::size_t len = boost::asio::read_until(stream, boost::asio::dynamic_buffer(buffer), '\n', ec);
+
+    if (ec)
+    {
+        return std::string();
+    }
+
+    std::string line = buffer.substr(0, len - 2);
+
+    buffer.erase(0, len);
+
+    return line;
+}
+
+template<typename Stream>
+void write_line(Stream & stream, const std::string & line)
+{
+    boost::system::error_code ignored;
+
+    boost::asio::write(stream, boost::asio::buffer(line), ignored);
+}
+
+/* A scripted server of the protocol the client speaks, on the in-memory
+ * transport. It logs in anyone, handing out its token, and serves EPSV_S,
+ * STOR, RETR, NOOP and QUIT. Tests add commands, or replace these, with
+ * 'on'. Commands it doesn't know are refused with 502.
+ *
+ * 'start' serves control connections, each on a thread of its own until
+ * QUIT or until the client goes away. Handlers of different connections
+ * may run at the same time. What the server recorded may only be looked at
+ * after 'join'.
+ */
+class fake_server
+{
+public:
+    /* Handles a command, given its whole line. */
+    using handler = std::function<void (const std::string & line)>;
+
+    /* Listens on port 21 of the host, and on a data port. */
+    explicit fake_server(const std::string & host, const std::string & token = "secret")
+        : token_(token)
+    {
+        add_handlers();
+        control_acceptor_ = std::make_unique<ftp::memory_transport::acceptor>(host, 21);
+        data_acceptor_ = std::make_unique<ftp::memory_transport::acceptor>(host);
+
+        on("EPSV_S", [this](const std::string &)
+        {
+            reply_encrypted("229 Entering Extended Passive Mode (|||" + std::to_string(data_port()) + "|)");
+        });
+    }
+
+    /* Without listening, for tests that pass connections of their own to
+     * 'serve'.
+     */
+    fake_server()
+        : token_("secret")
+    {
+        add_handlers();
+    }
+
+    fake_server(const fake_server &) = delete;
+
+    fake_server & operator=(const fake_server &) = delete;
+
+    ~fake_server()
+    {
+        join();
+    }
+
+    void on(const std::string & command, handler handler)
+    {
+        handlers_[command] = std::move(handler);
+    }
+
+    /* Greets the next control connections and serves them. 'join' waits
+     * for exactly that many.
+     */
+    void start(std::size_t connections = 1)
+    {
+        thread_ = std::thread([this, connections]()
+        {
+            std::vector<std::thread> sessions;
+
+            for (std::size_t i = 0; i < connections; ++i)
+            {
+                auto control = std::make_shared<ftp::memory_transport::socket>(io_context_);
+
+                control_acceptor_->accept(*control);
+                write_line(*control, "220 Welcome\r\n");
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    controls_.push_back(control);
+                }
+
+                sessions.emplace_back([this, control]()
+                {
+                    serve(*control);
+                });
+            }
+
+            for (std::thread & session : sessions)
+            {
+                session.join();
+            }
+        });
+    }
+
+    /* Drops the control connections without a word, as if the network
+     * went away.
+     */
+    void hang_up()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (const auto & control : controls_)
+        {
+            boost::system::error_code ignored;
+
+            control->shutdown(boost::asio::socket_base::shutdown_both, ignored);
+        }
+    }
+
+    void join()
+    {
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    /* Answers commands from the connection until QUIT or until the client
+     * goes away.
+     */
+    template<typename Stream>
+    void serve(Stream & control)
+    {
+        std::string buffer;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            writers_[std::this_thread::get_id()] = [&control](const std::string & line)
+            {
+                write_line(control, line);
+            };
+        }
+
+        for (;;)
+        {
+            std::string line = read_command(control, buffer);
+
+            if (line.empty())
+            {
+                break;
+            }
+
+            std::string command = line.substr(0, line.find(' '));
+            auto it = handlers_.find(command);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                commands_.push_back(command);
+                lines_.push_back(line);
+            }
+
+            if (it != handlers_.end())
+            {
+                it->second(line);
+            }
+            else
+            {
+                reply("502 Not implemented.");
+            }
+
+            if (command == "QUIT")
+            {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        writers_.erase(std::this_thread::get_id());
+    }
+
+    /* On the connection whose command is being handled. */
+    void reply(const std::string & text)
+    {
+        write(text + "\r\n");
+    }
+
+    /* Encrypted with the token unless told otherwise, as the server does
+     * once the client has logged in.
+     */
+    void reply_encrypted(const std::string & text)
+    {
+        reply_encrypted(text, token_);
+    }
+
+    void reply_encrypted(const std::string & text, const std::string & key)
+    {
+        write(encrypted_reply(text, key));
+    }
+
+    /* Accepts the data connection of a transfer. */
+    std::unique_ptr<ftp::memory_transport::socket> accept_data()
+    {
+        auto data = std::make_unique<ftp::memory_transport::socket>(io_context_);
+
+        data_acceptor_->accept(*data);
+
+        return data;
+    }
+
+    /* The argument of a command, without the file name the client adds to
+     * transfer commands.
+     */
+    static std::string argument(const std::string & line)
+    {
+        std::size_t first = line.find(' ');
+        std::size_t last = line.rfind(' ');
+
+        if (first == std::string::npos)
+        {
+            return std::string();
+        }
+
+        return first == last ? line.substr(first + 1) : line.substr(first + 1, last - first - 1);
+    }
+
+    /* Served by RETR. */
+    void set_file(const std::string & name, const std::string & contents)
+    {
+        files_[name] = contents;
+    }
+
+    /* Received by STOR, by name. */
+    const std::map<std::string, std::string> & stored() const
+    {
+        return stored_;
+    }
+
+    const std::vector<std::string> & commands() const
+    {
+        return commands_;
+    }
+
+    const std::vector<std::string> & lines() const
+    {
+        return lines_;
+    }
+
+    const std::string & token() const
+    {
+        return token_;
+    }
+
+    std::uint16_t data_port() const
+    {
+        return data_acceptor_->port();
+    }
+
+private:
+    void add_handlers()
+    {
+        on("USER_S", [this](const std::string &)
+        {
+            reply_encrypted("331 Password required.", "tipray");
+        });
+        on("PASS_S", [this](const std::string &)
+        {
+            reply_encrypted("230 Token=" + token_ + ".", "tipray");
+        });
+        on("STOR", [this](const std::string & line)
+        {
+            std::unique_ptr<ftp::memory_transport::socket> data = accept_data();
+            std::string received;
+            boost::system::error_code ec;
+
+            /* The client reads a second reply to transfer commands. */
+            reply("150 Ok to send data.");
+            reply("150 Ok to send data.");
+            boost::asio::read(*data, boost::asio::dynamic_buffer(received), ec);
+            data->close();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stored_[argument(line)] = received;
+            }
+
+            reply("226 Done.");
+        });
+        on("RETR", [this](const std::string & line)
+        {
+            auto it = files_.find(argument(line));
+
+            if (it == files_.end())
+            {
+                reply("550 No such file.");
+                return;
+            }
+
+            std::unique_ptr<ftp::memory_transport::socket> data = accept_data();
+
+            reply("150 Opening data connection.");
+            reply("150 Opening data connection.");
+            write_line(*data, it->second);
+            data->close();
+            reply("226 Done.");
+        });
+        on("NOOP", [this](const std::string &)
+        {
+            reply("200 OK.");
+        });
+        on("QUIT", [this](const std::string &)
+        {
+            reply("221 Bye.");
+        });
+    }
+
+    void write(const std::string & line)
+    {
+        std::function<void (const std::string &)> writer;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writer = writers_.at(std::this_thread::get_id());
+        }
+
+        writer(line);
+    }
+
+    const std::string token_;
+    boost::asio::io_context io_context_;
+    std::unique_ptr<ftp::memory_transport::acceptor> control_acceptor_;
+    std::unique_ptr<ftp::memory_transport::acceptor> data_acceptor_;
+    std::map<std::string, handler> handlers_;
+    std::mutex mutex_;
+    /* Of the connection each thread serves. */
+    std::map<std::thread::id, std::function<void (const std::string &)>> writers_;
+    std::vector<std::shared_ptr<ftp::memory_transport::socket>> controls_;
+    std::map<std::string, std::string> files_;
+    std::map<std::string, std::string> stored_;
+    std::vector<std::string> commands_;
+    std::vector<std::string> lines_;
+    std::thread thread_;
+};
+
+#endif //FTP_TEST_FAKE_SERVER_HPP
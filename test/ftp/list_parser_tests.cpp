@@ -0,0 +1,109 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include "ftp/detail/list_parser.hpp"
+
+using std::string;
+using std::vector;
+
+using ftp::list_entry;
+using ftp::detail::parse_list;
+using ftp::detail::parse_stat_listing;
+using ftp::detail::try_parse_list_line;
+
+TEST(ListParserTest, ParseUnixLineTest)
+{
+    list_entry entry;
+
+    ASSERT_TRUE(try_parse_list_line("-rw-r--r--   1 owner    group      370692 Jan 01 00:00 file.txt\r\n", entry));
+    EXPECT_EQ("file.txt", entry.name);
+    EXPECT_EQ(list_entry::entry_type::file, entry.type);
+    EXPECT_EQ(370692u, entry.size);
+    EXPECT_EQ("-rw-r--r--", entry.permissions);
+    EXPECT_EQ("Jan 01 00:00", entry.modified);
+
+    ASSERT_TRUE(try_parse_list_line("drwxr-xr-x   2 owner    group        4096 Dec 31  2019 dir with spaces", entry));
+    EXPECT_EQ("dir with spaces", entry.name);
+    EXPECT_TRUE(entry.is_directory());
+    EXPECT_EQ("Dec 31  2019", entry.modified);
+
+    ASSERT_TRUE(try_parse_list_line("lrwxrwxrwx   1 owner    group          11 Jan 01 00:00 link -> target", entry));
+    EXPECT_EQ("link", entry.name);
+    EXPECT_EQ("target", entry.link_target);
+    EXPECT_EQ(list_entry::entry_type::link, entry.type);
+}
+
+TEST(ListParserTest, ParseUnixLineWithoutGroupTest)
+{
+    list_entry entry;
+
+    ASSERT_TRUE(try_parse_list_line("-rw-r--r--   1 owner      42 Feb 10 12:30 file", entry));
+    EXPECT_EQ("file", entry.name);
+    EXPECT_EQ(42u, entry.size);
+}
+
+TEST(ListParserTest, ParseDosLineTest)
+{
+    list_entry entry;
+
+    ASSERT_TRUE(try_parse_list_line("01-16-02  11:14AM       <DIR>          epsgroup", entry));
+    EXPECT_EQ("epsgroup", entry.name);
+    EXPECT_TRUE(entry.is_directory());
+
+    ASSERT_TRUE(try_parse_list_line("01-16-02  11:14AM               370692 file name.txt", entry));
+    EXPECT_EQ("file name.txt", entry.name);
+    EXPECT_EQ(370692u, entry.size);
+    EXPECT_EQ(list_entry::entry_type::file, entry.type);
+}
+
+TEST(ListParserTest, ParseInvalidLineTest)
+{
+    list_entry entry;
+
+    EXPECT_FALSE(try_parse_list_line("", entry));
+    EXPECT_FALSE(try_parse_list_line("total 42", entry));
+    EXPECT_FALSE(try_parse_list_line("213 End of status.", entry));
+}
+
+TEST(ListParserTest, ListAndStatListingMatchTest)
+{
+    string lines = "-rw-r--r--   1 owner    group          42 Jan 01 00:00 a.txt\r\n"
+                   "drwxr-xr-x   2 owner    group        4096 Jan 01 00:00 dir\r\n";
+
+    vector<list_entry> list = parse_list("total 2\r\n" + lines);
+    vector<list_entry> stat = parse_stat_listing("213-Status of \"/\":\r\n" + lines + "213 End of status.\r\n");
+
+    ASSERT_EQ(2u, list.size());
+    ASSERT_EQ(list.size(), stat.size());
+
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        EXPECT_EQ(list[i].name, stat[i].name);
+        EXPECT_EQ(list[i].type, stat[i].type);
+        EXPECT_EQ(list[i].size, stat[i].size);
+    }
+
+    EXPECT_TRUE(parse_stat_listing("213-Status of \"/empty\":\r\n213 End of status.\r\n").empty());
+}
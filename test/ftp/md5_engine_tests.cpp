@@ -0,0 +1,183 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <openssl/evp.h>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ftp/detail/md5.hpp"
+#include "ftp/detail/md5_engine.hpp"
+
+using std::string;
+
+using ftp::detail::md5;
+using ftp::detail::md5_engine;
+
+static string sample(size_t size, unsigned int seed)
+{
+    string data(size, '\0');
+
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = static_cast<char>((i * 2654435761u + seed) >> 13);
+    }
+
+    return data;
+}
+
+/* OpenSSL's MD5, in upper-case hex. */
+static string reference(const string & data)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    string hex;
+
+    EVP_Digest(data.data(), data.size(), digest, &size, EVP_md5(), nullptr);
+
+    for (unsigned int i = 0; i < size; i++)
+    {
+        char byte[3];
+
+        std::snprintf(byte, sizeof(byte), "%02X", digest[i]);
+        hex += byte;
+    }
+
+    return hex;
+}
+
+TEST(Md5EngineTest, LanesTest)
+{
+    if (!ftp::detail::md5_has_lanes())
+    {
+        GTEST_SKIP() << "No AVX2";
+    }
+
+    const size_t blocks = 5;
+    std::vector<string> inputs;
+    alignas(32) std::uint32_t lanes[4][md5_engine::lanes];
+    const unsigned char *data[md5_engine::lanes];
+
+    for (size_t lane = 0; lane < md5_engine::lanes; lane++)
+    {
+        inputs.push_back(sample(64 * blocks, lane));
+    }
+
+    for (size_t lane = 0; lane < md5_engine::lanes; lane++)
+    {
+        for (size_t word = 0; word < 4; word++)
+        {
+            lanes[word][lane] = static_cast<std::uint32_t>(lane * 4 + word);
+        }
+
+        data[lane] = reinterpret_cast<const unsigned char *>(inputs[lane].data());
+    }
+
+    ftp::detail::md5_compress_lanes(lanes, data, blocks);
+
+    for (size_t lane = 0; lane < md5_engine::lanes; lane++)
+    {
+        std::uint32_t state[4];
+
+        for (size_t word = 0; word < 4; word++)
+        {
+            state[word] = static_cast<std::uint32_t>(lane * 4 + word);
+        }
+
+        ftp::detail::md5_compress(state, data[lane], blocks);
+
+        for (size_t word = 0; word < 4; word++)
+        {
+            EXPECT_EQ(state[word], lanes[word][lane]) << "lane " << lane << ", word " << word;
+        }
+    }
+}
+
+TEST(Md5EngineTest, DigestTest)
+{
+    /* Around the padding boundaries of 56 and 64 bytes. */
+    for (size_t size : { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000 })
+    {
+        string data = sample(size, 7);
+        md5 hash;
+
+        hash.update(data.data(), data.size());
+
+        EXPECT_EQ(reference(data), hash.hex_digest()) << size;
+    }
+}
+
+/* More streams than threads allowed to hash, so their blocks share lanes. */
+TEST(Md5EngineTest, ConcurrentTest)
+{
+    md5_engine engine(1);
+    const size_t streams = 16;
+    std::vector<string> inputs;
+    std::vector<string> digests(streams);
+    std::vector<std::thread> threads;
+
+    for (size_t stream = 0; stream < streams; stream++)
+    {
+        inputs.push_back(sample(512 * 1024 + stream * 100, stream));
+    }
+
+    for (size_t stream = 0; stream < streams; stream++)
+    {
+        threads.emplace_back([&engine, &inputs, &digests, stream]()
+        {
+            const string & data = inputs[stream];
+            md5 hash(engine);
+
+            /* Chunks like the data connection's, not on block boundaries. */
+            for (size_t offset = 0; offset < data.size(); offset += 8000)
+            {
+                hash.update(data.data() + offset, std::min<size_t>(8000, data.size() - offset));
+            }
+
+            digests[stream] = hash.hex_digest();
+        });
+    }
+
+    for (std::thread & thread : threads)
+    {
+        thread.join();
+    }
+
+    std::uint64_t blocks = 0;
+
+    for (size_t stream = 0; stream < streams; stream++)
+    {
+        EXPECT_EQ(reference(inputs[stream]), digests[stream]) << stream;
+        blocks += inputs[stream].size() / 64;
+    }
+
+    md5_engine::stats stats = engine.get_stats();
+
+    EXPECT_EQ(blocks, stats.blocks);
+
+    if (ftp::detail::md5_has_lanes())
+    {
+        EXPECT_GT(stats.shared_blocks, 0u);
+    }
+}
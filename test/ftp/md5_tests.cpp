@@ -0,0 +1,103 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/memory_transport.hpp"
+#include "ftp/detail/md5.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+
+using ftp::memory_transport;
+using ftp::detail::md5;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+static string hex_digest(const string & data)
+{
+    md5 hash;
+
+    hash.update(data.data(), data.size());
+
+    return hash.hex_digest();
+}
+
+TEST(Md5Test, KnownValuesTest)
+{
+    /* RFC 1321, A.5. */
+    EXPECT_EQ("D41D8CD98F00B204E9800998ECF8427E", hex_digest(""));
+    EXPECT_EQ("900150983CD24FB0D6963F7D28E17F72", hex_digest("abc"));
+    EXPECT_EQ("57EDF4A22BE3C955AC49DA2E2107B67A",
+              hex_digest("12345678901234567890123456789012345678901234567890123456789012345678901234567890"));
+}
+
+TEST(Md5Test, ChunksTest)
+{
+    const string data(100000, 'm');
+    md5 hash;
+
+    for (size_t offset = 0, size = 1; offset < data.size(); offset += size, size = size * 2 + 1)
+    {
+        hash.update(data.data() + offset, std::min(size, data.size() - offset));
+    }
+
+    EXPECT_EQ(hex_digest(data), hash.hex_digest());
+}
+
+TEST(Md5Test, UploadTest)
+{
+    fake_server server("md5.example.com");
+    string contents(300000, '\0');
+
+    for (size_t i = 0; i < contents.size(); i++)
+    {
+        contents[i] = static_cast<char>(i * 7 + 3);
+    }
+
+    server.start();
+
+    const string local_file = "/tmp/md5_test_" + std::to_string(::getpid());
+
+    std::ofstream(local_file, std::ios_base::binary) << contents;
+
+    memory_client client;
+
+    client.set_content_md5(true);
+
+    ASSERT_TRUE(client.open("md5.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_TRUE(client.upload(local_file, "object"));
+    EXPECT_TRUE(client.close());
+
+    server.join();
+    std::remove(local_file.c_str());
+
+    EXPECT_EQ(contents, server.stored().at("object"));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_EQ(hex_digest(contents), client.last_transfer()->md5);
+}
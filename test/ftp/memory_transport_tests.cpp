@@ -0,0 +1,447 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <boost/asio/read.hpp>
+#include <boost/system/system_error.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/ftp_exception.hpp"
+#include "ftp/memory_transport.hpp"
+#include "ftp/timer_service.hpp"
+#include "ftp/detail/connection_exception.hpp"
+#include "ftp/detail/data_connection.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+
+using ftp::memory_transport;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+TEST(MemoryTransportTest, ConnectTest)
+{
+    boost::asio::io_context io_context;
+    memory_transport::acceptor acceptor("server", 21);
+    memory_transport::socket client(io_context);
+    memory_transport::socket server(io_context);
+    boost::system::error_code ec;
+
+    memory_transport::connect(client, "server", 21, ec);
+    ASSERT_FALSE(ec);
+    acceptor.accept(server);
+
+    EXPECT_TRUE(memory_transport::is_alive(client));
+
+    write_line(server, "hello\r\n");
+    EXPECT_FALSE(memory_transport::is_alive(client));
+
+    string buffer;
+    EXPECT_EQ("hello", read_command(client, buffer));
+
+    server.close();
+
+    std::array<char, 1> data;
+    boost::asio::read(client, boost::asio::buffer(data), ec);
+    EXPECT_EQ(boost::asio::error::eof, ec);
+
+    memory_transport::socket other(io_context);
+    memory_transport::connect(other, "server", 22, ec);
+    EXPECT_EQ(boost::asio::error::connection_refused, ec);
+
+    EXPECT_THROW(memory_transport::acceptor("server", 21), boost::system::system_error);
+}
+
+TEST(MemoryTransportTest, DataConnectionTest)
+{
+    memory_transport::acceptor acceptor("server");
+    ftp::detail::basic_data_connection<memory_transport> connection("server", acceptor.port());
+    const size_t size = 4 * 1024 * 1024;
+
+    /* More than fits into a pipe, the writer has to wait for the reader. */
+    std::thread server([&acceptor, size]()
+    {
+        boost::asio::io_context io_context;
+        memory_transport::socket socket(io_context);
+
+        acceptor.accept(socket);
+
+        std::vector<char> data(size, 'x');
+        boost::asio::write(socket, boost::asio::buffer(data));
+        socket.close();
+    });
+
+    connection.open();
+    string data = connection.recv();
+    connection.close();
+    server.join();
+
+    EXPECT_EQ(size, data.size());
+    EXPECT_EQ(size, connection.result().bytes);
+    EXPECT_FALSE(connection.result().final_sample);
+}
+
+TEST(MemoryTransportTest, TimeoutTest)
+{
+    memory_transport::acceptor acceptor("server");
+    ftp::detail::basic_data_connection<memory_transport> connection("server", acceptor.port());
+
+    connection.set_timeouts(std::chrono::seconds(1), std::chrono::milliseconds(50));
+    connection.open();
+
+    /* Nobody ever writes. */
+    EXPECT_THROW(connection.recv(), ftp::detail::timeout_exception);
+}
+
+TEST(MemoryTransportTest, TimerServiceTimeoutTest)
+{
+    memory_transport::acceptor acceptor("server");
+    ftp::detail::basic_data_connection<memory_transport> connection("server", acceptor.port());
+
+    connection.set_timer_service(std::make_shared<ftp::timer_service>());
+    connection.set_timeouts(std::chrono::seconds(1), std::chrono::milliseconds(50));
+    connection.open();
+
+    EXPECT_THROW(connection.recv(), ftp::detail::timeout_exception);
+}
+
+TEST(MemoryTransportTest, ClientTest)
+{
+    fake_server server("ftp.example.com");
+    const string listing = "-rw-r--r-- 1 ftp ftp 42 Jan 01 00:00 file.txt\r\n";
+
+    server.on("LIST", [&server, &listing](const string &)
+    {
+        std::unique_ptr<memory_transport::socket> data = server.accept_data();
+
+        /* The client reads a second reply to the command. */
+        server.reply("150 Here comes the listing.");
+        server.reply("150 Here comes the listing.");
+        write_line(*data, listing);
+        data->close();
+        server.reply("226 Done.");
+    });
+    server.start();
+
+    struct recorder : ftp::event_observer
+    {
+        void on_reply(const string & reply) override
+        {
+            replies.push_back(reply);
+        }
+
+        std::vector<string> replies;
+    } observer;
+
+    memory_client client(&observer);
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_EQ(server.token(), client.getToken());
+    ASSERT_TRUE(client.ls());
+    EXPECT_TRUE(client.noop());
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    EXPECT_NE(observer.replies.end(), std::find(observer.replies.begin(), observer.replies.end(), listing));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_EQ(listing.size(), client.last_transfer()->bytes);
+    EXPECT_EQ((std::vector<string>{"USER_S", "PASS_S", "EPSV_S", "LIST", "NOOP", "QUIT"}), server.commands());
+}
+
+/* Replacements are asked for once a transfer is done, and their replies
+ * read by the next command. A refused one only costs the next transfer a
+ * connection of its own.
+ */
+TEST(MemoryTransportTest, PrefetchTest)
+{
+    fake_server server("ftp.example.com");
+    int epsv = 0;
+
+    server.on("EPSV_S", [&server, &epsv](const string &)
+    {
+        if (++epsv == 2)
+        {
+            server.reply_encrypted("425 No more ports.");
+            return;
+        }
+
+        server.reply_encrypted("229 Entering Extended Passive Mode (|||" + std::to_string(server.data_port()) + "|)");
+    });
+    server.on("LIST", [&server](const string &)
+    {
+        std::unique_ptr<memory_transport::socket> data = server.accept_data();
+
+        server.reply("150 Here comes the listing.");
+        server.reply("150 Here comes the listing.");
+        data->close();
+        server.reply("226 Done.");
+    });
+    server.start();
+
+    memory_client client;
+
+    client.set_prefetch_depth(1);
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_TRUE(client.ls());
+    EXPECT_TRUE(client.ls());
+    EXPECT_TRUE(client.ls());
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S",
+                                    "EPSV_S", "LIST", "EPSV_S",
+                                    "EPSV_S", "LIST", "EPSV_S",
+                                    "LIST", "EPSV_S",
+                                    "QUIT" }), server.commands());
+}
+
+/* The reply to a refill is read whenever the next command comes, the time
+ * in between is no round trip.
+ */
+TEST(MemoryTransportTest, PrefetchRttTest)
+{
+    fake_server server("ftp.example.com");
+
+    server.on("LIST", [&server](const string &)
+    {
+        std::unique_ptr<memory_transport::socket> data = server.accept_data();
+
+        server.reply("150 Here comes the listing.");
+        server.reply("150 Here comes the listing.");
+        data->close();
+        server.reply("226 Done.");
+    });
+    server.start();
+
+    memory_client client;
+
+    client.set_prefetch_depth(1);
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_TRUE(client.ls());
+
+    std::chrono::microseconds srtt = client.smoothed_rtt();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    EXPECT_TRUE(client.is_alive());
+    EXPECT_EQ(srtt, client.smoothed_rtt());
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "EPSV_S", "LIST", "EPSV_S", "QUIT" }),
+              server.commands());
+}
+
+/* The data connection is made while the command is on its way. The server
+ * only accepts it once the command has arrived.
+ */
+TEST(MemoryTransportTest, OverlapDataConnectTest)
+{
+    fake_server server("ftp.example.com");
+    const string contents(5000, 'o');
+    const string local_file = "/tmp/overlap_test_" + std::to_string(::getpid());
+    const string downloaded = local_file + "_downloaded";
+
+    server.set_file("file", contents);
+    server.start();
+
+    std::ofstream(local_file, std::ios_base::binary) << contents;
+
+    memory_client client;
+
+    client.set_overlap_data_connect(true);
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_TRUE(client.upload(local_file, "uploaded"));
+    EXPECT_TRUE(client.download("file", downloaded));
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::ifstream file(downloaded, std::ios_base::binary);
+    string received((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::remove(local_file.c_str());
+    std::remove(downloaded.c_str());
+
+    EXPECT_EQ(contents, received);
+    EXPECT_EQ(contents, server.stored().at("uploaded"));
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "EPSV_S", "STOR", "EPSV_S", "RETR", "QUIT" }),
+              server.commands());
+}
+
+/* A refused command leaves the data connection made alongside it unused.
+ * The client closes it, and the next transfer starts over.
+ */
+TEST(MemoryTransportTest, OverlapDataConnectRefusedTest)
+{
+    fake_server server("ftp.example.com");
+    const string contents(5000, 'o');
+    const string local_file = "/tmp/overlap_refused_test_" + std::to_string(::getpid());
+    boost::system::error_code dropped;
+
+    server.on("RETR", [&server, &contents, &dropped](const string & line)
+    {
+        std::unique_ptr<memory_transport::socket> data;
+
+        if (fake_server::argument(line) != "file")
+        {
+            /* The client reads a second reply to transfer commands. */
+            server.reply("550 No such file.");
+            server.reply("550 No such file.");
+
+            /* Reads end of file once the client has closed it. */
+            data = server.accept_data();
+
+            char byte;
+            boost::asio::read(*data, boost::asio::buffer(&byte, 1), dropped);
+
+            return;
+        }
+
+        data = server.accept_data();
+        server.reply("150 Opening data connection.");
+        server.reply("150 Opening data connection.");
+        write_line(*data, contents);
+        data->close();
+        server.reply("226 Done.");
+    });
+    server.start();
+
+    memory_client client;
+
+    client.set_overlap_data_connect(true);
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    EXPECT_FALSE(client.download("missing", local_file));
+    std::remove(local_file.c_str());
+    EXPECT_TRUE(client.download("file", local_file));
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::ifstream file(local_file, std::ios_base::binary);
+    string received((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::remove(local_file.c_str());
+
+    EXPECT_EQ(boost::asio::error::eof, dropped);
+    EXPECT_EQ(contents, received);
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S", "EPSV_S", "RETR", "EPSV_S", "RETR", "QUIT" }),
+              server.commands());
+}
+
+/* 211 is a listing when it lists something and the server status
+ * otherwise, which leaves listing to 'LIST'.
+ */
+TEST(MemoryTransportTest, StatListingTest)
+{
+    fake_server server("ftp.example.com");
+    const string listing = "-rw-r--r-- 1 ftp ftp 42 Jan 01 00:00 file.txt\r\n";
+
+    server.on("STAT", [&server, &listing](const string & line)
+    {
+        if (fake_server::argument(line) == "dir")
+        {
+            server.reply("211-Status of \"dir\":\r\n" + listing + "211 End of status.");
+        }
+        else
+        {
+            server.reply("211-FTP server status:\r\n     Connected to 127.0.0.1\r\n211 End of status.");
+        }
+    });
+    server.on("LIST", [&server, &listing](const string &)
+    {
+        std::unique_ptr<memory_transport::socket> data = server.accept_data();
+
+        server.reply("150 Here comes the listing.");
+        server.reply("150 Here comes the listing.");
+        write_line(*data, listing);
+        data->close();
+        server.reply("226 Done.");
+    });
+    server.start();
+
+    memory_client client;
+    std::vector<ftp::list_entry> entries;
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+    ASSERT_TRUE(client.ls(string("dir"), entries));
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ("file.txt", entries[0].name);
+    EXPECT_EQ(42u, entries[0].size);
+    ASSERT_TRUE(client.ls(string("other"), entries));
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ("file.txt", entries[0].name);
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    EXPECT_EQ((std::vector<string>{"USER_S", "PASS_S", "STAT", "STAT", "EPSV_S", "LIST", "QUIT"}),
+              server.commands());
+}
+
+TEST(MemoryTransportTest, ActiveModeTest)
+{
+    memory_transport::acceptor acceptor("ftp.example.com", 21);
+
+    std::thread server([&acceptor]()
+    {
+        boost::asio::io_context io_context;
+        memory_transport::socket control(io_context);
+
+        acceptor.accept(control);
+        write_line(control, "220 Welcome\r\n");
+    });
+
+    memory_client client;
+
+    ASSERT_TRUE(client.open("ftp.example.com"));
+    server.join();
+
+    client.set_transfer_mode(ftp::transfer_mode::active);
+
+    EXPECT_THROW(client.ls(), ftp::ftp_exception);
+    EXPECT_FALSE(client.is_open());
+}
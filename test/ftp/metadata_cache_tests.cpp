@@ -0,0 +1,240 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/memory_transport.hpp"
+#include "ftp/metadata_cache.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+using std::vector;
+
+using ftp::list_entry;
+using ftp::memory_transport;
+using ftp::metadata_cache;
+using ftp::detail::reply_t;
+
+using memory_client = ftp::basic_client<memory_transport>;
+
+TEST(MetadataCacheTest, HitAndMissTest)
+{
+    metadata_cache cache;
+
+    EXPECT_FALSE(cache.find_size("/file"));
+
+    cache.store_size("/file", reply_t(213, "213 42\r\n"));
+
+    auto reply = cache.find_size("/file");
+    ASSERT_TRUE(reply);
+    EXPECT_EQ(213, reply->status_code);
+    EXPECT_EQ("213 42\r\n", reply->status_line);
+
+    /* Size and stat of the same path are cached separately. */
+    EXPECT_FALSE(cache.find_stat("/file"));
+
+    metadata_cache::stats stats = cache.get_stats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(1u, stats.entries);
+}
+
+TEST(MetadataCacheTest, ExpirationTest)
+{
+    metadata_cache cache(std::chrono::milliseconds(10));
+
+    cache.store_stat("/file", reply_t(213, "213 status\r\n"));
+    EXPECT_TRUE(cache.find_stat("/file"));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    EXPECT_FALSE(cache.find_stat("/file"));
+    EXPECT_EQ(0u, cache.get_stats().entries);
+}
+
+TEST(MetadataCacheTest, EvictionTest)
+{
+    metadata_cache cache(std::chrono::seconds(30), 2);
+
+    cache.store_size("/a", reply_t(213, "213 1\r\n"));
+    cache.store_size("/b", reply_t(213, "213 2\r\n"));
+
+    /* Touch '/a', so '/b' is the least recently used entry. */
+    EXPECT_TRUE(cache.find_size("/a"));
+
+    cache.store_size("/c", reply_t(213, "213 3\r\n"));
+
+    EXPECT_TRUE(cache.find_size("/a"));
+    EXPECT_FALSE(cache.find_size("/b"));
+    EXPECT_TRUE(cache.find_size("/c"));
+    EXPECT_EQ(1u, cache.get_stats().evictions);
+}
+
+TEST(MetadataCacheTest, InvalidateTest)
+{
+    metadata_cache cache;
+
+    list_entry entry;
+    entry.name = "file";
+
+    cache.store_listing("/dir", vector<list_entry>{ entry });
+    cache.store_size("/dir/file", reply_t(213, "213 42\r\n"));
+    cache.store_size("/dir2", reply_t(213, "213 1\r\n"));
+    cache.store_size("/dir-file", reply_t(213, "213 1\r\n"));
+
+    cache.invalidate("/dir");
+
+    EXPECT_FALSE(cache.find_listing("/dir"));
+    EXPECT_FALSE(cache.find_size("/dir/file"));
+    EXPECT_TRUE(cache.find_size("/dir2"));
+    EXPECT_TRUE(cache.find_size("/dir-file"));
+    EXPECT_EQ(2u, cache.get_stats().invalidations);
+
+    cache.store_listing("/dir", vector<list_entry>{ entry });
+    cache.store_stat("/dir", reply_t(213, "213 status\r\n"));
+    cache.store_size("/dir/file", reply_t(213, "213 42\r\n"));
+
+    cache.invalidate_listing("/dir");
+
+    EXPECT_FALSE(cache.find_listing("/dir"));
+    EXPECT_FALSE(cache.find_stat("/dir"));
+    EXPECT_TRUE(cache.find_size("/dir/file"));
+}
+
+/* Relative and absolute names of a file share its entries, so changing the
+ * file through either drops them. Keys carry the server and the user.
+ */
+TEST(MetadataCacheTest, ClientTest)
+{
+    fake_server server("metadata.example.com");
+    string directory = "/home/user";
+
+    server.on("PWD", [&](const string &)
+    {
+        server.reply("257 \"" + directory + "\" is the current directory.");
+    });
+    server.on("CWD", [&](const string & line)
+    {
+        directory = fake_server::argument(line);
+        server.reply("250 Directory changed.");
+    });
+    server.on("SIZE", [&](const string &)
+    {
+        server.reply("213 42");
+    });
+    server.on("DELE", [&](const string &)
+    {
+        server.reply("250 Deleted.");
+    });
+    server.start();
+
+    auto cache = std::make_shared<metadata_cache>();
+    memory_client client;
+
+    client.set_metadata_cache(cache);
+
+    ASSERT_TRUE(client.open("metadata.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+
+    EXPECT_TRUE(client.size("file"));
+    EXPECT_TRUE(client.size("/home/user/file"));
+    EXPECT_TRUE(client.size("/home/user/./dir/../file"));
+
+    EXPECT_TRUE(client.rm("/home/user/file"));
+    EXPECT_TRUE(client.size("file"));
+
+    EXPECT_TRUE(client.cd("/tmp"));
+    EXPECT_TRUE(client.size("file"));
+    EXPECT_TRUE(client.size("/tmp/file"));
+
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    EXPECT_EQ((vector<string>{ "USER_S", "PASS_S",
+                               "PWD", "SIZE",
+                               "DELE", "SIZE",
+                               "CWD", "PWD", "SIZE",
+                               "QUIT" }), server.commands());
+
+    EXPECT_TRUE(cache->find_size("metadata.example.com:21:user:/home/user/file"));
+    EXPECT_TRUE(cache->find_size("metadata.example.com:21:user:/tmp/file"));
+    EXPECT_FALSE(cache->find_size("/home/user/file"));
+}
+
+/* A change drops the listing of its directory, but nothing cached about the
+ * files next to it, not even right below the root.
+ */
+TEST(MetadataCacheTest, SiblingTest)
+{
+    fake_server server("metadata.example.com");
+    const string local_file = "/tmp/metadata_sibling_test_" + std::to_string(::getpid());
+
+    server.on("PWD", [&](const string &)
+    {
+        server.reply("257 \"/\" is the current directory.");
+    });
+    server.on("SIZE", [&](const string &)
+    {
+        server.reply("213 42");
+    });
+    server.start();
+
+    {
+        std::ofstream file(local_file, std::ios_base::binary);
+        file << "contents";
+    }
+
+    auto cache = std::make_shared<metadata_cache>();
+    memory_client client;
+
+    client.set_metadata_cache(cache);
+    cache->store_listing("metadata.example.com:21:user:/", vector<list_entry>());
+
+    ASSERT_TRUE(client.open("metadata.example.com"));
+    ASSERT_TRUE(client.login("user", "password"));
+
+    EXPECT_TRUE(client.size("sibling"));
+    EXPECT_TRUE(client.upload(local_file, "uploaded"));
+    EXPECT_TRUE(client.size("sibling"));
+
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    std::remove(local_file.c_str());
+
+    EXPECT_EQ((vector<string>{ "USER_S", "PASS_S",
+                               "PWD", "SIZE",
+                               "EPSV_S", "STOR",
+                               "QUIT" }), server.commands());
+
+    EXPECT_FALSE(cache->find_listing("metadata.example.com:21:user:/"));
+    EXPECT_TRUE(cache->find_size("metadata.example.com:21:user:/sibling"));
+}
@@ -0,0 +1,102 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include "ftp/detail/connection_exception.hpp"
+#include "ftp/detail/control_connection.hpp"
+#include "ftp/detail/resolver.hpp"
+
+using std::vector;
+using boost::asio::ip::make_address;
+using boost::asio::ip::tcp;
+
+using ftp::detail::address_family;
+using ftp::detail::resolver;
+
+TEST(ResolverTest, LiteralTest)
+{
+    resolver resolver;
+
+    vector<tcp::endpoint> endpoints = resolver.resolve("127.0.0.1", 21, address_family::v6);
+
+    ASSERT_EQ(1u, endpoints.size());
+    EXPECT_EQ(tcp::endpoint(make_address("127.0.0.1"), 21), endpoints[0]);
+
+    endpoints = resolver.resolve("fe80::1%1", 2121, address_family::any);
+
+    ASSERT_EQ(1u, endpoints.size());
+    EXPECT_TRUE(endpoints[0].address().is_v6());
+    EXPECT_EQ(1u, endpoints[0].address().to_v6().scope_id());
+    EXPECT_EQ(2121, endpoints[0].port());
+}
+
+TEST(ResolverTest, InterleaveFamiliesTest)
+{
+    vector<tcp::endpoint> endpoints = {
+        tcp::endpoint(make_address("::1"), 21),
+        tcp::endpoint(make_address("::2"), 21),
+        tcp::endpoint(make_address("::3"), 21),
+        tcp::endpoint(make_address("10.0.0.1"), 21),
+        tcp::endpoint(make_address("10.0.0.2"), 21)
+    };
+
+    vector<tcp::endpoint> expected = {
+        tcp::endpoint(make_address("::1"), 21),
+        tcp::endpoint(make_address("10.0.0.1"), 21),
+        tcp::endpoint(make_address("::2"), 21),
+        tcp::endpoint(make_address("10.0.0.2"), 21),
+        tcp::endpoint(make_address("::3"), 21)
+    };
+
+    EXPECT_EQ(expected, ftp::detail::interleave_families(endpoints));
+}
+
+TEST(ResolverTest, HostNameTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(make_address("127.0.0.1"), 0));
+    ftp::detail::control_connection connection;
+
+    /* 'localhost' may resolve to '::1' first, where nobody listens. The
+     * connection falls back to the next address.
+     */
+    connection.open("localhost", acceptor.local_endpoint().port());
+
+    EXPECT_TRUE(connection.is_open());
+    EXPECT_EQ("127.0.0.1", connection.ip());
+}
+
+TEST(ResolverTest, ConnectionRefusedTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(make_address("127.0.0.1"), 0));
+    uint16_t port = acceptor.local_endpoint().port();
+    ftp::detail::control_connection connection;
+
+    acceptor.close();
+
+    EXPECT_THROW(connection.open("127.0.0.1", port), ftp::detail::connection_exception);
+    EXPECT_FALSE(connection.is_open());
+}
@@ -0,0 +1,208 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include "ftp/ftp_exception.hpp"
+#include "ftp/memory_transport.hpp"
+#include "ftp/session_pool.hpp"
+#include "ftp/timer_service.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+using std::chrono::milliseconds;
+
+using ftp::memory_transport;
+
+using memory_session_pool = ftp::basic_session_pool<memory_transport>;
+
+static const string host = "pool.example.com";
+
+/* Only the password a session logged in with gets it back. */
+TEST(SessionPoolTest, CredentialsTest)
+{
+    fake_server server(host);
+    string right = "PASS_S " + encrypted_reply("right password", "tipray");
+
+    right.resize(right.size() - 2);
+
+    server.on("PASS_S", [&server, &right](const string & line)
+    {
+        if (line == right)
+        {
+            server.reply_encrypted("230 Token=" + server.token() + ".", "tipray");
+        }
+        else
+        {
+            server.reply("530 Login incorrect.");
+        }
+    });
+    server.start(2);
+
+    {
+        memory_session_pool pool;
+
+        {
+            memory_session_pool::lease lease = pool.acquire(host, 21, "user", "right password");
+        }
+
+        EXPECT_THROW(pool.acquire(host, 21, "user", "wrong password"), ftp::ftp_exception);
+
+        {
+            memory_session_pool::lease lease = pool.acquire(host, 21, "user", "right password");
+
+            EXPECT_TRUE(lease->is_open());
+        }
+
+        memory_session_pool::stats stats = pool.get_stats();
+
+        EXPECT_EQ(1u, stats.hits);
+        EXPECT_EQ(1u, stats.misses);
+        EXPECT_EQ(1u, stats.idle);
+        EXPECT_EQ(0u, stats.leased);
+    }
+
+    server.join();
+
+    EXPECT_EQ((std::vector<string>{ "USER_S", "PASS_S",
+                                    "USER_S", "PASS_S", "QUIT",
+                                    "QUIT" }), server.commands());
+}
+
+/* Above the limit 'acquire' waits for a release, and gives up after the
+ * acquire timeout.
+ */
+TEST(SessionPoolTest, MaxSessionsTest)
+{
+    fake_server server(host);
+    memory_session_pool::options options;
+
+    options.max_sessions_per_key = 1;
+    options.acquire_timeout = milliseconds(200);
+    server.start();
+
+    {
+        memory_session_pool pool(options);
+        std::optional<memory_session_pool::lease> first = pool.acquire(host, 21, "user", "password");
+
+        EXPECT_THROW(pool.acquire(host, 21, "user", "password"), ftp::ftp_exception);
+
+        std::thread waiter([&pool]()
+        {
+            memory_session_pool::lease lease = pool.acquire(host, 21, "user", "password");
+
+            EXPECT_TRUE(lease->is_open());
+        });
+
+        std::this_thread::sleep_for(milliseconds(20));
+        first.reset();
+        waiter.join();
+
+        memory_session_pool::stats stats = pool.get_stats();
+
+        EXPECT_EQ(1u, stats.hits);
+        EXPECT_EQ(1u, stats.misses);
+        EXPECT_EQ(2u, stats.waits);
+        EXPECT_GE(stats.max_wait, milliseconds(200));
+        EXPECT_EQ(1u, stats.idle);
+        EXPECT_EQ(0u, stats.leased);
+    }
+
+    server.join();
+}
+
+/* A pooled session the server has dropped is closed, and another one is
+ * opened in its place.
+ */
+TEST(SessionPoolTest, DeadSessionTest)
+{
+    fake_server server(host);
+
+    server.start(2);
+
+    {
+        memory_session_pool pool;
+
+        {
+            memory_session_pool::lease lease = pool.acquire(host, 21, "user", "password");
+        }
+
+        server.hang_up();
+
+        {
+            memory_session_pool::lease lease = pool.acquire(host, 21, "user", "password");
+
+            EXPECT_TRUE(lease->noop());
+        }
+
+        memory_session_pool::stats stats = pool.get_stats();
+
+        EXPECT_EQ(0u, stats.hits);
+        EXPECT_EQ(2u, stats.misses);
+        EXPECT_EQ(1u, stats.evictions);
+        EXPECT_EQ(1u, stats.idle);
+    }
+
+    server.join();
+}
+
+TEST(SessionPoolTest, KeepaliveTest)
+{
+    fake_server server(host);
+    memory_session_pool::options options;
+
+    options.keepalive_interval = milliseconds(20);
+    options.timers = std::make_shared<ftp::timer_service>(milliseconds(5));
+    server.start();
+
+    {
+        memory_session_pool pool(options);
+
+        {
+            memory_session_pool::lease lease = pool.acquire(host, 21, "user", "password");
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        while (pool.get_stats().keepalives < 2 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+
+        memory_session_pool::stats stats = pool.get_stats();
+
+        EXPECT_GE(stats.keepalives, 2u);
+        EXPECT_EQ(0u, stats.evictions);
+        EXPECT_EQ(1u, stats.idle);
+    }
+
+    server.join();
+
+    EXPECT_GE(std::count(server.commands().begin(), server.commands().end(), "NOOP"), 2);
+}
@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include "ftp/socket_profile.hpp"
+#include "ftp/detail/socket_tuning.hpp"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+using boost::asio::ip::tcp;
+
+using ftp::socket_profile;
+using ftp::socket_options;
+
+static int get_option(tcp::socket & socket, int level, int name)
+{
+    int value = 0;
+    socklen_t len = sizeof(value);
+
+    ::getsockopt(socket.native_handle(), level, name, &value, &len);
+
+    return value;
+}
+
+TEST(SocketProfileTest, FindTest)
+{
+    EXPECT_TRUE(socket_profile::find("lan"));
+    EXPECT_TRUE(socket_profile::find("wan-high-bdp"));
+    EXPECT_TRUE(socket_profile::find("low-latency"));
+    EXPECT_FALSE(socket_profile::find("fast"));
+
+    EXPECT_TRUE(socket_profile::find("lan")->control.no_delay);
+    EXPECT_EQ(4 * 1024 * 1024, socket_profile::find("wan-high-bdp")->data.receive_buffer);
+}
+
+TEST(SocketProfileTest, ApplyTest)
+{
+    boost::asio::io_context io_context;
+    tcp::socket socket(io_context);
+    socket_options options;
+
+    options.no_delay = true;
+    options.receive_buffer = 256 * 1024;
+    options.keepalive_idle = std::chrono::seconds(42);
+    /* Not every system has it, it must be skipped quietly. */
+    options.congestion_control = std::string("no-such-algorithm");
+
+    socket.open(tcp::v4());
+    ftp::detail::apply_socket_options(socket, options);
+
+    EXPECT_EQ(1, get_option(socket, IPPROTO_TCP, TCP_NODELAY));
+    EXPECT_EQ(1, get_option(socket, SOL_SOCKET, SO_KEEPALIVE));
+    EXPECT_EQ(42, get_option(socket, IPPROTO_TCP, TCP_KEEPIDLE));
+    /* The system may round the size up, e.g. Linux doubles it. */
+    EXPECT_LE(256 * 1024, get_option(socket, SOL_SOCKET, SO_RCVBUF));
+}
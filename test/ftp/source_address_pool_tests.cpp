@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <array>
+#include <memory>
+#include "ftp/ftp_exception.hpp"
+#include "ftp/source_address_pool.hpp"
+#include "ftp/detail/data_connection.hpp"
+
+using boost::asio::ip::tcp;
+
+using ftp::source_address_pool;
+
+TEST(SourceAddressPoolTest, RoundRobinTest)
+{
+    source_address_pool pool({"127.0.0.1", "::1", "127.0.0.2"});
+
+    EXPECT_EQ(0u, pool.acquire(tcp::v4()));
+    EXPECT_EQ(2u, pool.acquire(tcp::v4()));
+    EXPECT_EQ(0u, pool.acquire(tcp::v4()));
+    EXPECT_EQ(1u, pool.acquire(tcp::v6()));
+    EXPECT_EQ(1u, pool.acquire(tcp::v6()));
+
+    EXPECT_EQ("127.0.0.2", pool.address(2).to_string());
+}
+
+TEST(SourceAddressPoolTest, MissingFamilyTest)
+{
+    source_address_pool pool({"127.0.0.1"});
+
+    EXPECT_FALSE(pool.acquire(tcp::v6()));
+}
+
+TEST(SourceAddressPoolTest, InvalidAddressTest)
+{
+    EXPECT_THROW(source_address_pool({"127.0.0.1", "localhost"}), ftp::ftp_exception);
+}
+
+TEST(SourceAddressPoolTest, StatsTest)
+{
+    source_address_pool pool({"127.0.0.1"});
+
+    std::size_t first = *pool.acquire(tcp::v4());
+    std::size_t second = *pool.acquire(tcp::v4());
+    pool.release(first, true);
+
+    std::vector<source_address_pool::address_stats> stats = pool.get_stats();
+
+    ASSERT_EQ(1u, stats.size());
+    EXPECT_EQ("127.0.0.1", stats[0].address);
+    EXPECT_EQ(2u, stats[0].connections);
+    EXPECT_EQ(1u, stats[0].active);
+    EXPECT_EQ(1u, stats[0].time_wait);
+    EXPECT_GT(stats[0].port_range, 0u);
+    EXPECT_DOUBLE_EQ(2.0 / stats[0].port_range, stats[0].port_usage());
+
+    pool.release(second, false);
+
+    stats = pool.get_stats();
+    EXPECT_EQ(0u, stats[0].active);
+    EXPECT_EQ(1u, stats[0].time_wait);
+}
+
+TEST(SourceAddressPoolTest, DataConnectionTest)
+{
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::any(), 0));
+    uint16_t port = acceptor.local_endpoint().port();
+    auto pool = std::make_shared<source_address_pool>(std::vector<std::string>{"127.0.0.2"});
+
+    {
+        ftp::socket_options options;
+        options.closing = ftp::close_mode::abortive_when_safe;
+
+        ftp::detail::data_connection connection("127.0.0.1", port);
+        connection.set_socket_options(options);
+        connection.set_source_pool(pool);
+        connection.open();
+
+        tcp::socket peer(io_context);
+        acceptor.accept(peer);
+
+        EXPECT_EQ("127.0.0.2", peer.remote_endpoint().address().to_string());
+        EXPECT_EQ(1u, pool->get_stats()[0].active);
+
+        /* Nothing was sent, so the connection is reset. */
+        connection.close();
+
+        std::array<char, 1> data;
+        boost::system::error_code ec;
+        boost::asio::read(peer, boost::asio::buffer(data), ec);
+
+        EXPECT_EQ(boost::asio::error::connection_reset, ec);
+    }
+
+    std::vector<source_address_pool::address_stats> stats = pool->get_stats();
+
+    EXPECT_EQ(1u, stats[0].connections);
+    EXPECT_EQ(0u, stats[0].active);
+    EXPECT_EQ(0u, stats[0].time_wait);
+}
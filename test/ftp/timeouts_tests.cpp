@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include "ftp/detail/connection_exception.hpp"
+#include "ftp/detail/data_connection.hpp"
+#include "ftp/detail/rtt_estimator.hpp"
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+using ftp::detail::rtt_estimator;
+
+TEST(RttEstimatorTest, InitialRtoTest)
+{
+    rtt_estimator rtt;
+
+    EXPECT_FALSE(rtt.has_samples());
+    EXPECT_EQ(seconds(1), rtt.rto());
+}
+
+TEST(RttEstimatorTest, SampleTest)
+{
+    rtt_estimator rtt;
+
+    rtt.sample(milliseconds(400));
+
+    EXPECT_TRUE(rtt.has_samples());
+    EXPECT_EQ(milliseconds(400), rtt.srtt());
+    EXPECT_EQ(milliseconds(200), rtt.rttvar());
+    /* SRTT + 4 * RTTVAR */
+    EXPECT_EQ(milliseconds(1200), rtt.rto());
+
+    rtt.sample(milliseconds(800));
+
+    /* RTTVAR = 3/4 * 200 + 1/4 * 400, SRTT = 7/8 * 400 + 1/8 * 800 */
+    EXPECT_EQ(milliseconds(250), rtt.rttvar());
+    EXPECT_EQ(milliseconds(450), rtt.srtt());
+    EXPECT_EQ(milliseconds(1450), rtt.rto());
+}
+
+TEST(RttEstimatorTest, RtoBoundsTest)
+{
+    rtt_estimator rtt;
+
+    rtt.sample(milliseconds(1));
+    EXPECT_EQ(seconds(1), rtt.rto());
+
+    rtt.reset();
+    rtt.sample(seconds(100));
+    EXPECT_EQ(seconds(60), rtt.rto());
+}
+
+TEST(RttEstimatorTest, DeadlineTest)
+{
+    rtt_estimator rtt;
+
+    EXPECT_EQ(seconds(10), rtt.deadline(4, seconds(10), seconds(120)));
+
+    rtt.sample(seconds(5));
+    EXPECT_EQ(seconds(60), rtt.deadline(4, seconds(10), seconds(120)));
+    EXPECT_EQ(seconds(30), rtt.deadline(4, seconds(10), seconds(30)));
+}
+
+TEST(DeadlineTest, DataInactivityTimeoutTest)
+{
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::acceptor acceptor(io_context,
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    ftp::detail::data_connection connection("127.0.0.1", acceptor.local_endpoint().port());
+    connection.set_timeouts(seconds(5), milliseconds(50));
+    connection.open();
+
+    /* The peer accepts the connection but never sends anything. */
+    boost::asio::ip::tcp::socket peer(io_context);
+    acceptor.accept(peer);
+
+    EXPECT_THROW(connection.recv(), ftp::detail::timeout_exception);
+    EXPECT_FALSE(connection.is_open());
+}
@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "ftp/detail/timing_wheel.hpp"
+#include "ftp/timer_service.hpp"
+
+using std::uint64_t;
+using std::vector;
+using std::pair;
+
+using ftp::detail::timing_wheel;
+
+class TimingWheelTest : public ::testing::Test
+{
+protected:
+    vector<uint64_t> advance(uint64_t tick)
+    {
+        vector<pair<timing_wheel::timer_id, timing_wheel::callback>> expired;
+        m_wheel.advance(tick, expired);
+
+        for (auto & timer : expired)
+        {
+            timer.second();
+        }
+
+        vector<uint64_t> result;
+        result.swap(m_fired);
+        return result;
+    }
+
+    timing_wheel::timer_id schedule(uint64_t delay)
+    {
+        return m_wheel.schedule(delay, [this, delay]()
+        {
+            m_fired.push_back(delay);
+        });
+    }
+
+    timing_wheel m_wheel;
+    vector<uint64_t> m_fired;
+};
+
+TEST_F(TimingWheelTest, ExpireInOrderTest)
+{
+    schedule(3);
+    schedule(1);
+    schedule(2);
+
+    EXPECT_EQ(3u, m_wheel.size());
+    EXPECT_EQ(vector<uint64_t>({ 1 }), advance(1));
+    EXPECT_EQ(vector<uint64_t>({ 2, 3 }), advance(3));
+    EXPECT_EQ(0u, m_wheel.size());
+}
+
+TEST_F(TimingWheelTest, CascadeTest)
+{
+    /* One timer on each level, and one beyond the reach of the wheel. */
+    for (uint64_t delay : { uint64_t(255), uint64_t(256), uint64_t(70000), uint64_t(20000000),
+                            uint64_t(5000000000) })
+    {
+        schedule(delay);
+    }
+
+    EXPECT_EQ(vector<uint64_t>({ 255, 256 }), advance(256));
+    EXPECT_EQ(vector<uint64_t>({ 70000 }), advance(70000));
+    EXPECT_TRUE(advance(19999999).empty());
+    EXPECT_EQ(vector<uint64_t>({ 20000000 }), advance(20000000));
+    EXPECT_TRUE(advance(4999999999).empty());
+    EXPECT_EQ(vector<uint64_t>({ 5000000000 }), advance(5000000000));
+}
+
+TEST_F(TimingWheelTest, UnalignedStartTest)
+{
+    advance(1000);
+
+    for (uint64_t delay = 1; delay < 100000; delay += 997)
+    {
+        schedule(delay);
+    }
+
+    EXPECT_EQ(101u, advance(101000).size());
+}
+
+TEST_F(TimingWheelTest, CancelTest)
+{
+    timing_wheel::timer_id first = schedule(10);
+    timing_wheel::timer_id second = schedule(1000);
+
+    EXPECT_TRUE(m_wheel.cancel(second));
+    EXPECT_FALSE(m_wheel.cancel(second));
+
+    EXPECT_EQ(vector<uint64_t>({ 10 }), advance(2000));
+    EXPECT_FALSE(m_wheel.cancel(first));
+
+    /* The node is reused, the stale id must not cancel the new timer. */
+    schedule(5);
+    EXPECT_FALSE(m_wheel.cancel(first));
+    EXPECT_EQ(1u, m_wheel.size());
+}
+
+TEST(TimerServiceTest, ScheduleAndCancelTest)
+{
+    ftp::timer_service timers(std::chrono::milliseconds(1));
+    std::atomic<int> fired(0);
+
+    timers.schedule(std::chrono::milliseconds(5), [&fired]() { ++fired; });
+    ftp::timer_service::timer_id cancelled = timers.schedule(std::chrono::milliseconds(5), [&fired]() { fired += 10; });
+
+    EXPECT_TRUE(timers.cancel(cancelled));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_EQ(1, fired);
+    EXPECT_EQ(0u, timers.size());
+}
@@ -0,0 +1,517 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/read.hpp>
+#include <openssl/evp.h>
+#include <openssl/x509v3.h>
+#include <linux/tls.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/ftp_exception.hpp"
+#include "ftp/tls_transport.hpp"
+#include "ftp/detail/data_connection.hpp"
+#include "ftp/detail/kernel_tls.hpp"
+#include "fake_server.hpp"
+
+using std::string;
+
+using boost::asio::ip::tcp;
+
+namespace ssl = boost::asio::ssl;
+
+using ftp::tls_transport;
+
+using ftp::detail::tls_tx_keys;
+
+using ftps_client = ftp::basic_client<tls_transport>;
+
+/* Seals an application data record with the keys the way the kernel does,
+ * see RFC 5288 and RFC 7905 for TLS 1.2, and RFC 8446, section 5.2.
+ */
+static string seal_record(const tls_tx_keys & keys, const string & data)
+{
+    const bool tls13 = keys.version == TLS1_3_VERSION;
+    const EVP_CIPHER *cipher = keys.cipher == TLS_CIPHER_AES_GCM_128 ? EVP_aes_128_gcm()
+                             : keys.cipher == TLS_CIPHER_AES_GCM_256 ? EVP_aes_256_gcm()
+                             : EVP_chacha20_poly1305();
+    string sequence(8, '\0');
+
+    for (int i = 0; i < 8; ++i)
+    {
+        sequence[i] = static_cast<char>(keys.sequence >> (56 - 8 * i));
+    }
+
+    string nonce(keys.iv.begin(), keys.iv.end());
+    string explicit_nonce;
+
+    if (nonce.size() == 4)
+    {
+        explicit_nonce = sequence;
+        nonce += sequence;
+    }
+    else
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            nonce[4 + i] ^= sequence[i];
+        }
+    }
+
+    string plaintext = tls13 ? data + '\x17' : data;
+    size_t length = explicit_nonce.size() + plaintext.size() + 16;
+    string header = { '\x17', '\x03', '\x03', static_cast<char>(length >> 8), static_cast<char>(length) };
+    string aad = tls13 ? header : sequence + string({ '\x17', '\x03', '\x03',
+                                                      static_cast<char>(plaintext.size() >> 8),
+                                                      static_cast<char>(plaintext.size()) });
+    string ciphertext(plaintext.size() + 16, '\0');
+    auto *out = reinterpret_cast<unsigned char *>(&ciphertext[0]);
+    int len = 0;
+
+    EVP_CIPHER_CTX *context = EVP_CIPHER_CTX_new();
+
+    EVP_EncryptInit_ex(context, cipher, nullptr, nullptr, nullptr);
+    EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_AEAD_SET_IVLEN, 12, nullptr);
+    EVP_EncryptInit_ex(context, nullptr, nullptr, keys.key.data(),
+                       reinterpret_cast<const unsigned char *>(nonce.data()));
+    EVP_EncryptUpdate(context, nullptr, &len, reinterpret_cast<const unsigned char *>(aad.data()), aad.size());
+    EVP_EncryptUpdate(context, out, &len, reinterpret_cast<const unsigned char *>(plaintext.data()),
+                      plaintext.size());
+    EVP_EncryptFinal_ex(context, out + len, &len);
+    EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_AEAD_GET_TAG, 16, out + plaintext.size());
+    EVP_CIPHER_CTX_free(context);
+
+    return header + explicit_nonce + ciphertext;
+}
+
+class TlsTransportTest : public ::testing::Test
+{
+protected:
+    TlsTransportTest()
+        : server_context_(ssl::context::tls_server),
+          client_context_(std::make_shared<ssl::context>(ssl::context::tls_client)),
+          acceptor_(io_context_, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+          data_acceptor_(io_context_, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+    {
+    }
+
+    /* A self-signed certificate for 127.0.0.1, which the client trusts. */
+    void SetUp() override
+    {
+        EVP_PKEY_CTX *key_context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+        EVP_PKEY *key = nullptr;
+
+        EVP_PKEY_keygen_init(key_context);
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_context, NID_X9_62_prime256v1);
+        EVP_PKEY_keygen(key_context, &key);
+        EVP_PKEY_CTX_free(key_context);
+
+        X509 *certificate = X509_new();
+
+        X509_set_version(certificate, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+        X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+        X509_set_pubkey(certificate, key);
+
+        X509_NAME *name = X509_get_subject_name(certificate);
+
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char *>("ftp test"), -1, -1, 0);
+        X509_set_issuer_name(certificate, name);
+
+        X509_EXTENSION *alt_name = X509V3_EXT_conf_nid(nullptr, nullptr, NID_subject_alt_name,
+                                                       const_cast<char *>("IP:127.0.0.1"));
+
+        X509_add_ext(certificate, alt_name, -1);
+        X509_EXTENSION_free(alt_name);
+        X509_sign(certificate, key, EVP_sha256());
+
+        SSL_CTX_use_certificate(server_context_.native_handle(), certificate);
+        SSL_CTX_use_PrivateKey(server_context_.native_handle(), key);
+
+        const unsigned char session_context[] = "ftp test";
+        SSL_CTX_set_session_id_context(server_context_.native_handle(), session_context, sizeof(session_context));
+
+        client_context_->set_verify_mode(ssl::verify_peer);
+        X509_STORE_add_cert(SSL_CTX_get_cert_store(client_context_->native_handle()), certificate);
+
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+    }
+
+    /* Secures the control connection, logs in and serves listings, each
+     * over a data connection of its own.
+     */
+    void serve()
+    {
+        tcp::socket control(io_context_);
+        string buffer;
+
+        acceptor_.accept(control);
+        write_line(control, "220 Welcome\r\n");
+
+        string command = read_command(control, buffer);
+        commands_.push_back(command);
+
+        if (command != "AUTH TLS")
+        {
+            return;
+        }
+
+        write_line(control, "234 Proceed.\r\n");
+
+        ssl::stream<tcp::socket &> secure(control, server_context_);
+        boost::system::error_code ec;
+
+        secure.handshake(ssl::stream_base::server, ec);
+
+        if (ec)
+        {
+            return;
+        }
+
+        fake_server server;
+
+        server.on("PBSZ", [&server](const string &)
+        {
+            server.reply("200 OK.");
+        });
+        server.on("PROT", [&server](const string &)
+        {
+            server.reply("200 OK.");
+        });
+        server.on("EPSV_S", [this, &server](const string &)
+        {
+            string port = std::to_string(data_acceptor_.local_endpoint().port());
+
+            server.reply_encrypted("229 Entering Extended Passive Mode (|||" + port + "|)");
+        });
+        server.on("LIST", [this, &server](const string &)
+        {
+            tcp::socket data(io_context_);
+            boost::system::error_code ec;
+
+            data_acceptor_.accept(data);
+
+            /* The client reads a second reply to the command. */
+            server.reply("150 Here comes the listing.");
+            server.reply("150 Here comes the listing.");
+
+            ssl::stream<tcp::socket &> secure_data(data, server_context_);
+
+            secure_data.handshake(ssl::stream_base::server, ec);
+
+            if (ec)
+            {
+                server.reply("425 Cannot secure the data connection.");
+                return;
+            }
+
+            data_resumed_.push_back(SSL_session_reused(secure_data.native_handle()) == 1);
+            write_line(secure_data, listing_);
+            secure_data.shutdown(ec);
+            data.close();
+            server.reply("226 Done.");
+        });
+        server.serve(secure);
+
+        commands_.insert(commands_.end(), server.commands().begin(), server.commands().end());
+    }
+
+    boost::asio::io_context io_context_;
+    ssl::context server_context_;
+    std::shared_ptr<ssl::context> client_context_;
+    tcp::acceptor acceptor_;
+    tcp::acceptor data_acceptor_;
+    const string listing_ = "-rw-r--r-- 1 ftp ftp 42 Jan 01 00:00 file.txt\r\n";
+    std::vector<string> commands_;
+    std::vector<bool> data_resumed_;
+};
+
+TEST_F(TlsTransportTest, ClientTest)
+{
+    std::thread server([this]()
+    {
+        serve();
+    });
+
+    struct recorder : ftp::event_observer
+    {
+        void on_reply(const string & reply) override
+        {
+            replies.push_back(reply);
+        }
+
+        std::vector<string> replies;
+    } observer;
+
+    ftps_client client(&observer);
+
+    client.set_tls_context(client_context_);
+
+    ASSERT_TRUE(client.open("127.0.0.1", acceptor_.local_endpoint().port()));
+    ASSERT_TRUE(client.login("user", "password"));
+    ASSERT_TRUE(client.ls());
+    ASSERT_TRUE(client.ls());
+    EXPECT_TRUE(client.close());
+
+    server.join();
+
+    EXPECT_EQ((std::vector<string>{"AUTH TLS", "PBSZ", "PROT", "USER_S", "PASS_S",
+                                   "EPSV_S", "LIST", "EPSV_S", "LIST", "QUIT"}), commands_);
+    EXPECT_EQ(2, std::count(observer.replies.begin(), observer.replies.end(), listing_));
+    ASSERT_TRUE(client.last_transfer());
+    EXPECT_EQ(listing_.size(), client.last_transfer()->bytes);
+
+    /* Both data connections resumed the session of the control connection. */
+    ftp::tls_stats stats = client.get_tls_stats();
+
+    EXPECT_EQ(1u, stats.control_handshakes);
+    EXPECT_EQ(2u, stats.data_handshakes);
+    EXPECT_EQ(2u, stats.resumed);
+    EXPECT_DOUBLE_EQ(1.0, stats.resumption_rate());
+    EXPECT_EQ((std::vector<bool>{true, true}), data_resumed_);
+}
+
+TEST_F(TlsTransportTest, UntrustedCertificateTest)
+{
+    std::thread server([this]()
+    {
+        serve();
+    });
+
+    /* The default context only trusts the system's authorities. */
+    ftps_client client;
+
+    EXPECT_THROW(client.open("127.0.0.1", acceptor_.local_endpoint().port()), ftp::ftp_exception);
+    EXPECT_FALSE(client.is_open());
+
+    server.join();
+
+    EXPECT_EQ(0u, client.get_tls_stats().control_handshakes);
+}
+
+TEST_F(TlsTransportTest, AuthRefusedTest)
+{
+    std::thread server([this]()
+    {
+        tcp::socket control(io_context_);
+        string buffer;
+
+        acceptor_.accept(control);
+        write_line(control, "220 Welcome\r\n");
+        commands_.push_back(read_command(control, buffer));
+        write_line(control, "502 Not implemented.\r\n");
+
+        /* The client gives up rather than go on in plain text. */
+        commands_.push_back(read_command(control, buffer));
+    });
+
+    ftps_client client;
+
+    client.set_tls_context(client_context_);
+
+    EXPECT_FALSE(client.open("127.0.0.1", acceptor_.local_endpoint().port()));
+    EXPECT_FALSE(client.is_open());
+
+    server.join();
+
+    EXPECT_EQ((std::vector<string>{"AUTH TLS", ""}), commands_);
+}
+
+static int key_log_lines = 0;
+
+static void count_key_log_line(const SSL *, const char *)
+{
+    ++key_log_lines;
+}
+
+/* The kernel may be missing here, so the keys are checked by sealing records
+ * with them in user space the way the kernel would, for the server to open.
+ * The key log callback set before keeps getting the lines.
+ */
+TEST_F(TlsTransportTest, KernelTxKeysTest)
+{
+    struct
+    {
+        int version;
+        const char *cipher;
+    } cases[] = {
+        { TLS1_2_VERSION, "ECDHE-ECDSA-AES128-GCM-SHA256" },
+        { TLS1_2_VERSION, "ECDHE-ECDSA-AES256-GCM-SHA384" },
+        { TLS1_2_VERSION, "ECDHE-ECDSA-CHACHA20-POLY1305" },
+        { TLS1_3_VERSION, "TLS_AES_128_GCM_SHA256" },
+        { TLS1_3_VERSION, "TLS_AES_256_GCM_SHA384" },
+        { TLS1_3_VERSION, "TLS_CHACHA20_POLY1305_SHA256" }
+    };
+
+    key_log_lines = 0;
+    SSL_CTX_set_keylog_callback(client_context_->native_handle(), count_key_log_line);
+    ftp::detail::own_tls_context(client_context_->native_handle());
+
+    for (const auto & c : cases)
+    {
+        SSL_CTX *context = client_context_->native_handle();
+
+        SSL_CTX_set_min_proto_version(context, c.version);
+        SSL_CTX_set_max_proto_version(context, c.version);
+
+        if (c.version == TLS1_3_VERSION)
+        {
+            SSL_CTX_set_ciphersuites(context, c.cipher);
+        }
+        else
+        {
+            SSL_CTX_set_cipher_list(context, c.cipher);
+        }
+
+        string received;
+
+        std::thread server([this, &received]()
+        {
+            tcp::socket socket(io_context_);
+
+            acceptor_.accept(socket);
+
+            ssl::stream<tcp::socket &> secure(socket, server_context_);
+            boost::system::error_code ec;
+
+            secure.handshake(ssl::stream_base::server, ec);
+
+            received.resize(11);
+            boost::asio::read(secure, boost::asio::buffer(&received[0], received.size()), ec);
+
+            if (ec)
+            {
+                received = ec.message();
+            }
+        });
+
+        tcp::socket socket(io_context_);
+
+        socket.connect(acceptor_.local_endpoint());
+
+        ssl::stream<tcp::socket &> secure(socket, *client_context_);
+
+        ftp::detail::keep_tls_secrets(secure.native_handle());
+        secure.handshake(ssl::stream_base::client);
+
+        tls_tx_keys keys;
+
+        ASSERT_TRUE(ftp::detail::derive_tx_keys(secure.native_handle(), keys)) << c.cipher;
+
+        /* Two records, so the sequence numbers count as well. */
+        boost::asio::write(socket, boost::asio::buffer(seal_record(keys, "hello")));
+        ++keys.sequence;
+        boost::asio::write(socket, boost::asio::buffer(seal_record(keys, " world")));
+
+        server.join();
+
+        EXPECT_EQ("hello world", received) << c.cipher;
+    }
+
+    EXPECT_GT(key_log_lines, 0);
+}
+
+/* The key log callback of a context the application owns stays as it is. */
+TEST_F(TlsTransportTest, UnownedContextTest)
+{
+    ssl::context context(ssl::context::tls_client);
+
+    SSL_CTX_set_keylog_callback(context.native_handle(), count_key_log_line);
+
+    SSL *ssl = SSL_new(context.native_handle());
+
+    ftp::detail::keep_tls_secrets(ssl);
+
+    EXPECT_EQ(count_key_log_line, SSL_CTX_get_keylog_callback(context.native_handle()));
+
+    SSL_free(ssl);
+}
+
+/* Whether or not the kernel takes over, the data arrives: with sendfile
+ * and kernel TLS, or through OpenSSL.
+ */
+TEST_F(TlsTransportTest, KernelTlsFallbackTest)
+{
+    const string data(1024 * 1024, 'x');
+    const string path = (std::filesystem::temp_directory_path() /
+                         ("ftp_tls_test_" + std::to_string(::getpid()))).string();
+
+    std::ofstream(path, std::ios_base::binary) << data;
+
+    string received;
+
+    std::thread server([this, &received]()
+    {
+        tcp::socket socket(io_context_);
+
+        acceptor_.accept(socket);
+
+        ssl::stream<tcp::socket &> secure(socket, server_context_);
+        boost::system::error_code ec;
+
+        secure.handshake(ssl::stream_base::server, ec);
+        boost::asio::read(secure, boost::asio::dynamic_buffer(received), ec);
+
+        /* Ends with the client's close_notify. */
+        EXPECT_EQ(boost::asio::error::eof, ec);
+
+        secure.shutdown(ec);
+    });
+
+    ftp::detail::basic_data_connection<tls_transport> connection("127.0.0.1", acceptor_.local_endpoint().port());
+
+    connection.set_kernel_tls(true);
+    connection.open();
+    connection.start_tls(*client_context_, "127.0.0.1", nullptr);
+
+    if (!connection.send_file(path, 0))
+    {
+        EXPECT_FALSE(connection.is_kernel_tls());
+
+        std::ifstream file(path, std::ios_base::binary);
+
+        connection.send(file);
+    }
+
+    connection.close();
+    server.join();
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(data.size(), received.size());
+    EXPECT_EQ(data, received);
+    EXPECT_EQ(data.size(), connection.result().bytes);
+}
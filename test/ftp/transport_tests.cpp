@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "ftp/client.hpp"
+#include "ftp/transport.hpp"
+#include "ftp/detail/data_connection.hpp"
+
+using std::string;
+
+using boost::asio::local::stream_protocol;
+
+using ftp::unix_transport;
+
+class UnixTransportTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        path_ = (std::filesystem::temp_directory_path() / ("ftp_test_" + std::to_string(::getpid()))).string();
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove(path_);
+        std::filesystem::remove(unix_transport::data_path(path_, 50000));
+    }
+
+    string path_;
+};
+
+TEST_F(UnixTransportTest, DataPathTest)
+{
+    EXPECT_EQ("/run/ftpd.sock.50000", unix_transport::data_path("/run/ftpd.sock", 50000));
+}
+
+TEST_F(UnixTransportTest, ClientTest)
+{
+    boost::asio::io_context io_context;
+    stream_protocol::acceptor acceptor(io_context, stream_protocol::endpoint(path_));
+
+    std::thread server([&acceptor, &io_context]()
+    {
+        stream_protocol::socket control(io_context);
+        string buffer;
+
+        acceptor.accept(control);
+        boost::asio::write(control, boost::asio::buffer(string("220 Welcome\r\n")));
+
+        size_t len = boost::asio::read_until(control, boost::asio::dynamic_buffer(buffer), '\n');
+        EXPECT_EQ("NOOP\r\n", buffer.substr(0, len));
+        boost::asio::write(control, boost::asio::buffer(string("200 OK\r\n")));
+    });
+
+    ftp::basic_client<unix_transport> client;
+
+    ASSERT_TRUE(client.open(path_));
+    EXPECT_TRUE(client.noop());
+    server.join();
+}
+
+TEST_F(UnixTransportTest, DataConnectionTest)
+{
+    boost::asio::io_context io_context;
+    stream_protocol::endpoint endpoint(unix_transport::data_path(path_, 50000));
+    stream_protocol::acceptor acceptor(io_context, endpoint);
+
+    /* The host of a data connection is the control socket's path. */
+    ftp::detail::basic_data_connection<unix_transport> connection(path_, 50000);
+
+    std::thread server([&acceptor, &io_context]()
+    {
+        stream_protocol::socket data(io_context);
+
+        acceptor.accept(data);
+        boost::asio::write(data, boost::asio::buffer(string("listing")));
+    });
+
+    connection.open();
+    EXPECT_EQ("listing", connection.recv());
+    connection.close();
+    server.join();
+
+    EXPECT_EQ(7u, connection.result().bytes);
+}
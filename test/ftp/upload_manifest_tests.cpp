@@ -0,0 +1,309 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Denis Kovalchuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ftp/upload_manifest.hpp"
+#include "ftp/ftp_exception.hpp"
+
+using std::string;
+
+using ftp::manifest_entry;
+using ftp::upload_manifest;
+
+class UploadManifestTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        path_ = "/tmp/upload_manifest_test_" + std::to_string(::getpid());
+        remove_files();
+    }
+
+    void TearDown() override
+    {
+        remove_files();
+    }
+
+    void remove_files()
+    {
+        std::remove(path_.c_str());
+        std::remove((path_ + ".index").c_str());
+    }
+
+    static manifest_entry entry(std::uint64_t inode, const string & md5)
+    {
+        manifest_entry entry;
+
+        entry.path = "/data/file_" + std::to_string(inode);
+        entry.inode = inode;
+        entry.mtime = 1000 + inode;
+        entry.size = 10 * inode;
+        entry.md5 = md5;
+        entry.remote_name = "objects/" + md5 + "_" + std::to_string(entry.size);
+
+        return entry;
+    }
+
+    /* A distinct MD5 for each number. */
+    static string md5(std::uint64_t n)
+    {
+        char hex[33];
+
+        std::snprintf(hex, sizeof(hex), "%016llX%016llX",
+                      static_cast<unsigned long long>(n * 0x9E3779B97F4A7C15),
+                      static_cast<unsigned long long>(n));
+
+        return hex;
+    }
+
+    static std::streamoff file_size(const string & path)
+    {
+        return std::ifstream(path, std::ios_base::binary | std::ios_base::ate).tellg();
+    }
+
+    string path_;
+};
+
+TEST_F(UploadManifestTest, FindTest)
+{
+    upload_manifest manifest(path_);
+
+    manifest.add(entry(1, md5(1)));
+    manifest.add(entry(2, md5(2)));
+
+    std::optional<manifest_entry> found = manifest.find_file(2, 1002, 20);
+
+    ASSERT_TRUE(found);
+    EXPECT_EQ("/data/file_2", found->path);
+    EXPECT_EQ(md5(2), found->md5);
+    EXPECT_EQ("objects/" + md5(2) + "_20", found->remote_name);
+
+    /* A different modification time is a different file. */
+    EXPECT_FALSE(manifest.find_file(2, 1003, 20));
+    EXPECT_FALSE(manifest.find_file(3, 1003, 30));
+
+    found = manifest.find_content(md5(1));
+
+    ASSERT_TRUE(found);
+    EXPECT_EQ("/data/file_1", found->path);
+    EXPECT_FALSE(manifest.find_content(md5(3)));
+    EXPECT_FALSE(manifest.find_content("not an MD5"));
+}
+
+TEST_F(UploadManifestTest, ReopenTest)
+{
+    {
+        upload_manifest manifest(path_);
+
+        manifest.add(entry(1, md5(1)));
+    }
+
+    {
+        upload_manifest manifest(path_);
+
+        EXPECT_TRUE(manifest.find_file(1, 1001, 10));
+        manifest.add(entry(2, md5(2)));
+    }
+
+    /* Without the index, it is rebuilt from the log. */
+    std::remove((path_ + ".index").c_str());
+
+    upload_manifest manifest(path_, true);
+
+    EXPECT_TRUE(manifest.find_file(1, 1001, 10));
+    EXPECT_TRUE(manifest.find_content(md5(2)));
+    EXPECT_EQ(2u, manifest.get_stats().files);
+}
+
+TEST_F(UploadManifestTest, TornRecordTest)
+{
+    std::streamoff whole;
+
+    {
+        upload_manifest manifest(path_);
+
+        manifest.add(entry(1, md5(1)));
+        whole = file_size(path_);
+        manifest.add(entry(2, md5(2)));
+    }
+
+    /* As if the second record was only partly written. */
+    ASSERT_EQ(0, ::truncate(path_.c_str(), whole + 20));
+
+    {
+        upload_manifest manifest(path_);
+
+        EXPECT_TRUE(manifest.find_file(1, 1001, 10));
+        EXPECT_FALSE(manifest.find_file(2, 1002, 20));
+        EXPECT_EQ(static_cast<std::uint64_t>(whole), manifest.get_stats().log_bytes);
+
+        manifest.add(entry(3, md5(3)));
+    }
+
+    /* Garbage is dropped too. */
+    std::ofstream(path_, std::ios_base::binary | std::ios_base::app) << string(100, 'x');
+
+    upload_manifest manifest(path_);
+
+    EXPECT_TRUE(manifest.find_file(1, 1001, 10));
+    EXPECT_TRUE(manifest.find_file(3, 1003, 30));
+    EXPECT_EQ(2u, manifest.get_stats().files);
+}
+
+TEST_F(UploadManifestTest, GrowTest)
+{
+    const std::uint64_t count = 5000;
+
+    {
+        upload_manifest manifest(path_);
+
+        for (std::uint64_t i = 1; i <= count; i++)
+        {
+            manifest.add(entry(i, md5(i)));
+        }
+
+        upload_manifest::stats stats = manifest.get_stats();
+
+        EXPECT_EQ(count, stats.files);
+        EXPECT_EQ(count, stats.contents);
+        EXPECT_GE(stats.capacity, 2 * count);
+    }
+
+    upload_manifest manifest(path_);
+
+    for (std::uint64_t i = 1; i <= count; i++)
+    {
+        ASSERT_TRUE(manifest.find_file(i, 1000 + i, 10 * i)) << i;
+        ASSERT_TRUE(manifest.find_content(md5(i))) << i;
+    }
+}
+
+TEST_F(UploadManifestTest, CompactTest)
+{
+    upload_manifest manifest(path_);
+
+    for (int round = 0; round < 10; round++)
+    {
+        manifest_entry first = entry(1, md5(1));
+
+        first.remote_name += "_" + std::to_string(round);
+        manifest.add(first);
+    }
+
+    /* Another file of the same contents. */
+    manifest.add(entry(2, md5(1)));
+
+    upload_manifest::stats before = manifest.get_stats();
+
+    EXPECT_EQ(2u, before.files);
+    EXPECT_EQ(1u, before.contents);
+
+    manifest.compact();
+
+    upload_manifest::stats after = manifest.get_stats();
+
+    EXPECT_EQ(2u, after.files);
+    EXPECT_EQ(1u, after.contents);
+    EXPECT_LT(after.log_bytes * 4, before.log_bytes);
+    EXPECT_EQ(after.log_bytes, static_cast<std::uint64_t>(file_size(path_)));
+
+    std::optional<manifest_entry> found = manifest.find_file(1, 1001, 10);
+
+    ASSERT_TRUE(found);
+    EXPECT_EQ("objects/" + md5(1) + "_10_9", found->remote_name);
+
+    found = manifest.find_content(md5(1));
+
+    ASSERT_TRUE(found);
+    EXPECT_EQ("/data/file_2", found->path);
+}
+
+TEST_F(UploadManifestTest, InvalidEntryTest)
+{
+    upload_manifest manifest(path_);
+
+    EXPECT_THROW(manifest.add(entry(1, "xyz")), ftp::ftp_exception);
+    EXPECT_EQ(0u, manifest.get_stats().log_bytes);
+}
+
+TEST_F(UploadManifestTest, CompactDamagedRecordTest)
+{
+    upload_manifest manifest(path_);
+    std::streamoff first;
+    std::streamoff second;
+
+    manifest.add(entry(1, md5(1)));
+    first = file_size(path_);
+    manifest.add(entry(2, md5(2)));
+    second = file_size(path_);
+    manifest.add(entry(3, md5(3)));
+
+    /* The last byte of the second record's strings. */
+    {
+        std::fstream file(path_, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+
+        file.seekp(second - 1);
+        file.put('#');
+    }
+
+    manifest.compact();
+
+    EXPECT_TRUE(manifest.find_file(1, 1001, 10));
+    EXPECT_FALSE(manifest.find_file(2, 1002, 20));
+    EXPECT_TRUE(manifest.find_file(3, 1003, 30));
+    EXPECT_EQ(2u, manifest.get_stats().files);
+    EXPECT_EQ(static_cast<std::uint64_t>(file_size(path_)), manifest.get_stats().log_bytes);
+    EXPECT_EQ(static_cast<std::uint64_t>(2 * first), manifest.get_stats().log_bytes);
+}
+
+/* The manifest keeps working with what it had if compacting fails. */
+TEST_F(UploadManifestTest, CompactFailureTest)
+{
+    const string blocker = path_ + ".index.tmp";
+    upload_manifest manifest(path_);
+
+    manifest.add(entry(1, md5(1)));
+    manifest.add(entry(1, md5(1)));
+
+    std::streamoff before = file_size(path_);
+
+    /* The new index can't be created where a directory is. */
+    ASSERT_EQ(0, ::mkdir(blocker.c_str(), 0755));
+
+    EXPECT_THROW(manifest.compact(), ftp::ftp_exception);
+
+    ::rmdir(blocker.c_str());
+
+    EXPECT_EQ(before, file_size(path_));
+    EXPECT_TRUE(manifest.find_file(1, 1001, 10));
+
+    manifest.add(entry(2, md5(2)));
+
+    EXPECT_TRUE(manifest.find_content(md5(2)));
+    EXPECT_EQ(2u, manifest.get_stats().files);
+}